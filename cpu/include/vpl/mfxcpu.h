@@ -0,0 +1,373 @@
+/*############################################################################
+  # Copyright (C) 2020 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#ifndef CPU_INCLUDE_VPL_MFXCPU_H_
+#define CPU_INCLUDE_VPL_MFXCPU_H_
+
+#include "vpl/mfxstructures.h"
+
+// Extension buffers understood only by the oneVPL CPU runtime.
+// Other implementations reject or ignore them like any unknown buffer.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Extended Buffer Ids */
+enum {
+    /*!
+       This extended buffer selects how libav threads split the work of
+       a decoder or encoder. Attach it to mfxVideoParam for Init/Query.
+    */
+    MFX_EXTBUFF_CPU_THREADING = MFX_MAKEFOURCC('C', 'T', 'H', 'R'),
+    /*!
+       This extended buffer pins the worker threads of a session to a set of
+       CPUs. Attach it to mfxInitParam (MFXInitEx) or mfxInitializationParam
+       (MFXInitialize).
+    */
+    MFX_EXTBUFF_CPU_AFFINITY = MFX_MAKEFOURCC('C', 'A', 'F', 'F'),
+    /*!
+       This extended buffer registers a function the encoder calls as soon as
+       it has produced a bitstream. Attach it to mfxVideoParam for
+       MFXVideoENCODE_Init.
+    */
+    MFX_EXTBUFF_CPU_ENCODE_CALLBACK = MFX_MAKEFOURCC('C', 'E', 'C', 'B'),
+    /*!
+       This extended buffer sets the allocation policy of the surface pools a
+       component creates for MFXMemory_GetSurfaceFor* and internally allocated
+       surfaces. Attach it to mfxVideoParam for Init.
+    */
+    MFX_EXTBUFF_CPU_SURFACE_POOL = MFX_MAKEFOURCC('C', 'S', 'P', 'L'),
+    /*!
+       This extended buffer reports the usage of the surface pools of a
+       component. Attach it to mfxVideoParam for GetVideoParam.
+    */
+    MFX_EXTBUFF_CPU_SURFACE_POOL_STATS = MFX_MAKEFOURCC('C', 'S', 'P', 'S'),
+    /*!
+       This extended buffer sets the size of the image buffer cache all sessions
+       of the process share. Attach it to mfxInitParam (MFXInitEx) or
+       mfxInitializationParam (MFXInitialize).
+    */
+    MFX_EXTBUFF_CPU_BUFFER_CACHE = MFX_MAKEFOURCC('C', 'B', 'U', 'F'),
+    /*!
+       This extended buffer lets the decoder skip decode work on its own while
+       the application falls behind. Attach it to mfxVideoParam for
+       MFXVideoDECODE_Init.
+    */
+    MFX_EXTBUFF_CPU_DECODE_SKIP = MFX_MAKEFOURCC('C', 'D', 'S', 'K'),
+    /*!
+       This extended buffer reports how many frames the decoder holds back.
+       Attach it to mfxVideoParam for MFXVideoDECODE_GetVideoParam.
+    */
+    MFX_EXTBUFF_CPU_DECODE_LATENCY = MFX_MAKEFOURCC('C', 'D', 'L', 'T'),
+    /*!
+       This extended buffer reports decode timing and bitstream statistics
+       beyond mfxDecodeStat. Attach it to mfxVideoParam for
+       MFXVideoDECODE_GetVideoParam.
+    */
+    MFX_EXTBUFF_CPU_DECODE_STATS = MFX_MAKEFOURCC('C', 'D', 'S', 'T'),
+};
+
+/*!
+   Handle type of the mfxCPUMemoryInterface of a session, returned by
+   MFXVideoCORE_GetHandle. The interface lives as long as the session.
+*/
+#define MFX_HANDLE_CPU_MEMORY_INTERFACE ((mfxHandleType)MFX_MAKEFOURCC('C', 'M', 'E', 'M'))
+
+/*! Version of mfxCPUMemoryInterface. */
+#define MFX_CPU_MEMORY_INTERFACE_VERSION MFX_STRUCT_VERSION(1, 1)
+
+/* ThreadType */
+enum {
+    MFX_CPU_THREAD_TYPE_AUTO  = 0, /*!< Frame and slice threading as the codec supports them.
+                                        AsyncDepth 1 selects slice threading only. */
+    MFX_CPU_THREAD_TYPE_FRAME = 1, /*!< Frame threading, adds one frame of delay per thread. */
+    MFX_CPU_THREAD_TYPE_SLICE = 2, /*!< Slice threading, no added delay. */
+};
+
+MFX_PACK_BEGIN_USUAL_STRUCT()
+/*!
+   Threading control for one component. The number of threads is taken
+   from mfxInfoMFX::NumThread, capped at the session's share of the
+   runtime threads, 0 lets the runtime decide.
+*/
+typedef struct {
+    mfxExtBuffer Header; /*!< BufferId must be MFX_EXTBUFF_CPU_THREADING. */
+    mfxU16 ThreadType;   /*!< One of MFX_CPU_THREAD_TYPE_*. */
+    mfxU16 reserved[31];
+} mfxExtCPUThreading;
+MFX_PACK_END()
+
+/*! The session is not bound to a NUMA node. */
+#define MFX_CPU_NUMA_NODE_ANY 0xFFFF
+
+MFX_PACK_BEGIN_STRUCT_W_L_TYPE()
+/*!
+   CPU set for the threads of a session. Sessions with the same CPU set
+   share one thread pool, and runtime-allocated surfaces are first touched
+   on those CPUs so their memory lands on the local NUMA node.
+*/
+typedef struct {
+    mfxExtBuffer Header; /*!< BufferId must be MFX_EXTBUFF_CPU_AFFINITY. */
+    mfxU16 NumaNode;     /*!< NUMA node whose CPUs are used, or MFX_CPU_NUMA_NODE_ANY. */
+    mfxU16 reserved1[3];
+    mfxU64 CpuMask[16];  /*!< Logical CPU n is bit n % 64 of CpuMask[n / 64]. Overrides NumaNode
+                              if any bit is set. */
+    mfxU16 reserved[32];
+} mfxExtCPUAffinity;
+MFX_PACK_END()
+
+MFX_PACK_BEGIN_STRUCT_W_PTR()
+/*!
+   Bitstream ready notification, lets an application wait for output of many
+   sessions without polling MFXVideoENCODE_EncodeFrameAsync.
+*/
+typedef struct {
+    mfxExtBuffer Header; /*!< BufferId must be MFX_EXTBUFF_CPU_ENCODE_CALLBACK. */
+    mfxU32 reserved1[2];
+    mfxHDL pthis; /*!< Passed to BitstreamReady. */
+    /*!
+       Called on a runtime thread each time the encoder has produced a bitstream,
+       the next MFXVideoENCODE_EncodeFrameAsync call returns it. The function must
+       return quickly and must not call into the session.
+    */
+    void(MFX_CDECL *BitstreamReady)(mfxHDL pthis);
+    mfxHDL reserved[14];
+} mfxExtCPUEncodeCallback;
+MFX_PACK_END()
+
+MFX_PACK_BEGIN_USUAL_STRUCT()
+/*!
+   Surface pool limits. A bounded pool (MFX_ALLOCATION_LIMITED or
+   MFX_ALLOCATION_OPTIMAL) returns MFX_WRN_ALLOC_TIMEOUT_EXPIRED and no surface
+   if all of its surfaces are still in use after Wait milliseconds. Without
+   this buffer pools are MFX_ALLOCATION_UNLIMITED.
+   Any pool can free surfaces nobody used for IdleTimeout milliseconds, so
+   memory grown for a burst of frames is returned once the burst is over.
+*/
+typedef struct {
+    mfxExtBuffer Header;     /*!< BufferId must be MFX_EXTBUFF_CPU_SURFACE_POOL. */
+    mfxU32 AllocationPolicy; /*!< One of mfxPoolAllocationPolicy. MFX_ALLOCATION_OPTIMAL limits
+                                  the pool to the NumFrameSuggested of the component. */
+    mfxU32 NumSurfaces;      /*!< Maximum number of surfaces for MFX_ALLOCATION_LIMITED. */
+    mfxU32 Wait;             /*!< Time in ms to wait for a surface to be released. */
+    mfxU32 IdleTimeout;      /*!< Time in ms after which an unused surface is freed, 0 keeps
+                                  all surfaces until the component is closed. */
+    mfxU32 MinSurfaces;      /*!< Idle surfaces are not freed below this pool size. */
+    mfxU16 Alignment;        /*!< Alignment in bytes of the rows and planes of surfaces the
+                                  runtime allocates, a power of 2, 0 for 64. */
+    mfxU16 Padding;          /*!< Pixels of border around the image of those surfaces, e.g.
+                                  for filters which read past the edges, not counted in Width
+                                  and Height. */
+    mfxU16 HugePages;        /*!< MFX_CODINGOPTION_ON backs surfaces of 2 MB or more with huge
+                                  pages (Linux only), explicit ones if the system reserved any,
+                                  else transparent ones. Surfaces get normal pages if neither
+                                  is available. */
+    mfxU16 reserved1;
+    mfxU32 reserved[9];
+} mfxExtCPUSurfacePool;
+MFX_PACK_END()
+
+MFX_PACK_BEGIN_STRUCT_W_L_TYPE()
+/*!
+   Usage of one surface pool. Memory is counted as of the last time each
+   surface was idle in the pool, decoded surfaces get their buffers from
+   the decoder.
+*/
+typedef struct {
+    mfxU32 NumSurfaces;        /*!< Surfaces currently allocated. */
+    mfxU32 PeakNumSurfaces;    /*!< Most surfaces allocated at the same time. */
+    mfxU32 NumTrimmed;         /*!< Surfaces freed because they were idle. */
+    mfxU32 reserved1;
+    mfxU64 AllocatedBytes;     /*!< Image memory of the surfaces currently allocated. */
+    mfxU64 PeakAllocatedBytes; /*!< Most image memory allocated at the same time. */
+    mfxU64 HugePageBytes;      /*!< Part of AllocatedBytes mapped with explicit huge pages,
+                                    transparent ones are not counted since the kernel may
+                                    back them with normal pages. */
+    mfxU32 reserved[2];
+} mfxCPUSurfacePoolStats;
+MFX_PACK_END()
+
+MFX_PACK_BEGIN_STRUCT_W_L_TYPE()
+/*!
+   Surface pool statistics of a component, filled by GetVideoParam. Pools
+   which are not created yet report zeros.
+*/
+typedef struct {
+    mfxExtBuffer Header;        /*!< BufferId must be MFX_EXTBUFF_CPU_SURFACE_POOL_STATS. */
+    mfxCPUSurfacePoolStats In;  /*!< Encoder and VPP input surfaces. */
+    mfxCPUSurfacePoolStats Out; /*!< Decoder and VPP output surfaces. */
+    mfxU32 reserved[8];
+} mfxExtCPUSurfacePoolStats;
+MFX_PACK_END()
+
+MFX_PACK_BEGIN_STRUCT_W_L_TYPE()
+/*!
+   Image buffers the runtime allocates (surfaces of its pools and decoder
+   frames) are kept in a process-wide cache when they are freed and reused
+   for the next buffer of the same size, by any session. The last setting
+   of any session applies.
+*/
+typedef struct {
+    mfxExtBuffer Header; /*!< BufferId must be MFX_EXTBUFF_CPU_BUFFER_CACHE. */
+    mfxU32 reserved1[2];
+    mfxU64 MaxBytes;     /*!< Bytes of freed buffers kept for reuse, 0 disables the cache.
+                              The default is 256 MB. */
+    mfxU32 reserved[12];
+} mfxExtCPUBufferCache;
+MFX_PACK_END()
+
+/*! Highest skip level of the decoders. */
+#define MFX_CPU_DECODE_MAX_SKIP_LEVEL 5
+
+MFX_PACK_BEGIN_USUAL_STRUCT()
+/*!
+   Automatic skipping of decode work. Each MFX_SKIPMODE_MORE of
+   MFXVideoDECODE_SetSkipMode goes up one level, MFX_SKIPMODE_LESS down one
+   and MFX_SKIPMODE_NOSKIP back to 0. Every level also skips what the lower
+   ones do:
+   1 - frames no other frame references are not decoded.
+   2 - B frames are not decoded, only reference frames are deblocked.
+   3 - only key frames are deblocked.
+   4 - the inverse transform is skipped except in key frames.
+   5 - only key frames are decoded, in full.
+   Codecs skip what their libav decoder supports, AVC, HEVC and MPEG-2 the
+   most. With AutoSkip on, the decoder expects bitstreams at the frame rate
+   of the stream and goes up a level while the application falls behind
+   that rate, and down again once it keeps up. The level set with
+   MFXVideoDECODE_SetSkipMode is the lowest one automatic skipping uses.
+   KeyFramesOnly is meant for thumbnails and scene indexes, it drops other
+   frames as soon as they are split from the bitstream, so a stream is
+   scanned at the cost of its key frames.
+*/
+typedef struct {
+    mfxExtBuffer Header;  /*!< BufferId must be MFX_EXTBUFF_CPU_DECODE_SKIP. */
+    mfxU16 AutoSkip;      /*!< MFX_CODINGOPTION_ON enables automatic skipping. */
+    mfxU16 MaxSkipLevel;  /*!< Highest level automatic skipping goes to, 0 for
+                               MFX_CPU_DECODE_MAX_SKIP_LEVEL. */
+    mfxU16 KeyFramesOnly; /*!< MFX_CODINGOPTION_ON decodes key frames (and I pictures of MPEG-2)
+                               only, whatever the skip level. */
+    mfxU16 LowRes;        /*!< Decode MJPEG and MPEG-2 at 1/2^LowRes of their size, 0 to 3.
+                               Other codecs decode at full size. */
+    mfxU16 reserved[28];
+} mfxExtCPUDecodeSkip;
+MFX_PACK_END()
+
+MFX_PACK_BEGIN_USUAL_STRUCT()
+/*!
+   Decoder pipeline depth. A frame is output FrameDelay bitstream frames
+   after its own, the last ones when the decoder is drained, so
+   MFXVideoDECODE_DecodeFrameAsync needs as many work surfaces more than
+   the application keeps. The reorder delay is known once the decoder has
+   seen the sequence header and may grow with the stream.
+   mfxInfoMFX::DecodedOrder set at Init selects low latency decoding: libav
+   low delay mode, slice threads only, and a frame delay of 1 for dav1d.
+   Frames then leave the decoder as soon as they are decoded, in decoded
+   order for streams without B frames.
+*/
+typedef struct {
+    mfxExtBuffer Header;  /*!< BufferId must be MFX_EXTBUFF_CPU_DECODE_LATENCY. */
+    mfxU16 FrameDelay;    /*!< Sum of ReorderFrames and ThreadFrames. */
+    mfxU16 ReorderFrames; /*!< Frames held to output them in display order. */
+    mfxU16 ThreadFrames;  /*!< Frames in flight on frame threads. */
+    mfxU16 reserved[29];
+} mfxExtCPUDecodeLatency;
+MFX_PACK_END()
+
+MFX_PACK_BEGIN_STRUCT_W_L_TYPE()
+/*!
+   Decoder statistics since Init. Latency is the time from when a frame's
+   bitstream went into the decoder until the decoded frame came out, which
+   includes the time it waited for later frames to be passed in.
+*/
+typedef struct {
+    mfxExtBuffer Header;  /*!< BufferId must be MFX_EXTBUFF_CPU_DECODE_STATS. */
+    mfxU32 reserved1[2];
+    mfxU64 DecodeTime;    /*!< Microseconds spent in libav decode calls. Work of frame threads
+                               that overlaps with the application is not included. */
+    mfxU64 BytesConsumed; /*!< Bitstream bytes the decoder took from mfxBitstream. */
+    mfxU32 LatencyP50;    /*!< Median latency of the last 1024 frames, in microseconds. */
+    mfxU32 LatencyP90;    /*!< 90th percentile latency of the last 1024 frames. */
+    mfxU32 LatencyP99;    /*!< 99th percentile latency of the last 1024 frames. */
+    mfxU32 LatencyMax;    /*!< Highest latency of the last 1024 frames. */
+    mfxU32 reserved[8];
+} mfxExtCPUDecodeStats;
+MFX_PACK_END()
+
+MFX_PACK_BEGIN_STRUCT_W_PTR()
+/*!
+   System memory image owned by the application. Supported FourCCs are
+   I420, I010, I422, I210, NV12, P010 and RGB4.
+*/
+typedef struct {
+    mfxFrameInfo Info; /*!< FourCC, Width and Height of the image, crop and frame rate are kept. */
+    mfxFrameData Data; /*!< Plane pointers, Pitch and TimeStamp, other fields are ignored. */
+    mfxHDL pthis;      /*!< Passed to Release. */
+    /*!
+       Called on any thread once the runtime and libav no longer reference
+       the image, may be null. The memory must stay valid and unchanged until
+       then.
+    */
+    void(MFX_CDECL *Release)(mfxHDL pthis);
+    mfxHDL reserved[14];
+} mfxCPUSurfaceSystem;
+MFX_PACK_END()
+
+MFX_PACK_BEGIN_STRUCT_W_L_TYPE()
+/*!
+   Memory allocated by the components of a session. Memory libav allocates
+   internally (codec and filter state, encoder reference frames) is not
+   included, nor are buffers of the process-wide buffer cache nobody uses.
+*/
+typedef struct {
+    mfxU64 SurfaceBytes;     /*!< Surfaces of the runtime pools and VPP and decoder output
+                                  buffers. */
+    mfxU64 DecodeFrameBytes; /*!< Frames decoders allocated, which includes their reference
+                                  frames and the decoded frames output surfaces still hold. */
+    mfxU64 BitstreamBytes;   /*!< Encoded data waiting for MFXVideoENCODE_EncodeFrameAsync. */
+    mfxU64 TotalBytes;       /*!< Sum of the above. */
+    mfxU64 PeakTotalBytes;   /*!< Largest TotalBytes since the session was created. */
+    mfxU64 ReusedBytes;      /*!< Buffers the session took from the process-wide buffer cache
+                                  instead of allocating them, in total since the session was
+                                  created. */
+    mfxU64 reserved[10];
+} mfxCPUMemoryStats;
+MFX_PACK_END()
+
+MFX_PACK_BEGIN_STRUCT_W_PTR()
+/*!
+   Memory interface of a session, the counterpart of mfxMemoryInterface for
+   system memory.
+*/
+typedef struct mfxCPUMemoryInterface {
+    mfxHDL Context;           /*!< The context of the interface. */
+    mfxStructVersion Version; /*!< MFX_CPU_MEMORY_INTERFACE_VERSION. */
+    mfxU16 reserved1[3];
+    /*!
+       Wrap an application image in a runtime surface without copying it.
+       Encode and VPP read the image in place. The surface is released with
+       FrameInterface->Release like a surface from MFXMemory_GetSurfaceFor*.
+       Returns MFX_ERR_UNSUPPORTED for an unsupported FourCC and
+       MFX_ERR_INVALID_VIDEO_PARAM if a plane pointer or the pitch is missing.
+    */
+    mfxStatus(MFX_CDECL *ImportFrameSurface)(struct mfxCPUMemoryInterface *memory_interface,
+                                             const mfxCPUSurfaceSystem *external_surface,
+                                             mfxFrameSurface1 **imported_surface);
+    /*!
+       Report the memory the session currently uses and its peak, e.g. for
+       admission control of new streams. Available since version 1.1.
+    */
+    mfxStatus(MFX_CDECL *GetMemoryStats)(struct mfxCPUMemoryInterface *memory_interface,
+                                         mfxCPUMemoryStats *stats);
+    mfxHDL reserved[15];
+} mfxCPUMemoryInterface;
+MFX_PACK_END()
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // CPU_INCLUDE_VPL_MFXCPU_H_
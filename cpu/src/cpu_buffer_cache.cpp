@@ -0,0 +1,195 @@
+/*############################################################################
+  # Copyright (C) 2020 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#include "src/cpu_buffer_cache.h"
+#include <iterator>
+#include <memory>
+#include <utility>
+#if defined(__linux__)
+    #include <sys/mman.h>
+#endif
+
+// size bytes rounded up to whole huge pages, nullptr if the system has none
+// explicit huge pages (MAP_HUGETLB) come from the pool the administrator reserved
+//   and are backed at mmap(), otherwise the kernel is asked to back an aligned
+//   range with transparent huge pages, which it does on first touch if it can
+// *hugeTLB is set only for explicit huge pages, the others may stay normal pages
+static uint8_t *MapHugePages(size_t size, size_t *mappedSize, bool *hugeTLB) {
+#if defined(__linux__)
+    const size_t pageSize = CpuBufferCache::HUGE_PAGE_SIZE;
+
+    size       = FFALIGN(size, pageSize);
+    void *data = mmap(nullptr,
+                      size,
+                      PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                      -1,
+                      0);
+    if (data == MAP_FAILED) {
+        // mmap() only aligns to normal pages, map one huge page more and trim
+        void *mapping = mmap(nullptr,
+                             size + pageSize,
+                             PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS,
+                             -1,
+                             0);
+        if (mapping == MAP_FAILED)
+            return nullptr;
+
+        uint8_t *range   = static_cast<uint8_t *>(mapping);
+        uint8_t *aligned = reinterpret_cast<uint8_t *>(
+            FFALIGN(reinterpret_cast<uintptr_t>(range), static_cast<uintptr_t>(pageSize)));
+        if (aligned > range)
+            munmap(range, aligned - range);
+        munmap(aligned + size, pageSize - (aligned - range));
+
+        // fails if the kernel was built without transparent huge pages
+        if (madvise(aligned, size, MADV_HUGEPAGE)) {
+            munmap(aligned, size);
+            return nullptr;
+        }
+        data = aligned;
+    }
+    else {
+        *hugeTLB = true;
+    }
+
+    *mappedSize = size;
+    return static_cast<uint8_t *>(data);
+#else
+    // large pages of Windows need the lock memory privilege, which applications
+    //   rarely have
+    return nullptr;
+#endif
+}
+
+CpuBufferCache::CpuBufferCache()
+        : m_mutex(),
+          m_idle(),
+          m_idleBytes(0),
+          m_maxBytes(DEFAULT_MAX_BYTES) {}
+
+CpuBufferCache::~CpuBufferCache() {
+    for (Entry *entry : m_idle)
+        FreeEntry(entry);
+}
+
+std::shared_ptr<CpuBufferCache> CpuBufferCache::GetShared() {
+    // buffers in use hold a reference of their own, so the cache goes away
+    //   with the last of them if that is freed after exit() destroyed this one
+    static std::shared_ptr<CpuBufferCache> s_cache = std::make_shared<CpuBufferCache>();
+    return s_cache;
+}
+
+void CpuBufferCache::SetMaxBytes(mfxU64 maxBytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_maxBytes = maxBytes;
+    TrimIdle(maxBytes);
+}
+
+AVBufferRef *CpuBufferCache::GetBuffer(size_t size,
+                                       bool hugePages,
+                                       bool *gotHugePages,
+                                       std::shared_ptr<CpuMemoryStats> stats,
+                                       CpuMemoryStats::Kind kind,
+                                       const std::vector<mfxU32> &cpus) {
+    // smaller buffers would waste most of a huge page
+    hugePages = hugePages && size >= HUGE_PAGE_SIZE;
+
+    // the most recently released buffer is the most likely to be in the cache
+    Entry *entry = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto it = m_idle.rbegin(); it != m_idle.rend(); ++it) {
+            if ((*it)->size == size && (*it)->bHugePages == hugePages && (*it)->cpus == cpus) {
+                entry = *it;
+                m_idle.erase(std::next(it).base());
+                m_idleBytes -= size;
+                break;
+            }
+        }
+    }
+
+    bool reused = (entry != nullptr);
+    if (!entry)
+        entry = AllocEntry(size, hugePages, cpus);
+    if (!entry)
+        return nullptr;
+
+    AVBufferRef *buf = av_buffer_create(entry->data, size, RecycleBuffer, entry, 0);
+    if (!buf) {
+        FreeEntry(entry);
+        return nullptr;
+    }
+    entry->cache = shared_from_this();
+    entry->stats = std::move(stats);
+    entry->kind  = kind;
+    if (entry->stats) {
+        entry->stats->Add(kind, size);
+        if (reused)
+            entry->stats->AddReused(size);
+    }
+
+    if (gotHugePages)
+        *gotHugePages = entry->bHugeTLB;
+    return buf;
+}
+
+// AVBuffer free callback, may be called on any thread
+void CpuBufferCache::RecycleBuffer(void *opaque, uint8_t *data) {
+    Entry *entry                          = static_cast<Entry *>(opaque);
+    std::shared_ptr<CpuBufferCache> cache = std::move(entry->cache);
+    if (entry->stats) {
+        entry->stats->Add(entry->kind, -static_cast<int64_t>(entry->size));
+        entry->stats.reset();
+    }
+    {
+        std::lock_guard<std::mutex> lock(cache->m_mutex);
+        if (entry->size <= cache->m_maxBytes) {
+            cache->TrimIdle(cache->m_maxBytes - entry->size);
+            cache->m_idle.push_back(entry);
+            cache->m_idleBytes += entry->size;
+            return;
+        }
+    }
+    FreeEntry(entry);
+}
+
+CpuBufferCache::Entry *CpuBufferCache::AllocEntry(size_t size,
+                                                  bool hugePages,
+                                                  const std::vector<mfxU32> &cpus) {
+    auto entry        = std::make_unique<Entry>();
+    entry->size       = size;
+    entry->bHugePages = hugePages;
+    entry->cpus       = cpus;
+    if (hugePages)
+        entry->data = MapHugePages(size, &entry->mappedSize, &entry->bHugeTLB);
+    // zeroed like the buffers of libav pools, mmap() pages already are
+    if (!entry->data)
+        entry->data = static_cast<uint8_t *>(av_mallocz(size));
+    return entry->data ? entry.release() : nullptr;
+}
+
+void CpuBufferCache::FreeEntry(Entry *entry) {
+#if defined(__linux__)
+    if (entry->mappedSize)
+        munmap(entry->data, entry->mappedSize);
+    else
+#endif
+        av_free(entry->data);
+    delete entry;
+}
+
+// free the least recently released buffers until at most maxBytes are idle
+// must be called with m_mutex held
+void CpuBufferCache::TrimIdle(mfxU64 maxBytes) {
+    while (m_idleBytes > maxBytes) {
+        Entry *entry = m_idle.front();
+        m_idle.pop_front();
+        m_idleBytes -= entry->size;
+        FreeEntry(entry);
+    }
+}
@@ -0,0 +1,88 @@
+/*############################################################################
+  # Copyright (C) 2020 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#ifndef CPU_SRC_CPU_BUFFER_CACHE_H_
+#define CPU_SRC_CPU_BUFFER_CACHE_H_
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "src/cpu_common.h"
+#include "src/cpu_memory_stats.h"
+
+// Image buffers released by any session of the process are kept here, up to
+// a byte limit, and handed out again for the next request of the same size.
+// Sessions which come and go with the same resolution then reuse warm memory
+// instead of allocating and freeing (and faulting in) the same buffers.
+// Buffers are only reused on the CPU set they were first written on, so the
+// memory of a pinned session stays on its NUMA node.
+// A buffer is returned to the cache by the free callback of its last
+// AVBufferRef, on whichever thread drops it. Buffers in use keep the cache
+// alive, so they may outlive the last session.
+class CpuBufferCache : public std::enable_shared_from_this<CpuBufferCache> {
+public:
+    // limit of the cache unless the application sets one
+    static const mfxU64 DEFAULT_MAX_BYTES = 256 * 1024 * 1024;
+
+    // 2 MB pages of x86-64
+    static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    CpuBufferCache();
+    ~CpuBufferCache();
+
+    // the cache of the process, created on first use
+    static std::shared_ptr<CpuBufferCache> GetShared();
+
+    // bytes of idle buffers kept for reuse, 0 disables the cache
+    // idle buffers above a lower limit are freed right away
+    void SetMaxBytes(mfxU64 maxBytes);
+
+    // buffer of size bytes, aligned like av_malloc(), nullptr if out of memory
+    // new buffers are zeroed, reused ones hold what their last user wrote
+    // with hugePages set, buffers of at least HUGE_PAGE_SIZE are mapped with
+    //   huge pages if the system has them, *gotHugePages tells if explicit
+    //   huge pages back the buffer, transparent ones are not known to
+    // the buffer is counted as kind in stats, if set, until it is freed
+    // cpus is the CPU set of the thread pool which writes the buffer first,
+    //   empty for an unpinned one, only buffers of the same set are reused
+    AVBufferRef *GetBuffer(size_t size,
+                           bool hugePages,
+                           bool *gotHugePages,
+                           std::shared_ptr<CpuMemoryStats> stats,
+                           CpuMemoryStats::Kind kind,
+                           const std::vector<mfxU32> &cpus);
+
+private:
+    struct Entry {
+        uint8_t *data;
+        size_t size;                           // bytes requested, the key of the entry
+        size_t mappedSize;                     // bytes of the huge page mapping, 0 for av_malloc()
+        bool bHugePages;                       // requested, part of the key
+        bool bHugeTLB;                         // mapped with explicit huge pages
+        std::vector<mfxU32> cpus;              // placed by, the last part of the key
+        std::shared_ptr<CpuBufferCache> cache; // set while the buffer is in use
+        std::shared_ptr<CpuMemoryStats> stats; // of the session using the buffer
+        CpuMemoryStats::Kind kind;
+    };
+
+    static void RecycleBuffer(void *opaque, uint8_t *data);
+    static Entry *AllocEntry(size_t size, bool hugePages, const std::vector<mfxU32> &cpus);
+    static void FreeEntry(Entry *entry);
+
+    void TrimIdle(mfxU64 maxBytes);
+
+    std::mutex m_mutex;
+    std::list<Entry *> m_idle; // most recently released last
+    mfxU64 m_idleBytes;
+    mfxU64 m_maxBytes;
+
+    /* copy not allowed */
+    CpuBufferCache(const CpuBufferCache &);
+    CpuBufferCache &operator=(const CpuBufferCache &);
+};
+
+#endif // CPU_SRC_CPU_BUFFER_CACHE_H_
@@ -6,6 +6,7 @@
 
 #include "src/cpu_common.h"
 #include "src/frame_lock.h"
+#include "src/plane_copy.h"
 
 AVPixelFormat MFXFourCC2AVPixelFormat(uint32_t fourcc) {
     switch (fourcc) {
@@ -81,19 +82,7 @@ mfxU32 AVCodecID_to_MFXCodecId(AVCodecID CodecId) {
     return 0;
 }
 
-mfxStatus AVFrame2mfxFrameSurface(mfxFrameSurface1 *surface,
-                                  AVFrame *frame,
-                                  mfxFrameAllocator *allocator) {
-    FrameLock locker;
-    RET_ERROR(locker.Lock(surface, MFX_MAP_WRITE, allocator));
-    mfxFrameData *data = locker.GetData();
-    mfxFrameInfo *info = &surface->Info;
-
-    mfxU32 w, h, y, pitch, offset;
-
-    RET_IF_FALSE(info->Width == frame->width && info->Height == frame->height,
-                 MFX_ERR_INCOMPATIBLE_VIDEO_PARAM);
-
+void AVFrame2mfxFrameInfo(mfxFrameInfo *info, AVFrame *frame) {
     info->CropX = 0;
     info->CropY = 0;
     info->CropW = frame->width;
@@ -124,6 +113,18 @@ mfxStatus AVFrame2mfxFrameSurface(mfxFrameSurface1 *surface,
             info->BitDepthChroma = 8;
             info->ChromaFormat   = MFX_CHROMAFORMAT_YUV420;
             break;
+        case AV_PIX_FMT_NV12:
+            info->FourCC         = MFX_FOURCC_NV12;
+            info->BitDepthLuma   = 8;
+            info->BitDepthChroma = 8;
+            info->ChromaFormat   = MFX_CHROMAFORMAT_YUV420;
+            break;
+        case AV_PIX_FMT_P010LE:
+            info->FourCC         = MFX_FOURCC_P010;
+            info->BitDepthLuma   = 10;
+            info->BitDepthChroma = 10;
+            info->ChromaFormat   = MFX_CHROMAFORMAT_YUV420;
+            break;
         case AV_PIX_FMT_BGRA:
             info->FourCC         = MFX_FOURCC_BGRA;
             info->BitDepthLuma   = 8;
@@ -145,86 +146,203 @@ mfxStatus AVFrame2mfxFrameSurface(mfxFrameSurface1 *surface,
         info->AspectRatioW = frame->sample_aspect_ratio.num;
         info->AspectRatioH = frame->sample_aspect_ratio.den;
     }
-    if (frame->format == AV_PIX_FMT_YUV420P10LE) {
-        RET_IF_FALSE(info->FourCC == MFX_FOURCC_I010, MFX_ERR_INCOMPATIBLE_VIDEO_PARAM);
+}
 
-        w = info->Width * 2;
-        h = info->Height;
-    }
-    else if (frame->format == AV_PIX_FMT_YUV420P || frame->format == AV_PIX_FMT_YUVJ420P) {
-        RET_IF_FALSE(info->FourCC == MFX_FOURCC_I420, MFX_ERR_INCOMPATIBLE_VIDEO_PARAM);
+// bytes per sample, log2 of the luma rows per chroma row and planes of a format
+struct ImageLayout {
+    mfxU32 sampleBytes;
+    mfxU32 chromaShiftY;
+    int numPlanes;
+};
 
-        w = info->Width;
-        h = info->Height;
+static bool GetImageLayout(int format, ImageLayout *layout) {
+    switch (format) {
+        case AV_PIX_FMT_YUV420P:
+        case AV_PIX_FMT_YUVJ420P:
+            *layout = { 1, 1, 3 };
+            return true;
+        case AV_PIX_FMT_YUV420P10LE:
+            *layout = { 2, 1, 3 };
+            return true;
+        case AV_PIX_FMT_YUV422P:
+            *layout = { 1, 0, 3 };
+            return true;
+        case AV_PIX_FMT_YUV422P10LE:
+            *layout = { 2, 0, 3 };
+            return true;
+        case AV_PIX_FMT_NV12:
+            *layout = { 1, 1, 2 };
+            return true;
+        case AV_PIX_FMT_P010LE:
+            *layout = { 2, 1, 2 };
+            return true;
+        case AV_PIX_FMT_BGRA:
+            *layout = { 4, 0, 1 };
+            return true;
+        default:
+            return false;
     }
-    else if (frame->format == AV_PIX_FMT_YUV422P10LE) {
-        RET_IF_FALSE(info->FourCC == MFX_FOURCC_I210, MFX_ERR_INCOMPATIBLE_VIDEO_PARAM);
+}
 
-        w = info->Width * 2;
-        h = info->Height;
-    }
-    else if (frame->format == AV_PIX_FMT_YUV422P) {
-        RET_IF_FALSE(info->FourCC == MFX_FOURCC_I422, MFX_ERR_INCOMPATIBLE_VIDEO_PARAM);
+mfxStatus CopyImage(uint8_t *const dstData[],
+                    const int dstLinesize[],
+                    int dstFormat,
+                    const AVFrame *src,
+                    int shift,
+                    CpuThreadPool *pool) {
+    ImageLayout in, out;
+    RET_IF_FALSE(GetImageLayout(src->format, &in) && GetImageLayout(dstFormat, &out),
+                 MFX_ERR_INCOMPATIBLE_VIDEO_PARAM);
 
-        w = info->Width;
-        h = info->Height;
-    }
-    else if (frame->format == AV_PIX_FMT_BGRA) {
-        RET_IF_FALSE(info->FourCC == MFX_FOURCC_RGB4, MFX_ERR_INCOMPATIBLE_VIDEO_PARAM);
+    // only the chroma planes may be interleaved or split
+    RET_IF_FALSE(in.sampleBytes == out.sampleBytes && in.chromaShiftY == out.chromaShiftY &&
+                     (in.numPlanes == 1) == (out.numPlanes == 1),
+                 MFX_ERR_INCOMPATIBLE_VIDEO_PARAM);
 
-        w = info->Width * 4;
-        h = info->Height;
-    }
-    else {
-        RET_ERROR(MFX_ERR_INCOMPATIBLE_VIDEO_PARAM);
+    mfxU32 width  = src->width;
+    mfxU32 height = src->height;
+    if (in.sampleBytes != 2)
+        shift = 0;
+
+    CopyPlane luma   = {};
+    luma.src         = src->data[0];
+    luma.srcPitch    = src->linesize[0];
+    luma.dst         = dstData[0];
+    luma.dstPitch    = dstLinesize[0];
+    luma.width       = width;
+    luma.sampleBytes = in.sampleBytes;
+    luma.rows        = height;
+    luma.shift       = shift;
+
+    CopyPlane planes[3] = { luma };
+    int numPlanes       = 1;
+
+    if (in.numPlanes > 1) {
+        CopyPlane chroma = luma;
+        chroma.src       = src->data[1];
+        chroma.srcPitch  = src->linesize[1];
+        chroma.dst       = dstData[1];
+        chroma.dstPitch  = dstLinesize[1];
+        chroma.width     = (width + 1) >> 1;
+        chroma.rows      = (height + (1 << in.chromaShiftY) - 1) >> in.chromaShiftY;
+
+        if (in.numPlanes == 3 && out.numPlanes == 3) {
+            planes[numPlanes++] = chroma;
+            chroma.src          = src->data[2];
+            chroma.srcPitch     = src->linesize[2];
+            chroma.dst          = dstData[2];
+            chroma.dstPitch     = dstLinesize[2];
+        }
+        else if (in.numPlanes == 3) {
+            RET_IF_FALSE(src->linesize[2] == src->linesize[1], MFX_ERR_INCOMPATIBLE_VIDEO_PARAM);
+            chroma.src2 = src->data[2];
+        }
+        else if (out.numPlanes == 3) {
+            RET_IF_FALSE(dstLinesize[2] == dstLinesize[1], MFX_ERR_INCOMPATIBLE_VIDEO_PARAM);
+            chroma.dst2 = dstData[2];
+        }
+        else {
+            // interleaved U and V are copied as one plane
+            chroma.width *= 2;
+        }
+        planes[numPlanes++] = chroma;
     }
 
-    pitch = data->Pitch;
+    CopyPlanes(planes, numPlanes, pool);
+    return MFX_ERR_NONE;
+}
 
-    if (frame->format == AV_PIX_FMT_BGRA) {
-        for (y = 0; y < h; y++) {
-            offset = pitch * (y + info->CropY) + info->CropX;
-            memcpy_s(data->B + offset, w, frame->data[0] + y * frame->linesize[0], w);
-        }
+AVFrame *ConvertAVFrame(const AVFrame *src, AVPixelFormat format, int shift, CpuThreadPool *pool) {
+    AVFrame *dst = av_frame_alloc();
+    RET_IF_FALSE(dst, nullptr);
+
+    dst->format = format;
+    dst->width  = src->width;
+    dst->height = src->height;
+    if (av_frame_get_buffer(dst, 0) < 0 || av_frame_copy_props(dst, src) < 0 ||
+        CopyImage(dst->data, dst->linesize, format, src, shift, pool) != MFX_ERR_NONE) {
+        av_frame_free(&dst);
+        return nullptr;
     }
-    else if ((frame->format == AV_PIX_FMT_YUV422P) || (frame->format == AV_PIX_FMT_YUV422P10LE)) {
-        // copy Y plane
-        for (y = 0; y < h; y++) {
-            offset = pitch * (y + info->CropY) + info->CropX;
-            memcpy_s(data->Y + offset, w, frame->data[0] + y * frame->linesize[0], w);
-        }
+    return dst;
+}
 
-        // copy U plane
-        for (y = 0; y < h; y++) {
-            offset = pitch / 2 * (y + info->CropY) + info->CropX;
-            memcpy_s(data->U + offset, w / 2, frame->data[1] + y * frame->linesize[1], w / 2);
-        }
+size_t GetImageSpan(const AVFrame *frame, int height, uint8_t **start) {
+    AVPixelFormat format           = static_cast<AVPixelFormat>(frame->format);
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    *start                         = frame->data[0];
+    RET_IF_FALSE(desc, 0);
 
-        // copy V plane
-        for (y = 0; y < h; y++) {
-            offset = pitch / 2 * (y + info->CropY) + info->CropX;
-            memcpy_s(data->V + offset, w / 2, frame->data[2] + y * frame->linesize[2], w / 2);
-        }
+    uint8_t *end = frame->data[0];
+    for (int i = 0; i < av_pix_fmt_count_planes(format); i++) {
+        if (!frame->data[i])
+            continue;
+
+        // planes 1 and 2 are the chroma planes, subsampled vertically
+        bool chroma       = (i == 1 || i == 2);
+        int rows          = chroma ? AV_CEIL_RSHIFT(height, desc->log2_chroma_h) : height;
+        uint8_t *planeEnd = frame->data[i] + static_cast<ptrdiff_t>(frame->linesize[i]) * rows;
+
+        *start = std::min(*start, frame->data[i]);
+        end    = std::max(end, planeEnd);
     }
-    else {
-        // copy Y plane
-        for (y = 0; y < h; y++) {
-            offset = pitch * (y + info->CropY) + info->CropX;
-            memcpy_s(data->Y + offset, w, frame->data[0] + y * frame->linesize[0], w);
-        }
+    return static_cast<size_t>(end - *start);
+}
 
-        // copy U plane
-        for (y = 0; y < h / 2; y++) {
-            offset = pitch / 2 * (y + info->CropY) + info->CropX;
-            memcpy_s(data->U + offset, w / 2, frame->data[1] + y * frame->linesize[1], w / 2);
-        }
+mfxStatus AVFrame2mfxFrameSurface(mfxFrameSurface1 *surface,
+                                  AVFrame *frame,
+                                  mfxFrameAllocator *allocator,
+                                  FrameMapCache *cache,
+                                  CpuThreadPool *pool) {
+    FrameLock locker;
+    RET_ERROR(locker.Lock(surface, MFX_MAP_WRITE, allocator, cache));
+    mfxFrameData *data = locker.GetData();
+    mfxFrameInfo *info = &surface->Info;
 
-        // copy V plane
-        for (y = 0; y < h / 2; y++) {
-            offset = pitch / 2 * (y + info->CropY) + info->CropX;
-            memcpy_s(data->V + offset, w / 2, frame->data[2] + y * frame->linesize[2], w / 2);
-        }
+    // a smaller frame (e.g. decoded at lowres) goes to the top left of the
+    //   surface, CropW and CropH give its size
+    RET_IF_FALSE(info->Width >= frame->width && info->Height >= frame->height,
+                 MFX_ERR_INCOMPATIBLE_VIDEO_PARAM);
+
+    // semi-planar surfaces keep their FourCC, the frame is interleaved into them
+    mfxU32 fourCC = info->FourCC;
+    AVFrame2mfxFrameInfo(info, frame);
+    if (fourCC == MFX_FOURCC_NV12 || fourCC == MFX_FOURCC_P010)
+        info->FourCC = fourCC;
+
+    AVPixelFormat format = MFXFourCC2AVPixelFormat(info->FourCC);
+    ImageLayout layout;
+    RET_IF_FALSE(GetImageLayout(format, &layout), MFX_ERR_INCOMPATIBLE_VIDEO_PARAM);
+
+    // 10-bit samples are in the high bits of libav P010 and of P010 surfaces with Shift set
+    int shift = (info->FourCC == MFX_FOURCC_P010 && info->Shift) ? 6 : 0;
+    if (frame->format == AV_PIX_FMT_P010LE)
+        shift -= 6;
+
+    // the frame starts at the top left, AVFrame2mfxFrameInfo() resets the crop offset
+    int pitch = data->Pitch;
+
+    uint8_t *planes[3] = {};
+    int pitches[3]     = {};
+    if (layout.numPlanes == 1) {
+        planes[0]  = data->B;
+        pitches[0] = pitch;
     }
+    else if (layout.numPlanes == 2) {
+        planes[0]  = data->Y;
+        planes[1]  = data->UV;
+        pitches[0] = pitch;
+        pitches[1] = pitch;
+    }
+    else {
+        planes[0]  = data->Y;
+        planes[1]  = data->U;
+        planes[2]  = data->V;
+        pitches[0] = pitch;
+        pitches[1] = pitch / 2;
+        pitches[2] = pitch / 2;
+    }
+    RET_ERROR(CopyImage(planes, pitches, format, frame, shift, pool));
 
     if (frame->pts) {
         surface->Data.TimeStamp = frame->pts;
@@ -242,6 +360,8 @@ mfxStatus CheckFrameInfoCommon(mfxFrameInfo *info, mfxU32 codecId) {
         case MFX_FOURCC_I010:
         case MFX_FOURCC_I422:
         case MFX_FOURCC_I210:
+        case MFX_FOURCC_NV12:
+        case MFX_FOURCC_P010:
             break;
         default:
             return MFX_ERR_INVALID_VIDEO_PARAM;
@@ -263,17 +383,14 @@ mfxStatus CheckFrameInfoCommon(mfxFrameInfo *info, mfxU32 codecId) {
         switch (info->FourCC) {
             case MFX_FOURCC_I010:
             case MFX_FOURCC_I210:
-                //case MFX_FOURCC_P010: // for later
+            case MFX_FOURCC_P010:
                 break;
             default:
                 return MFX_ERR_INVALID_VIDEO_PARAM;
         }
     }
 
-    // for later, shift = 1 for ms10bit in msdk
-    //if (info->FourCC == MFX_FOURCC_P010) {
-    //    RET_IF_FALSE(info->Shift, MFX_ERR_INVALID_VIDEO_PARAM);
-    //}
+    // P010 with Shift = 0 keeps the samples in the low bits like I010
 
     RET_IF_FALSE((info->ChromaFormat == MFX_CHROMAFORMAT_YUV420) ||
                      (info->ChromaFormat == MFX_CHROMAFORMAT_YUV422),
@@ -295,18 +412,20 @@ mfxStatus CheckFrameInfoCodecs(mfxFrameInfo *info, mfxU32 codecId) {
     switch (codecId) {
         case MFX_CODEC_JPEG:
         case MFX_CODEC_MPEG2:
-            if (info->FourCC != MFX_FOURCC_I420)
+            if (info->FourCC != MFX_FOURCC_I420 && info->FourCC != MFX_FOURCC_NV12)
                 return MFX_ERR_INVALID_VIDEO_PARAM;
             break;
         case MFX_CODEC_AVC:
         case MFX_CODEC_HEVC:
         case MFX_CODEC_AV1:
             if (info->FourCC != MFX_FOURCC_I420 && info->FourCC != MFX_FOURCC_I010 &&
-                info->FourCC != MFX_FOURCC_I422 && info->FourCC != MFX_FOURCC_I210)
+                info->FourCC != MFX_FOURCC_I422 && info->FourCC != MFX_FOURCC_I210 &&
+                info->FourCC != MFX_FOURCC_NV12 && info->FourCC != MFX_FOURCC_P010)
                 return MFX_ERR_INVALID_VIDEO_PARAM;
             break;
         default:
-            RET_IF_FALSE(info->FourCC == MFX_FOURCC_I420, MFX_ERR_INVALID_VIDEO_PARAM);
+            RET_IF_FALSE(info->FourCC == MFX_FOURCC_I420 || info->FourCC == MFX_FOURCC_NV12,
+                         MFX_ERR_INVALID_VIDEO_PARAM);
             break;
     }
 
@@ -367,3 +486,205 @@ mfxStatus CheckVideoParamCommon(mfxVideoParam *in) {
 
     return MFX_ERR_NONE;
 }
+
+mfxExtBuffer *FindExtBuffer(mfxVideoParam *par, mfxU32 bufferId) {
+    if (!par->ExtParam)
+        return nullptr;
+
+    for (mfxU16 i = 0; i < par->NumExtParam; i++) {
+        if (par->ExtParam[i] && par->ExtParam[i]->BufferId == bufferId)
+            return par->ExtParam[i];
+    }
+
+    return nullptr;
+}
+
+mfxStatus CheckThreadingParam(mfxVideoParam *par, bool canCorrect) {
+    mfxExtBuffer *buf = FindExtBuffer(par, MFX_EXTBUFF_CPU_THREADING);
+    if (!buf)
+        return MFX_ERR_NONE;
+
+    RET_IF_FALSE(buf->BufferSz == sizeof(mfxExtCPUThreading), MFX_ERR_INVALID_VIDEO_PARAM);
+
+    mfxExtCPUThreading *threading = reinterpret_cast<mfxExtCPUThreading *>(buf);
+    switch (threading->ThreadType) {
+        case MFX_CPU_THREAD_TYPE_AUTO:
+        case MFX_CPU_THREAD_TYPE_FRAME:
+        case MFX_CPU_THREAD_TYPE_SLICE:
+            break;
+        default:
+            if (!canCorrect)
+                return MFX_ERR_INVALID_VIDEO_PARAM;
+            threading->ThreadType = MFX_CPU_THREAD_TYPE_AUTO;
+            return MFX_WRN_INCOMPATIBLE_VIDEO_PARAM;
+    }
+
+    return MFX_ERR_NONE;
+}
+
+bool HasOnlyExtBuffers(mfxVideoParam *par, const std::vector<mfxU32> &ids) {
+    if (!par->NumExtParam)
+        return true;
+    if (!par->ExtParam)
+        return false;
+
+    std::vector<mfxU32> found;
+    for (mfxU16 i = 0; i < par->NumExtParam; i++) {
+        if (!par->ExtParam[i])
+            return false;
+
+        mfxU32 id = par->ExtParam[i]->BufferId;
+        if (std::find(ids.begin(), ids.end(), id) == ids.end() ||
+            std::find(found.begin(), found.end(), id) != found.end())
+            return false;
+        found.push_back(id);
+    }
+
+    return true;
+}
+
+mfxStatus CheckSurfacePoolParam(mfxVideoParam *par, bool canCorrect) {
+    mfxExtBuffer *buf = FindExtBuffer(par, MFX_EXTBUFF_CPU_SURFACE_POOL);
+    if (!buf)
+        return MFX_ERR_NONE;
+
+    RET_IF_FALSE(buf->BufferSz == sizeof(mfxExtCPUSurfacePool), MFX_ERR_INVALID_VIDEO_PARAM);
+
+    mfxExtCPUSurfacePool *pool = reinterpret_cast<mfxExtCPUSurfacePool *>(buf);
+    switch (pool->AllocationPolicy) {
+        case MFX_ALLOCATION_OPTIMAL:
+        case MFX_ALLOCATION_UNLIMITED:
+            break;
+        case MFX_ALLOCATION_LIMITED:
+            if (pool->NumSurfaces)
+                break;
+            // a limit of 0 surfaces cannot work
+            if (!canCorrect)
+                return MFX_ERR_INVALID_VIDEO_PARAM;
+            pool->AllocationPolicy = MFX_ALLOCATION_OPTIMAL;
+            return MFX_WRN_INCOMPATIBLE_VIDEO_PARAM;
+        default:
+            if (!canCorrect)
+                return MFX_ERR_INVALID_VIDEO_PARAM;
+            pool->AllocationPolicy = MFX_ALLOCATION_UNLIMITED;
+            return MFX_WRN_INCOMPATIBLE_VIDEO_PARAM;
+    }
+
+    // the alignment must be a power of 2 (0 for the default) and at most a page
+    if ((pool->Alignment & (pool->Alignment - 1)) || pool->Alignment > 4096) {
+        if (!canCorrect)
+            return MFX_ERR_INVALID_VIDEO_PARAM;
+        pool->Alignment = 0;
+        return MFX_WRN_INCOMPATIBLE_VIDEO_PARAM;
+    }
+
+    // the pitch of a padded 4K RGB4 surface must still fit mfxFrameData::Pitch
+    if (pool->Padding > 1024) {
+        if (!canCorrect)
+            return MFX_ERR_INVALID_VIDEO_PARAM;
+        pool->Padding = 1024;
+        return MFX_WRN_INCOMPATIBLE_VIDEO_PARAM;
+    }
+
+    switch (pool->HugePages) {
+        case MFX_CODINGOPTION_UNKNOWN:
+        case MFX_CODINGOPTION_ON:
+        case MFX_CODINGOPTION_OFF:
+            break;
+        default:
+            if (!canCorrect)
+                return MFX_ERR_INVALID_VIDEO_PARAM;
+            pool->HugePages = MFX_CODINGOPTION_UNKNOWN;
+            return MFX_WRN_INCOMPATIBLE_VIDEO_PARAM;
+    }
+
+    return MFX_ERR_NONE;
+}
+
+mfxStatus CheckDecodeSkipParam(mfxVideoParam *par, bool canCorrect) {
+    mfxExtBuffer *buf = FindExtBuffer(par, MFX_EXTBUFF_CPU_DECODE_SKIP);
+    if (!buf)
+        return MFX_ERR_NONE;
+
+    RET_IF_FALSE(buf->BufferSz == sizeof(mfxExtCPUDecodeSkip), MFX_ERR_INVALID_VIDEO_PARAM);
+
+    mfxExtCPUDecodeSkip *skip = reinterpret_cast<mfxExtCPUDecodeSkip *>(buf);
+    switch (skip->AutoSkip) {
+        case MFX_CODINGOPTION_UNKNOWN:
+        case MFX_CODINGOPTION_ON:
+        case MFX_CODINGOPTION_OFF:
+            break;
+        default:
+            if (!canCorrect)
+                return MFX_ERR_INVALID_VIDEO_PARAM;
+            skip->AutoSkip = MFX_CODINGOPTION_UNKNOWN;
+            return MFX_WRN_INCOMPATIBLE_VIDEO_PARAM;
+    }
+
+    if (skip->MaxSkipLevel > MFX_CPU_DECODE_MAX_SKIP_LEVEL) {
+        if (!canCorrect)
+            return MFX_ERR_INVALID_VIDEO_PARAM;
+        skip->MaxSkipLevel = MFX_CPU_DECODE_MAX_SKIP_LEVEL;
+        return MFX_WRN_INCOMPATIBLE_VIDEO_PARAM;
+    }
+
+    switch (skip->KeyFramesOnly) {
+        case MFX_CODINGOPTION_UNKNOWN:
+        case MFX_CODINGOPTION_ON:
+        case MFX_CODINGOPTION_OFF:
+            break;
+        default:
+            if (!canCorrect)
+                return MFX_ERR_INVALID_VIDEO_PARAM;
+            skip->KeyFramesOnly = MFX_CODINGOPTION_UNKNOWN;
+            return MFX_WRN_INCOMPATIBLE_VIDEO_PARAM;
+    }
+
+    // the max_lowres of the libav decoders which have it
+    if (skip->LowRes > 3) {
+        if (!canCorrect)
+            return MFX_ERR_INVALID_VIDEO_PARAM;
+        skip->LowRes = 3;
+        return MFX_WRN_INCOMPATIBLE_VIDEO_PARAM;
+    }
+
+    return MFX_ERR_NONE;
+}
+
+void GetSurfacePoolParam(mfxVideoParam *par, mfxExtCPUSurfacePool *param) {
+    mfxExtBuffer *buf = par ? FindExtBuffer(par, MFX_EXTBUFF_CPU_SURFACE_POOL) : nullptr;
+    if (buf && buf->BufferSz == sizeof(mfxExtCPUSurfacePool)) {
+        *param = *reinterpret_cast<mfxExtCPUSurfacePool *>(buf);
+        return;
+    }
+
+    InitExtBuffer(*param);
+    param->AllocationPolicy = MFX_ALLOCATION_UNLIMITED;
+}
+
+void SetCodecThreading(AVCodecContext *ctx, mfxVideoParam *par, mfxU32 defaultThreads) {
+    if (par->mfx.NumThread)
+        ctx->thread_count = std::min<mfxU32>(par->mfx.NumThread, defaultThreads);
+#ifdef ENABLE_LIBAV_AUTO_THREADS
+    else
+        ctx->thread_count = defaultThreads;
+#endif
+
+    mfxExtCPUThreading *threading =
+        reinterpret_cast<mfxExtCPUThreading *>(FindExtBuffer(par, MFX_EXTBUFF_CPU_THREADING));
+    mfxU16 threadType = threading ? threading->ThreadType : MFX_CPU_THREAD_TYPE_AUTO;
+
+    switch (threadType) {
+        case MFX_CPU_THREAD_TYPE_FRAME:
+            ctx->thread_type = FF_THREAD_FRAME;
+            break;
+        case MFX_CPU_THREAD_TYPE_SLICE:
+            ctx->thread_type = FF_THREAD_SLICE;
+            break;
+        default:
+            // AsyncDepth 1 asks for the lowest latency, frame threads add a frame each
+            ctx->thread_type =
+                (par->AsyncDepth == 1) ? FF_THREAD_SLICE : (FF_THREAD_FRAME | FF_THREAD_SLICE);
+            break;
+    }
+}
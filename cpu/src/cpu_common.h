@@ -14,7 +14,11 @@
 #include <memory>
 #include <string>
 #include <vector>
+#if defined(_MSC_VER)
+    #include <intrin.h>
+#endif
 
+#include "vpl/mfxcpu.h"
 #include "vpl/mfxjpeg.h"
 #include "vpl/mfxstructures.h"
 #include "vpl/mfxsurfacepool.h"
@@ -115,15 +119,91 @@ mfxU32 AVCodecID_to_MFXCodecId(AVCodecID CodecId);
 std::shared_ptr<AVFrame> GetAVFrameFromMfxSurface(mfxFrameSurface1 *surface,
                                                   mfxFrameAllocator *allocator);
 
-// copy image data from AVFrame to mfxFrameSurface1
+// set crop, format and aspect ratio of info from AVFrame
+void AVFrame2mfxFrameInfo(mfxFrameInfo *info, AVFrame *frame);
+
+class FrameMapCache;
+class CpuThreadPool;
+
+// copy image data from AVFrame to mfxFrameSurface1, NV12 and P010 surfaces
+//   receive planar frames of the same bit depth and subsampling
+// cache may be null, see FrameMapCache
+// large frames are copied in row bands on pool if it is not null
 mfxStatus AVFrame2mfxFrameSurface(mfxFrameSurface1 *surface,
                                   AVFrame *frame,
-                                  mfxFrameAllocator *allocator);
+                                  mfxFrameAllocator *allocator,
+                                  FrameMapCache *cache = nullptr,
+                                  CpuThreadPool *pool  = nullptr);
+
+// copy the image of src to dst planes of dstFormat, which may differ from the
+//   format of src only by interleaved (NV12, P010) or separate chroma planes
+// 16-bit samples are shifted left by shift bits, right if shift is negative
+mfxStatus CopyImage(uint8_t *const dstData[],
+                    const int dstLinesize[],
+                    int dstFormat,
+                    const AVFrame *src,
+                    int shift,
+                    CpuThreadPool *pool);
+
+// new frame holding the image of src in format, see CopyImage, null on failure
+AVFrame *ConvertAVFrame(const AVFrame *src, AVPixelFormat format, int shift, CpuThreadPool *pool);
+
+// bytes from the lowest plane of frame to the end of its highest plane with
+//   the given number of luma rows, start is set to the lowest plane - lets one
+//   AVBufferRef own an image whose planes are in a single allocation
+size_t GetImageSpan(const AVFrame *frame, int height, uint8_t **start);
 
 mfxStatus CheckFrameInfoCommon(mfxFrameInfo *info, mfxU32 codecId);
 mfxStatus CheckFrameInfoCodecs(mfxFrameInfo *info, mfxU32 codecId);
 mfxStatus CheckVideoParamCommon(mfxVideoParam *in);
 
+// return the attached extension buffer with the given id, or nullptr
+mfxExtBuffer *FindExtBuffer(mfxVideoParam *par, mfxU32 bufferId);
+
+// validate mfxExtCPUThreading if attached to par
+mfxStatus CheckThreadingParam(mfxVideoParam *par, bool canCorrect);
+
+// true if every extension buffer of par has one of the ids, none of them twice
+bool HasOnlyExtBuffers(mfxVideoParam *par, const std::vector<mfxU32> &ids);
+
+// validate mfxExtCPUSurfacePool if attached to par
+mfxStatus CheckSurfacePoolParam(mfxVideoParam *par, bool canCorrect);
+
+// copy mfxExtCPUSurfacePool from par, or the MFX_ALLOCATION_UNLIMITED default (par may be null)
+void GetSurfacePoolParam(mfxVideoParam *par, mfxExtCPUSurfacePool *param);
+
+// validate mfxExtCPUDecodeSkip if attached to par
+mfxStatus CheckDecodeSkipParam(mfxVideoParam *par, bool canCorrect);
+
+// set libav threading from mfx.NumThread and mfxExtCPUThreading
+// defaultThreads is the session's thread budget, NumThread may lower it and is
+//   capped at it, the budget is used if the application leaves NumThread at 0
+void SetCodecThreading(AVCodecContext *ctx, mfxVideoParam *par, mfxU32 defaultThreads);
+
+// mfxFrameData::Locked is shared with the application and the worker threads
+#if defined(_MSC_VER)
+inline void IncrementLocked(mfxFrameData *data) {
+    _InterlockedIncrement16(reinterpret_cast<volatile short *>(&data->Locked));
+}
+inline void DecrementLocked(mfxFrameData *data) {
+    _InterlockedDecrement16(reinterpret_cast<volatile short *>(&data->Locked));
+}
+inline mfxU16 GetLocked(mfxFrameData *data) {
+    return static_cast<mfxU16>(
+        _InterlockedOr16(reinterpret_cast<volatile short *>(&data->Locked), 0));
+}
+#else
+inline void IncrementLocked(mfxFrameData *data) {
+    __atomic_add_fetch(&data->Locked, 1, __ATOMIC_ACQ_REL);
+}
+inline void DecrementLocked(mfxFrameData *data) {
+    __atomic_sub_fetch(&data->Locked, 1, __ATOMIC_ACQ_REL);
+}
+inline mfxU16 GetLocked(mfxFrameData *data) {
+    return __atomic_load_n(&data->Locked, __ATOMIC_ACQUIRE);
+}
+#endif
+
 template <class T>
 inline void Zero(T &obj) {
     memset(&obj, 0, sizeof(obj));
@@ -134,6 +214,22 @@ template <>
 struct Type2Id<mfxExtAV1BitstreamParam> {
     enum { id = MFX_EXTBUFF_AV1_BITSTREAM_PARAM };
 };
+template <>
+struct Type2Id<mfxExtCPUThreading> {
+    enum { id = MFX_EXTBUFF_CPU_THREADING };
+};
+template <>
+struct Type2Id<mfxExtCPUEncodeCallback> {
+    enum { id = MFX_EXTBUFF_CPU_ENCODE_CALLBACK };
+};
+template <>
+struct Type2Id<mfxExtCPUSurfacePool> {
+    enum { id = MFX_EXTBUFF_CPU_SURFACE_POOL };
+};
+template <>
+struct Type2Id<mfxExtCPUDecodeSkip> {
+    enum { id = MFX_EXTBUFF_CPU_DECODE_SKIP };
+};
 template <class T>
 mfxExtBuffer MakeExtBufferHeader() {
     mfxExtBuffer header = { Type2Id<T>::id, sizeof(T) };
@@ -5,8 +5,11 @@
   ############################################################################*/
 
 #include "src/cpu_decode.h"
+#include <algorithm>
+#include <cmath>
 #include <memory>
 #include <utility>
+#include "src/cpu_buffer_cache.h"
 #include "src/cpu_workstream.h"
 
 CpuDecode::CpuDecode(CpuWorkstream *session)
@@ -17,11 +20,60 @@ CpuDecode::CpuDecode(CpuWorkstream *session)
           m_avDecFrameOut(nullptr),
           m_swsContext(nullptr),
           m_param(),
+          m_extSurfacePool(),
           m_decSurfaces(),
-          m_bFrameBuffered(false),
           m_bStreamInfo(false),
+          m_bSemiPlanar(false),
+          m_taskQueue(),
+          m_extDecodeSkip(),
+          m_skipLevel(0),
+          m_autoSkipLevel(0),
+          m_appliedSkipLevel(0),
+          m_paceStart(),
+          m_lastPacket(),
+          m_pacePackets(0),
+          m_onTimePackets(0),
+          m_decodeStats(),
+          m_surfaceMutex(),
+          m_workSurfaces(),
+          m_surfaceBuffers(),
+          m_knownSurfaces(),
+          m_frameMap(),
           m_session(session),
-          m_frameOrder(0) {}
+          m_frameOrder(0) {
+    GetSurfacePoolParam(nullptr, &m_extSurfacePool);
+    m_taskQueue.SetThreadPool(session->GetThreadPool(), session->GetPriorityRef());
+}
+
+// libav skip options of the skip levels, see mfxExtCPUDecodeSkip
+static const struct {
+    AVDiscard frame;
+    AVDiscard loopFilter;
+    AVDiscard idct;
+} s_skipLevels[MFX_CPU_DECODE_MAX_SKIP_LEVEL + 1] = {
+    { AVDISCARD_DEFAULT, AVDISCARD_DEFAULT, AVDISCARD_DEFAULT },
+    { AVDISCARD_NONREF, AVDISCARD_DEFAULT, AVDISCARD_DEFAULT },
+    { AVDISCARD_BIDIR, AVDISCARD_NONREF, AVDISCARD_DEFAULT },
+    { AVDISCARD_BIDIR, AVDISCARD_NONKEY, AVDISCARD_DEFAULT },
+    { AVDISCARD_BIDIR, AVDISCARD_NONKEY, AVDISCARD_NONKEY },
+    { AVDISCARD_NONKEY, AVDISCARD_DEFAULT, AVDISCARD_DEFAULT },
+};
+
+// FourCC of the output surfaces for decoder frames of FourCC fourcc
+static mfxU32 GetOutputFourCC(mfxU32 fourcc, bool semiPlanar) {
+    if (!semiPlanar)
+        return fourcc;
+
+    switch (fourcc) {
+        case MFX_FOURCC_I420:
+        case MFX_FOURCC_IYUV:
+            return MFX_FOURCC_NV12;
+        case MFX_FOURCC_I010:
+            return MFX_FOURCC_P010;
+        default:
+            return fourcc;
+    }
+}
 
 mfxStatus CpuDecode::ValidateDecodeParams(mfxVideoParam *par, bool canCorrect) {
     bool fixedIncompatible = false;
@@ -48,16 +100,34 @@ mfxStatus CpuDecode::ValidateDecodeParams(mfxVideoParam *par, bool canCorrect) {
         if (par->Protected)
             par->Protected = 0;
 
-        if (par->NumExtParam)
-            par->NumExtParam = 0;
+        // mfxExtCPUThreading, mfxExtCPUSurfacePool and mfxExtCPUDecodeSkip are the only
+        //   supported extension buffers
+        if (par->NumExtParam) {
+            mfxStatus sts     = CheckThreadingParam(par, true);
+            mfxStatus stsPool = CheckSurfacePoolParam(par, true);
+            mfxStatus stsSkip = CheckDecodeSkipParam(par, true);
+            if (sts < 0 || stsPool < 0 || stsSkip < 0 ||
+                !HasOnlyExtBuffers(par,
+                                   { MFX_EXTBUFF_CPU_THREADING,
+                                     MFX_EXTBUFF_CPU_SURFACE_POOL,
+                                     MFX_EXTBUFF_CPU_DECODE_SKIP }))
+                par->NumExtParam = 0;
+            else if (sts == MFX_WRN_INCOMPATIBLE_VIDEO_PARAM ||
+                     stsPool == MFX_WRN_INCOMPATIBLE_VIDEO_PARAM ||
+                     stsSkip == MFX_WRN_INCOMPATIBLE_VIDEO_PARAM)
+                fixedIncompatible = true;
+        }
 
         par->IOPattern = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
 
+        // DecodedOrder selects low latency decoding, there is only the one mode
+        if (par->mfx.DecodedOrder > 1) {
+            par->mfx.DecodedOrder = 1;
+            fixedIncompatible     = true;
+        }
+
         if (!par->mfx.FrameInfo.FourCC)
             par->mfx.FrameInfo.FourCC = MFX_FOURCC_I420;
-
-        if (par->mfx.NumThread)
-            par->mfx.NumThread = 0; //not supported
     }
     else {
         if (par->AsyncDepth > 16) {
@@ -66,13 +136,21 @@ mfxStatus CpuDecode::ValidateDecodeParams(mfxVideoParam *par, bool canCorrect) {
 
         if (par->Protected)
             return MFX_ERR_INVALID_VIDEO_PARAM;
-        if (par->NumExtParam)
-            return MFX_ERR_INVALID_VIDEO_PARAM;
+        if (par->NumExtParam) {
+            if (!HasOnlyExtBuffers(par,
+                                   { MFX_EXTBUFF_CPU_THREADING,
+                                     MFX_EXTBUFF_CPU_SURFACE_POOL,
+                                     MFX_EXTBUFF_CPU_DECODE_SKIP }))
+                return MFX_ERR_INVALID_VIDEO_PARAM;
+            RET_ERROR(CheckThreadingParam(par, false));
+            RET_ERROR(CheckSurfacePoolParam(par, false));
+            RET_ERROR(CheckDecodeSkipParam(par, false));
+        }
 
         if (par->IOPattern != MFX_IOPATTERN_OUT_SYSTEM_MEMORY)
             return MFX_ERR_INVALID_VIDEO_PARAM;
 
-        if (par->mfx.NumThread)
+        if (par->mfx.DecodedOrder > 1)
             return MFX_ERR_INVALID_VIDEO_PARAM;
 
         //only YUV420 or YUV422 chromaformats accepted
@@ -82,9 +160,10 @@ mfxStatus CpuDecode::ValidateDecodeParams(mfxVideoParam *par, bool canCorrect) {
             return MFX_ERR_INVALID_VIDEO_PARAM;
     }
 
-    //only I420, I422, I010, and and I210 colorspaces allowed
+    //only I420, I422, I010, I210, NV12 and P010 colorspaces allowed
     switch (par->mfx.FrameInfo.FourCC) {
         case MFX_FOURCC_I420:
+        case MFX_FOURCC_NV12:
             if (canCorrect) {
                 if (par->mfx.FrameInfo.BitDepthLuma && par->mfx.FrameInfo.BitDepthLuma != 8)
                     fixedIncompatible = true;
@@ -125,6 +204,7 @@ mfxStatus CpuDecode::ValidateDecodeParams(mfxVideoParam *par, bool canCorrect) {
             }
             break;
         case MFX_FOURCC_I010:
+        case MFX_FOURCC_P010:
             if (canCorrect) {
                 if (par->mfx.FrameInfo.BitDepthLuma && par->mfx.FrameInfo.BitDepthLuma != 10)
                     fixedIncompatible = true;
@@ -230,9 +310,31 @@ mfxStatus CpuDecode::InitDecode(mfxVideoParam *par, mfxBitstream *bs) {
         return MFX_ERR_INVALID_VIDEO_PARAM;
     }
 
-#ifdef ENABLE_LIBAV_AUTO_THREADS
-    m_avDecContext->thread_count = 0;
-#endif
+    // frames for application surfaces are decoded in place if the surface fits,
+    //   other frames get buffers from the process-wide cache, mjpeg output is
+    //   converted after decode and keeps the libav buffers
+    if ((m_avDecCodec->capabilities & AV_CODEC_CAP_DR1) && m_avDecCodec->id != AV_CODEC_ID_MJPEG) {
+        m_avDecContext->opaque      = this;
+        m_avDecContext->get_buffer2 = GetBuffer2;
+    }
+
+    // threads libav creates itself are limited to this session's share of the pool
+    //   unless the application asks for a number
+    SetCodecThreading(m_avDecContext, par, m_session->GetThreadBudget());
+
+    // DecodedOrder asks for the lowest latency, frames leave the decoder as soon
+    //   as they are decoded, frame threads would hold one frame each
+    if (par->mfx.DecodedOrder) {
+        m_avDecContext->flags |= AV_CODEC_FLAG_LOW_DELAY;
+        m_avDecContext->thread_type = FF_THREAD_SLICE;
+    }
+
+    mfxExtBuffer *skip = FindExtBuffer(par, MFX_EXTBUFF_CPU_DECODE_SKIP);
+    if (skip && skip->BufferSz == sizeof(mfxExtCPUDecodeSkip))
+        m_extDecodeSkip = *reinterpret_cast<mfxExtCPUDecodeSkip *>(skip);
+
+    // decoders without lowres (max_lowres 0) decode at full size
+    m_avDecContext->lowres = std::min<int>(m_extDecodeSkip.LowRes, m_avDecCodec->max_lowres);
 
     if (!bs) {
         if (m_avDecCodec->id == AV_CODEC_ID_AV1) {
@@ -244,10 +346,23 @@ mfxStatus CpuDecode::InitDecode(mfxVideoParam *par, mfxBitstream *bs) {
                 if (ret != 0)
                     return MFX_ERR_INVALID_VIDEO_PARAM;
             }
+
+            // dav1d keeps frames in flight for its own frame threads
+            if (par->mfx.DecodedOrder)
+                av_opt_set_int(m_avDecContext->priv_data,
+                               "max_frame_delay",
+                               1,
+                               AV_OPT_SEARCH_CHILDREN);
         }
     }
 
-    if (avcodec_open2(m_avDecContext, m_avDecCodec, NULL) < 0) {
+    std::shared_ptr<CpuThreadPool> pool = m_session->GetThreadPool();
+
+    // decoder threads created by libav inherit the session priority and CPU affinity
+    int err = pool->CallWithThreadAttributes(m_session->GetPriority(), [this]() {
+        return avcodec_open2(m_avDecContext, m_avDecCodec, NULL);
+    });
+    if (err < 0) {
         return MFX_ERR_INVALID_VIDEO_PARAM;
     }
 
@@ -261,7 +376,15 @@ mfxStatus CpuDecode::InitDecode(mfxVideoParam *par, mfxBitstream *bs) {
         return MFX_ERR_MEMORY_ALLOC;
     }
 
-    m_param = *par;
+    GetSurfacePoolParam(par, &m_extSurfacePool);
+
+    // extension buffers belong to the application and are only read during init
+    m_param             = *par;
+    m_param.NumExtParam = 0;
+    m_param.ExtParam    = nullptr;
+
+    m_bSemiPlanar = (par->mfx.FrameInfo.FourCC == MFX_FOURCC_NV12 ||
+                     par->mfx.FrameInfo.FourCC == MFX_FOURCC_P010);
 
     if (bs) {
         // create copy to not modify caller's mfxBitstream
@@ -270,7 +393,7 @@ mfxStatus CpuDecode::InitDecode(mfxVideoParam *par, mfxBitstream *bs) {
         mfxBitstream bs2 = *bs;
         bs2.DataFlag |= MFX_BITSTREAM_EOS;
         m_bStreamInfo = true;
-        DecodeFrame(&bs2, nullptr, nullptr);
+        DecodeFrame(&bs2, nullptr, nullptr, nullptr);
         GetVideoParam(par);
     }
 
@@ -278,6 +401,9 @@ mfxStatus CpuDecode::InitDecode(mfxVideoParam *par, mfxBitstream *bs) {
 }
 
 CpuDecode::~CpuDecode() {
+    // queued output copies may still be running
+    m_taskQueue.WaitPending(0);
+
     if (m_swsContext) {
         sws_freeContext(m_swsContext);
     }
@@ -302,37 +428,40 @@ CpuDecode::~CpuDecode() {
         avcodec_free_context(&m_avDecContext);
         m_avDecContext = nullptr;
     }
+
+    // work surfaces which never got a frame
+    for (mfxFrameSurface1 *surface : m_workSurfaces)
+        TaskUnlockSurface(surface);
+    m_workSurfaces.clear();
 }
 
 // bs == 0 is a signal to drain
 mfxStatus CpuDecode::DecodeFrame(mfxBitstream *bs,
                                  mfxFrameSurface1 *surface_work,
-                                 mfxFrameSurface1 **surface_out) {
-    if (m_bFrameBuffered) {
-        if (surface_work && surface_out) {
-            RET_ERROR(AVFrame2mfxFrameSurface(surface_work,
-                                              m_avDecFrameOut,
-                                              m_session->GetFrameAllocator()));
-
-            surface_work->Data.FrameOrder = m_frameOrder++;
-            *surface_out                  = surface_work;
-            m_bFrameBuffered              = false;
-            return MFX_ERR_NONE;
-        }
-        else {
-            return MFX_ERR_MORE_SURFACE;
-        }
-    }
+                                 mfxFrameSurface1 **surface_out,
+                                 mfxSyncPoint *syncp) {
+    RET_ERROR(m_taskQueue.TakeError());
 
     // Try get AVFrame from surface_work
     AVFrame *avframe    = nullptr;
     CpuFrame *cpu_frame = CpuFrame::TryCast(surface_work);
-    if (cpu_frame) {
+    if (cpu_frame && !m_bSemiPlanar) {
         avframe = cpu_frame->GetAVFrame();
     }
     if (!avframe) { // Otherwise use AVFrame allocated in this class
         avframe = m_avDecFrameOut;
     }
+    if (surface_work && !cpu_frame)
+        RET_ERROR(AddWorkSurface(surface_work));
+
+    // a frame received in an earlier call is still waiting for an output surface
+    if (surface_out && m_avDecFrameOut->buf[0]) {
+        if (avframe != m_avDecFrameOut) {
+            av_frame_unref(avframe);
+            av_frame_move_ref(avframe, m_avDecFrameOut);
+        }
+        return OutputFrame(avframe, cpu_frame, surface_work, surface_out, syncp);
+    }
 
     bool complete_frame_mode = false;
     if (bs && ((bs->DataFlag & MFX_BITSTREAM_COMPLETE_FRAME) == MFX_BITSTREAM_COMPLETE_FRAME)) {
@@ -348,6 +477,7 @@ mfxStatus CpuDecode::DecodeFrame(mfxBitstream *bs,
             bytes_parsed        = bs->DataLength;
             bs->DataOffset += bytes_parsed;
             bs->DataLength -= bytes_parsed;
+            m_decodeStats.AddBytes(bytes_parsed);
         }
         else {
             // parse
@@ -366,6 +496,19 @@ mfxStatus CpuDecode::DecodeFrame(mfxBitstream *bs,
             if (bs && bytes_parsed) {
                 bs->DataOffset += bytes_parsed;
                 bs->DataLength -= bytes_parsed;
+                m_decodeStats.AddBytes(bytes_parsed);
+            }
+
+            // other frames do not even reach the decoder, the AVC, HEVC and AV1
+            //   parsers report key frames, others (MPEG-2) the picture type
+            if (m_avDecPacket->size && m_extDecodeSkip.KeyFramesOnly == MFX_CODINGOPTION_ON) {
+                bool keyFrame = m_avDecParser->key_frame > 0 ||
+                                (m_avDecParser->key_frame < 0 &&
+                                 m_avDecParser->pict_type == AV_PICTURE_TYPE_I);
+                if (!keyFrame) {
+                    m_avDecPacket->size = 0;
+                    m_decodeStats.AddSkipped();
+                }
             }
         }
 
@@ -374,11 +517,22 @@ mfxStatus CpuDecode::DecodeFrame(mfxBitstream *bs,
             if (bs && bs->TimeStamp)
                 m_avDecPacket->pts = bs->TimeStamp;
 
-            auto av_ret = avcodec_send_packet(m_avDecContext, m_avDecPacket);
+            if (m_extDecodeSkip.AutoSkip == MFX_CODINGOPTION_ON)
+                UpdateAutoSkip();
+            ApplySkipLevel();
+
+            // the packet number comes back in AVFrame::pkt_pos for the latency
+            m_avDecPacket->pos = m_decodeStats.SendPacket();
+            auto sendStart     = std::chrono::steady_clock::now();
+            auto av_ret        = avcodec_send_packet(m_avDecContext, m_avDecPacket);
+            m_decodeStats.AddDecodeTime(std::chrono::steady_clock::now() - sendStart);
 
             if (av_ret == AVERROR_INVALIDDATA) {
+                m_decodeStats.AddError();
+
                 // corrupted stream - set Corrupted flag in mfxFrameData and return
                 if (surface_work && surface_out) {
+                    RemoveWorkSurface(surface_work);
                     surface_work->Data.Corrupted = MFX_CORRUPTION_MAJOR;
                     *surface_out                 = surface_work;
                     return MFX_ERR_NONE;
@@ -396,8 +550,14 @@ mfxStatus CpuDecode::DecodeFrame(mfxBitstream *bs,
         }
 
         // receive frame
-        auto av_ret = avcodec_receive_frame(m_avDecContext, avframe);
+        auto receiveStart = std::chrono::steady_clock::now();
+        auto av_ret       = avcodec_receive_frame(m_avDecContext, avframe);
+        m_decodeStats.AddDecodeTime(std::chrono::steady_clock::now() - receiveStart);
         if (av_ret == 0) {
+            m_decodeStats.ReceiveFrame(
+                avframe->pkt_pos,
+                avframe->decode_error_flags || (avframe->flags & AV_FRAME_FLAG_CORRUPT));
+
             // in case mjpeg, convert yuvj420p -> yuv420p
             if (m_avDecContext->codec_id == AV_CODEC_ID_MJPEG) {
                 if (m_avDecContext->pix_fmt != AV_PIX_FMT_YUV420P) {
@@ -485,28 +645,14 @@ mfxStatus CpuDecode::DecodeFrame(mfxBitstream *bs,
                         m_param.mfx.FrameInfo.FourCC = MFX_FOURCC_I420;
                         break;
                 }
+                m_param.mfx.FrameInfo.FourCC =
+                    GetOutputFourCC(m_param.mfx.FrameInfo.FourCC, m_bSemiPlanar);
             }
-            if (surface_out) {
-                if (avframe == m_avDecFrameOut) { // copy image data
-                    m_bFrameBuffered = true;
-                    RET_ERROR(AVFrame2mfxFrameSurface(surface_work,
-                                                      m_avDecFrameOut,
-                                                      m_session->GetFrameAllocator()));
-                    surface_work->Info.FrameRateExtN = (uint16_t)m_avDecContext->framerate.num;
-                    surface_work->Info.FrameRateExtD = (uint16_t)m_avDecContext->framerate.den;
-                    m_bFrameBuffered                 = false;
-                }
-                else {
-                    if (cpu_frame) { // update MFXFrameSurface from AVFrame
-                        cpu_frame->Update();
-                        surface_work->Info.FrameRateExtN = (uint16_t)m_avDecContext->framerate.num;
-                        surface_work->Info.FrameRateExtD = (uint16_t)m_avDecContext->framerate.den;
-                    }
-                }
-                surface_work->Data.FrameOrder = m_frameOrder++;
-                *surface_out                  = surface_work;
+            if (!surface_out) {
+                av_frame_unref(m_avDecFrameOut);
+                return MFX_ERR_NONE;
             }
-            return MFX_ERR_NONE;
+            return OutputFrame(avframe, cpu_frame, surface_work, surface_out, syncp);
         }
         if (av_ret == AVERROR(EAGAIN)) {
             if (bs && bs->DataLength) {
@@ -526,12 +672,352 @@ mfxStatus CpuDecode::DecodeFrame(mfxBitstream *bs,
             }
         }
         if (av_ret == AVERROR_EOF) {
+            // drained, surface_work will not get a frame
+            RemoveWorkSurface(surface_work);
             return MFX_ERR_MORE_DATA;
         }
         return MFX_ERR_ABORTED;
     }
 }
 
+mfxStatus CpuDecode::OutputFrame(AVFrame *avframe,
+                                 CpuFrame *cpu_frame,
+                                 mfxFrameSurface1 *surface_work,
+                                 mfxFrameSurface1 **surface_out,
+                                 mfxSyncPoint *syncp) {
+    std::shared_ptr<CpuTask> task;
+    AVRational framerate      = m_avDecContext->framerate;
+    mfxFrameSurface1 *surface = nullptr;
+
+    SurfaceBuffer *buffer = FindSurfaceBuffer(avframe);
+    if (buffer) {
+        // decoded into an application surface, it stays locked as long as
+        //   libav keeps the frame as a reference
+        surface            = buffer->surface;
+        mfxFrameData *data = buffer->lock.GetData();
+        size_t offset      = avframe->data[0] - data->Y;
+
+        AVFrame2mfxFrameInfo(&surface->Info, avframe);
+        mfxU32 bytes = surface->Info.BitDepthLuma > 8 ? 2 : 1;
+        // libav crops by moving the plane pointers
+        surface->Info.CropX         = (mfxU16)((offset % data->Pitch) / bytes);
+        surface->Info.CropY         = (mfxU16)(offset / data->Pitch);
+        surface->Info.FrameRateExtN = (uint16_t)framerate.num;
+        surface->Info.FrameRateExtD = (uint16_t)framerate.den;
+        if (avframe->pts) {
+            surface->Data.TimeStamp = avframe->pts;
+            surface->Data.DataFlag  = MFX_FRAMEDATA_ORIGINAL_TIMESTAMP;
+        }
+        av_frame_unref(avframe);
+
+        // nothing left to run
+        task = std::make_shared<CpuTask>(nullptr);
+        task->Execute();
+    }
+    else if (avframe == m_avDecFrameOut) {
+        if (cpu_frame) {
+            surface = surface_work;
+            if (m_bSemiPlanar)
+                RET_ERROR(AllocateSemiPlanar(cpu_frame, m_avDecFrameOut));
+            TaskLockSurface(surface);
+        }
+        else {
+            // work surfaces are locked since AddWorkSurface(), the copy task unlocks them
+            surface = TakeOutputSurface(surface_work);
+            // libav took all work surfaces, keep the frame for the next call
+            if (!surface)
+                return MFX_ERR_MORE_SURFACE;
+        }
+
+        // copy image data on the worker while the next packet is decoded
+        AVFrame *task_frame = av_frame_clone(m_avDecFrameOut);
+        if (!task_frame) {
+            TaskUnlockSurface(surface);
+            return MFX_ERR_MEMORY_ALLOC;
+        }
+        av_frame_unref(m_avDecFrameOut);
+        mfxFrameAllocator *allocator = m_session->GetFrameAllocator();
+        FrameMapCache *cache         = &m_frameMap;
+        CpuThreadPool *pool          = m_session->GetThreadPool().get();
+
+        task = m_taskQueue.Submit(
+            [surface, task_frame, framerate, allocator, cache, pool]() mutable {
+                mfxStatus sts =
+                    AVFrame2mfxFrameSurface(surface, task_frame, allocator, cache, pool);
+                surface->Info.FrameRateExtN = (uint16_t)framerate.num;
+                surface->Info.FrameRateExtD = (uint16_t)framerate.den;
+                av_frame_free(&task_frame);
+                TaskUnlockSurface(surface);
+                return sts;
+            });
+    }
+    else {
+        surface = surface_work;
+        if (cpu_frame) { // update MFXFrameSurface from AVFrame
+            cpu_frame->Update();
+            surface->Info.FrameRateExtN = (uint16_t)framerate.num;
+            surface->Info.FrameRateExtD = (uint16_t)framerate.den;
+        }
+        // decoded in place - nothing left to run
+        task = std::make_shared<CpuTask>(nullptr);
+        task->Execute();
+    }
+
+    m_session->SetSurfaceTask(surface, task);
+    if (syncp)
+        *syncp = m_session->AddSyncPoint(task);
+
+    surface->Data.FrameOrder = m_frameOrder++;
+    *surface_out             = surface;
+
+    m_taskQueue.WaitPending(m_param.AsyncDepth > 1 ? m_param.AsyncDepth - 1 : 0);
+    RET_ERROR(m_taskQueue.TakeError());
+    return MFX_ERR_NONE;
+}
+
+// surface_work is kept (and locked) until libav or an output copy takes it,
+//   so a frame decoded later (e.g. by a frame thread) can still use its memory
+mfxStatus CpuDecode::AddWorkSurface(mfxFrameSurface1 *surface) {
+    std::lock_guard<std::mutex> lock(m_surfaceMutex);
+
+    // libav still references the image, the surface is locked
+    for (SurfaceBuffer *buffer : m_surfaceBuffers) {
+        if (buffer->surface == surface)
+            return MFX_ERR_MORE_SURFACE;
+    }
+
+    m_knownSurfaces.insert(surface);
+    if (std::find(m_workSurfaces.begin(), m_workSurfaces.end(), surface) != m_workSurfaces.end())
+        return MFX_ERR_NONE;
+
+    // one surface is enough to wait for the next buffer request, older ones
+    //   go back to the application which may have no other unlocked surface
+    while (!m_workSurfaces.empty()) {
+        TaskUnlockSurface(m_workSurfaces.front());
+        m_workSurfaces.pop_front();
+    }
+    TaskLockSurface(surface);
+    m_workSurfaces.push_back(surface);
+    return MFX_ERR_NONE;
+}
+
+// prefers surface_work, otherwise the oldest work surface, the lock moves to the caller
+mfxFrameSurface1 *CpuDecode::TakeOutputSurface(mfxFrameSurface1 *surface_work) {
+    std::lock_guard<std::mutex> lock(m_surfaceMutex);
+    if (m_workSurfaces.empty())
+        return nullptr;
+
+    auto it = std::find(m_workSurfaces.begin(), m_workSurfaces.end(), surface_work);
+    if (it == m_workSurfaces.end())
+        it = m_workSurfaces.begin();
+
+    mfxFrameSurface1 *surface = *it;
+    m_workSurfaces.erase(it);
+    return surface;
+}
+
+void CpuDecode::RemoveWorkSurface(mfxFrameSurface1 *surface) {
+    std::lock_guard<std::mutex> lock(m_surfaceMutex);
+    auto it = std::find(m_workSurfaces.begin(), m_workSurfaces.end(), surface);
+    if (it != m_workSurfaces.end()) {
+        TaskUnlockSurface(surface);
+        m_workSurfaces.erase(it);
+    }
+}
+
+CpuDecode::SurfaceBuffer *CpuDecode::FindSurfaceBuffer(AVFrame *avframe) {
+    if (!avframe->buf[0])
+        return nullptr;
+
+    void *opaque = av_buffer_get_opaque(avframe->buf[0]);
+    std::lock_guard<std::mutex> lock(m_surfaceMutex);
+    auto it = std::find(m_surfaceBuffers.begin(), m_surfaceBuffers.end(), opaque);
+    return it != m_surfaceBuffers.end() ? *it : nullptr;
+}
+
+// may be called on any libav thread
+int CpuDecode::GetBuffer2(AVCodecContext *c, AVFrame *frame, int flags) {
+    CpuDecode *decode = static_cast<CpuDecode *>(c->opaque);
+
+    SurfaceBuffer *buffer = decode->TakeWorkSurface(c, frame);
+    if (!buffer)
+        return decode->GetCacheBuffer(c, frame, flags);
+
+    // one buffer for all planes of the surface
+    uint8_t *start = nullptr;
+    size_t size    = GetImageSpan(frame, buffer->surface->Info.Height, &start);
+    frame->buf[0]  = av_buffer_create(start, size, FreeSurfaceBuffer, buffer, 0);
+    if (!frame->buf[0]) {
+        FreeSurfaceBuffer(buffer, nullptr);
+        return AVERROR(ENOMEM);
+    }
+    frame->extended_data = frame->data;
+    return 0;
+}
+
+// same layout as avcodec_default_get_buffer2(), but one buffer for all planes
+//   from the process-wide cache instead of a pool of this codec context, so
+//   the next decoder with the same frame size starts with warm buffers
+int CpuDecode::GetCacheBuffer(AVCodecContext *c, AVFrame *frame, int flags) {
+    AVPixelFormat format           = static_cast<AVPixelFormat>(frame->format);
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL)) ||
+        c->hw_frames_ctx)
+        return avcodec_default_get_buffer2(c, frame, flags);
+
+    // widen the rows until the pitch of every plane has the alignment the codec needs
+    int width  = frame->width;
+    int height = frame->height;
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2(c, &width, &height, linesize_align);
+
+    int linesizes[4] = {};
+    bool unaligned   = false;
+    do {
+        if (av_image_fill_linesizes(linesizes, format, width) < 0)
+            return AVERROR(EINVAL);
+        width += width & ~(width - 1);
+
+        unaligned = false;
+        for (int i = 0; i < 4; i++)
+            unaligned |= (linesizes[i] % linesize_align[i]) != 0;
+    } while (unaligned);
+
+    ptrdiff_t pitches[4] = { linesizes[0], linesizes[1], linesizes[2], linesizes[3] };
+    size_t planeSizes[4] = {};
+    if (av_image_fill_plane_sizes(planeSizes, format, height, pitches) < 0)
+        return AVERROR(EINVAL);
+
+    // libav pools add 16 bytes to each plane for SIMD reads past the last row
+    size_t offsets[4] = {};
+    size_t size       = 0;
+    for (int i = 0; i < 4 && planeSizes[i]; i++) {
+        offsets[i] = size;
+        size += FFALIGN(planeSizes[i] + 16, CpuFrame::DEFAULT_ALIGNMENT);
+    }
+
+    // libav threads of a pinned session run on its CPUs like the pool workers,
+    //   the buffers they write first are kept apart for that CPU set
+    std::shared_ptr<CpuThreadPool> pool = m_session->GetThreadPool();
+
+    bool hugePages   = (m_extSurfacePool.HugePages == MFX_CODINGOPTION_ON);
+    AVBufferRef *buf = CpuBufferCache::GetShared()->GetBuffer(size,
+                                                              hugePages,
+                                                              nullptr,
+                                                              m_session->GetMemoryStats(),
+                                                              CpuMemoryStats::DECODE_FRAMES,
+                                                              pool->GetCpus());
+    if (!buf)
+        return AVERROR(ENOMEM);
+
+    // a reused buffer holds the frame of another decoder, SIMD reads past the
+    //   last row must see zeros as in a fresh one
+    for (int i = 0; i < 4 && planeSizes[i]; i++) {
+        frame->data[i]     = buf->data + offsets[i];
+        frame->linesize[i] = linesizes[i];
+        memset(frame->data[i] + planeSizes[i],
+               0,
+               FFALIGN(planeSizes[i] + 16, CpuFrame::DEFAULT_ALIGNMENT) - planeSizes[i]);
+    }
+    frame->buf[0]        = buf;
+    frame->extended_data = frame->data;
+    return 0;
+}
+
+void CpuDecode::FreeSurfaceBuffer(void *opaque, uint8_t *data) {
+    SurfaceBuffer *buffer = static_cast<SurfaceBuffer *>(opaque);
+    {
+        std::lock_guard<std::mutex> lock(buffer->decode->m_surfaceMutex);
+        std::vector<SurfaceBuffer *> &buffers = buffer->decode->m_surfaceBuffers;
+        buffers.erase(std::find(buffers.begin(), buffers.end(), buffer));
+    }
+    // unlocks the surface
+    delete buffer;
+}
+
+CpuDecode::SurfaceBuffer *CpuDecode::TakeWorkSurface(AVCodecContext *c, AVFrame *frame) {
+    std::lock_guard<std::mutex> lock(m_surfaceMutex);
+    if (m_workSurfaces.empty())
+        return nullptr;
+
+    // reference frames keep their surface locked, leave the application the
+    //   surfaces for the frames it holds (up to AsyncDepth) and the next
+    //   surface_work, so it never runs out of unlocked surfaces
+    size_t numReserved = static_cast<size_t>(std::max<mfxU16>(m_param.AsyncDepth, 1)) + 1;
+    if (m_surfaceBuffers.size() + numReserved >= m_knownSurfaces.size())
+        return nullptr;
+
+    auto buffer     = std::make_unique<SurfaceBuffer>();
+    buffer->decode  = this;
+    buffer->surface = m_workSurfaces.front();
+    mfxFrameAllocator *allocator = m_session->GetFrameAllocator();
+    if (buffer->lock.Lock(buffer->surface, MFX_MAP_WRITE, allocator, &m_frameMap) < 0)
+        return nullptr;
+    if (!GetSurfacePlanes(c, frame, &buffer->surface->Info, buffer->lock.GetData()))
+        return nullptr;
+
+    // the buffer lock replaces the one from AddWorkSurface()
+    TaskUnlockSurface(buffer->surface);
+    m_workSurfaces.pop_front();
+    m_surfaceBuffers.push_back(buffer.get());
+    return buffer.release();
+}
+
+// give an internal surface a writable NV12 or P010 buffer for the image of avframe
+mfxStatus CpuDecode::AllocateSemiPlanar(CpuFrame *cpu_frame, AVFrame *avframe) {
+    mfxU32 fourcc  = GetOutputFourCC(AVPixelFormat2MFXFourCC(avframe->format), m_bSemiPlanar);
+    AVFrame *frame = cpu_frame->GetAVFrame();
+    if (frame->format == MFXFourCC2AVPixelFormat(fourcc) && frame->width == avframe->width &&
+        frame->height == avframe->height && av_frame_is_writable(frame))
+        return MFX_ERR_NONE;
+
+    av_frame_unref(frame);
+    return cpu_frame->Allocate(fourcc, avframe->width, avframe->height);
+}
+
+// set the planes of frame to the surface memory if the surface has the format,
+//   padding and alignment libav gives its own buffers
+bool CpuDecode::GetSurfacePlanes(AVCodecContext *c,
+                                 AVFrame *frame,
+                                 mfxFrameInfo *info,
+                                 mfxFrameData *data) {
+    int bytes = 1;
+    switch (info->FourCC) {
+        case MFX_FOURCC_I420:
+        case MFX_FOURCC_I422:
+            break;
+        case MFX_FOURCC_I010:
+        case MFX_FOURCC_I210:
+            bytes = 2;
+            break;
+        default:
+            return false;
+    }
+    if (frame->format != MFXFourCC2AVPixelFormat(info->FourCC))
+        return false;
+
+    int width  = frame->width;
+    int height = frame->height;
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2(c, &width, &height, linesize_align);
+    if (info->Width < width || info->Height < height || data->Pitch < width * bytes)
+        return false;
+
+    uint8_t *planes[3] = { data->Y, data->U, data->V };
+    int linesizes[3]   = { data->Pitch, data->Pitch / 2, data->Pitch / 2 };
+    for (int i = 0; i < 3; i++) {
+        if (!planes[i] || linesizes[i] % linesize_align[i] ||
+            reinterpret_cast<uintptr_t>(planes[i]) % linesize_align[i])
+            return false;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        frame->data[i]     = planes[i];
+        frame->linesize[i] = linesizes[i];
+    }
+    return true;
+}
+
 AVFrame *CpuDecode::ConvertJPEGOutputColorSpace(AVFrame *avframe, AVPixelFormat target_pixfmt) {
     static int prev_w, prev_h;
 
@@ -625,6 +1111,7 @@ mfxStatus CpuDecode::DecodeQuery(mfxVideoParam *in, mfxVideoParam *out) {
         out->mfx.FrameInfo.AspectRatioH   = 1;
         out->mfx.CodecProfile             = 1;
         out->mfx.CodecLevel               = 1;
+        out->mfx.DecodedOrder             = 1;
         out->IOPattern                    = 1;
     }
 
@@ -638,6 +1125,8 @@ mfxStatus CpuDecode::GetDecodeSurface(mfxFrameSurface1 **surface) {
         RET_ERROR(DecodeQueryIOSurf(&m_param, &DecRequest));
 
         auto pool = std::make_unique<CpuFramePool>();
+        pool->SetMemoryStats(m_session->GetMemoryStats());
+        pool->SetAllocationPolicy(m_extSurfacePool, DecRequest.NumFrameSuggested);
         RET_ERROR(pool->Init(DecRequest.NumFrameSuggested));
         m_decSurfaces = std::move(pool);
     }
@@ -654,7 +1143,163 @@ mfxStatus CpuDecode::GetDecodeSurface(mfxFrameSurface1 **surface) {
     return sts;
 }
 
+// may be called on any thread, concurrent calls each move the level one step
+mfxStatus CpuDecode::SetSkipMode(mfxSkipMode mode) {
+    int level = m_skipLevel.load();
+    int newLevel;
+    do {
+        switch (mode) {
+            case MFX_SKIPMODE_NOSKIP:
+                newLevel = 0;
+                break;
+            case MFX_SKIPMODE_MORE:
+                newLevel = std::min(level + 1, MFX_CPU_DECODE_MAX_SKIP_LEVEL);
+                break;
+            case MFX_SKIPMODE_LESS:
+                newLevel = std::max(level - 1, 0);
+                break;
+            default:
+                return MFX_ERR_UNSUPPORTED;
+        }
+
+        if (newLevel == level)
+            return MFX_WRN_VALUE_NOT_CHANGED;
+        // level is reloaded if another call changed it meanwhile
+    } while (!m_skipLevel.compare_exchange_weak(level, newLevel));
+
+    return MFX_ERR_NONE;
+}
+
+// called for each packet with AutoSkip on, packets are expected at the frame
+//   rate of the stream, the level goes up while the application is more than
+//   two frames late and down after two seconds without being late
+// frames already late are not made up, the clock restarts instead, as it does
+//   when packets come early and after a pause (or seek) of more than a second
+void CpuDecode::UpdateAutoSkip() {
+    const mfxU32 rateN = m_param.mfx.FrameInfo.FrameRateExtN;
+    const mfxU32 rateD = m_param.mfx.FrameInfo.FrameRateExtD;
+    double frameRate   = (rateN && rateD) ? static_cast<double>(rateN) / rateD : 30.0;
+
+    auto now = std::chrono::steady_clock::now();
+    if (!m_pacePackets || now - m_lastPacket > std::chrono::seconds(1)) {
+        m_paceStart   = now;
+        m_pacePackets = 0;
+    }
+    m_lastPacket = now;
+
+    std::chrono::duration<double> elapsed = now - m_paceStart;
+    double late                           = elapsed.count() * frameRate - m_pacePackets;
+    m_pacePackets++;
+
+    if (late < 0) {
+        m_paceStart   = now;
+        m_pacePackets = 1;
+    }
+
+    if (late < 1) {
+        if (++m_onTimePackets >= 2 * frameRate && m_autoSkipLevel > 0) {
+            m_autoSkipLevel--;
+            m_onTimePackets = 0;
+        }
+        return;
+    }
+    m_onTimePackets = 0;
+
+    if (late > 2) {
+        int maxLevel = m_extDecodeSkip.MaxSkipLevel;
+        if (!maxLevel)
+            maxLevel = MFX_CPU_DECODE_MAX_SKIP_LEVEL;
+
+        int level = std::max(m_skipLevel.load(), m_autoSkipLevel);
+        if (level < maxLevel)
+            m_autoSkipLevel = level + 1;
+
+        m_paceStart   = now;
+        m_pacePackets = 1;
+    }
+}
+
+// set the libav skip options of the current level, on the thread which decodes
+// in key frame only mode the decoder skips what the parser let through, e.g.
+//   complete frames, which are not parsed
+void CpuDecode::ApplySkipLevel() {
+    int level = std::max(m_skipLevel.load(), m_autoSkipLevel);
+    if (m_extDecodeSkip.KeyFramesOnly == MFX_CODINGOPTION_ON)
+        level = MFX_CPU_DECODE_MAX_SKIP_LEVEL;
+    if (level == m_appliedSkipLevel)
+        return;
+
+    m_avDecContext->skip_frame       = s_skipLevels[level].frame;
+    m_avDecContext->skip_loop_filter = s_skipLevels[level].loopFilter;
+    m_avDecContext->skip_idct        = s_skipLevels[level].idct;
+    m_appliedSkipLevel               = level;
+}
+
+// fill mfxExtCPUDecodeLatency if attached to par
+mfxStatus CpuDecode::GetDecodeLatency(mfxVideoParam *par) {
+    mfxExtBuffer *buf = FindExtBuffer(par, MFX_EXTBUFF_CPU_DECODE_LATENCY);
+    if (!buf)
+        return MFX_ERR_NONE;
+
+    RET_IF_FALSE(buf->BufferSz == sizeof(mfxExtCPUDecodeLatency), MFX_ERR_INVALID_VIDEO_PARAM);
+    GetDecodeLatency(reinterpret_cast<mfxExtCPUDecodeLatency *>(buf));
+
+    return MFX_ERR_NONE;
+}
+
+void CpuDecode::GetDecodeLatency(mfxExtCPUDecodeLatency *latency) {
+    int threadFrames = 0;
+    if (m_avDecContext->active_thread_type & FF_THREAD_FRAME) {
+        threadFrames = m_avDecContext->thread_count - 1;
+    }
+    else if (m_avDecCodec->id == AV_CODEC_ID_AV1) {
+        // dav1d threads itself, by default with min(sqrt(threads), 8) frames in flight
+        int64_t maxFrameDelay = 0;
+        av_opt_get_int(m_avDecContext->priv_data,
+                       "max_frame_delay",
+                       AV_OPT_SEARCH_CHILDREN,
+                       &maxFrameDelay);
+        if (m_avDecContext->flags & AV_CODEC_FLAG_LOW_DELAY)
+            maxFrameDelay = 1;
+        else if (!maxFrameDelay)
+            maxFrameDelay = std::min(
+                static_cast<int>(std::ceil(std::sqrt(std::max(m_avDecContext->thread_count, 1)))),
+                8);
+        threadFrames = static_cast<int>(maxFrameDelay) - 1;
+    }
+
+    latency->ReorderFrames = static_cast<mfxU16>(m_avDecContext->has_b_frames);
+    latency->ThreadFrames  = static_cast<mfxU16>(std::max(threadFrames, 0));
+    latency->FrameDelay    = latency->ReorderFrames + latency->ThreadFrames;
+}
+
+// fill mfxExtCPUDecodeStats if attached to par
+mfxStatus CpuDecode::GetDecodeStats(mfxVideoParam *par) {
+    mfxExtBuffer *buf = FindExtBuffer(par, MFX_EXTBUFF_CPU_DECODE_STATS);
+    if (!buf)
+        return MFX_ERR_NONE;
+
+    RET_IF_FALSE(buf->BufferSz == sizeof(mfxExtCPUDecodeStats), MFX_ERR_INVALID_VIDEO_PARAM);
+    m_decodeStats.GetStats(reinterpret_cast<mfxExtCPUDecodeStats *>(buf));
+
+    return MFX_ERR_NONE;
+}
+
+// packets in the decoder up to its frame delay are cached, the decoder
+//   skipped the rest
+mfxStatus CpuDecode::GetDecodeStat(mfxDecodeStat *stat) {
+    mfxExtCPUDecodeLatency latency = {};
+    GetDecodeLatency(&latency);
+    m_decodeStats.GetStat(stat, latency.FrameDelay);
+
+    return MFX_ERR_NONE;
+}
+
 mfxStatus CpuDecode::GetVideoParam(mfxVideoParam *par) {
+    RET_ERROR(GetSurfacePoolStats(par, nullptr, m_decSurfaces.get()));
+    RET_ERROR(GetDecodeLatency(par));
+    RET_ERROR(GetDecodeStats(par));
+
     par->mfx       = m_param.mfx;
     par->IOPattern = m_param.IOPattern;
 
@@ -679,14 +1324,43 @@ mfxStatus CpuDecode::GetVideoParam(mfxVideoParam *par) {
     //been effectively set
     par->mfx.CodecId = AVCodecID_to_MFXCodecId(m_avDecCodec->id);
 
+    StreamHeader header = {};
+    header.width        = m_avDecContext->width;
+    header.height       = m_avDecContext->height;
+    header.pixFmt       = m_avDecContext->pix_fmt;
+    header.frameRate    = m_avDecContext->framerate;
+    header.aspectRatio  = m_avDecContext->sample_aspect_ratio;
+    header.profile      = m_avDecContext->profile;
+    header.level        = m_avDecContext->level;
+    SetStreamParam(par, header, m_bSemiPlanar);
+
+    return MFX_ERR_NONE;
+}
+
+mfxStatus CpuDecode::DecodeHeader(mfxBitstream *bs, mfxVideoParam *par) {
+    StreamHeader header = {};
+    RET_ERROR(ParseStreamHeader(par->mfx.CodecId,
+                                bs->Data + bs->DataOffset,
+                                bs->DataLength,
+                                &header));
+    RET_ERROR(GetSurfacePoolStats(par, nullptr, nullptr));
+
+    bool semiPlanar = (par->mfx.FrameInfo.FourCC == MFX_FOURCC_NV12 ||
+                       par->mfx.FrameInfo.FourCC == MFX_FOURCC_P010);
+    SetStreamParam(par, header, semiPlanar);
+
+    return MFX_ERR_NONE;
+}
+
+void CpuDecode::SetStreamParam(mfxVideoParam *par, const StreamHeader &header, bool semiPlanar) {
     // resolution
-    par->mfx.FrameInfo.Width  = (uint16_t)m_avDecContext->width;
-    par->mfx.FrameInfo.Height = (uint16_t)m_avDecContext->height;
-    par->mfx.FrameInfo.CropW  = (uint16_t)m_avDecContext->width;
-    par->mfx.FrameInfo.CropH  = (uint16_t)m_avDecContext->height;
+    par->mfx.FrameInfo.Width  = (uint16_t)header.width;
+    par->mfx.FrameInfo.Height = (uint16_t)header.height;
+    par->mfx.FrameInfo.CropW  = (uint16_t)header.width;
+    par->mfx.FrameInfo.CropH  = (uint16_t)header.height;
 
     // FourCC and chroma format
-    switch (m_avDecContext->pix_fmt) {
+    switch (header.pixFmt) {
         case AV_PIX_FMT_YUV420P10LE:
             par->mfx.FrameInfo.FourCC         = MFX_FOURCC_I010;
             par->mfx.FrameInfo.BitDepthLuma   = 10;
@@ -717,30 +1391,38 @@ mfxStatus CpuDecode::GetVideoParam(mfxVideoParam *par) {
             //a supported decode fourcc could not be found
             par->mfx.FrameInfo.FourCC = 0;
     }
+    par->mfx.FrameInfo.FourCC = GetOutputFourCC(par->mfx.FrameInfo.FourCC, semiPlanar);
 
     // Frame rate
-    par->mfx.FrameInfo.FrameRateExtN = (uint16_t)m_avDecContext->framerate.num;
-    par->mfx.FrameInfo.FrameRateExtD = (uint16_t)m_avDecContext->framerate.den;
+    par->mfx.FrameInfo.FrameRateExtN = (uint16_t)header.frameRate.num;
+    par->mfx.FrameInfo.FrameRateExtD = (uint16_t)header.frameRate.den;
 
     // Aspect ratio
-    if (m_avDecContext->sample_aspect_ratio.num == 0 &&
-        m_avDecContext->sample_aspect_ratio.den == 1) {
+    if (header.aspectRatio.num == 0 && header.aspectRatio.den == 1) {
         par->mfx.FrameInfo.AspectRatioW = 1;
         par->mfx.FrameInfo.AspectRatioH = 1;
     }
     else {
-        par->mfx.FrameInfo.AspectRatioW = (uint16_t)m_avDecContext->sample_aspect_ratio.num;
-        par->mfx.FrameInfo.AspectRatioH = (uint16_t)m_avDecContext->sample_aspect_ratio.den;
+        par->mfx.FrameInfo.AspectRatioW = (uint16_t)header.aspectRatio.num;
+        par->mfx.FrameInfo.AspectRatioH = (uint16_t)header.aspectRatio.den;
     }
 
     // Profile/Level
-    int profile = m_avDecContext->profile;
-    int level   = m_avDecContext->level;
+    int profile = header.profile;
+    int level   = header.level;
 
     switch (par->mfx.CodecId) {
         case MFX_CODEC_AV1:
-            //if (profile==FF_PROFILE_AV1_MAIN)
-            //if (profile==FF_PROFILE_AV1_HIGH)
+            if (profile == FF_PROFILE_AV1_MAIN)
+                par->mfx.CodecProfile = MFX_PROFILE_AV1_MAIN;
+            if (profile == FF_PROFILE_AV1_HIGH)
+                par->mfx.CodecProfile = MFX_PROFILE_AV1_HIGH;
+            if (profile == FF_PROFILE_AV1_PROFESSIONAL)
+                par->mfx.CodecProfile = MFX_PROFILE_AV1_PRO;
+
+            // seq_level_idx, ((major_level - 2) << 2) | minor_level as in DecodeFrame()
+            if (level >= 0 && level < 24)
+                par->mfx.CodecLevel = static_cast<mfxU16>(((level >> 2) + 2) * 10 + (level & 3));
             break;
 
         case MFX_CODEC_MPEG2:
@@ -784,11 +1466,10 @@ mfxStatus CpuDecode::GetVideoParam(mfxVideoParam *par) {
         default:
             par->mfx.CodecProfile = 0;
             par->mfx.CodecLevel   = 0;
-            return MFX_ERR_NONE;
+            return;
     }
 
     par->IOPattern = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
-    return MFX_ERR_NONE;
 }
 
 mfxStatus CpuDecode::CheckVideoParamDecoders(mfxVideoParam *in) {
@@ -804,7 +1485,7 @@ mfxStatus CpuDecode::CheckVideoParamDecoders(mfxVideoParam *in) {
         }
     }
 
-    if (in->mfx.DecodedOrder)
+    if (in->mfx.DecodedOrder > 1)
         return MFX_ERR_UNSUPPORTED;
 
     if (in->NumExtParam)
@@ -7,9 +7,19 @@
 #ifndef CPU_SRC_CPU_DECODE_H_
 #define CPU_SRC_CPU_DECODE_H_
 
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
 #include "src/cpu_common.h"
+#include "src/cpu_decode_stats.h"
 #include "src/cpu_frame_pool.h"
+#include "src/cpu_task.h"
+#include "src/frame_lock.h"
+#include "src/header_parser.h"
 
 class CpuWorkstream;
 
@@ -21,19 +31,65 @@ public:
     static mfxStatus DecodeQuery(mfxVideoParam *in, mfxVideoParam *out);
     static mfxStatus DecodeQueryIOSurf(mfxVideoParam *par, mfxFrameAllocRequest *request);
 
+    // fill par from the sequence header in bs without a decoder, par is unchanged
+    //   on errors, which mean the parameters have to come from InitDecode(par, bs)
+    static mfxStatus DecodeHeader(mfxBitstream *bs, mfxVideoParam *par);
+
     mfxStatus InitDecode(mfxVideoParam *par, mfxBitstream *bs);
     mfxStatus DecodeFrame(mfxBitstream *bs,
                           mfxFrameSurface1 *surface_work,
-                          mfxFrameSurface1 **surface_out);
+                          mfxFrameSurface1 **surface_out,
+                          mfxSyncPoint *syncp);
     mfxStatus GetVideoParam(mfxVideoParam *par);
     mfxStatus GetDecodeSurface(mfxFrameSurface1 **surface);
+    mfxStatus GetDecodeStat(mfxDecodeStat *stat);
+
+    // move the skip level by one for MFX_SKIPMODE_MORE and LESS, or back to 0,
+    //   from any thread, the decoder picks it up with the next packet
+    mfxStatus SetSkipMode(mfxSkipMode mode);
 
     mfxStatus CheckVideoParamDecoders(mfxVideoParam *in);
     mfxStatus IsSameVideoParam(mfxVideoParam *newPar, mfxVideoParam *oldPar);
 
 private:
+    // image memory of an application surface lent to libav by GetBuffer2()
+    struct SurfaceBuffer {
+        CpuDecode *decode;
+        mfxFrameSurface1 *surface;
+        FrameLock lock; // keeps the surface locked while libav references it
+    };
+
     static mfxStatus ValidateDecodeParams(mfxVideoParam *par, bool canCorrect);
+    mfxStatus GetDecodeLatency(mfxVideoParam *par);
+    void GetDecodeLatency(mfxExtCPUDecodeLatency *latency);
+    mfxStatus GetDecodeStats(mfxVideoParam *par);
+    static void SetStreamParam(mfxVideoParam *par, const StreamHeader &header, bool semiPlanar);
     AVFrame *ConvertJPEGOutputColorSpace(AVFrame *avframe, AVPixelFormat target_pixfmt);
+
+    // libav get_buffer2 callback, lets the decoder write (and keep its reference
+    //   frames) straight into application surfaces which fit the frame
+    static int GetBuffer2(AVCodecContext *c, AVFrame *frame, int flags);
+    static void FreeSurfaceBuffer(void *opaque, uint8_t *data);
+    int GetCacheBuffer(AVCodecContext *c, AVFrame *frame, int flags);
+    static bool GetSurfacePlanes(AVCodecContext *c,
+                                 AVFrame *frame,
+                                 mfxFrameInfo *info,
+                                 mfxFrameData *data);
+    SurfaceBuffer *TakeWorkSurface(AVCodecContext *c, AVFrame *frame);
+
+    mfxStatus AddWorkSurface(mfxFrameSurface1 *surface);
+    mfxFrameSurface1 *TakeOutputSurface(mfxFrameSurface1 *surface_work);
+    void RemoveWorkSurface(mfxFrameSurface1 *surface);
+    SurfaceBuffer *FindSurfaceBuffer(AVFrame *avframe);
+    void UpdateAutoSkip();
+    void ApplySkipLevel();
+    mfxStatus AllocateSemiPlanar(CpuFrame *cpu_frame, AVFrame *avframe);
+    mfxStatus OutputFrame(AVFrame *avframe,
+                          CpuFrame *cpu_frame,
+                          mfxFrameSurface1 *surface_work,
+                          mfxFrameSurface1 **surface_out,
+                          mfxSyncPoint *syncp);
+
     const AVCodec *m_avDecCodec;
     AVCodecContext *m_avDecContext;
     AVCodecParserContext *m_avDecParser;
@@ -42,9 +98,31 @@ private:
     struct SwsContext *m_swsContext;
 
     mfxVideoParam m_param;
+    mfxExtCPUSurfacePool m_extSurfacePool;
     std::unique_ptr<CpuFramePool> m_decSurfaces;
-    bool m_bFrameBuffered;
     bool m_bStreamInfo;
+    bool m_bSemiPlanar; // NV12 or P010 output, interleaved from the planar decoder frames
+    CpuTaskQueue m_taskQueue;
+
+    // skipping of decode work, see mfxExtCPUDecodeSkip for the levels
+    mfxExtCPUDecodeSkip m_extDecodeSkip;
+    std::atomic<int> m_skipLevel; // set by SetSkipMode()
+    int m_autoSkipLevel;          // raised and lowered by UpdateAutoSkip()
+    int m_appliedSkipLevel;       // last level set in m_avDecContext
+    std::chrono::steady_clock::time_point m_paceStart; // wall clock time of the first packet
+    std::chrono::steady_clock::time_point m_lastPacket;
+    mfxU32 m_pacePackets;   // packets sent since m_paceStart
+    mfxU32 m_onTimePackets; // packets in a row that were not late
+
+    CpuDecodeStats m_decodeStats;
+
+    // application surfaces passed to DecodeFrame which did not get a frame yet,
+    //   they stay locked until GetBuffer2() or an output copy takes them
+    std::mutex m_surfaceMutex;
+    std::deque<mfxFrameSurface1 *> m_workSurfaces;
+    std::vector<SurfaceBuffer *> m_surfaceBuffers; // surfaces libav writes or references
+    std::set<mfxFrameSurface1 *> m_knownSurfaces; // all surfaces the application passed
+    FrameMapCache m_frameMap;                     // external allocator frames
 
     CpuWorkstream *m_session;
 
@@ -0,0 +1,120 @@
+/*############################################################################
+  # Copyright (C) 2020 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#include "src/cpu_decode_stats.h"
+#include <algorithm>
+
+// packets in flight whose send time is kept, more than any decoder holds
+static const size_t SEND_TIMES = 256;
+
+CpuDecodeStats::CpuDecodeStats()
+        : m_bytes(0),
+          m_skipped(0),
+          m_packets(0),
+          m_rejected(0),
+          m_frames(0),
+          m_corrupt(0),
+          m_decodeTime(0),
+          m_sendTimes(SEND_TIMES),
+          m_mutex(),
+          m_latencies(),
+          m_nextLatency(0) {
+    m_latencies.reserve(LATENCY_WINDOW);
+}
+
+void CpuDecodeStats::AddBytes(mfxU32 bytes) {
+    m_bytes += bytes;
+}
+
+void CpuDecodeStats::AddSkipped() {
+    m_skipped++;
+}
+
+// only the thread which decodes counts packets, no other can come in between
+int64_t CpuDecodeStats::SendPacket() {
+    mfxU64 packet                    = m_packets.load();
+    m_sendTimes[packet % SEND_TIMES] = std::chrono::steady_clock::now();
+    m_packets                        = packet + 1;
+    return static_cast<int64_t>(packet);
+}
+
+void CpuDecodeStats::AddError() {
+    m_rejected++;
+}
+
+void CpuDecodeStats::AddDecodeTime(std::chrono::steady_clock::duration time) {
+    m_decodeTime += time.count();
+}
+
+void CpuDecodeStats::ReceiveFrame(int64_t pos, bool corrupt) {
+    auto now = std::chrono::steady_clock::now();
+
+    if (corrupt)
+        m_corrupt++;
+    m_frames++;
+
+    // frames of packets which were not numbered, or so long ago that their
+    //   send time is overwritten, have no latency
+    mfxU64 packet  = static_cast<mfxU64>(pos);
+    mfxU64 packets = m_packets.load();
+    if (pos < 0 || packet >= packets || packets - packet > SEND_TIMES)
+        return;
+
+    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+        now - m_sendTimes[packet % SEND_TIMES]);
+    mfxU32 us = static_cast<mfxU32>(std::min<int64_t>(latency.count(), UINT32_MAX));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_latencies.size() < LATENCY_WINDOW) {
+        m_latencies.push_back(us);
+    }
+    else {
+        m_latencies[m_nextLatency] = us;
+        m_nextLatency              = (m_nextLatency + 1) % LATENCY_WINDOW;
+    }
+}
+
+void CpuDecodeStats::GetStat(mfxDecodeStat *stat, mfxU32 maxCached) {
+    // frames before packets, a packet is counted before its frame comes out
+    mfxU64 frames   = m_frames.load();
+    mfxU64 rejected = m_rejected.load();
+    mfxU64 packets  = m_packets.load();
+
+    // a packet may also hold no frame (e.g. the second field of a frame)
+    mfxU64 inDecoder = packets - std::min(packets, frames + rejected);
+    mfxU64 cached    = std::min<mfxU64>(inDecoder, maxCached);
+
+    *stat                 = {};
+    stat->NumFrame        = static_cast<mfxU32>(frames);
+    stat->NumSkippedFrame = static_cast<mfxU32>(m_skipped.load() + inDecoder - cached);
+    stat->NumError        = static_cast<mfxU32>(rejected + m_corrupt.load());
+    stat->NumCachedFrame  = static_cast<mfxU32>(cached);
+}
+
+void CpuDecodeStats::GetStats(mfxExtCPUDecodeStats *stats) {
+    std::chrono::steady_clock::duration decodeTime(m_decodeTime.load());
+    stats->DecodeTime    = std::chrono::duration_cast<std::chrono::microseconds>(decodeTime).count();
+    stats->BytesConsumed = m_bytes.load();
+
+    std::vector<mfxU32> latencies;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        latencies = m_latencies;
+    }
+
+    stats->LatencyP50 = 0;
+    stats->LatencyP90 = 0;
+    stats->LatencyP99 = 0;
+    stats->LatencyMax = 0;
+    if (latencies.empty())
+        return;
+
+    std::sort(latencies.begin(), latencies.end());
+    stats->LatencyP50 = latencies[(latencies.size() - 1) * 50 / 100];
+    stats->LatencyP90 = latencies[(latencies.size() - 1) * 90 / 100];
+    stats->LatencyP99 = latencies[(latencies.size() - 1) * 99 / 100];
+    stats->LatencyMax = latencies.back();
+}
@@ -0,0 +1,73 @@
+/*############################################################################
+  # Copyright (C) 2020 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#ifndef CPU_SRC_CPU_DECODE_STATS_H_
+#define CPU_SRC_CPU_DECODE_STATS_H_
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include "src/cpu_common.h"
+
+// Counters and timing of one decoder, updated on the thread which decodes
+// and read by GetDecodeStat and GetVideoParam on any thread.
+// The counters are atomic so a packet takes no lock, only the latency window
+// of the received frames is behind the mutex.
+// Packets are numbered in the order they are sent, the number goes into
+// AVPacket::pos and comes back in AVFrame::pkt_pos, which libav keeps with
+// the frame through reordering and frame threads.
+class CpuDecodeStats {
+public:
+    // frames the latency percentiles are taken from
+    static const size_t LATENCY_WINDOW = 1024;
+
+    CpuDecodeStats();
+
+    // bytes taken from the application bitstream
+    void AddBytes(mfxU32 bytes);
+
+    // packet dropped before the decoder
+    void AddSkipped();
+
+    // number of the packet about to be sent
+    int64_t SendPacket();
+
+    // packet the decoder rejected as invalid
+    void AddError();
+
+    // time spent in a libav decode call
+    void AddDecodeTime(std::chrono::steady_clock::duration time);
+
+    // frame received from the decoder, pos is its AVFrame::pkt_pos
+    void ReceiveFrame(int64_t pos, bool corrupt);
+
+    // maxCached is the most frames the decoder holds, sent packets which did
+    //   not come out and do not fit there were skipped by the decoder
+    void GetStat(mfxDecodeStat *stat, mfxU32 maxCached);
+    void GetStats(mfxExtCPUDecodeStats *stats);
+
+private:
+    std::atomic<mfxU64> m_bytes;
+    std::atomic<mfxU64> m_skipped; // by the parser
+    std::atomic<mfxU64> m_packets;
+    std::atomic<mfxU64> m_rejected;
+    std::atomic<mfxU64> m_frames;
+    std::atomic<mfxU64> m_corrupt; // frames output with errors
+    std::atomic<std::chrono::steady_clock::rep> m_decodeTime;
+    // by packet number modulo size, only used on the thread which decodes
+    std::vector<std::chrono::steady_clock::time_point> m_sendTimes;
+
+    std::mutex m_mutex;
+    std::vector<mfxU32> m_latencies; // microseconds, the last LATENCY_WINDOW frames
+    size_t m_nextLatency;
+
+    /* copy not allowed */
+    CpuDecodeStats(const CpuDecodeStats &);
+    CpuDecodeStats &operator=(const CpuDecodeStats &);
+};
+
+#endif // CPU_SRC_CPU_DECODE_STATS_H_
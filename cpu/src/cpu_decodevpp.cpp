@@ -123,6 +123,7 @@ mfxStatus CpuDecodeVPP::DecodeVPPFrame(mfxBitstream *bs,
     // decode out from 0th channel
     RET_ERROR(
         MFXVideoDECODE_DecodeFrameAsync(m_mfxsession, bs, pWorkSurface, &m_surfOut[0], &syncp));
+    RET_ERROR(MFXVideoCORE_SyncOperation(m_mfxsession, syncp, MFX_INFINITE));
 
     //output DEC
     RAIISurfaceArray surfArray;
@@ -23,27 +23,43 @@ CpuEncode::CpuEncode(CpuWorkstream *session)
           m_avEncCodec(nullptr),
           m_avEncContext(nullptr),
           m_avEncPacket(nullptr),
-          m_input_locker(),
+          m_frameMap(),
           m_param({}),
           m_bFrameEncoded(false),
+          m_encPackets(),
+          m_packetMutex(),
+          m_sendTasks(),
+          m_numSendTasks(0),
+          m_unwrittenSurface(nullptr),
+          m_taskQueue(),
           m_session(session),
           m_encSurfaces(),
           m_extAV1BSParam(),
+          m_extCPUThreading(),
+          m_extEncodeCallback(),
+          m_extSurfacePool(),
           m_extParamAll(),
-          m_numExtSupported(0) {}
+          m_numExtSupported(0) {
+    m_taskQueue.SetThreadPool(session->GetThreadPool(), session->GetPriorityRef());
+}
 
 CpuEncode::~CpuEncode() {
+    // queued frames still reference the encoder context
+    m_taskQueue.WaitPending(0);
+
     if (m_bFrameEncoded) {
         // drain encoder - workaround for encoder hang on avcodec_close
-        mfxBitstream bs{};
-        mfxStatus sts;
-        do {
-            sts = EncodeFrame(nullptr, nullptr, &bs);
-        } while (sts == MFX_ERR_NOT_ENOUGH_BUFFER || sts == MFX_ERR_NONE);
-
+        SendFrame(nullptr, m_numSendTasks);
         m_bFrameEncoded = false;
     }
 
+    for (EncodedPacket &packet : m_encPackets) {
+        m_session->GetMemoryStats()->Add(CpuMemoryStats::BITSTREAMS, -packet.pkt->size);
+        av_packet_free(&packet.pkt);
+    }
+    m_encPackets.clear();
+    m_sendTasks.clear();
+
     if (m_avEncContext) {
         avcodec_close(m_avEncContext);
         avcodec_free_context(&m_avEncContext);
@@ -56,6 +72,15 @@ CpuEncode::~CpuEncode() {
     }
 }
 
+// formats is a list ended by AV_PIX_FMT_NONE, or null if unknown
+static bool HasPixelFormat(const AVPixelFormat *formats, AVPixelFormat format) {
+    for (; formats && *formats != AV_PIX_FMT_NONE; formats++) {
+        if (*formats == format)
+            return true;
+    }
+    return false;
+}
+
 mfxStatus CpuEncode::ValidateEncodeParams(mfxVideoParam *par, bool canCorrect) {
     bool fixedIncompatible = false;
     //Check if params given are settable.
@@ -71,6 +96,16 @@ mfxStatus CpuEncode::ValidateEncodeParams(mfxVideoParam *par, bool canCorrect) {
             par->Protected = 0;
         if (par->IOPattern != MFX_IOPATTERN_IN_SYSTEM_MEMORY)
             par->IOPattern = MFX_IOPATTERN_IN_SYSTEM_MEMORY;
+
+        mfxStatus sts = CheckThreadingParam(par, true);
+        RET_ERROR(sts);
+        if (sts == MFX_WRN_INCOMPATIBLE_VIDEO_PARAM)
+            fixedIncompatible = true;
+
+        sts = CheckSurfacePoolParam(par, true);
+        RET_ERROR(sts);
+        if (sts == MFX_WRN_INCOMPATIBLE_VIDEO_PARAM)
+            fixedIncompatible = true;
     }
     else {
         if (par->AsyncDepth > 16) {
@@ -82,6 +117,9 @@ mfxStatus CpuEncode::ValidateEncodeParams(mfxVideoParam *par, bool canCorrect) {
 
         if (par->IOPattern != MFX_IOPATTERN_IN_SYSTEM_MEMORY)
             return MFX_ERR_INVALID_VIDEO_PARAM;
+
+        RET_ERROR(CheckThreadingParam(par, false));
+        RET_ERROR(CheckSurfacePoolParam(par, false));
     }
 
     // mfx params
@@ -90,8 +128,6 @@ mfxStatus CpuEncode::ValidateEncodeParams(mfxVideoParam *par, bool canCorrect) {
             par->mfx.LowPower = 0; //not supported
         if (par->mfx.BRCParamMultiplier)
             par->mfx.BRCParamMultiplier = 0; //not supported
-        if (par->mfx.NumThread)
-            par->mfx.NumThread = 0; //not supported
 #ifdef ENABLE_ENCODER_OPENH264
         if (par->mfx.TargetUsage)
             par->mfx.TargetUsage = 0; // not supportd
@@ -125,8 +161,6 @@ mfxStatus CpuEncode::ValidateEncodeParams(mfxVideoParam *par, bool canCorrect) {
             return MFX_ERR_INVALID_VIDEO_PARAM;
         if (par->mfx.BRCParamMultiplier)
             return MFX_ERR_INVALID_VIDEO_PARAM;
-        if (par->mfx.NumThread)
-            return MFX_ERR_INVALID_VIDEO_PARAM;
 
         //only GOP_CLOSED flag is supported in the CPU reference implementation
         if (par->mfx.GopOptFlag != 0 && par->mfx.GopOptFlag != MFX_GOP_CLOSED)
@@ -151,7 +185,8 @@ mfxStatus CpuEncode::ValidateEncodeParams(mfxVideoParam *par, bool canCorrect) {
 
     // mfx.FrameInfo params
 
-    if (par->mfx.FrameInfo.Shift) {
+    // only P010 may have the samples in the high bits
+    if (par->mfx.FrameInfo.Shift && par->mfx.FrameInfo.FourCC != MFX_FOURCC_P010) {
         if (canCorrect)
             par->mfx.FrameInfo.Shift = 0;
         else
@@ -176,7 +211,9 @@ mfxStatus CpuEncode::ValidateEncodeParams(mfxVideoParam *par, bool canCorrect) {
 
     if (par->mfx.FrameInfo.FourCC) {
         if (par->mfx.FrameInfo.FourCC != MFX_FOURCC_I420 &&
-            par->mfx.FrameInfo.FourCC != MFX_FOURCC_I010)
+            par->mfx.FrameInfo.FourCC != MFX_FOURCC_I010 &&
+            par->mfx.FrameInfo.FourCC != MFX_FOURCC_NV12 &&
+            par->mfx.FrameInfo.FourCC != MFX_FOURCC_P010)
             return MFX_ERR_INVALID_VIDEO_PARAM;
     }
     else if (canCorrect) {
@@ -231,7 +268,9 @@ mfxStatus CpuEncode::ValidateEncodeParams(mfxVideoParam *par, bool canCorrect) {
         return MFX_ERR_INVALID_VIDEO_PARAM;
 
     if (par->mfx.FrameInfo.FourCC == MFX_FOURCC_I420 ||
-        par->mfx.FrameInfo.FourCC == MFX_FOURCC_I010) {
+        par->mfx.FrameInfo.FourCC == MFX_FOURCC_I010 ||
+        par->mfx.FrameInfo.FourCC == MFX_FOURCC_NV12 ||
+        par->mfx.FrameInfo.FourCC == MFX_FOURCC_P010) {
         if (par->mfx.FrameInfo.CropW % 2 || par->mfx.FrameInfo.CropH % 2)
             return MFX_ERR_INVALID_VIDEO_PARAM;
     }
@@ -272,7 +311,8 @@ mfxStatus CpuEncode::ValidateEncodeParams(mfxVideoParam *par, bool canCorrect) {
     if ((par->mfx.FrameInfo.BitDepthLuma == 8) && (par->mfx.FrameInfo.BitDepthChroma == 10)) {
         if (canCorrect)
             fixedIncompatible = true;
-        if (par->mfx.FrameInfo.FourCC == MFX_FOURCC_I420)
+        if (par->mfx.FrameInfo.FourCC == MFX_FOURCC_I420 ||
+            par->mfx.FrameInfo.FourCC == MFX_FOURCC_NV12)
             par->mfx.FrameInfo.BitDepthChroma = 8;
         else
             par->mfx.FrameInfo.BitDepthChroma = 10;
@@ -281,7 +321,8 @@ mfxStatus CpuEncode::ValidateEncodeParams(mfxVideoParam *par, bool canCorrect) {
     if ((par->mfx.FrameInfo.BitDepthLuma == 10) && (par->mfx.FrameInfo.BitDepthChroma == 8)) {
         if (canCorrect)
             fixedIncompatible = true;
-        if (par->mfx.FrameInfo.FourCC == MFX_FOURCC_I420)
+        if (par->mfx.FrameInfo.FourCC == MFX_FOURCC_I420 ||
+            par->mfx.FrameInfo.FourCC == MFX_FOURCC_NV12)
             par->mfx.FrameInfo.BitDepthLuma = 8;
         else
             par->mfx.FrameInfo.BitDepthLuma = 10;
@@ -321,7 +362,8 @@ mfxStatus CpuEncode::ValidateEncodeParams(mfxVideoParam *par, bool canCorrect) {
                     return MFX_ERR_INVALID_VIDEO_PARAM;
 
             if (par->mfx.CodecProfile) {
-                if (par->mfx.FrameInfo.FourCC == MFX_FOURCC_I010) {
+                if (par->mfx.FrameInfo.FourCC == MFX_FOURCC_I010 ||
+                    par->mfx.FrameInfo.FourCC == MFX_FOURCC_P010) {
                     if (par->mfx.CodecProfile != MFX_PROFILE_AVC_HIGH10 &&
                         par->mfx.CodecProfile != MFX_PROFILE_AVC_HIGH_422)
                         return MFX_ERR_INVALID_VIDEO_PARAM;
@@ -334,7 +376,8 @@ mfxStatus CpuEncode::ValidateEncodeParams(mfxVideoParam *par, bool canCorrect) {
                 }
             }
             else if (canCorrect) {
-                if (par->mfx.FrameInfo.FourCC == MFX_FOURCC_I010) {
+                if (par->mfx.FrameInfo.FourCC == MFX_FOURCC_I010 ||
+                    par->mfx.FrameInfo.FourCC == MFX_FOURCC_P010) {
                     par->mfx.CodecProfile = MFX_PROFILE_AVC_HIGH10;
                 }
                 else
@@ -513,7 +556,8 @@ mfxStatus CpuEncode::ValidateEncodeParams(mfxVideoParam *par, bool canCorrect) {
         }
 
         if (par->mfx.FrameInfo.FourCC) {
-            if (par->mfx.FrameInfo.FourCC != MFX_FOURCC_I420)
+            if (par->mfx.FrameInfo.FourCC != MFX_FOURCC_I420 &&
+                par->mfx.FrameInfo.FourCC != MFX_FOURCC_NV12)
                 return MFX_ERR_INVALID_VIDEO_PARAM;
         }
         else if (canCorrect) {
@@ -551,12 +595,18 @@ void CpuEncode::InitExtBuffers() {
     CleanUpExtBuffers();
     size_t count           = 0;
     m_extParamAll[count++] = &m_extAV1BSParam.Header;
+    m_extParamAll[count++] = &m_extCPUThreading.Header;
+    m_extParamAll[count++] = &m_extEncodeCallback.Header;
+    m_extParamAll[count++] = &m_extSurfacePool.Header;
 
     m_numExtSupported = sizeof(m_extParamAll) / sizeof(m_extParamAll[--count]);
 }
 
 void CpuEncode::CleanUpExtBuffers() {
     InitExtBuffer(m_extAV1BSParam);
+    InitExtBuffer(m_extCPUThreading);
+    InitExtBuffer(m_extEncodeCallback);
+    InitExtBuffer(m_extSurfacePool);
 }
 
 mfxStatus CpuEncode::CheckExtBuffers(mfxExtBuffer **extParam, int32_t numExtParam) {
@@ -625,6 +675,15 @@ mfxStatus CpuEncode::InitEncode(mfxVideoParam *par) {
         }
     }
 
+    mfxExtBuffer *callback = FindExtBuffer(par, MFX_EXTBUFF_CPU_ENCODE_CALLBACK);
+    if (callback) {
+        RET_IF_FALSE(callback->BufferSz == sizeof(mfxExtCPUEncodeCallback),
+                     MFX_ERR_INVALID_VIDEO_PARAM);
+        memcpy(&m_extEncodeCallback, callback, sizeof(mfxExtCPUEncodeCallback));
+    }
+
+    GetSurfacePoolParam(par, &m_extSurfacePool);
+
     AVCodecID cid = MFXCodecId_to_AVCodecID(m_param.mfx.CodecId);
     RET_IF_FALSE(cid, MFX_ERR_INVALID_VIDEO_PARAM);
 
@@ -671,7 +730,7 @@ mfxStatus CpuEncode::InitEncode(mfxVideoParam *par) {
     if (par->mfx.GopOptFlag == MFX_GOP_CLOSED)
         m_avEncContext->flags &= AV_CODEC_FLAG_CLOSED_GOP;
 
-    if (par->mfx.FrameInfo.BitDepthChroma == 10) {
+    if (par->mfx.FrameInfo.BitDepthChroma == 10 || par->mfx.FrameInfo.FourCC == MFX_FOURCC_P010) {
         // Main10: 10-bit 420
         m_avEncContext->pix_fmt = AV_PIX_FMT_YUV420P10;
     }
@@ -683,7 +742,19 @@ mfxStatus CpuEncode::InitEncode(mfxVideoParam *par) {
             m_avEncContext->pix_fmt = AV_PIX_FMT_YUV420P;
     }
 
-    if (m_avEncContext->pix_fmt == AV_PIX_FMT_YUV420P10LE)
+    // semi-planar input goes to encoders which take it as is, to the others
+    //   it is converted to planar frames in SendFrame()
+    mfxU32 inputFourCC = par->mfx.FrameInfo.FourCC;
+    if (inputFourCC == MFX_FOURCC_NV12 || inputFourCC == MFX_FOURCC_P010) {
+        AVPixelFormat format = MFXFourCC2AVPixelFormat(inputFourCC);
+        // libav P010 has the samples in the high bits
+        bool sameLayout = (inputFourCC == MFX_FOURCC_NV12 || par->mfx.FrameInfo.Shift);
+        if (sameLayout && par->mfx.CodecId != MFX_CODEC_JPEG &&
+            HasPixelFormat(m_avEncCodec->pix_fmts, format))
+            m_avEncContext->pix_fmt = format;
+        m_param.mfx.FrameInfo.FourCC = inputFourCC;
+    }
+    else if (m_avEncContext->pix_fmt == AV_PIX_FMT_YUV420P10LE)
         m_param.mfx.FrameInfo.FourCC = MFX_FOURCC_I010;
     else if (m_avEncContext->pix_fmt == AV_PIX_FMT_YUV420P)
         m_param.mfx.FrameInfo.FourCC = MFX_FOURCC_I420;
@@ -720,12 +791,16 @@ mfxStatus CpuEncode::InitEncode(mfxVideoParam *par) {
             return MFX_ERR_INVALID_VIDEO_PARAM;
     }
 
-#ifdef ENABLE_LIBAV_AUTO_THREADS
-    m_avEncContext->thread_count = 0;
-#endif
+    // threads libav creates itself are limited to this session's share of the pool
+    //   unless the application asks for a number
+    SetCodecThreading(m_avEncContext, par, m_session->GetThreadBudget());
 
-    int err = 0;
-    err     = avcodec_open2(m_avEncContext, m_avEncCodec, NULL);
+    std::shared_ptr<CpuThreadPool> pool = m_session->GetThreadPool();
+
+    // encoder threads created by libav inherit the session priority and CPU affinity
+    int err = pool->CallWithThreadAttributes(m_session->GetPriority(), [this]() {
+        return avcodec_open2(m_avEncContext, m_avEncCodec, NULL);
+    });
     RET_IF_FALSE(err == 0, MFX_ERR_INVALID_VIDEO_PARAM);
 
     if (!m_param.mfx.BufferSizeInKB) {
@@ -1459,9 +1534,11 @@ mfxStatus CpuEncode::GetAV1Params(mfxVideoParam *par) {
     return MFX_ERR_NONE;
 }
 
-mfxStatus CpuEncode::EncodeFrame(mfxFrameSurface1 *surface, mfxEncodeCtrl *ctrl, mfxBitstream *bs) {
+mfxStatus CpuEncode::EncodeFrame(mfxFrameSurface1 *surface,
+                                 mfxEncodeCtrl *ctrl,
+                                 mfxBitstream *bs,
+                                 mfxSyncPoint *syncp) {
     RET_IF_FALSE(m_avEncContext, MFX_ERR_NOT_INITIALIZED);
-    int err;
 
     // check mfxEncodeCtrl
     // none of these features are implemented so function returns invalid param
@@ -1480,12 +1557,118 @@ mfxStatus CpuEncode::EncodeFrame(mfxFrameSurface1 *surface, mfxEncodeCtrl *ctrl,
             return MFX_ERR_INVALID_VIDEO_PARAM;
     }
 
-    // encode one frame
+    RET_ERROR(m_taskQueue.TakeError());
+
+    EncodedPacket packet = {};
+    {
+        std::lock_guard<std::mutex> lock(m_packetMutex);
+        if (!m_encPackets.empty())
+            packet = m_encPackets.front();
+    }
+
+    // a retry after MFX_ERR_NOT_ENOUGH_BUFFER brings the surface again, it is
+    //   in the encoder already
+    bool submitted     = surface && surface == m_unwrittenSurface;
+    m_unwrittenSurface = nullptr;
+    if (!submitted) {
+        // nothing is submitted while the oldest packet does not fit into bs
+        mfxU32 nBytesAvail = bs->MaxLength - (bs->DataLength + bs->DataOffset);
+        if (packet.pkt && GetPacketBytes(packet.pkt) > nBytesAvail)
+            return MFX_ERR_NOT_ENOUGH_BUFFER;
+
+        // encode on the worker, up to AsyncDepth frames in flight
+        // the bitstream gets the oldest packet which is ready, so the first
+        //   AsyncDepth-1 frames return MFX_ERR_MORE_DATA like a HW encoder would
+        std::shared_ptr<CpuTask> task;
+        mfxU64 sendTask = m_numSendTasks++;
+        if (surface) {
+            // surface may be the pending output of decode or VPP of this session
+            std::shared_ptr<CpuTask> producer = m_session->GetSurfaceTask(surface);
+
+            TaskLockSurface(surface);
+            task = m_taskQueue.Submit(
+                [this, surface, sendTask]() {
+                    mfxStatus sts = SendFrame(surface, sendTask);
+                    TaskUnlockSurface(surface);
+                    return sts;
+                },
+                producer);
+            m_taskQueue.WaitPending(m_param.AsyncDepth > 1 ? m_param.AsyncDepth - 1 : 0);
+        }
+        else {
+            // drain - flush the encoder and collect every remaining packet
+            task = m_taskQueue.Submit([this, sendTask]() {
+                return SendFrame(nullptr, sendTask);
+            });
+            m_taskQueue.WaitPending(0);
+        }
+        m_sendTasks.emplace_back(sendTask, task);
+        RET_ERROR(m_taskQueue.TakeError());
+
+        if (!packet.pkt) {
+            std::lock_guard<std::mutex> lock(m_packetMutex);
+            if (!m_encPackets.empty())
+                packet = m_encPackets.front();
+        }
+    }
+    if (!packet.pkt)
+        return MFX_ERR_MORE_DATA;
+
+    // packet stays queued if it does not fit into bs
+    mfxStatus sts = WritePacket(packet.pkt, bs);
+    if (sts == MFX_ERR_NOT_ENOUGH_BUFFER)
+        m_unwrittenSurface = surface;
+    RET_ERROR(sts);
+
+    {
+        std::lock_guard<std::mutex> lock(m_packetMutex);
+        m_encPackets.pop_front();
+    }
+    m_session->GetMemoryStats()->Add(CpuMemoryStats::BITSTREAMS, -packet.pkt->size);
+    av_packet_free(&packet.pkt);
+
+    // the sync point is the task which produced the packet, not the one just
+    //   submitted, tasks before it which produced no packet are done with
+    while (m_sendTasks.front().first < packet.sendTask)
+        m_sendTasks.pop_front();
+    if (syncp)
+        *syncp = m_session->AddSyncPoint(m_sendTasks.front().second);
+
+    return MFX_ERR_NONE;
+}
+
+// runs on the worker thread
+// send one frame (nullptr to drain) and queue every packet the encoder returns
+//   with the number of this task
+mfxStatus CpuEncode::SendFrame(mfxFrameSurface1 *surface, mfxU64 sendTask) {
+    int err;
+
     if (surface) {
-        AVFrame *av_frame =
-            m_input_locker.GetAVFrame(surface, MFX_MAP_READ, m_session->GetFrameAllocator());
+        // the encoder keeps a reference instead of a copy for reordering
+        AVFrame *av_frame = RefSurfaceAVFrame(surface,
+                                              MFX_MAP_READ,
+                                              m_session->GetFrameAllocator(),
+                                              &m_frameMap);
         RET_IF_FALSE(av_frame, MFX_ERR_ABORTED);
 
+        // semi-planar surfaces the encoder does not take as they are
+        if (av_frame->format == AV_PIX_FMT_NV12 || av_frame->format == AV_PIX_FMT_P010LE) {
+            int shift = 0;
+            if (av_frame->format == AV_PIX_FMT_P010LE) {
+                shift = (m_avEncContext->pix_fmt == AV_PIX_FMT_P010LE) ? 6 : 0;
+                shift -= surface->Info.Shift ? 6 : 0;
+            }
+            if (av_frame->format != m_avEncContext->pix_fmt || shift) {
+                AVFrame *converted = ConvertAVFrame(av_frame,
+                                                    m_avEncContext->pix_fmt,
+                                                    shift,
+                                                    m_session->GetThreadPool().get());
+                av_frame_free(&av_frame);
+                RET_IF_FALSE(converted, MFX_ERR_MEMORY_ALLOC);
+                av_frame = converted;
+            }
+        }
+
         if (m_param.mfx.CodecId == MFX_CODEC_JPEG) {
             // must be set for every frame
             av_frame->quality = m_avEncContext->global_quality;
@@ -1495,8 +1678,10 @@ mfxStatus CpuEncode::EncodeFrame(mfxFrameSurface1 *surface, mfxEncodeCtrl *ctrl,
             av_frame->pts = static_cast<int64_t>(surface->Data.TimeStamp);
 
         err = avcodec_send_frame(m_avEncContext, av_frame);
-        m_input_locker.Unlock();
+        av_frame_free(&av_frame);
         RET_IF_FALSE(err >= 0, MFX_ERR_ABORTED);
+
+        m_bFrameEncoded = true;
     }
     else {
         // send NULL packet to drain frames
@@ -1504,103 +1689,108 @@ mfxStatus CpuEncode::EncodeFrame(mfxFrameSurface1 *surface, mfxEncodeCtrl *ctrl,
         RET_IF_FALSE(err == 0 || err == AVERROR_EOF, MFX_ERR_UNKNOWN);
     }
 
-    // get encoded packet, if available
-    mfxU32 nBytesOut = 0, nBytesAvail = 0;
+    for (;;) {
+        err = avcodec_receive_packet(m_avEncContext, m_avEncPacket);
+        if (err == AVERROR(EAGAIN) || err == AVERROR_EOF) {
+            // need more data - nothing to do
+            break;
+        }
+        RET_IF_FALSE(err == 0, MFX_ERR_UNDEFINED_BEHAVIOR);
+
+        AVPacket *pkt = av_packet_alloc();
+        RET_IF_FALSE(pkt, MFX_ERR_MEMORY_ALLOC);
+        av_packet_move_ref(pkt, m_avEncPacket);
+        m_session->GetMemoryStats()->Add(CpuMemoryStats::BITSTREAMS, pkt->size);
+
+        {
+            std::lock_guard<std::mutex> lock(m_packetMutex);
+            m_encPackets.push_back({ pkt, sendTask });
+        }
 
-    err = avcodec_receive_packet(m_avEncContext, m_avEncPacket);
-    if (err == AVERROR(EAGAIN)) {
-        // need more data - nothing to do
-        RET_ERROR(MFX_ERR_MORE_DATA);
+        // mfxExtCPUEncodeCallback
+        if (m_extEncodeCallback.BitstreamReady)
+            m_extEncodeCallback.BitstreamReady(m_extEncodeCallback.pthis);
     }
-    else if (err == AVERROR_EOF) {
-        RET_ERROR(MFX_ERR_MORE_DATA);
+
+    return MFX_ERR_NONE;
+}
+
+// bytes WritePacket() writes for the packet
+mfxU32 CpuEncode::GetPacketBytes(AVPacket *pkt) {
+    if (m_bWriteIVFHeaders == true) {
+        if (m_cfgIVF.frame_count ==
+            0) // add the stream header and the frame header for the 1st frame
+            return IVF_STREAM_HEADER_SIZE + IVF_FRAME_HEADER_SIZE + pkt->size;
+        else // add the frame header only from 2nd frame
+            return IVF_FRAME_HEADER_SIZE + pkt->size;
     }
-    else if (err != 0) {
-        // other error
-        RET_ERROR(MFX_ERR_UNDEFINED_BEHAVIOR);
+    return pkt->size;
+}
+
+// copy encoded packet to output buffer
+mfxStatus CpuEncode::WritePacket(AVPacket *pkt, mfxBitstream *bs) {
+    mfxU32 nBytesOut   = GetPacketBytes(pkt);
+    mfxU32 nBytesAvail = bs->MaxLength - (bs->DataLength + bs->DataOffset);
+
+    if (nBytesOut > nBytesAvail) {
+        //error if encoded bytes out is larger than provided output buffer size
+        return MFX_ERR_NOT_ENOUGH_BUFFER;
     }
-    else {
-        if (!m_bFrameEncoded)
-            m_bFrameEncoded = true;
-
-        // copy encoded data to output buffer
-        if (m_bWriteIVFHeaders == true) {
-            if (m_cfgIVF.frame_count ==
-                0) // add the stream header and the frame header for the 1st frame
-                nBytesOut = IVF_STREAM_HEADER_SIZE + IVF_FRAME_HEADER_SIZE + m_avEncPacket->size;
-            else // add the frame header only from 2nd frame
-                nBytesOut = IVF_FRAME_HEADER_SIZE + m_avEncPacket->size;
-        }
-        else {
-            nBytesOut = m_avEncPacket->size;
-        }
-        nBytesAvail = bs->MaxLength - (bs->DataLength + bs->DataOffset);
 
-        if (nBytesOut > nBytesAvail) {
-            //error if encoded bytes out is larger than provided output buffer size
-            return MFX_ERR_NOT_ENOUGH_BUFFER;
+    // only available for av1, otherwise it is 0 always
+    mfxU32 nHeaderSize = 0;
+    if (m_bWriteIVFHeaders == true) {
+        ++m_cfgIVF.frame_count;
+
+        if (m_cfgIVF.frame_count == 1) {
+            m_cfgIVF.input_padded_width     = (m_param.mfx.FrameInfo.CropW)
+                                                  ? m_param.mfx.FrameInfo.CropW
+                                                  : m_param.mfx.FrameInfo.Width;
+            m_cfgIVF.input_padded_height    = (m_param.mfx.FrameInfo.CropH)
+                                                  ? m_param.mfx.FrameInfo.CropH
+                                                  : m_param.mfx.FrameInfo.Height;
+            m_cfgIVF.frame_rate_numerator   = m_param.mfx.FrameInfo.FrameRateExtN;
+            m_cfgIVF.frame_rate_denominator = m_param.mfx.FrameInfo.FrameRateExtD;
+
+            WriteIVFStreamHeader(&m_cfgIVF, bs->Data + bs->DataOffset, nBytesAvail);
+
+            nHeaderSize = IVF_STREAM_HEADER_SIZE;
+            nBytesAvail -= IVF_STREAM_HEADER_SIZE;
         }
 
-        // only available for av1, otherwise it is 0 always
-        mfxU32 nHeaderSize = 0;
-        if (m_bWriteIVFHeaders == true) {
-            ++m_cfgIVF.frame_count;
-
-            if (m_cfgIVF.frame_count == 1) {
-                m_cfgIVF.input_padded_width     = (m_param.mfx.FrameInfo.CropW)
-                                                      ? m_param.mfx.FrameInfo.CropW
-                                                      : m_param.mfx.FrameInfo.Width;
-                m_cfgIVF.input_padded_height    = (m_param.mfx.FrameInfo.CropH)
-                                                      ? m_param.mfx.FrameInfo.CropH
-                                                      : m_param.mfx.FrameInfo.Height;
-                m_cfgIVF.frame_rate_numerator   = m_param.mfx.FrameInfo.FrameRateExtN;
-                m_cfgIVF.frame_rate_denominator = m_param.mfx.FrameInfo.FrameRateExtD;
-
-                WriteIVFStreamHeader(&m_cfgIVF, bs->Data + bs->DataOffset, nBytesAvail);
-
-                nHeaderSize = IVF_STREAM_HEADER_SIZE;
-                nBytesAvail -= IVF_STREAM_HEADER_SIZE;
-            }
+        WriteIVFFrameHeader(&m_cfgIVF,
+                            bs->Data + bs->DataOffset + nHeaderSize,
+                            nBytesAvail,
+                            pkt->size);
 
-            WriteIVFFrameHeader(&m_cfgIVF,
-                                bs->Data + bs->DataOffset + nHeaderSize,
-                                nBytesAvail,
-                                m_avEncPacket->size);
+        nHeaderSize += IVF_FRAME_HEADER_SIZE;
+        nBytesAvail -= IVF_FRAME_HEADER_SIZE;
+    }
 
-            nHeaderSize += IVF_FRAME_HEADER_SIZE;
-            nBytesAvail -= IVF_FRAME_HEADER_SIZE;
-        }
+    memcpy_s(bs->Data + bs->DataOffset + nHeaderSize, nBytesAvail, pkt->data, pkt->size);
 
-        memcpy_s(bs->Data + bs->DataOffset + nHeaderSize,
-                 nBytesAvail,
-                 m_avEncPacket->data,
-                 m_avEncPacket->size);
-
-        bs->DataLength += nBytesOut;
-        // TO DO - convert to 90khz timestamps (read m_avEncPacket->pts, ->dts)
-        // Note dts may start at < 0, should +=1 each frame
-        bs->TimeStamp       = m_avEncPacket->pts;
-        bs->DecodeTimeStamp = MFX_TIMESTAMP_UNKNOWN;
-        bs->CodecId         = m_param.mfx.CodecId;
-        bs->PicStruct       = MFX_PICSTRUCT_PROGRESSIVE;
-
-        // TO DO - verify logic across codecs - may require parsing
-        //   output packets to get correct mapping of frame types
-        bs->FrameType = MFX_FRAMETYPE_UNKNOWN;
-        if (m_avEncPacket->flags & AV_PKT_FLAG_KEY) {
-            bs->FrameType = MFX_FRAMETYPE_I;
-            bs->FrameType |= MFX_FRAMETYPE_REF;
-        }
-        else if (m_avEncPacket->flags & AV_PKT_FLAG_DISPOSABLE) {
-            bs->FrameType = MFX_FRAMETYPE_B;
-        }
-        else {
-            bs->FrameType = MFX_FRAMETYPE_P;
-            bs->FrameType |= MFX_FRAMETYPE_REF;
-        }
-    }
+    bs->DataLength += nBytesOut;
+    // TO DO - convert to 90khz timestamps (read pkt->pts, ->dts)
+    // Note dts may start at < 0, should +=1 each frame
+    bs->TimeStamp       = pkt->pts;
+    bs->DecodeTimeStamp = MFX_TIMESTAMP_UNKNOWN;
+    bs->CodecId         = m_param.mfx.CodecId;
+    bs->PicStruct       = MFX_PICSTRUCT_PROGRESSIVE;
 
-    av_packet_unref(m_avEncPacket);
+    // TO DO - verify logic across codecs - may require parsing
+    //   output packets to get correct mapping of frame types
+    bs->FrameType = MFX_FRAMETYPE_UNKNOWN;
+    if (pkt->flags & AV_PKT_FLAG_KEY) {
+        bs->FrameType = MFX_FRAMETYPE_I;
+        bs->FrameType |= MFX_FRAMETYPE_REF;
+    }
+    else if (pkt->flags & AV_PKT_FLAG_DISPOSABLE) {
+        bs->FrameType = MFX_FRAMETYPE_B;
+    }
+    else {
+        bs->FrameType = MFX_FRAMETYPE_P;
+        bs->FrameType |= MFX_FRAMETYPE_REF;
+    }
 
     return MFX_ERR_NONE;
 }
@@ -1694,6 +1884,9 @@ mfxStatus CpuEncode::GetEncodeSurface(mfxFrameSurface1 **surface) {
         RET_ERROR(EncodeQueryIOSurf(&m_param, &EncRequest));
 
         auto pool = std::make_unique<CpuFramePool>();
+        pool->SetThreadPool(m_session->GetThreadPool());
+        pool->SetMemoryStats(m_session->GetMemoryStats());
+        pool->SetAllocationPolicy(m_extSurfacePool, EncRequest.NumFrameSuggested);
         RET_ERROR(pool->Init(m_param.mfx.FrameInfo, EncRequest.NumFrameSuggested));
         m_encSurfaces = std::move(pool);
     }
@@ -1712,7 +1905,18 @@ mfxStatus CpuEncode::GetEncodeSurface(mfxFrameSurface1 **surface) {
 }
 
 mfxStatus CpuEncode::GetVideoParam(mfxVideoParam *par) {
-    *par = m_param;
+    // encoder context must not be read while frames are in flight
+    m_taskQueue.WaitPending(0);
+
+    RET_ERROR(GetSurfacePoolStats(par, m_encSurfaces.get(), nullptr));
+
+    // extension buffers of the caller are kept
+    mfxExtBuffer **extParam = par->ExtParam;
+    mfxU16 numExtParam      = par->NumExtParam;
+
+    *par             = m_param;
+    par->ExtParam    = extParam;
+    par->NumExtParam = numExtParam;
     //*par = { 0 };
 
     par->IOPattern = MFX_IOPATTERN_IN_SYSTEM_MEMORY;
@@ -1764,6 +1968,11 @@ mfxStatus CpuEncode::GetVideoParam(mfxVideoParam *par) {
             //a supported decode fourcc could not be found
             par->mfx.FrameInfo.FourCC = 0;
     }
+    if (m_param.mfx.FrameInfo.FourCC == MFX_FOURCC_NV12 ||
+        m_param.mfx.FrameInfo.FourCC == MFX_FOURCC_P010) {
+        par->mfx.FrameInfo.FourCC = m_param.mfx.FrameInfo.FourCC;
+        par->mfx.FrameInfo.Shift  = m_param.mfx.FrameInfo.Shift;
+    }
 
     // Frame rate
     par->mfx.FrameInfo.FrameRateExtN = (uint16_t)m_avEncContext->framerate.num;
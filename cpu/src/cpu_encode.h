@@ -7,11 +7,14 @@
 #ifndef CPU_SRC_CPU_ENCODE_H_
 #define CPU_SRC_CPU_ENCODE_H_
 
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <utility>
 #include "src/cpu_common.h"
 #include "src/cpu_frame_pool.h"
+#include "src/cpu_task.h"
 #include "src/frame_lock.h"
 
 // AV1: for adding IVF header
@@ -42,7 +45,10 @@ public:
     static mfxStatus EncodeQueryIOSurf(mfxVideoParam *par, mfxFrameAllocRequest *request);
 
     mfxStatus InitEncode(mfxVideoParam *par);
-    mfxStatus EncodeFrame(mfxFrameSurface1 *surface, mfxEncodeCtrl *ctrl, mfxBitstream *bs);
+    mfxStatus EncodeFrame(mfxFrameSurface1 *surface,
+                          mfxEncodeCtrl *ctrl,
+                          mfxBitstream *bs,
+                          mfxSyncPoint *syncp);
     mfxStatus GetVideoParam(mfxVideoParam *par);
     mfxStatus GetEncodeSurface(mfxFrameSurface1 **surface);
     mfxStatus IsSameVideoParam(mfxVideoParam *newPar, mfxVideoParam *oldPar);
@@ -59,7 +65,16 @@ private:
     mfxStatus InitJPEGParams(mfxVideoParam *par);
     mfxStatus GetJPEGParams(mfxVideoParam *par);
 
+    // packet of the encoder with the number of the SendFrame() task which got it
+    struct EncodedPacket {
+        AVPacket *pkt;
+        mfxU64 sendTask;
+    };
+
     AVFrame *CreateAVFrame(mfxFrameSurface1 *surface);
+    mfxStatus SendFrame(mfxFrameSurface1 *surface, mfxU64 sendTask);
+    mfxU32 GetPacketBytes(AVPacket *pkt);
+    mfxStatus WritePacket(AVPacket *pkt, mfxBitstream *bs);
 
     inline void mem_put_le32(void *vmem, int32_t val) {
         uint8_t *mem = (uint8_t *)vmem;
@@ -89,11 +104,23 @@ private:
     const AVCodec *m_avEncCodec;
     AVCodecContext *m_avEncContext;
     AVPacket *m_avEncPacket;
-    FrameLock m_input_locker;
+    FrameMapCache m_frameMap; // external allocator frames, see RefSurfaceAVFrame()
 
     mfxVideoParam m_param;
     bool m_bFrameEncoded;
 
+    // packets produced by the worker, not yet returned to the application
+    std::deque<EncodedPacket> m_encPackets;
+    std::mutex m_packetMutex;
+    // SendFrame() tasks by number, from the one of the oldest queued packet on,
+    //   only used by the application thread
+    std::deque<std::pair<mfxU64, std::shared_ptr<CpuTask>>> m_sendTasks;
+    mfxU64 m_numSendTasks;
+    // submitted surface whose call returned MFX_ERR_NOT_ENOUGH_BUFFER, the
+    //   application calls again with it and a larger bitstream
+    mfxFrameSurface1 *m_unwrittenSurface;
+    CpuTaskQueue m_taskQueue;
+
     CpuWorkstream *m_session;
 
     std::unique_ptr<CpuFramePool> m_encSurfaces;
@@ -113,7 +140,10 @@ private:
     }
 
     mfxExtAV1BitstreamParam m_extAV1BSParam;
-    mfxExtBuffer *m_extParamAll[1];
+    mfxExtCPUThreading m_extCPUThreading;
+    mfxExtCPUEncodeCallback m_extEncodeCallback;
+    mfxExtCPUSurfacePool m_extSurfacePool;
+    mfxExtBuffer *m_extParamAll[4];
 
     size_t m_numExtSupported;
 
@@ -5,6 +5,9 @@
   ############################################################################*/
 
 #include "src/cpu_frame.h"
+#include <memory>
+#include "src/cpu_buffer_cache.h"
+#include "src/cpu_frame_pool.h"
 
 // increase refCount on surface (+1)
 mfxStatus CpuFrame::AddRef(mfxFrameSurface1 *surface) {
@@ -26,10 +29,24 @@ mfxStatus CpuFrame::Release(mfxFrameSurface1 *surface) {
     CpuFrame *cpu_frame = TryCast(surface);
     RET_IF_FALSE(cpu_frame, MFX_ERR_INVALID_HANDLE);
 
-    if (cpu_frame->m_refCount == 0)
-        return MFX_ERR_UNDEFINED_BEHAVIOR;
-
-    cpu_frame->m_refCount--;
+    mfxU32 count = cpu_frame->m_refCount;
+    do {
+        if (count == 0)
+            return MFX_ERR_UNDEFINED_BEHAVIOR;
+    } while (!cpu_frame->m_refCount.compare_exchange_weak(count, count - 1));
+
+    // the last reference puts the surface back on the free list of its pool,
+    //   imported surfaces have no pool and are deleted
+    // libav may still reference the image, it is freed with the last AVBufferRef
+    if (count == 1 && cpu_frame->m_parentPoolInterface) {
+        CpuFramePool *pool =
+            static_cast<CpuFramePool *>(cpu_frame->m_parentPoolInterface->GetParentPool());
+        if (pool)
+            pool->ReleaseFrame(cpu_frame);
+    }
+    else if (count == 1) {
+        delete cpu_frame;
+    }
 
     return MFX_ERR_NONE;
 }
@@ -66,7 +83,7 @@ mfxStatus CpuFrame::Map(mfxFrameSurface1 *surface, mfxU32 flags) {
     if ((flags | validFlags) != validFlags)
         return MFX_ERR_UNSUPPORTED;
 
-    if ((flags & MFX_MAP_WRITE) && (cpu_frame->Data.Locked != 0))
+    if ((flags & MFX_MAP_WRITE) && GetLocked(&cpu_frame->Data))
         return MFX_ERR_LOCK_MEMORY;
 
     // save mapping flags
@@ -132,13 +149,15 @@ mfxStatus CpuFrame::Synchronize(mfxFrameSurface1 *surface, mfxU32 wait) {
     CpuFrame *cpu_frame = TryCast(surface);
     RET_IF_FALSE(cpu_frame, MFX_ERR_INVALID_HANDLE);
 
-    // TO DO - VPL CPU ref is currently synchronous (Sync does nothing)
-    // need to align sync behavior between legacy SyncOperation()
-    //   and new sync on surfaces
-    // probably need to track mapping of unique sync points to associated
-    //   mfxFrameSurface1 surfaces, and sync here
+    // surface is not the output of a pending operation
+    if (!cpu_frame->m_task)
+        return MFX_ERR_NONE;
 
-    return MFX_ERR_NONE;
+    mfxStatus sts = cpu_frame->m_task->Wait(wait);
+    if (sts != MFX_WRN_IN_EXECUTION)
+        cpu_frame->m_task.reset();
+
+    return sts;
 }
 
 void CpuFrame::OnComplete(mfxStatus sts) {
@@ -171,3 +190,142 @@ mfxStatus CpuFrame::QueryInterface(mfxFrameSurface1 *surface, mfxGUID guid, mfxH
 
     return MFX_ERR_NOT_IMPLEMENTED;
 }
+
+mfxStatus CpuFrame::Allocate(mfxU32 FourCC, mfxU32 width, mfxU32 height) {
+    AVPixelFormat format           = MFXFourCC2AVPixelFormat(FourCC);
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    RET_IF_FALSE(desc, MFX_ERR_INVALID_VIDEO_PARAM);
+    RET_IF_FALSE(m_avframe && !m_avframe->buf[0], MFX_ERR_UNDEFINED_BEHAVIOR);
+
+    // chroma planes of planar formats have half the pitch and half the left
+    //   border of the luma plane, so both are aligned to twice the alignment
+    int numPlanes = av_pix_fmt_count_planes(format);
+    size_t align  = (numPlanes == 3) ? 2 * m_alignment : m_alignment;
+    size_t bps    = desc->comp[0].step;
+    size_t left   = FFALIGN(m_padding * bps, align);
+    size_t pitch  = FFALIGN(left + (width + m_padding) * bps, align);
+
+    size_t offsets[4] = {};
+    size_t size       = 0;
+    for (int i = 0; i < numPlanes; i++) {
+        int shiftX        = (i > 0 && numPlanes == 3) ? desc->log2_chroma_w : 0;
+        int shiftY        = (i > 0) ? desc->log2_chroma_h : 0;
+        size_t planePitch = pitch >> shiftX;
+        size_t border     = m_padding >> shiftY;
+        size_t rows       = ((height + (1 << shiftY) - 1) >> shiftY) + 2 * border;
+
+        m_avframe->linesize[i] = static_cast<int>(planePitch);
+        offsets[i]             = size + border * planePitch + (left >> shiftX);
+        size += FFALIGN(rows * planePitch, m_alignment);
+    }
+
+    // av_malloc() aligns to the widest SIMD libav was built for, which may be
+    //   less, and SIMD loads of the last row may run past the image
+    size += m_alignment + AV_INPUT_BUFFER_PADDING_SIZE;
+
+    // released surfaces of any session with the same size are reused
+    bool hugePages   = false;
+    AVBufferRef *buf = CpuBufferCache::GetShared()->GetBuffer(size,
+                                                              m_bHugePages,
+                                                              &hugePages,
+                                                              m_memoryStats,
+                                                              CpuMemoryStats::SURFACES,
+                                                              m_cpus);
+    RET_IF_FALSE(buf, MFX_ERR_MEMORY_ALLOC);
+    m_hugePageBuffer = hugePages ? buf->data : nullptr;
+
+    uint8_t *base = reinterpret_cast<uint8_t *>(
+        FFALIGN(reinterpret_cast<uintptr_t>(buf->data), static_cast<uintptr_t>(m_alignment)));
+
+    for (int i = 0; i < numPlanes; i++)
+        m_avframe->data[i] = base + offsets[i];
+    m_avframe->extended_data = m_avframe->data;
+    m_avframe->buf[0]        = buf;
+    m_avframe->format        = format;
+    m_avframe->width         = width;
+    m_avframe->height        = height;
+    return Update();
+}
+
+// release callback of the application, copied so the descriptor need not outlive the import
+struct CpuSystemMemory {
+    mfxHDL pthis;
+    void(MFX_CDECL *Release)(mfxHDL pthis);
+};
+
+void CpuFrame::FreeSystemMemory(void *opaque, uint8_t *data) {
+    CpuSystemMemory *memory = static_cast<CpuSystemMemory *>(opaque);
+    if (memory->Release)
+        memory->Release(memory->pthis);
+    delete memory;
+}
+
+mfxStatus CpuFrame::ImportSystemMemory(const mfxCPUSurfaceSystem &external) {
+    const mfxFrameInfo &info = external.Info;
+    const mfxFrameData &data = external.Data;
+
+    RET_IF_FALSE(m_avframe && !m_avframe->buf[0], MFX_ERR_UNDEFINED_BEHAVIOR);
+    RET_IF_FALSE(info.Width && info.Height && data.Pitch, MFX_ERR_INVALID_VIDEO_PARAM);
+
+    // same plane layout as FrameLock::GetAVFrame()
+    m_avframe->linesize[0] = data.Pitch;
+    switch (info.FourCC) {
+        case MFX_FOURCC_I420:
+        case MFX_FOURCC_I010:
+        case MFX_FOURCC_I422:
+        case MFX_FOURCC_I210:
+            RET_IF_FALSE(data.Y && data.U && data.V, MFX_ERR_INVALID_VIDEO_PARAM);
+            m_avframe->data[0]     = data.Y;
+            m_avframe->data[1]     = data.U;
+            m_avframe->data[2]     = data.V;
+            m_avframe->linesize[1] = data.Pitch / 2;
+            m_avframe->linesize[2] = data.Pitch / 2;
+            break;
+        case MFX_FOURCC_NV12:
+        case MFX_FOURCC_P010:
+            RET_IF_FALSE(data.Y && data.UV, MFX_ERR_INVALID_VIDEO_PARAM);
+            m_avframe->data[0]     = data.Y;
+            m_avframe->data[1]     = data.UV;
+            m_avframe->linesize[1] = data.Pitch;
+            break;
+        case MFX_FOURCC_RGB4:
+            RET_IF_FALSE(data.B, MFX_ERR_INVALID_VIDEO_PARAM);
+            m_avframe->data[0] = data.B;
+            break;
+        default:
+            return MFX_ERR_UNSUPPORTED;
+    }
+    m_avframe->extended_data = m_avframe->data;
+    m_avframe->format        = MFXFourCC2AVPixelFormat(info.FourCC);
+    m_avframe->width         = info.Width;
+    m_avframe->height        = info.Height;
+
+    // libav clones of the frame share this buffer, the application gets
+    //   its memory back once all of them are gone
+    auto memory     = std::make_unique<CpuSystemMemory>();
+    memory->pthis   = external.pthis;
+    memory->Release = external.Release;
+
+    uint8_t *start    = nullptr;
+    size_t size       = GetImageSpan(m_avframe, info.Height, &start);
+    m_avframe->buf[0] = av_buffer_create(start, size, FreeSystemMemory, memory.get(), 0);
+    RET_IF_FALSE(m_avframe->buf[0], MFX_ERR_MEMORY_ALLOC);
+    memory.release();
+
+    RET_ERROR(Update());
+    if (info.CropW && info.CropH) {
+        Info.CropX = info.CropX;
+        Info.CropY = info.CropY;
+        Info.CropW = info.CropW;
+        Info.CropH = info.CropH;
+    }
+    Info.FrameRateExtN = info.FrameRateExtN;
+    Info.FrameRateExtD = info.FrameRateExtD;
+    if (info.PicStruct)
+        Info.PicStruct = info.PicStruct;
+    Data.TimeStamp  = data.TimeStamp;
+    Data.FrameOrder = data.FrameOrder;
+    Data.MemType    = MFX_MEMTYPE_SYSTEM_MEMORY | MFX_MEMTYPE_EXTERNAL_FRAME;
+
+    return MFX_ERR_NONE;
+}
@@ -7,7 +7,15 @@
 #ifndef CPU_SRC_CPU_FRAME_H_
 #define CPU_SRC_CPU_FRAME_H_
 
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
 #include "src/cpu_common.h"
+#include "src/cpu_memory_stats.h"
+#include "src/cpu_task.h"
+
+class CpuFramePool;
 
 // interface for MFX_GUID_SURFACE_POOL
 struct CpuFramePoolInterface {
@@ -54,9 +62,24 @@ private:
 // Implemented via AVFrame
 class CpuFrame : public mfxFrameSurface1 {
 public:
+    // cache line, also the widest SIMD load (AVX-512) of libav
+    static const mfxU32 DEFAULT_ALIGNMENT = 64;
+
     explicit CpuFrame(CpuFramePoolInterface *parentPoolInterface)
             : m_refCount(0),
               m_mappedFlags(0),
+              m_task(),
+              m_nextFree(nullptr),
+              m_bInPool(false),
+              m_releaseTime(),
+              m_poolBytes(0),
+              m_poolHugePageBytes(0),
+              m_alignment(DEFAULT_ALIGNMENT),
+              m_padding(0),
+              m_bHugePages(false),
+              m_cpus(),
+              m_hugePageBuffer(nullptr),
+              m_memoryStats(),
               m_interface(),
               m_parentPoolInterface(parentPoolInterface) {
         m_avframe = av_frame_alloc();
@@ -99,13 +122,49 @@ public:
         return m_avframe;
     }
 
-    mfxStatus Allocate(mfxU32 FourCC, mfxU32 width, mfxU32 height) {
-        m_avframe->width  = width;
-        m_avframe->height = height;
-        m_avframe->format = MFXFourCC2AVPixelFormat(FourCC);
-        RET_IF_FALSE(m_avframe->format != AV_PIX_FMT_NONE, MFX_ERR_INVALID_VIDEO_PARAM);
-        RET_IF_FALSE(av_frame_get_buffer(m_avframe, 1) == 0, MFX_ERR_MEMORY_ALLOC);
-        return Update();
+    // row and plane alignment in bytes (a power of 2) and pixels of border
+    //   on each side of the image for the buffers Allocate() creates, which
+    //   are mapped with huge pages if hugePages is set and the system has them
+    // cpus is the CPU set Allocate() runs on, empty if not pinned
+    void SetBufferLayout(mfxU32 alignment,
+                         mfxU32 padding,
+                         bool hugePages,
+                         const std::vector<mfxU32> &cpus) {
+        m_alignment  = alignment;
+        m_padding    = padding;
+        m_bHugePages = hugePages;
+        m_cpus       = cpus;
+    }
+
+    // session the buffers Allocate() creates are counted for
+    void SetMemoryStats(std::shared_ptr<CpuMemoryStats> stats) {
+        m_memoryStats = stats;
+    }
+
+    // one buffer for all planes, every row and plane starts on an alignment
+    //   boundary, the chroma pitch of planar formats is half of Data.Pitch
+    mfxStatus Allocate(mfxU32 FourCC, mfxU32 width, mfxU32 height);
+
+    // size of the image buffers currently attached
+    mfxU64 GetBufferSize() {
+        mfxU64 size = 0;
+        for (int i = 0; i < AV_NUM_DATA_POINTERS && m_avframe && m_avframe->buf[i]; i++)
+            size += m_avframe->buf[i]->size;
+        return size;
+    }
+
+    // size of the image buffer if it is still the huge page mapping of Allocate()
+    mfxU64 GetHugePageSize() {
+        if (!m_hugePageBuffer || !m_avframe || !m_avframe->buf[0] ||
+            m_avframe->buf[0]->data != m_hugePageBuffer)
+            return 0;
+        return m_avframe->buf[0]->size;
+    }
+
+    // write all buffers of the frame once
+    void ClearBuffers() {
+        for (int i = 0; i < AV_NUM_DATA_POINTERS && m_avframe->buf[i]; i++)
+            memset(m_avframe->buf[i]->data, 0, m_avframe->buf[i]->size);
     }
 
     mfxStatus ImportAVFrame(AVFrame *avframe) {
@@ -137,6 +196,16 @@ public:
                 Info.BitDepthChroma = 8;
                 Info.ChromaFormat   = MFX_CHROMAFORMAT_YUV422;
                 break;
+            case AV_PIX_FMT_NV12:
+                Info.BitDepthLuma   = 8;
+                Info.BitDepthChroma = 8;
+                Info.ChromaFormat   = MFX_CHROMAFORMAT_YUV420;
+                break;
+            case AV_PIX_FMT_P010LE:
+                Info.BitDepthLuma   = 10;
+                Info.BitDepthChroma = 10;
+                Info.ChromaFormat   = MFX_CHROMAFORMAT_YUV420;
+                break;
             case AV_PIX_FMT_BGRA:
                 Info.BitDepthLuma   = 8;
                 Info.BitDepthChroma = 8;
@@ -146,6 +215,8 @@ public:
                 Info.BitDepthLuma   = 0;
                 Info.BitDepthChroma = 0;
         }
+        // libav P010 has the samples in the high bits
+        Info.Shift     = (avframe->format == AV_PIX_FMT_P010LE) ? 1 : 0;
         Info.CropW     = avframe->width;
         Info.CropH     = avframe->height;
         Info.PicStruct = MFX_PICSTRUCT_PROGRESSIVE;
@@ -165,6 +236,12 @@ public:
             Data.R = avframe->data[0] + 2;
             Data.A = avframe->data[0] + 3;
         }
+        else if (Info.FourCC == MFX_FOURCC_NV12 || Info.FourCC == MFX_FOURCC_P010) {
+            Data.Y  = avframe->data[0];
+            Data.UV = avframe->data[1];
+            Data.V  = avframe->data[1] + (Info.FourCC == MFX_FOURCC_P010 ? 2 : 1);
+            Data.A  = nullptr;
+        }
         else {
             Data.Y = avframe->data[0];
             Data.U = avframe->data[1];
@@ -181,13 +258,48 @@ public:
         return ImportAVFrame(m_avframe);
     }
 
+    // wrap application memory without copying, for frames without a pool
+    //   which are deleted when the last reference is released
+    mfxStatus ImportSystemMemory(const mfxCPUSurfaceSystem &external);
+
+    // task which produces the content of this surface, waited on by Synchronize()
+    void SetTask(std::shared_ptr<CpuTask> task) {
+        m_task = task;
+    }
+    std::shared_ptr<CpuTask> GetTask() {
+        return m_task;
+    }
+
+    // no reference is held by the application, a task or libav
+    bool IsReusable() {
+        if (m_refCount != 0 || GetLocked(&Data))
+            return false;
+        return !(m_avframe && m_avframe->data[0] && !av_frame_is_writable(m_avframe));
+    }
+
 private:
+    friend class CpuFramePool;
+
     std::atomic<mfxU32> m_refCount; // TODO(we have C++11, correct?)
     mfxU32 m_mappedFlags;
+    std::shared_ptr<CpuTask> m_task;
+    CpuFrame *m_nextFree;                                // free list link, owned by the pool
+    std::atomic<bool> m_bInPool;                         // released, not handed out since
+    std::chrono::steady_clock::time_point m_releaseTime; // last release to the pool
+    mfxU64 m_poolBytes;                                  // GetBufferSize() counted by the pool
+    mfxU64 m_poolHugePageBytes;                          // GetHugePageSize() counted by the pool
+    mfxU32 m_alignment;
+    mfxU32 m_padding;
+    bool m_bHugePages;
+    std::vector<mfxU32> m_cpus; // the buffer cache keeps buffers apart by CPU set
+    uint8_t *m_hugePageBuffer; // data of the last huge page buffer Allocate() created
+    std::shared_ptr<CpuMemoryStats> m_memoryStats;
     AVFrame *m_avframe;
     mfxFrameSurfaceInterface m_interface;
     CpuFramePoolInterface *m_parentPoolInterface;
 
+    static void FreeSystemMemory(void *opaque, uint8_t *data);
+
     static mfxStatus AddRef(mfxFrameSurface1 *surface);
     static mfxStatus Release(mfxFrameSurface1 *surface);
     static mfxStatus GetRefCounter(mfxFrameSurface1 *surface, mfxU32 *counter);
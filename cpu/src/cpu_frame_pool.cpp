@@ -5,14 +5,47 @@
   ############################################################################*/
 
 #include "src/cpu_frame_pool.h"
+#include <algorithm>
+#include <chrono>
 #include <memory>
 #include <utility>
 
+void CpuFramePool::SetAllocationPolicy(const mfxExtCPUSurfacePool &param, mfxU32 numSuggested) {
+    m_policy      = static_cast<mfxPoolAllocationPolicy>(param.AllocationPolicy);
+    m_wait        = param.Wait;
+    m_idleTimeout = std::chrono::milliseconds(param.IdleTimeout);
+    m_minSurfaces = param.MinSurfaces;
+    m_alignment   = param.Alignment ? param.Alignment : CpuFrame::DEFAULT_ALIGNMENT;
+    m_padding     = param.Padding;
+    m_bHugePages  = (param.HugePages == MFX_CODINGOPTION_ON);
+
+    switch (m_policy) {
+        case MFX_ALLOCATION_OPTIMAL:
+            m_maxSurfaces = std::max<mfxU32>(numSuggested, 1);
+            break;
+        case MFX_ALLOCATION_LIMITED:
+            m_maxSurfaces = std::max<mfxU32>(param.NumSurfaces, 1);
+            break;
+        default:
+            m_policy      = MFX_ALLOCATION_UNLIMITED;
+            m_maxSurfaces = 0xFFFFFFFF;
+            break;
+    }
+}
+
 mfxStatus CpuFramePool::Init(mfxU32 nPoolSize) {
+    nPoolSize = std::min(nPoolSize, m_maxSurfaces);
+
     for (mfxU32 i = 0; i < nPoolSize; i++) {
-        auto cpu_frame = std::make_unique<CpuFrame>(&m_framePoolInterface);
-        RET_IF_FALSE(cpu_frame->GetAVFrame(), MFX_ERR_MEMORY_ALLOC);
-        m_surfaces.push_back(std::move(cpu_frame));
+        std::unique_ptr<CpuFrame> frame;
+        RET_ERROR(CreateFrame(frame));
+
+        CpuFrame *cpu_frame = frame.get();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            AddFrame(std::move(frame));
+        }
+        ReleaseFrame(cpu_frame);
     }
 
     return MFX_ERR_NONE;
@@ -21,40 +54,294 @@ mfxStatus CpuFramePool::Init(mfxU32 nPoolSize) {
 mfxStatus CpuFramePool::Init(mfxFrameInfo info, mfxU32 nPoolSize) {
     memcpy_s(&m_info, sizeof(mfxFrameInfo), &info, sizeof(mfxFrameInfo));
 
-    for (mfxU32 i = 0; i < nPoolSize; i++) {
-        auto cpu_frame = std::make_unique<CpuFrame>(&m_framePoolInterface);
-        RET_ERROR(cpu_frame->Allocate(m_info.FourCC, m_info.Width, m_info.Height));
-        m_surfaces.push_back(std::move(cpu_frame));
+    return Init(nPoolSize);
+}
+
+// memory is placed on the NUMA node of the CPU which first writes it,
+//   so frames of a pinned session are allocated and cleared on its CPUs
+mfxStatus CpuFramePool::AllocateFrame(CpuFrame *frame) {
+    if (!m_threadPool || !m_threadPool->IsPinned())
+        return frame->Allocate(m_info.FourCC, m_info.Width, m_info.Height);
+
+    mfxStatus sts = MFX_ERR_NONE;
+    m_threadPool->RunAndWait([&]() {
+        sts = frame->Allocate(m_info.FourCC, m_info.Width, m_info.Height);
+        if (sts == MFX_ERR_NONE)
+            frame->ClearBuffers();
+    });
+    return sts;
+}
+
+// new frame with image buffers if the frame info is known, not yet in m_surfaces
+// called without m_mutex held, allocation may wait for a worker thread
+mfxStatus CpuFramePool::CreateFrame(std::unique_ptr<CpuFrame> &frame) {
+    frame = std::make_unique<CpuFrame>(&m_framePoolInterface);
+    RET_IF_FALSE(frame && frame->GetAVFrame(), MFX_ERR_MEMORY_ALLOC);
+    frame->SetBufferLayout(m_alignment,
+                           m_padding,
+                           m_bHugePages,
+                           m_threadPool ? m_threadPool->GetCpus() : std::vector<mfxU32>());
+    frame->SetMemoryStats(m_memoryStats);
+    if (m_info.FourCC) {
+        RET_ERROR(AllocateFrame(frame.get()));
     }
 
     return MFX_ERR_NONE;
 }
 
+// must be called with m_mutex held
+void CpuFramePool::AddFrame(std::unique_ptr<CpuFrame> frame) {
+    CpuFrame *cpu_frame = frame.get();
+    m_surfaces.push_back(std::move(frame));
+
+    m_stats.NumSurfaces     = (mfxU32)m_surfaces.size();
+    m_stats.PeakNumSurfaces = std::max(m_stats.PeakNumSurfaces, m_stats.NumSurfaces);
+    CountFrameBytes(cpu_frame);
+}
+
+// must be called with m_mutex held, frame must not be on any list
+void CpuFramePool::DestroyFrame(CpuFrame *frame) {
+    for (auto it = m_surfaces.begin(); it != m_surfaces.end(); ++it) {
+        if (it->get() == frame) {
+            m_stats.AllocatedBytes -= frame->m_poolBytes;
+            m_stats.HugePageBytes -= frame->m_poolHugePageBytes;
+            m_surfaces.erase(it);
+            m_stats.NumSurfaces = (mfxU32)m_surfaces.size();
+            return;
+        }
+    }
+}
+
+// update the memory statistics with the current buffers of frame
+// must be called with m_mutex held, while nobody else uses the frame
+void CpuFramePool::CountFrameBytes(CpuFrame *frame) {
+    mfxU64 hugePageBytes       = frame->GetHugePageSize();
+    m_stats.HugePageBytes      = m_stats.HugePageBytes - frame->m_poolHugePageBytes + hugePageBytes;
+    frame->m_poolHugePageBytes = hugePageBytes;
+
+    mfxU64 bytes = frame->GetBufferSize();
+    if (bytes == frame->m_poolBytes)
+        return;
+
+    m_stats.AllocatedBytes     = m_stats.AllocatedBytes - frame->m_poolBytes + bytes;
+    m_stats.PeakAllocatedBytes = std::max(m_stats.PeakAllocatedBytes, m_stats.AllocatedBytes);
+    frame->m_poolBytes         = bytes;
+}
+
+// free surfaces released more than m_idleTimeout ago, down to m_minSurfaces
+// hot surfaces are reused first (the free list is LIFO), so after a burst
+//   the extra surfaces stay idle until they are freed here
+// must be called with m_mutex held
+void CpuFramePool::TrimIdleFrames() {
+    if (!m_idleTimeout.count())
+        return;
+
+    auto now = std::chrono::steady_clock::now();
+    if (now < m_nextTrim)
+        return;
+    m_nextTrim = now + m_idleTimeout / 2;
+
+    TakeReleasedFrames();
+
+    CpuFrame **link = &m_free;
+    while (*link && m_surfaces.size() > m_minSurfaces) {
+        CpuFrame *frame = *link;
+        if (now - frame->m_releaseTime >= m_idleTimeout && frame->IsReusable()) {
+            *link = frame->m_nextFree;
+            DestroyFrame(frame);
+            m_stats.NumTrimmed++;
+        }
+        else {
+            link = &frame->m_nextFree;
+        }
+    }
+
+    for (auto it = m_busy.begin(); it != m_busy.end() && m_surfaces.size() > m_minSurfaces;) {
+        CpuFrame *frame = *it;
+        if (now - frame->m_releaseTime >= m_idleTimeout && frame->IsReusable()) {
+            it = m_busy.erase(it);
+            DestroyFrame(frame);
+            m_stats.NumTrimmed++;
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+void CpuFramePool::ReleaseFrame(CpuFrame *frame) {
+    // released again before it was handed out, it is in the pool already
+    if (frame->m_bInPool.exchange(true))
+        return;
+
+    frame->m_releaseTime = std::chrono::steady_clock::now();
+
+    CpuFrame *head = m_freeList.load(std::memory_order_relaxed);
+    do {
+        frame->m_nextFree = head;
+    } while (!m_freeList.compare_exchange_weak(head, frame));
+
+    // the waiter registers before it looks at m_freeList, so either it sees
+    //   this frame or it is counted here
+    if (m_numWaiters) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cvFree.notify_all();
+    }
+}
+
+// move everything released so far in front of m_free, most recent first
+// must be called with m_mutex held
+void CpuFramePool::TakeReleasedFrames() {
+    CpuFrame *released = m_freeList.exchange(nullptr);
+    if (!released)
+        return;
+
+    CpuFrame *last = released;
+    while (last->m_nextFree)
+        last = last->m_nextFree;
+    last->m_nextFree = m_free;
+    m_free           = released;
+}
+
+// return a frame nobody references any more, or nullptr
+// frames are reused in LIFO order, so surfaces beyond the working set stay idle
+// must be called with m_mutex held
+CpuFrame *CpuFramePool::TakeFreeFrame() {
+    TakeReleasedFrames();
+
+    while (m_free) {
+        CpuFrame *frame = m_free;
+        m_free          = frame->m_nextFree;
+        if (frame->IsReusable())
+            return frame;
+        m_busy.push_back(frame);
+    }
+
+    // libav may have dropped its references since
+    for (auto it = m_busy.begin(); it != m_busy.end(); ++it) {
+        CpuFrame *frame = *it;
+        if (frame->IsReusable()) {
+            m_busy.erase(it);
+            return frame;
+        }
+    }
+
+    return nullptr;
+}
+
 // return free surface and set refCount to 1
 mfxStatus CpuFramePool::GetFreeSurface(mfxFrameSurface1 **surface) {
     RET_IF_FALSE(surface, MFX_ERR_NULL_PTR);
     *surface = nullptr;
 
-    for (std::unique_ptr<CpuFrame> &surf : m_surfaces) {
-        mfxU32 counter = 0xFFFFFFFF;
-        surf->FrameInterface->GetRefCounter(surf.get(), &counter);
-
-        if (!counter && !surf->Data.Locked) {
-            *surface = surf.get();
-            (*surface)->FrameInterface->AddRef(*surface);
-            return MFX_ERR_NONE;
+    CpuFrame *frame = nullptr;
+    bool bCreate    = false;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        TrimIdleFrames();
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_wait);
+        m_numWaiters++;
+        for (;;) {
+            frame = TakeFreeFrame();
+
+            // shrink a pool which is above its limit
+            while (frame && m_surfaces.size() > m_maxSurfaces) {
+                DestroyFrame(frame);
+                frame = TakeFreeFrame();
+            }
+            if (frame) {
+                // nobody references it now, the decoder may have changed its buffers
+                CountFrameBytes(frame);
+                break;
+            }
+
+            // no free surface found in pool, create new one if the policy allows
+            if (m_surfaces.size() + m_numCreating < m_maxSurfaces) {
+                m_numCreating++;
+                bCreate = true;
+                break;
+            }
+
+            // releases are signalled, but libav drops its references to
+            //   decoded frames silently, so look again every millisecond
+            auto now = std::chrono::steady_clock::now();
+            if (now >= deadline)
+                break;
+            m_cvFree.wait_until(lock, std::min(deadline, now + std::chrono::milliseconds(1)));
         }
+        m_numWaiters--;
     }
 
-    // no free surface found in pool, create new one
-    auto cpu_frame = std::make_unique<CpuFrame>(&m_framePoolInterface);
-    RET_IF_FALSE(cpu_frame && cpu_frame->GetAVFrame(), MFX_ERR_MEMORY_ALLOC);
-    if (m_info.FourCC) {
-        RET_ERROR(cpu_frame->Allocate(m_info.FourCC, m_info.Width, m_info.Height));
+    if (bCreate) {
+        std::unique_ptr<CpuFrame> newFrame;
+        mfxStatus sts = CreateFrame(newFrame);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_numCreating--;
+        RET_ERROR(sts);
+        frame = newFrame.get();
+        AddFrame(std::move(newFrame));
     }
-    *surface = cpu_frame.get();
-    (*surface)->FrameInterface->AddRef(*surface);
-    m_surfaces.push_back(std::move(cpu_frame));
+
+    if (!frame)
+        return MFX_WRN_ALLOC_TIMEOUT_EXPIRED;
+
+    frame->FrameInterface->AddRef(frame);
+    frame->m_bInPool = false;
+    *surface         = frame;
+
+    return MFX_ERR_NONE;
+}
+
+mfxStatus CpuFramePool::SetNumSurfaces(mfxU32 numSurfaces) {
+    if (m_policy == MFX_ALLOCATION_UNLIMITED)
+        return MFX_WRN_INCOMPATIBLE_VIDEO_PARAM;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_maxSurfaces = std::max<mfxU32>(numSurfaces, 1);
+    FreeAboveLimit();
+    m_cvFree.notify_all(); // waiters may create a surface now
+
+    return MFX_ERR_NONE;
+}
+
+mfxStatus CpuFramePool::RevokeSurfaces(mfxU32 numSurfaces) {
+    if (m_policy == MFX_ALLOCATION_UNLIMITED)
+        return MFX_WRN_INCOMPATIBLE_VIDEO_PARAM;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_maxSurfaces = (m_maxSurfaces > numSurfaces) ? m_maxSurfaces - numSurfaces : 1;
+    FreeAboveLimit();
+
+    return MFX_ERR_NONE;
+}
+
+// free surfaces which are not in use while the pool is above its limit
+// must be called with m_mutex held
+void CpuFramePool::FreeAboveLimit() {
+    while (m_surfaces.size() > m_maxSurfaces) {
+        CpuFrame *frame = TakeFreeFrame();
+        if (!frame)
+            break;
+        DestroyFrame(frame);
+    }
+}
+
+mfxStatus GetSurfacePoolStats(mfxVideoParam *par, CpuFramePool *in, CpuFramePool *out) {
+    mfxExtBuffer *buf = FindExtBuffer(par, MFX_EXTBUFF_CPU_SURFACE_POOL_STATS);
+    if (!buf)
+        return MFX_ERR_NONE;
+
+    RET_IF_FALSE(buf->BufferSz == sizeof(mfxExtCPUSurfacePoolStats), MFX_ERR_INVALID_VIDEO_PARAM);
+
+    mfxExtCPUSurfacePoolStats *stats = reinterpret_cast<mfxExtCPUSurfacePoolStats *>(buf);
+    stats->In                        = {};
+    stats->Out                       = {};
+    if (in)
+        in->GetStats(&stats->In);
+    if (out)
+        out->GetStats(&stats->Out);
 
     return MFX_ERR_NONE;
 }
@@ -110,8 +397,11 @@ mfxStatus CpuFramePoolInterface::SetNumSurfaces(struct mfxSurfacePoolInterface *
     CpuFramePoolInterface *framePoolInterface = (CpuFramePoolInterface *)(pool->Context);
     RET_IF_FALSE(framePoolInterface, MFX_ERR_INVALID_HANDLE);
 
-    // CpuFramePool only supports MFX_ALLOCATION_UNLIMITED policy
-    return MFX_WRN_INCOMPATIBLE_VIDEO_PARAM;
+    CpuFramePool *framePool = (CpuFramePool *)framePoolInterface->GetParentPool();
+    RET_IF_FALSE(framePool, MFX_ERR_INVALID_HANDLE);
+
+    // MFX_ALLOCATION_UNLIMITED pools ignore this with MFX_WRN_INCOMPATIBLE_VIDEO_PARAM
+    return framePool->SetNumSurfaces(num_surfaces);
 }
 
 mfxStatus CpuFramePoolInterface::RevokeSurfaces(struct mfxSurfacePoolInterface *pool,
@@ -121,8 +411,11 @@ mfxStatus CpuFramePoolInterface::RevokeSurfaces(struct mfxSurfacePoolInterface *
     CpuFramePoolInterface *framePoolInterface = (CpuFramePoolInterface *)(pool->Context);
     RET_IF_FALSE(framePoolInterface, MFX_ERR_INVALID_HANDLE);
 
-    // CpuFramePool only supports MFX_ALLOCATION_UNLIMITED policy
-    return MFX_WRN_INCOMPATIBLE_VIDEO_PARAM;
+    CpuFramePool *framePool = (CpuFramePool *)framePoolInterface->GetParentPool();
+    RET_IF_FALSE(framePool, MFX_ERR_INVALID_HANDLE);
+
+    // MFX_ALLOCATION_UNLIMITED pools ignore this with MFX_WRN_INCOMPATIBLE_VIDEO_PARAM
+    return framePool->RevokeSurfaces(num_surfaces);
 }
 
 mfxStatus CpuFramePoolInterface::GetAllocationPolicy(struct mfxSurfacePoolInterface *pool,
@@ -133,8 +426,10 @@ mfxStatus CpuFramePoolInterface::GetAllocationPolicy(struct mfxSurfacePoolInterf
     CpuFramePoolInterface *framePoolInterface = (CpuFramePoolInterface *)(pool->Context);
     RET_IF_FALSE(framePoolInterface, MFX_ERR_INVALID_HANDLE);
 
-    // CpuFramePool only supports MFX_ALLOCATION_UNLIMITED policy
-    *policy = MFX_ALLOCATION_UNLIMITED;
+    CpuFramePool *framePool = (CpuFramePool *)framePoolInterface->GetParentPool();
+    RET_IF_FALSE(framePool, MFX_ERR_INVALID_HANDLE);
+
+    *policy = framePool->GetAllocationPolicy();
 
     return MFX_ERR_NONE;
 }
@@ -147,8 +442,11 @@ mfxStatus CpuFramePoolInterface::GetMaximumPoolSize(struct mfxSurfacePoolInterfa
     CpuFramePoolInterface *framePoolInterface = (CpuFramePoolInterface *)(pool->Context);
     RET_IF_FALSE(framePoolInterface, MFX_ERR_INVALID_HANDLE);
 
-    // CpuFramePool only supports MFX_ALLOCATION_UNLIMITED policy
-    *size = 0xFFFFFFFF;
+    CpuFramePool *framePool = (CpuFramePool *)framePoolInterface->GetParentPool();
+    RET_IF_FALSE(framePool, MFX_ERR_INVALID_HANDLE);
+
+    // 0xFFFFFFFF for MFX_ALLOCATION_UNLIMITED
+    *size = framePool->GetMaximumPoolSize();
 
     return MFX_ERR_NONE;
 }
@@ -7,31 +7,147 @@
 #ifndef CPU_SRC_CPU_FRAME_POOL_H_
 #define CPU_SRC_CPU_FRAME_POOL_H_
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <vector>
 #include "src/cpu_common.h"
 #include "src/cpu_frame.h"
+#include "src/cpu_thread_pool.h"
 
+// Surfaces go back to the pool from CpuFrame::Release() on whichever thread
+// drops the last reference, by a lock-free push onto m_freeList.
+// GetFreeSurface() takes the whole list at once (no ABA on pop) and hands out
+// the most recently released surface first. Surfaces libav still references
+// (e.g. decoder reference frames) wait on m_busy until they become writable.
+// Pools grow on demand (MFX_ALLOCATION_UNLIMITED) unless mfxExtCPUSurfacePool
+// bounds them, then GetFreeSurface() waits for a surface to be released.
+// With an idle timeout, GetFreeSurface() also frees surfaces which have not
+// been used for that long, so memory grown for a burst is returned later.
 class CpuFramePool {
 public:
-    CpuFramePool() : m_surfaces(), m_info({}), m_framePoolInterface() {
+    CpuFramePool()
+            : m_surfaces(),
+              m_info({}),
+              m_framePoolInterface(),
+              m_threadPool(),
+              m_memoryStats(),
+              m_policy(MFX_ALLOCATION_UNLIMITED),
+              m_maxSurfaces(0xFFFFFFFF),
+              m_wait(0),
+              m_idleTimeout(0),
+              m_minSurfaces(0),
+              m_alignment(CpuFrame::DEFAULT_ALIGNMENT),
+              m_padding(0),
+              m_bHugePages(false),
+              m_freeList(nullptr),
+              m_numWaiters(0),
+              m_mutex(),
+              m_cvFree(),
+              m_free(nullptr),
+              m_busy(),
+              m_numCreating(0),
+              m_nextTrim(),
+              m_stats() {
         // pass handle to this pool for use in external interface functions
         m_framePoolInterface.SetParentPool(this);
     }
 
+    // surfaces are allocated on the CPUs of a pinned thread pool
+    void SetThreadPool(std::shared_ptr<CpuThreadPool> pool) {
+        m_threadPool = pool;
+    }
+
+    // surfaces are counted in the memory statistics of their session
+    void SetMemoryStats(std::shared_ptr<CpuMemoryStats> stats) {
+        m_memoryStats = stats;
+    }
+
+    // must be called before Init()
+    // numSuggested is the size of an MFX_ALLOCATION_OPTIMAL pool
+    void SetAllocationPolicy(const mfxExtCPUSurfacePool &param, mfxU32 numSuggested);
+
     mfxStatus Init(mfxU32 nPoolSize);
     mfxStatus Init(mfxFrameInfo info, mfxU32 nPoolSize);
+
+    // MFX_WRN_ALLOC_TIMEOUT_EXPIRED and no surface if a bounded pool stays exhausted
     mfxStatus GetFreeSurface(mfxFrameSurface1 **surface);
 
+    // called when the last reference to frame is released, from any thread
+    void ReleaseFrame(CpuFrame *frame);
+
+    // mfxSurfacePoolInterface, change the limit of a bounded pool
+    // surfaces above the limit which are not in use are freed right away,
+    //   the others by the first GetFreeSurface() which finds them released
+    mfxStatus SetNumSurfaces(mfxU32 numSurfaces);
+    mfxStatus RevokeSurfaces(mfxU32 numSurfaces);
+
+    mfxPoolAllocationPolicy GetAllocationPolicy() {
+        return m_policy;
+    }
+
+    mfxU32 GetMaximumPoolSize() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_maxSurfaces;
+    }
+
     mfxU32 GetCurrentPoolSize() {
+        std::lock_guard<std::mutex> lock(m_mutex);
         return (mfxU32)m_surfaces.size();
     }
 
+    void GetStats(mfxCPUSurfacePoolStats *stats) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        *stats = m_stats;
+    }
+
 private:
     std::vector<std::unique_ptr<CpuFrame>> m_surfaces;
     mfxFrameInfo m_info;
 
     CpuFramePoolInterface m_framePoolInterface;
+    std::shared_ptr<CpuThreadPool> m_threadPool;
+    std::shared_ptr<CpuMemoryStats> m_memoryStats;
+
+    mfxPoolAllocationPolicy m_policy;
+    mfxU32 m_maxSurfaces;
+    mfxU32 m_wait;
+    std::chrono::milliseconds m_idleTimeout; // 0 for no trimming
+    mfxU32 m_minSurfaces;
+    mfxU32 m_alignment; // buffer layout of the frames, see CpuFrame::SetBufferLayout()
+    mfxU32 m_padding;
+    bool m_bHugePages;
+
+    std::atomic<CpuFrame *> m_freeList; // released since the last GetFreeSurface()
+    std::atomic<mfxU32> m_numWaiters;   // GetFreeSurface() calls waiting for a release
+
+    // below are only used with m_mutex held
+    std::mutex m_mutex;
+    std::condition_variable m_cvFree;
+    CpuFrame *m_free;               // taken from m_freeList, most recent first
+    std::vector<CpuFrame *> m_busy; // released but still referenced by libav
+    mfxU32 m_numCreating;           // frames being allocated outside the lock
+    std::chrono::steady_clock::time_point m_nextTrim;
+    mfxCPUSurfacePoolStats m_stats;
+
+    mfxStatus AllocateFrame(CpuFrame *frame);
+    mfxStatus CreateFrame(std::unique_ptr<CpuFrame> &frame);
+    void TakeReleasedFrames();
+    CpuFrame *TakeFreeFrame();
+    void AddFrame(std::unique_ptr<CpuFrame> frame);
+    void DestroyFrame(CpuFrame *frame);
+    void CountFrameBytes(CpuFrame *frame);
+    void TrimIdleFrames();
+    void FreeAboveLimit();
+
+    /* copy not allowed */
+    CpuFramePool(const CpuFramePool &);
+    CpuFramePool &operator=(const CpuFramePool &);
 };
 
+// fill mfxExtCPUSurfacePoolStats if attached to par, pools not created yet may be null
+mfxStatus GetSurfacePoolStats(mfxVideoParam *par, CpuFramePool *in, CpuFramePool *out);
+
 #endif // CPU_SRC_CPU_FRAME_POOL_H_
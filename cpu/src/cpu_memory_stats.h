@@ -0,0 +1,71 @@
+/*############################################################################
+  # Copyright (C) 2020 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#ifndef CPU_SRC_CPU_MEMORY_STATS_H_
+#define CPU_SRC_CPU_MEMORY_STATS_H_
+
+#include <algorithm>
+#include <mutex>
+#include "src/cpu_common.h"
+
+// Memory one session allocated, by kind. Buffers keep a reference to the
+// stats of their session while they are allocated, so buffers freed after
+// the session is closed (e.g. surfaces the application still holds) are
+// subtracted safely.
+class CpuMemoryStats {
+public:
+    enum Kind {
+        SURFACES,      // pool surfaces, VPP and decoder output buffers
+        DECODE_FRAMES, // frames lent to libav decoders
+        BITSTREAMS,    // encoded packets not yet returned
+        NUM_KINDS
+    };
+
+    CpuMemoryStats()
+            : m_mutex(),
+              m_bytes(),
+              m_totalBytes(0),
+              m_peakTotalBytes(0),
+              m_reusedBytes(0) {}
+
+    // bytes is negative for memory which is freed
+    void Add(Kind kind, int64_t bytes) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bytes[kind] += bytes;
+        m_totalBytes += bytes;
+        m_peakTotalBytes = std::max(m_peakTotalBytes, m_totalBytes);
+    }
+
+    // a buffer of the buffer cache was reused
+    void AddReused(mfxU64 bytes) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_reusedBytes += bytes;
+    }
+
+    void GetStats(mfxCPUMemoryStats *stats) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        *stats                  = {};
+        stats->SurfaceBytes     = m_bytes[SURFACES];
+        stats->DecodeFrameBytes = m_bytes[DECODE_FRAMES];
+        stats->BitstreamBytes   = m_bytes[BITSTREAMS];
+        stats->TotalBytes       = m_totalBytes;
+        stats->PeakTotalBytes   = m_peakTotalBytes;
+        stats->ReusedBytes      = m_reusedBytes;
+    }
+
+private:
+    std::mutex m_mutex;
+    mfxU64 m_bytes[NUM_KINDS];
+    mfxU64 m_totalBytes;
+    mfxU64 m_peakTotalBytes;
+    mfxU64 m_reusedBytes;
+
+    /* copy not allowed */
+    CpuMemoryStats(const CpuMemoryStats &);
+    CpuMemoryStats &operator=(const CpuMemoryStats &);
+};
+
+#endif // CPU_SRC_CPU_MEMORY_STATS_H_
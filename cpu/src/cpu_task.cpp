@@ -0,0 +1,215 @@
+/*############################################################################
+  # Copyright (C) 2020 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#include "src/cpu_task.h"
+#include <utility>
+
+CpuTask::CpuTask(std::function<mfxStatus()> work)
+        : m_work(std::move(work)),
+          m_mutex(),
+          m_cvDone(),
+          m_bDone(false),
+          m_bSignaled(false),
+          m_status(MFX_WRN_IN_EXECUTION) {}
+
+CpuTask::~CpuTask() {}
+
+void CpuTask::Execute() {
+    mfxStatus sts = m_work ? m_work() : MFX_ERR_NONE;
+    m_work        = nullptr; // drop captured state as soon as possible
+
+    std::vector<std::function<void()>> continuations;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_status = sts;
+        m_bDone  = true;
+        continuations.swap(m_continuations);
+    }
+
+    // outside the lock, a continuation may query this task
+    for (auto &fn : continuations)
+        fn();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_bSignaled = true;
+    m_cvDone.notify_all();
+}
+
+mfxStatus CpuTask::Wait(mfxU32 wait) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (wait == MFX_INFINITE) {
+        m_cvDone.wait(lock, [this] {
+            return m_bSignaled;
+        });
+    }
+    else if (!m_cvDone.wait_for(lock, std::chrono::milliseconds(wait), [this] {
+                 return m_bSignaled;
+             })) {
+        return MFX_WRN_IN_EXECUTION;
+    }
+    return m_status;
+}
+
+bool CpuTask::IsDone() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bDone;
+}
+
+mfxStatus CpuTask::GetStatus() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_status;
+}
+
+bool CpuTask::AddContinuation(std::function<void()> fn) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_bDone)
+        return false;
+    m_continuations.push_back(std::move(fn));
+    return true;
+}
+
+CpuTaskQueue::CpuTaskQueue()
+        : m_pool(),
+          m_priority(nullptr),
+          m_mutex(),
+          m_cvDone(),
+          m_queue(),
+          m_numPending(0),
+          m_error(MFX_ERR_NONE),
+          m_bScheduled(false) {}
+
+CpuTaskQueue::~CpuTaskQueue() {
+    // RunTask() references this queue until it clears m_bScheduled
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cvDone.wait(lock, [this] {
+        return !m_bScheduled;
+    });
+}
+
+void CpuTaskQueue::SetThreadPool(std::shared_ptr<CpuThreadPool> pool,
+                                 const std::atomic<mfxPriority> *priority) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pool     = pool;
+    m_priority = priority;
+}
+
+std::shared_ptr<CpuTask> CpuTaskQueue::Submit(std::function<mfxStatus()> work,
+                                              std::shared_ptr<CpuTask> dependency) {
+    auto task = std::make_shared<CpuTask>(std::move(work));
+
+    CpuThreadPool *pool = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_pool)
+            m_pool = CpuThreadPool::GetShared();
+
+        m_queue.push_back({ task, dependency });
+        m_numPending++;
+
+        if (!m_bScheduled) {
+            m_bScheduled = true;
+            pool         = m_pool.get();
+        }
+    }
+
+    if (pool)
+        Schedule(pool);
+
+    return task;
+}
+
+void CpuTaskQueue::Schedule(CpuThreadPool *pool) {
+    mfxPriority priority = m_priority ? m_priority->load() : MFX_PRIORITY_NORMAL;
+    pool->Post(
+        [this]() {
+            RunTask();
+        },
+        priority);
+}
+
+void CpuTaskQueue::WaitPending(size_t maxPending) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cvDone.wait(lock, [this, maxPending] {
+        return m_numPending <= maxPending;
+    });
+}
+
+mfxStatus CpuTaskQueue::TakeError() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    mfxStatus sts = m_error;
+    m_error       = MFX_ERR_NONE;
+    return sts;
+}
+
+// runs the oldest task on a pool thread, then reschedules the queue if more are waiting
+// if the oldest task depends on an unfinished task, the dependency reschedules the queue
+//   when it is done and m_bScheduled stays set in the meantime
+void CpuTaskQueue::RunTask() {
+    std::shared_ptr<CpuTask> task;
+    std::shared_ptr<CpuTask> dependency;
+    CpuThreadPool *pool = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        task       = m_queue.front().task;
+        dependency = m_queue.front().dependency;
+        pool       = m_pool.get();
+    }
+
+    if (dependency) {
+        if (dependency->AddContinuation([this, pool]() {
+                Schedule(pool);
+            })) {
+            return;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.pop_front();
+    }
+
+    // a failed dependency is reported by its own queue, the task still runs
+    //   so it releases the surfaces it holds
+    task->Execute();
+    mfxStatus sts = task->GetStatus();
+
+    pool = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (sts < MFX_ERR_NONE && m_error == MFX_ERR_NONE)
+            m_error = sts;
+        m_numPending--;
+
+        if (m_queue.empty())
+            m_bScheduled = false;
+        else
+            pool = m_pool.get();
+        m_cvDone.notify_all();
+    }
+
+    if (pool)
+        Schedule(pool);
+}
+
+void TaskLockSurface(mfxFrameSurface1 *surface) {
+    if (!surface)
+        return;
+
+    if (surface->Version.Version >= MFX_FRAMESURFACE1_VERSION && surface->FrameInterface)
+        surface->FrameInterface->AddRef(surface);
+    else
+        IncrementLocked(&surface->Data);
+}
+
+void TaskUnlockSurface(mfxFrameSurface1 *surface) {
+    if (!surface)
+        return;
+
+    if (surface->Version.Version >= MFX_FRAMESURFACE1_VERSION && surface->FrameInterface)
+        surface->FrameInterface->Release(surface);
+    else
+        DecrementLocked(&surface->Data);
+}
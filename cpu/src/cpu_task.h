@@ -0,0 +1,115 @@
+/*############################################################################
+  # Copyright (C) 2020 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#ifndef CPU_SRC_CPU_TASK_H_
+#define CPU_SRC_CPU_TASK_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "src/cpu_common.h"
+#include "src/cpu_thread_pool.h"
+
+// One unit of asynchronous work (the body of a *FrameAsync call).
+// The task is done once its work has returned, waiters are released after
+// the continuations have run, so e.g. a surface OnComplete has been called
+// by the time SyncOperation returns.
+class CpuTask {
+public:
+    explicit CpuTask(std::function<mfxStatus()> work);
+    ~CpuTask();
+
+    void Execute();
+
+    // wait up to "wait" ms, returns MFX_WRN_IN_EXECUTION on timeout
+    mfxStatus Wait(mfxU32 wait);
+    bool IsDone();
+
+    // status of a task which is done, continuations must use this instead of Wait()
+    mfxStatus GetStatus();
+
+    // call fn on the executing thread once the task is done
+    // returns false (and does not keep fn) if the task is already done
+    bool AddContinuation(std::function<void()> fn);
+
+private:
+    std::function<mfxStatus()> m_work;
+    std::vector<std::function<void()>> m_continuations;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cvDone;
+    bool m_bDone;
+    bool m_bSignaled; // continuations have run, waiters are released
+    mfxStatus m_status;
+
+    /* copy not allowed */
+    CpuTask(const CpuTask &);
+    CpuTask &operator=(const CpuTask &);
+};
+
+// Runs tasks one at a time in submission order on the session thread pool.
+// Each component owns one queue, so calls into its libav context stay
+// serialized while the application thread moves on to the next stage.
+// The queue goes back to the pool after every task, so work from higher
+// priority sessions can overtake it between frames.
+// A task may depend on a task of another queue (e.g. the VPP task writing
+// the surface an encode task reads). The queue then stays off the pool
+// until the dependency is done, no worker ever blocks on it, which lets
+// decode, VPP and encode of one session run as a pipeline.
+class CpuTaskQueue {
+public:
+    CpuTaskQueue();
+    ~CpuTaskQueue();
+
+    // defaults to the library-wide pool if not set before the first Submit()
+    // priority is read each time the queue is scheduled, it may be null (NORMAL)
+    void SetThreadPool(std::shared_ptr<CpuThreadPool> pool,
+                       const std::atomic<mfxPriority> *priority);
+
+    // dependency may be null, otherwise work runs after dependency is done
+    std::shared_ptr<CpuTask> Submit(std::function<mfxStatus()> work,
+                                    std::shared_ptr<CpuTask> dependency = nullptr);
+
+    // block until no more than maxPending submitted tasks are unfinished
+    void WaitPending(size_t maxPending);
+
+    // return (and clear) the first error reported by a finished task
+    mfxStatus TakeError();
+
+private:
+    struct Entry {
+        std::shared_ptr<CpuTask> task;
+        std::shared_ptr<CpuTask> dependency;
+    };
+
+    void RunTask();
+    void Schedule(CpuThreadPool *pool);
+
+    std::shared_ptr<CpuThreadPool> m_pool;
+    const std::atomic<mfxPriority> *m_priority;
+    std::mutex m_mutex;
+    std::condition_variable m_cvDone;
+    std::deque<Entry> m_queue;
+    size_t m_numPending;
+    mfxStatus m_error;
+    bool m_bScheduled; // RunTask() is posted to (or running on) the pool
+
+    /* copy not allowed */
+    CpuTaskQueue(const CpuTaskQueue &);
+    CpuTaskQueue &operator=(const CpuTaskQueue &);
+};
+
+// Keep a surface owned by the runtime while a queued task references it.
+// Internal surfaces get an extra reference, and Data.Locked tells the
+// application not to reuse the surface until the task has finished.
+void TaskLockSurface(mfxFrameSurface1 *surface);
+void TaskUnlockSurface(mfxFrameSurface1 *surface);
+
+#endif // CPU_SRC_CPU_TASK_H_
@@ -0,0 +1,355 @@
+/*############################################################################
+  # Copyright (C) 2020 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#include "src/cpu_thread_pool.h"
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <string>
+#include <utility>
+#if defined(__linux__)
+    #include <sched.h>
+    #include <sys/resource.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#elif defined(_WIN32) || defined(_WIN64)
+    #include <windows.h>
+#endif
+
+// nice offsets used for libav-owned threads of LOW and HIGH priority sessions
+#define LOW_PRIORITY_NICE  10
+#define HIGH_PRIORITY_NICE -5
+
+// worker identity, lets Post() from a worker keep the job on its own deque
+static thread_local CpuThreadPool *t_pool = nullptr;
+static thread_local size_t t_workerIndex  = 0;
+
+// priority of the job running on this thread, inherited by its ParallelFor helpers
+static thread_local mfxPriority t_priority = MFX_PRIORITY_NORMAL;
+
+CpuThreadPool::CpuThreadPool(mfxU32 numThreads, const std::vector<mfxU32> &cpus)
+        : m_workers(),
+          m_cpus(cpus),
+          m_mutex(),
+          m_cvWork(),
+          m_numJobs(0),
+          m_nextWorker(0),
+          m_numClients(0),
+          m_bExit(false) {
+    if (!m_cpus.empty())
+        numThreads = static_cast<mfxU32>(m_cpus.size());
+    if (numThreads == 0)
+        numThreads = 1;
+
+    for (mfxU32 i = 0; i < numThreads; i++)
+        m_workers.push_back(std::make_unique<Worker>());
+
+    // start threads only after every deque exists, workers steal from all of them
+    for (mfxU32 i = 0; i < numThreads; i++)
+        m_workers[i]->thread = std::thread(&CpuThreadPool::WorkerLoop, this, i);
+}
+
+CpuThreadPool::~CpuThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bExit = true;
+    }
+    m_cvWork.notify_all();
+
+    // workers drain all queued jobs before exiting
+    for (auto &worker : m_workers) {
+        if (worker->thread.joinable())
+            worker->thread.join();
+    }
+}
+
+std::shared_ptr<CpuThreadPool> CpuThreadPool::GetShared() {
+    return GetShared(std::vector<mfxU32>());
+}
+
+std::shared_ptr<CpuThreadPool> CpuThreadPool::GetShared(const std::vector<mfxU32> &cpus) {
+    static std::mutex s_mutex;
+    static std::map<std::vector<mfxU32>, std::weak_ptr<CpuThreadPool>> s_pools;
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    std::shared_ptr<CpuThreadPool> pool = s_pools[cpus].lock();
+    if (!pool) {
+        pool          = std::make_shared<CpuThreadPool>(std::thread::hardware_concurrency(), cpus);
+        s_pools[cpus] = pool;
+    }
+    return pool;
+}
+
+std::vector<mfxU32> CpuThreadPool::GetNumaNodeCpus(mfxU32 node) {
+    std::vector<mfxU32> cpus;
+
+#if defined(__linux__)
+    // cpulist is a comma separated list of ranges, e.g. "0-15,32-47"
+    std::ifstream cpulist("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string range;
+    while (std::getline(cpulist, range, ',')) {
+        size_t dash = range.find('-');
+        try {
+            mfxU32 first = std::stoul(range.substr(0, dash));
+            mfxU32 last  = (dash == std::string::npos) ? first : std::stoul(range.substr(dash + 1));
+            for (mfxU32 cpu = first; cpu <= last; cpu++)
+                cpus.push_back(cpu);
+        }
+        catch (...) {
+            return std::vector<mfxU32>();
+        }
+    }
+#elif defined(_WIN32) || defined(_WIN64)
+    // processor group 0 only
+    ULONGLONG mask = 0;
+    if (node <= 0xFF && GetNumaNodeProcessorMask(static_cast<UCHAR>(node), &mask)) {
+        for (mfxU32 cpu = 0; cpu < 64; cpu++) {
+            if (mask & (1ULL << cpu))
+                cpus.push_back(cpu);
+        }
+    }
+#endif
+
+    return cpus;
+}
+
+void CpuThreadPool::Post(std::function<void()> job, mfxPriority priority) {
+    if (priority < MFX_PRIORITY_LOW || priority > MFX_PRIORITY_HIGH)
+        priority = MFX_PRIORITY_NORMAL;
+
+    // counted before it is pushed, a worker which takes the job right away
+    //   must not decrement below zero
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_numJobs++;
+    }
+    size_t index = (t_pool == this) ? t_workerIndex : (m_nextWorker++ % m_workers.size());
+    {
+        std::lock_guard<std::mutex> lock(m_workers[index]->mutex);
+        m_workers[index]->jobs[priority].push_back(std::move(job));
+    }
+    m_cvWork.notify_one();
+}
+
+void CpuThreadPool::RunAndWait(const std::function<void()> &job) {
+    if (t_pool == this) {
+        job();
+        return;
+    }
+
+    std::mutex mutex;
+    std::condition_variable cvDone;
+    bool bDone = false;
+
+    Post(
+        [&]() {
+            job();
+            std::lock_guard<std::mutex> lock(mutex);
+            bDone = true;
+            cvDone.notify_all();
+        },
+        t_priority);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    cvDone.wait(lock, [&bDone] {
+        return bDone;
+    });
+}
+
+void CpuThreadPool::ParallelFor(int count,
+                                int maxParallel,
+                                const std::function<void(int, int)> &func) {
+    if (count <= 0)
+        return;
+
+    maxParallel = std::min(std::min(maxParallel, count), static_cast<int>(GetNumThreads()) + 1);
+    if (maxParallel <= 1) {
+        for (int i = 0; i < count; i++)
+            func(i, 0);
+        return;
+    }
+
+    struct State {
+        std::atomic<int> next;
+        std::atomic<int> slot;
+        std::atomic<int> done;
+        int count;
+        const std::function<void(int, int)> *func;
+        std::mutex mutex;
+        std::condition_variable cvDone;
+    };
+    auto state   = std::make_shared<State>();
+    state->next  = 0;
+    state->slot  = 0;
+    state->done  = 0;
+    state->count = count;
+    state->func  = &func;
+
+    // helpers which start after all jobs are taken return without touching func
+    auto run = [state]() {
+        int slot = state->slot++;
+        for (int job = state->next++; job < state->count; job = state->next++) {
+            (*state->func)(job, slot);
+            if (++state->done == state->count) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->cvDone.notify_all();
+            }
+        }
+    };
+
+    for (int i = 1; i < maxParallel; i++)
+        Post(run, t_priority);
+    run();
+
+    // only jobs already running on other threads are left
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cvDone.wait(lock, [&state] {
+        return state->done == state->count;
+    });
+}
+
+void CpuThreadPool::AddClient() {
+    m_numClients++;
+}
+
+void CpuThreadPool::RemoveClient() {
+    m_numClients--;
+}
+
+mfxU32 CpuThreadPool::GetThreadBudget() {
+    mfxU32 numClients = std::max<mfxU32>(m_numClients, 1);
+    return std::max<mfxU32>(GetNumThreads() / numClients, 1);
+}
+
+int CpuThreadPool::CallWithThreadAttributes(mfxPriority priority,
+                                            const std::function<int()> &func) {
+    bool bNice = false;
+#if defined(__linux__)
+    bNice = (priority == MFX_PRIORITY_LOW || priority == MFX_PRIORITY_HIGH);
+#endif
+    if (!bNice && !IsPinned())
+        return func();
+
+    // nice and affinity are per-thread attributes on Linux and new threads
+    //   start with the values of their creator, so apply them on a scratch thread
+    int ret = 0;
+    std::thread caller([&]() {
+        PinCurrentThread();
+#if defined(__linux__)
+        if (bNice) {
+            pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+            int nice  = getpriority(PRIO_PROCESS, tid);
+            nice += (priority == MFX_PRIORITY_LOW) ? LOW_PRIORITY_NICE : HIGH_PRIORITY_NICE;
+            setpriority(PRIO_PROCESS, tid, nice); // failure leaves the default priority
+        }
+#endif
+        ret = func();
+    });
+    caller.join();
+    return ret;
+}
+
+int CpuThreadPool::FilterExecute(AVFilterContext *ctx,
+                                 avfilter_action_func *func,
+                                 void *arg,
+                                 int *ret,
+                                 int nb_jobs) {
+    auto job = [&](int jobnr, int threadnr) {
+        int r = func(ctx, arg, jobnr, nb_jobs);
+        if (ret)
+            ret[jobnr] = r;
+    };
+
+    CpuThreadPool *pool = static_cast<CpuThreadPool *>(ctx->graph->opaque);
+    if (pool) {
+        pool->ParallelFor(nb_jobs, nb_jobs, job);
+    }
+    else {
+        for (int i = 0; i < nb_jobs; i++)
+            job(i, 0);
+    }
+    return 0;
+}
+
+// best effort, a CPU outside the process affinity just leaves the thread unpinned
+void CpuThreadPool::PinCurrentThread() {
+    if (m_cpus.empty())
+        return;
+
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (mfxU32 cpu : m_cpus) {
+        if (cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    }
+    sched_setaffinity(0, sizeof(set), &set);
+#elif defined(_WIN32) || defined(_WIN64)
+    DWORD_PTR mask = 0;
+    for (mfxU32 cpu : m_cpus) {
+        if (cpu < sizeof(DWORD_PTR) * 8)
+            mask |= static_cast<DWORD_PTR>(1) << cpu;
+    }
+    if (mask)
+        SetThreadAffinityMask(GetCurrentThread(), mask);
+#endif
+}
+
+void CpuThreadPool::WorkerLoop(size_t index) {
+    t_pool        = this;
+    t_workerIndex = index;
+
+    PinCurrentThread();
+
+    for (;;) {
+        std::function<void()> job;
+        mfxPriority priority;
+        if (PopJob(index, job, priority)) {
+            m_numJobs--;
+            t_priority = priority;
+            job();
+            t_priority = MFX_PRIORITY_NORMAL;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cvWork.wait(lock, [this] {
+            return m_bExit || m_numJobs > 0;
+        });
+        if (m_bExit && m_numJobs == 0)
+            return;
+    }
+}
+
+// highest priority first, across all workers
+// own deque is served in FIFO order, other workers are robbed from the back
+bool CpuThreadPool::PopJob(size_t index, std::function<void()> &job, mfxPriority &priority) {
+    size_t numWorkers = m_workers.size();
+
+    for (int p = MFX_PRIORITY_HIGH; p >= MFX_PRIORITY_LOW; p--) {
+        for (size_t i = 0; i < numWorkers; i++) {
+            Worker *worker = m_workers[(index + i) % numWorkers].get();
+
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            std::deque<std::function<void()>> &jobs = worker->jobs[p];
+            if (jobs.empty())
+                continue;
+
+            if (i == 0) {
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            else {
+                job = std::move(jobs.back());
+                jobs.pop_back();
+            }
+            priority = static_cast<mfxPriority>(p);
+            return true;
+        }
+    }
+
+    return false;
+}
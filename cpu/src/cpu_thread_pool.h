@@ -0,0 +1,114 @@
+/*############################################################################
+  # Copyright (C) 2020 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#ifndef CPU_SRC_CPU_THREAD_POOL_H_
+#define CPU_SRC_CPU_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "src/cpu_common.h"
+
+// Work-stealing thread pool shared by all sessions in the process.
+// It runs the component task queues as well as the slice jobs of the
+// VPP filter graphs (AVFilterGraph::execute), so the number of runtime
+// threads no longer grows with the number of sessions. Codecs thread
+// themselves, their thread count is a share of the pool (GetThreadBudget).
+// Jobs are picked strictly by session priority, MFX_PRIORITY_HIGH work
+// queued anywhere in the pool runs before any NORMAL or LOW job.
+class CpuThreadPool {
+public:
+    // cpus lists the logical CPUs the workers are pinned to, empty for no pinning
+    CpuThreadPool(mfxU32 numThreads, const std::vector<mfxU32> &cpus);
+    ~CpuThreadPool();
+
+    // library-wide pool, created on first use and released with the last session
+    static std::shared_ptr<CpuThreadPool> GetShared();
+
+    // pool with one worker per CPU in cpus, shared by sessions asking for the same set
+    static std::shared_ptr<CpuThreadPool> GetShared(const std::vector<mfxU32> &cpus);
+
+    // logical CPUs of a NUMA node, empty if the node does not exist
+    static std::vector<mfxU32> GetNumaNodeCpus(mfxU32 node);
+
+    mfxU32 GetNumThreads() {
+        return static_cast<mfxU32>(m_workers.size());
+    }
+
+    bool IsPinned() {
+        return !m_cpus.empty();
+    }
+
+    // logical CPUs the workers are pinned to, empty for no pinning
+    const std::vector<mfxU32> &GetCpus() {
+        return m_cpus;
+    }
+
+    // queue a job to be run by any worker
+    void Post(std::function<void()> job, mfxPriority priority);
+
+    // run job on a worker and wait for it, used for work which must happen
+    //   on the pool CPUs (e.g. first touch of memory on its NUMA node)
+    void RunAndWait(const std::function<void()> &job);
+
+    // run func(job, slot) for job = 0..count-1 with at most maxParallel
+    // concurrent participants, slot < maxParallel identifies the participant
+    // the calling thread takes part, so this is safe to call from a worker
+    void ParallelFor(int count, int maxParallel, const std::function<void(int, int)> &func);
+
+    // clients are independent sessions (or groups of joined sessions)
+    // which split the pool for threads libav creates on its own
+    void AddClient();
+    void RemoveClient();
+    mfxU32 GetThreadBudget();
+
+    // run func on a temporary thread with the OS scheduling priority mapped
+    //   from priority and the CPU affinity of the pool, threads func creates
+    //   (e.g. in avcodec_open2) inherit both
+    // this is best effort, raising the priority usually needs privileges
+    int CallWithThreadAttributes(mfxPriority priority, const std::function<int()> &func);
+
+    // libav callback, AVFilterGraph::opaque holds the pool
+    static int FilterExecute(AVFilterContext *ctx,
+                             avfilter_action_func *func,
+                             void *arg,
+                             int *ret,
+                             int nb_jobs);
+
+private:
+    // MFX_PRIORITY_LOW .. MFX_PRIORITY_HIGH
+    static const int NUM_PRIORITIES = MFX_PRIORITY_HIGH + 1;
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> jobs[NUM_PRIORITIES];
+        std::thread thread;
+    };
+
+    void WorkerLoop(size_t index);
+    void PinCurrentThread();
+    bool PopJob(size_t index, std::function<void()> &job, mfxPriority &priority);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<mfxU32> m_cpus;
+    std::mutex m_mutex;
+    std::condition_variable m_cvWork;
+    std::atomic<size_t> m_numJobs;
+    std::atomic<size_t> m_nextWorker;
+    std::atomic<mfxU32> m_numClients;
+    bool m_bExit;
+
+    /* copy not allowed */
+    CpuThreadPool(const CpuThreadPool &);
+    CpuThreadPool &operator=(const CpuThreadPool &);
+};
+
+#endif // CPU_SRC_CPU_THREAD_POOL_H_
@@ -18,18 +18,23 @@ CpuVPP::CpuVPP()
         : m_vpp_graph(nullptr),
           m_buffersrc_ctx(nullptr),
           m_buffersink_ctx(nullptr),
-          m_input_locker(),
+          m_frameMap(),
           m_avVppFrameOut(nullptr),
+          m_swsContext(nullptr),
           m_vppFunc(0),
           m_param(),
+          m_extSurfacePool(),
           m_vppSurfacesIn(),
           m_vppSurfacesOut(),
+          m_taskQueue(),
           m_session(nullptr) {
     memset(m_vpp_filter_desc, 0, sizeof(m_vpp_filter_desc));
+    GetSurfacePoolParam(nullptr, &m_extSurfacePool);
 }
 
 void CpuVPP::SetSession(CpuWorkstream *session) {
     m_session = session;
+    m_taskQueue.SetThreadPool(session->GetThreadPool(), session->GetPriorityRef());
 }
 
 // buffersrc --> execution filters from filter description --> buffersink
@@ -49,6 +54,13 @@ bool CpuVPP::InitFilters(void) {
         return false;
     }
 
+    // slice threads of the filters run on the session thread pool
+    // must be set before any filter is added to the graph
+    CpuThreadPool *pool     = m_session->GetThreadPool().get();
+    m_vpp_graph->opaque     = pool;
+    m_vpp_graph->execute    = CpuThreadPool::FilterExecute;
+    m_vpp_graph->nb_threads = pool->GetNumThreads();
+
     snprintf(buffersrc_fmt,
              sizeof(buffersrc_fmt),
              "video_size=%ux%u:pix_fmt=%d:time_base=%u/%u", //:pixel_aspect=1/1",
@@ -83,41 +95,24 @@ bool CpuVPP::InitFilters(void) {
         return false;
     }
 
-    // scale
-    if (m_vppFunc & VPL_VPP_SCALE) {
-        snprintf(m_vpp_filter_desc,
-                 sizeof(m_vpp_filter_desc),
-                 "scale=%u:%u",
-                 (unsigned int)m_param.vpp.Out.Width,
-                 (unsigned int)m_param.vpp.Out.Height);
-    }
+    // without a background to compose on, scale and csc are not part of the
+    //   graph, the scaler writes its output straight into the output surface
+    //   (see WriteOutputFrame) instead of into a frame libavfilter allocates
+    //   with a chroma pitch which is not half of the luma pitch
+    bool bScaler = !(m_vppFunc & VPL_VPP_CROP) || (m_param.vpp.Out.Width == m_param.vpp.Out.CropW &&
+                                                   m_param.vpp.Out.Height == m_param.vpp.Out.CropH);
 
     // crop - do crop and scale to match msdk feature
     if (m_vppFunc & VPL_VPP_CROP) {
         // no need background
-        if (m_param.vpp.Out.Width == m_param.vpp.Out.CropW &&
-            m_param.vpp.Out.Height == m_param.vpp.Out.CropH) {
-            if (m_param.vpp.In.CropW == m_param.vpp.Out.CropW &&
-                m_param.vpp.In.CropH == m_param.vpp.Out.CropH) {
-                snprintf(m_vpp_filter_desc,
-                         sizeof(m_vpp_filter_desc),
-                         "crop=%u:%u:%u:%u",
-                         (unsigned int)m_param.vpp.In.CropW,
-                         (unsigned int)m_param.vpp.In.CropH,
-                         (unsigned int)m_param.vpp.In.CropX,
-                         (unsigned int)m_param.vpp.In.CropY);
-            }
-            else {
-                snprintf(m_vpp_filter_desc,
-                         sizeof(m_vpp_filter_desc),
-                         "crop=%u:%u:%u:%u,scale=%u:%u",
-                         (unsigned int)m_param.vpp.In.CropW,
-                         (unsigned int)m_param.vpp.In.CropH,
-                         (unsigned int)m_param.vpp.In.CropX,
-                         (unsigned int)m_param.vpp.In.CropY,
-                         (unsigned int)m_param.vpp.Out.CropW,
-                         (unsigned int)m_param.vpp.Out.CropH);
-            }
+        if (bScaler) {
+            snprintf(m_vpp_filter_desc,
+                     sizeof(m_vpp_filter_desc),
+                     "crop=%u:%u:%u:%u",
+                     (unsigned int)m_param.vpp.In.CropW,
+                     (unsigned int)m_param.vpp.In.CropH,
+                     (unsigned int)m_param.vpp.In.CropX,
+                     (unsigned int)m_param.vpp.In.CropY);
         }
         else {
             std::string f_split     = "split=2[bg][main];";
@@ -159,7 +154,7 @@ bool CpuVPP::InitFilters(void) {
     }
 
     // csc - set pixel format of buffersink
-    if (m_vppFunc & VPL_VPP_CSC) {
+    if ((m_vppFunc & VPL_VPP_CSC) && !bScaler) {
         AVPixelFormat csc_dst_fmt     = MFXFourCC2AVPixelFormat(m_param.vpp.Out.FourCC);
         enum AVPixelFormat pix_fmts[] = { csc_dst_fmt, AV_PIX_FMT_NONE };
 
@@ -174,13 +169,10 @@ bool CpuVPP::InitFilters(void) {
             return false;
         }
 
-        char pixel_format[50] = { 0 };
-        if (csc_dst_fmt == AV_PIX_FMT_YUV420P)
-            snprintf(pixel_format, sizeof(pixel_format), "format=pix_fmts=yuv420p");
-        else if (csc_dst_fmt == AV_PIX_FMT_YUV420P10LE)
-            snprintf(pixel_format, sizeof(pixel_format), "format=pix_fmts=yuv420p10le");
-        else if (csc_dst_fmt == AV_PIX_FMT_BGRA)
-            snprintf(pixel_format, sizeof(pixel_format), "format=pix_fmts=bgra");
+        char pixel_format[50]    = { 0 };
+        const char *csc_dst_name = av_get_pix_fmt_name(csc_dst_fmt);
+        if (csc_dst_name)
+            snprintf(pixel_format, sizeof(pixel_format), "format=pix_fmts=%s", csc_dst_name);
 
         if (m_vppFunc == VPL_VPP_CSC) // there's no filter assigned
             snprintf(m_vpp_filter_desc, sizeof(m_vpp_filter_desc), "%s", pixel_format);
@@ -227,9 +219,45 @@ bool CpuVPP::InitFilters(void) {
         printf("vpp filter initialization fail\n");
         return false;
     }
-    else {
+
+    if (bScaler)
+        return InitScaler();
+
+    return true;
+}
+
+// scale and csc from the graph output (the cropped input) to the output surface
+bool CpuVPP::InitScaler(void) {
+    AVPixelFormat src_fmt = MFXFourCC2AVPixelFormat(m_param.vpp.In.FourCC);
+    AVPixelFormat dst_fmt = MFXFourCC2AVPixelFormat(m_param.vpp.Out.FourCC);
+
+    if (src_fmt == dst_fmt && m_param.vpp.In.CropW == m_param.vpp.Out.Width &&
+        m_param.vpp.In.CropH == m_param.vpp.Out.Height) {
         return true;
     }
+
+    m_swsContext = sws_alloc_context();
+    if (!m_swsContext) {
+        printf("cannot alloc scaler\n");
+        return false;
+    }
+
+    // same defaults as the scale filter, which also runs libswscale on its own threads
+    av_opt_set_int(m_swsContext, "srcw", m_param.vpp.In.CropW, 0);
+    av_opt_set_int(m_swsContext, "srch", m_param.vpp.In.CropH, 0);
+    av_opt_set_int(m_swsContext, "src_format", src_fmt, 0);
+    av_opt_set_int(m_swsContext, "dstw", m_param.vpp.Out.Width, 0);
+    av_opt_set_int(m_swsContext, "dsth", m_param.vpp.Out.Height, 0);
+    av_opt_set_int(m_swsContext, "dst_format", dst_fmt, 0);
+    av_opt_set_int(m_swsContext, "sws_flags", SWS_BICUBIC, 0);
+    av_opt_set_int(m_swsContext, "threads", m_session->GetThreadBudget(), 0);
+
+    if (sws_init_context(m_swsContext, nullptr, nullptr) < 0) {
+        printf("cannot init scaler\n");
+        return false;
+    }
+
+    return true;
 }
 
 void CpuVPP::CloseFilterPads(AVFilterInOut *src_out, AVFilterInOut *sink_in) {
@@ -253,8 +281,14 @@ mfxStatus CpuVPP::ValidateVPPParams(mfxVideoParam *par, bool canCorrect) {
         if (par->Protected)
             par->Protected = 0;
 
-        if (par->NumExtParam)
-            par->NumExtParam = 0;
+        // mfxExtCPUSurfacePool is the only supported extension buffer
+        if (par->NumExtParam) {
+            mfxStatus sts = CheckSurfacePoolParam(par, true);
+            if (sts < 0 || !HasOnlyExtBuffers(par, { MFX_EXTBUFF_CPU_SURFACE_POOL }))
+                par->NumExtParam = 0;
+            else if (sts == MFX_WRN_INCOMPATIBLE_VIDEO_PARAM)
+                fixedIncompatible = true;
+        }
 
         if (!par->vpp.Out.Width)
             par->vpp.Out.Width = par->vpp.In.Width;
@@ -294,7 +328,7 @@ mfxStatus CpuVPP::ValidateVPPParams(mfxVideoParam *par, bool canCorrect) {
         if ((par->vpp.In.BitDepthLuma == 8) && (par->vpp.In.BitDepthChroma == 10)) {
             if (canCorrect)
                 fixedIncompatible = true;
-            if (par->vpp.In.FourCC == MFX_FOURCC_I420)
+            if (par->vpp.In.FourCC == MFX_FOURCC_I420 || par->vpp.In.FourCC == MFX_FOURCC_NV12)
                 par->vpp.In.BitDepthChroma = 8;
             else
                 par->vpp.In.BitDepthChroma = 10;
@@ -303,7 +337,7 @@ mfxStatus CpuVPP::ValidateVPPParams(mfxVideoParam *par, bool canCorrect) {
         if ((par->vpp.In.BitDepthLuma == 10) && (par->vpp.In.BitDepthChroma == 8)) {
             if (canCorrect)
                 fixedIncompatible = true;
-            if (par->vpp.In.FourCC == MFX_FOURCC_I420)
+            if (par->vpp.In.FourCC == MFX_FOURCC_I420 || par->vpp.In.FourCC == MFX_FOURCC_NV12)
                 par->vpp.In.BitDepthLuma = 8;
             else
                 par->vpp.In.BitDepthLuma = 10;
@@ -312,7 +346,7 @@ mfxStatus CpuVPP::ValidateVPPParams(mfxVideoParam *par, bool canCorrect) {
         if ((par->vpp.Out.BitDepthLuma == 8) && (par->vpp.Out.BitDepthChroma == 10)) {
             if (canCorrect)
                 fixedIncompatible = true;
-            if (par->vpp.Out.FourCC == MFX_FOURCC_I420)
+            if (par->vpp.Out.FourCC == MFX_FOURCC_I420 || par->vpp.Out.FourCC == MFX_FOURCC_NV12)
                 par->vpp.Out.BitDepthChroma = 8;
             else
                 par->vpp.Out.BitDepthChroma = 10;
@@ -321,7 +355,7 @@ mfxStatus CpuVPP::ValidateVPPParams(mfxVideoParam *par, bool canCorrect) {
         if ((par->vpp.Out.BitDepthLuma == 10) && (par->vpp.Out.BitDepthChroma == 8)) {
             if (canCorrect)
                 fixedIncompatible = true;
-            if (par->vpp.In.FourCC == MFX_FOURCC_I420)
+            if (par->vpp.In.FourCC == MFX_FOURCC_I420 || par->vpp.In.FourCC == MFX_FOURCC_NV12)
                 par->vpp.Out.BitDepthLuma = 8;
             else
                 par->vpp.Out.BitDepthLuma = 10;
@@ -336,8 +370,11 @@ mfxStatus CpuVPP::ValidateVPPParams(mfxVideoParam *par, bool canCorrect) {
         if (par->Protected)
             return MFX_ERR_INVALID_VIDEO_PARAM;
 
-        if (par->NumExtParam)
-            return MFX_ERR_INVALID_VIDEO_PARAM;
+        if (par->NumExtParam) {
+            if (!HasOnlyExtBuffers(par, { MFX_EXTBUFF_CPU_SURFACE_POOL }))
+                return MFX_ERR_INVALID_VIDEO_PARAM;
+            RET_ERROR(CheckSurfacePoolParam(par, false));
+        }
 
         if (!par->vpp.Out.Width)
             return MFX_ERR_INVALID_VIDEO_PARAM;
@@ -386,7 +423,7 @@ mfxStatus CpuVPP::ValidateVPPParams(mfxVideoParam *par, bool canCorrect) {
     if (par->Protected)
         return MFX_ERR_INVALID_VIDEO_PARAM;
 
-    if (par->NumExtParam)
+    if (!HasOnlyExtBuffers(par, { MFX_EXTBUFF_CPU_SURFACE_POOL }))
         return MFX_ERR_INVALID_VIDEO_PARAM;
 
     if (par->mfx.NumThread)
@@ -408,6 +445,7 @@ mfxStatus CpuVPP::InitVPP(mfxVideoParam *par) {
     RET_ERROR(valSts);
 
     m_param = *par;
+    GetSurfacePoolParam(par, &m_extSurfacePool);
 
     m_param.vpp.In.CropW =
         (m_param.vpp.In.CropW > m_param.vpp.In.Width) ? m_param.vpp.In.Width : m_param.vpp.In.CropW;
@@ -451,6 +489,9 @@ mfxStatus CpuVPP::InitVPP(mfxVideoParam *par) {
 }
 
 CpuVPP::~CpuVPP() {
+    // queued frames still reference the filter graph
+    m_taskQueue.WaitPending(0);
+
     if (m_avVppFrameOut) {
         av_frame_free(&m_avVppFrameOut);
     }
@@ -459,68 +500,50 @@ CpuVPP::~CpuVPP() {
         avfilter_graph_free(&m_vpp_graph);
         m_vpp_graph = nullptr;
     }
+
+    if (m_swsContext) {
+        sws_freeContext(m_swsContext);
+        m_swsContext = nullptr;
+    }
 }
 
 mfxStatus CpuVPP::ProcessFrame(mfxFrameSurface1 *surface_in,
                                mfxFrameSurface1 *surface_out,
                                mfxExtVppAuxData *aux) {
-    bool bWA_alignment = false;
-
-    // Try get AVFrame from surface_out
-    AVFrame *dst_avframe = nullptr;
-    CpuFrame *dst_frame  = CpuFrame::TryCast(surface_out);
-    if (dst_frame) {
-        dst_avframe = dst_frame->GetAVFrame();
-
-        // WA to cover 64 byte alignment issue --
-        // In case of i420, App know only Y pictch size and divide it by 2 for U,V pitch size.
-        // But the U,V pitch size is not /2 when the width is not 64 byte aligned.
-        // So, there's data misalignment when app processes data.
-        // We copy avframe data to mfx data to meet expecting pitch size instead of
-        // delievering memory pointer
-        bWA_alignment = NeedWAForAlignment(&surface_out->Info, (int *)dst_avframe->linesize);
-
-        // Do not unref because we do copy
-        if (bWA_alignment == false)
-            av_frame_unref(dst_avframe);
-    }
-    if (!dst_avframe) { // Otherwise use AVFrame allocated in this class
-        dst_avframe = m_avVppFrameOut;
-    }
-
     if (surface_in) {
-        AVFrame *av_frame =
-            m_input_locker.GetAVFrame(surface_in, MFX_MAP_READ, m_session->GetFrameAllocator());
+        // the filter graph references the surface instead of copying it
+        AVFrame *av_frame = RefSurfaceAVFrame(surface_in,
+                                              MFX_MAP_READ,
+                                              m_session->GetFrameAllocator(),
+                                              &m_frameMap);
         RET_IF_FALSE(av_frame, MFX_ERR_ABORTED);
 
-        int ret =
-            av_buffersrc_add_frame_flags(m_buffersrc_ctx, av_frame, AV_BUFFERSRC_FLAG_KEEP_REF);
-        m_input_locker.Unlock();
+        // libav P010 has the samples in the high bits
+        if (av_frame->format == AV_PIX_FMT_P010LE && !surface_in->Info.Shift) {
+            AVFrame *shifted = ConvertAVFrame(av_frame,
+                                              AV_PIX_FMT_P010LE,
+                                              6,
+                                              m_session->GetThreadPool().get());
+            av_frame_free(&av_frame);
+            RET_IF_FALSE(shifted, MFX_ERR_MEMORY_ALLOC);
+            av_frame = shifted;
+        }
+
+        int ret = av_buffersrc_add_frame_flags(m_buffersrc_ctx, av_frame, 0);
+        av_frame_free(&av_frame);
         RET_IF_FALSE(ret >= 0, MFX_ERR_ABORTED);
     }
 
     // av_buffersink_get_frame
-    int ret = av_buffersink_get_frame(m_buffersink_ctx, dst_avframe);
+    int ret = av_buffersink_get_frame(m_buffersink_ctx, m_avVppFrameOut);
     if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
         return MFX_ERR_MORE_DATA;
     }
     RET_IF_FALSE(ret >= 0, MFX_ERR_ABORTED);
 
-    if (dst_avframe == m_avVppFrameOut) { // copy image data
-        RET_ERROR(
-            AVFrame2mfxFrameSurface(surface_out, m_avVppFrameOut, m_session->GetFrameAllocator()));
-        av_frame_unref(m_avVppFrameOut);
-    }
-    else if (dst_frame) { // update MFXFrameSurface from AVFrame
-        if (bWA_alignment == true) {
-            RET_ERROR(
-                AVFrame2mfxFrameSurface(surface_out, dst_avframe, m_session->GetFrameAllocator()));
-            av_frame_unref(dst_avframe);
-        }
-        else {
-            dst_frame->Update();
-        }
-    }
+    mfxStatus sts = WriteOutputFrame(surface_out, m_avVppFrameOut);
+    av_frame_unref(m_avVppFrameOut);
+    RET_ERROR(sts);
 
     // fix cropW, cropH
     if (surface_out) {
@@ -543,6 +566,52 @@ mfxStatus CpuVPP::ProcessFrame(mfxFrameSurface1 *surface_in,
     return MFX_ERR_NONE;
 }
 
+// queue ProcessFrame() on the worker, keeping up to AsyncDepth frames in flight
+// the filter graph is 1-in-1-out, so the status is known before the frame is processed
+mfxStatus CpuVPP::SubmitFrame(mfxFrameSurface1 *surface_in,
+                              mfxFrameSurface1 *surface_out,
+                              mfxExtVppAuxData *aux,
+                              mfxSyncPoint *syncp) {
+    RET_ERROR(m_taskQueue.TakeError());
+
+    if (!surface_in) {
+        // drain - finish queued frames, then run on the caller's thread
+        m_taskQueue.WaitPending(0);
+        RET_ERROR(m_taskQueue.TakeError());
+        RET_ERROR(ProcessFrame(nullptr, surface_out, aux));
+
+        // nothing left to run
+        std::shared_ptr<CpuTask> task = std::make_shared<CpuTask>(nullptr);
+        task->Execute();
+
+        m_session->SetSurfaceTask(surface_out, task);
+        if (syncp)
+            *syncp = m_session->AddSyncPoint(task);
+        return MFX_ERR_NONE;
+    }
+
+    // surface_in may still be written by the decoder (or another VPP) of this session
+    std::shared_ptr<CpuTask> producer = m_session->GetSurfaceTask(surface_in);
+
+    TaskLockSurface(surface_in);
+    TaskLockSurface(surface_out);
+    std::shared_ptr<CpuTask> task = m_taskQueue.Submit(
+        [this, surface_in, surface_out, aux]() {
+            mfxStatus sts = ProcessFrame(surface_in, surface_out, aux);
+            TaskUnlockSurface(surface_out);
+            TaskUnlockSurface(surface_in);
+            return sts;
+        },
+        producer);
+
+    m_session->SetSurfaceTask(surface_out, task);
+    if (syncp)
+        *syncp = m_session->AddSyncPoint(task);
+
+    m_taskQueue.WaitPending(m_param.AsyncDepth > 1 ? m_param.AsyncDepth - 1 : 0);
+    return m_taskQueue.TakeError();
+}
+
 mfxStatus CpuVPP::VPPQuery(mfxVideoParam *in, mfxVideoParam *out) {
     mfxStatus sts = MFX_ERR_NONE;
 
@@ -657,6 +726,8 @@ mfxStatus CpuVPP::CheckFrameInfo(mfxFrameInfo *info) {
         case MFX_FOURCC_BGRA:
         case MFX_FOURCC_I420:
         case MFX_FOURCC_I010:
+        case MFX_FOURCC_NV12:
+        case MFX_FOURCC_P010:
             break;
         default:
             return MFX_ERR_INVALID_VIDEO_PARAM;
@@ -688,7 +759,15 @@ mfxStatus CpuVPP::CheckFrameInfo(mfxFrameInfo *info) {
 }
 
 mfxStatus CpuVPP::GetVideoParam(mfxVideoParam *par) {
-    *par = m_param;
+    RET_ERROR(GetSurfacePoolStats(par, m_vppSurfacesIn.get(), m_vppSurfacesOut.get()));
+
+    // extension buffers of the caller are kept
+    mfxExtBuffer **extParam = par->ExtParam;
+    mfxU16 numExtParam      = par->NumExtParam;
+
+    *par             = m_param;
+    par->ExtParam    = extParam;
+    par->NumExtParam = numExtParam;
 
     return MFX_ERR_NONE;
 }
@@ -699,6 +778,9 @@ mfxStatus CpuVPP::GetVPPSurface(mfxFrameSurface1 **surface) {
         VPPQueryIOSurf(nullptr, VPPRequest);
 
         auto pool = std::make_unique<CpuFramePool>();
+        pool->SetThreadPool(m_session->GetThreadPool());
+        pool->SetMemoryStats(m_session->GetMemoryStats());
+        pool->SetAllocationPolicy(m_extSurfacePool, VPPRequest[0].NumFrameSuggested);
         RET_ERROR(pool->Init(m_param.vpp.In, VPPRequest[0].NumFrameSuggested));
         m_vppSurfacesIn = std::move(pool);
     }
@@ -722,6 +804,9 @@ mfxStatus CpuVPP::GetVPPSurfaceOut(mfxFrameSurface1 **surface) {
         VPPQueryIOSurf(nullptr, VPPRequest);
 
         auto pool = std::make_unique<CpuFramePool>();
+        pool->SetThreadPool(m_session->GetThreadPool());
+        pool->SetMemoryStats(m_session->GetMemoryStats());
+        pool->SetAllocationPolicy(m_extSurfacePool, VPPRequest[1].NumFrameSuggested);
         RET_ERROR(pool->Init(m_param.vpp.Out, VPPRequest[1].NumFrameSuggested));
         m_vppSurfacesOut = std::move(pool);
     }
@@ -796,25 +881,100 @@ mfxStatus CpuVPP::IsSameVideoParam(mfxVideoParam *newPar, mfxVideoParam *oldPar)
     return MFX_ERR_NONE;
 }
 
-bool CpuVPP::NeedWAForAlignment(mfxFrameInfo *fi, int *linesize) {
-    if (fi->FourCC == MFX_FOURCC_I420) {
-        // check the U pitch size of output surface and output avframe
-        if (fi->Width / 2 != linesize[1]) {
+// mfxFrameData has a single pitch, the chroma pitch of planar formats is half of it
+bool CpuVPP::HasSinglePitch(AVFrame *frame) {
+    switch (frame->format) {
+        case AV_PIX_FMT_YUV420P:
+        case AV_PIX_FMT_YUVJ420P:
+        case AV_PIX_FMT_YUV420P10LE:
+        case AV_PIX_FMT_YUV422P:
+        case AV_PIX_FMT_YUV422P10LE:
+            return frame->linesize[1] * 2 == frame->linesize[0] &&
+                   frame->linesize[2] == frame->linesize[1];
+        case AV_PIX_FMT_NV12:
+        case AV_PIX_FMT_P010LE:
+            return frame->linesize[1] == frame->linesize[0];
+        default:
             return true;
-        }
     }
-    else if (fi->FourCC == MFX_FOURCC_I010) {
-        // check the U pitch size of output surface and output avframe
-        if (fi->Width != linesize[1]) {
-            return true;
-        }
+}
+
+// make sure a runtime output surface owns a writable buffer of the output format
+// a buffer libav still references (e.g. a frame queued in the encoder) is
+//   left to it and replaced
+mfxStatus CpuVPP::PrepareOutputBuffer(CpuFrame *frame) {
+    AVFrame *avframe = frame->GetAVFrame();
+    if (avframe->buf[0] && av_frame_is_writable(avframe) &&
+        avframe->format == MFXFourCC2AVPixelFormat(m_param.vpp.Out.FourCC) &&
+        avframe->width == m_param.vpp.Out.Width && avframe->height == m_param.vpp.Out.Height &&
+        HasSinglePitch(avframe)) {
+        return MFX_ERR_NONE;
     }
-    else { // bgra
-        // check the bgra pitch size of output surface and output avframe
-        if (fi->Width * 4 != linesize[0]) {
-            return true;
+
+    av_frame_unref(avframe);
+    return frame->Allocate(m_param.vpp.Out.FourCC, m_param.vpp.Out.Width, m_param.vpp.Out.Height);
+}
+
+// put the graph output into surface_out
+// graph output which meets the pitch rules of mfxFrameData is referenced by
+//   runtime surfaces, the scaler writes into the surface memory, anything else
+//   (application surfaces without scaler, composition) is copied
+mfxStatus CpuVPP::WriteOutputFrame(mfxFrameSurface1 *surface_out, AVFrame *frame) {
+    RET_IF_FALSE(surface_out, MFX_ERR_NULL_PTR);
+
+    CpuFrame *dst_frame = CpuFrame::TryCast(surface_out);
+    if (!m_swsContext) {
+        if (dst_frame && HasSinglePitch(frame)) {
+            AVFrame *dst_avframe = dst_frame->GetAVFrame();
+            av_frame_unref(dst_avframe);
+            av_frame_move_ref(dst_avframe, frame);
+            return dst_frame->Update();
         }
+
+        if (dst_frame) {
+            RET_ERROR(PrepareOutputBuffer(dst_frame));
+            RET_ERROR(dst_frame->Update());
+        }
+        return AVFrame2mfxFrameSurface(surface_out,
+                                       frame,
+                                       m_session->GetFrameAllocator(),
+                                       &m_frameMap,
+                                       m_session->GetThreadPool().get());
+    }
+
+    AVFrame *dst_avframe = nullptr;
+    if (dst_frame) {
+        RET_ERROR(PrepareOutputBuffer(dst_frame));
+        dst_avframe = av_frame_clone(dst_frame->GetAVFrame());
+    }
+    else {
+        dst_avframe = RefSurfaceAVFrame(surface_out,
+                                        MFX_MAP_WRITE,
+                                        m_session->GetFrameAllocator(),
+                                        &m_frameMap);
     }
+    RET_IF_FALSE(dst_avframe, MFX_ERR_LOCK_MEMORY);
+
+    // the surface view is cropped, the scaler fills the whole image
+    dst_avframe->width  = m_param.vpp.Out.Width;
+    dst_avframe->height = m_param.vpp.Out.Height;
+
+    int ret       = sws_scale_frame(m_swsContext, dst_avframe, frame);
+    mfxStatus sts = MFX_ERR_NONE;
+    if (ret >= 0 && !dst_frame) {
+        AVFrame2mfxFrameInfo(&surface_out->Info, dst_avframe);
+        // the scaler writes libav P010 with the samples in the high bits
+        if (dst_avframe->format == AV_PIX_FMT_P010LE && !surface_out->Info.Shift)
+            sts = CopyImage(dst_avframe->data,
+                            dst_avframe->linesize,
+                            AV_PIX_FMT_P010LE,
+                            dst_avframe,
+                            -6,
+                            m_session->GetThreadPool().get());
+    }
+    av_frame_free(&dst_avframe);
+    RET_IF_FALSE(ret >= 0, MFX_ERR_ABORTED);
+    RET_ERROR(sts);
 
-    return false;
+    return dst_frame ? dst_frame->Update() : MFX_ERR_NONE;
 }
\ No newline at end of file
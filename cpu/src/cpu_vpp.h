@@ -11,6 +11,7 @@
 #include <vector>
 #include "src/cpu_common.h"
 #include "src/cpu_frame_pool.h"
+#include "src/cpu_task.h"
 #include "src/frame_lock.h"
 
 typedef enum {
@@ -65,6 +66,10 @@ public:
     mfxStatus ProcessFrame(mfxFrameSurface1 *surface_in,
                            mfxFrameSurface1 *surface_out,
                            mfxExtVppAuxData *aux);
+    mfxStatus SubmitFrame(mfxFrameSurface1 *surface_in,
+                          mfxFrameSurface1 *surface_out,
+                          mfxExtVppAuxData *aux,
+                          mfxSyncPoint *syncp);
     mfxStatus GetVideoParam(mfxVideoParam *par);
     mfxStatus GetVPPSurface(mfxFrameSurface1 **surface);
     mfxStatus GetVPPSurfaceOut(mfxFrameSurface1 **surface);
@@ -76,15 +81,18 @@ private:
     AVFilterGraph *m_vpp_graph;
     AVFilterContext *m_buffersrc_ctx;
     AVFilterContext *m_buffersink_ctx;
-    FrameLock m_input_locker;
+    FrameMapCache m_frameMap; // external allocator frames, see RefSurfaceAVFrame()
     AVFrame *m_avVppFrameOut;
+    SwsContext *m_swsContext; // scale and csc into the output surface, null if not needed
 
     mfxU32 m_vppFunc;
     mfxVideoParam m_param;
+    mfxExtCPUSurfacePool m_extSurfacePool;
     std::unique_ptr<CpuFramePool> m_vppSurfacesIn;
     std::unique_ptr<CpuFramePool> m_vppSurfacesOut;
 
     bool InitFilters(void);
+    bool InitScaler(void);
     void CloseFilterPads(AVFilterInOut *src_out, AVFilterInOut *sink_in);
     static mfxStatus CheckIOPattern_AndSetIOMemTypes(mfxU16 IOPattern,
                                                      mfxU16 *pInMemType,
@@ -114,8 +122,11 @@ private:
     void GetDoNotUseFilterList(mfxVideoParam *par, mfxU32 **ppList, mfxU32 *pLen);
     bool CheckFilterList(mfxU32 *pList, mfxU32 count, bool bDoUseTable);
     mfxStatus CheckExtParam(mfxExtBuffer **ppExtParam, mfxU16 count);
-    bool NeedWAForAlignment(mfxFrameInfo *fi, int *linesize);
+    mfxStatus PrepareOutputBuffer(CpuFrame *frame);
+    mfxStatus WriteOutputFrame(mfxFrameSurface1 *surface_out, AVFrame *frame);
+    static bool HasSinglePitch(AVFrame *frame);
 
+    CpuTaskQueue m_taskQueue;
     CpuWorkstream *m_session;
 
     /* copy not allowed */
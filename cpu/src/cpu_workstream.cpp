@@ -5,20 +5,299 @@
   ############################################################################*/
 
 #include "src/cpu_workstream.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include "src/cpu_buffer_cache.h"
 #include "src/cpu_common.h"
 
+// finished tasks which were never synchronized are dropped beyond this count
+#define MAX_SYNC_POINTS 1024
+
+// sync point ids are unique across sessions, so joined sessions can share them
+static std::atomic<mfxU64> s_lastSyncPoint(0);
+
+// protects the parent/child links of all sessions
+static std::mutex s_joinMutex;
+
 CpuWorkstream::CpuWorkstream()
         : m_decode(),
           m_encode(),
           m_vpp(),
           m_decvpp(),
           m_allocator(),
-          m_handles() {
+          m_handles(),
+          m_memoryInterface(),
+          m_memoryStats(std::make_shared<CpuMemoryStats>()),
+          m_syncMutex(),
+          m_syncPoints(),
+          m_surfaceTasks(),
+          m_threadPool(CpuThreadPool::GetShared()),
+          m_priority(MFX_PRIORITY_NORMAL),
+          m_parent(nullptr),
+          m_children() {
     av_log_set_level(AV_LOG_QUIET);
+    m_threadPool->AddClient();
+
+    m_memoryInterface.Context            = (mfxHDL)this;
+    m_memoryInterface.Version.Version    = MFX_CPU_MEMORY_INTERFACE_VERSION;
+    m_memoryInterface.ImportFrameSurface = ImportFrameSurface;
+    m_memoryInterface.GetMemoryStats     = GetMemoryStats;
+
+    m_handles[MFX_HANDLE_CPU_MEMORY_INTERFACE] = &m_memoryInterface;
 }
 
-CpuWorkstream::~CpuWorkstream() {}
+CpuWorkstream::~CpuWorkstream() {
+    // components use the thread pool, release them first
+    m_decvpp.reset();
+    m_vpp.reset();
+    m_encode.reset();
+    m_decode.reset();
+
+    if (m_parent)
+        Disjoin();
+    m_threadPool->RemoveClient();
+}
+
+mfxStatus CpuWorkstream::InitExtParam(mfxExtBuffer **extParam, mfxU16 numExtParam) {
+    if (!extParam)
+        return MFX_ERR_NONE;
+
+    // buffers meant for other implementations (e.g. mfxExtThreadsParam) are ignored
+    for (mfxU16 i = 0; i < numExtParam; i++) {
+        RET_IF_FALSE(extParam[i], MFX_ERR_NULL_PTR);
+        if (extParam[i]->BufferId == MFX_EXTBUFF_CPU_BUFFER_CACHE) {
+            RET_IF_FALSE(extParam[i]->BufferSz == sizeof(mfxExtCPUBufferCache),
+                         MFX_ERR_INVALID_VIDEO_PARAM);
+            mfxExtCPUBufferCache *cache = reinterpret_cast<mfxExtCPUBufferCache *>(extParam[i]);
+            CpuBufferCache::GetShared()->SetMaxBytes(cache->MaxBytes);
+            continue;
+        }
+        if (extParam[i]->BufferId != MFX_EXTBUFF_CPU_AFFINITY)
+            continue;
+
+        RET_IF_FALSE(extParam[i]->BufferSz == sizeof(mfxExtCPUAffinity),
+                     MFX_ERR_INVALID_VIDEO_PARAM);
+        mfxExtCPUAffinity *affinity = reinterpret_cast<mfxExtCPUAffinity *>(extParam[i]);
+
+        std::vector<mfxU32> cpus;
+        for (mfxU32 cpu = 0; cpu < sizeof(affinity->CpuMask) * 8; cpu++) {
+            if (affinity->CpuMask[cpu / 64] & (1ULL << (cpu % 64)))
+                cpus.push_back(cpu);
+        }
+        if (cpus.empty() && affinity->NumaNode != MFX_CPU_NUMA_NODE_ANY)
+            cpus = CpuThreadPool::GetNumaNodeCpus(affinity->NumaNode);
+        RET_IF_FALSE(!cpus.empty() || affinity->NumaNode == MFX_CPU_NUMA_NODE_ANY,
+                     MFX_ERR_UNSUPPORTED);
+
+        std::shared_ptr<CpuThreadPool> pool = CpuThreadPool::GetShared(cpus);
+        pool->AddClient();
+        m_threadPool->RemoveClient();
+        m_threadPool = pool;
+    }
+
+    return MFX_ERR_NONE;
+}
+
+mfxSyncPoint CpuWorkstream::AddSyncPoint(std::shared_ptr<CpuTask> task) {
+    std::lock_guard<std::mutex> lock(m_syncMutex);
+
+    if (m_syncPoints.size() >= MAX_SYNC_POINTS) {
+        for (auto it = m_syncPoints.begin(); it != m_syncPoints.end();) {
+            if (it->second->IsDone())
+                it = m_syncPoints.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    // sync points are opaque ids, never 0
+    mfxSyncPoint syncp  = reinterpret_cast<mfxSyncPoint>(static_cast<uintptr_t>(++s_lastSyncPoint));
+    m_syncPoints[syncp] = task;
+
+    return syncp;
+}
+
+std::shared_ptr<CpuTask> CpuWorkstream::FindSyncPoint(mfxSyncPoint syncp, bool bRemove) {
+    std::lock_guard<std::mutex> lock(m_syncMutex);
+
+    auto it = m_syncPoints.find(syncp);
+    if (it == m_syncPoints.end())
+        return nullptr;
+
+    std::shared_ptr<CpuTask> task = it->second;
+    if (bRemove)
+        m_syncPoints.erase(it);
+
+    return task;
+}
+
+// internal surfaces keep the task themselves, application surfaces are
+//   looked up by address
+// mfxFrameSurfaceInterface::OnComplete is called once the task is done
+void CpuWorkstream::SetSurfaceTask(mfxFrameSurface1 *surface, std::shared_ptr<CpuTask> task) {
+    if (surface->Version.Version >= MFX_FRAMESURFACE1_VERSION && surface->FrameInterface &&
+        surface->FrameInterface->OnComplete) {
+        // the task holds its own reference while it is running, not until it returns
+        CpuTask *producer = task.get();
+        TaskLockSurface(surface);
+        auto notify = [surface, producer]() {
+            surface->FrameInterface->OnComplete(producer->GetStatus());
+            TaskUnlockSurface(surface);
+        };
+        if (!task->AddContinuation(notify))
+            notify();
+    }
+
+    CpuFrame *cpu_frame = CpuFrame::TryCast(surface);
+    if (cpu_frame) {
+        cpu_frame->SetTask(task);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_syncMutex);
+
+    // the application does not tell when it stops using a surface,
+    //   forget the producers which are done
+    for (auto it = m_surfaceTasks.begin(); it != m_surfaceTasks.end();) {
+        if (it->second->IsDone())
+            it = m_surfaceTasks.erase(it);
+        else
+            ++it;
+    }
+    if (!task->IsDone())
+        m_surfaceTasks[surface] = task;
+}
+
+std::shared_ptr<CpuTask> CpuWorkstream::GetSurfaceTask(mfxFrameSurface1 *surface) {
+    CpuFrame *cpu_frame = CpuFrame::TryCast(surface);
+    if (cpu_frame)
+        return cpu_frame->GetTask();
+
+    std::lock_guard<std::mutex> lock(m_syncMutex);
+
+    auto it = m_surfaceTasks.find(surface);
+    if (it == m_surfaceTasks.end())
+        return nullptr;
+
+    return it->second;
+}
+
+mfxStatus CpuWorkstream::ImportFrameSurface(mfxCPUMemoryInterface *memory_interface,
+                                            const mfxCPUSurfaceSystem *external_surface,
+                                            mfxFrameSurface1 **imported_surface) {
+    RET_IF_FALSE(memory_interface && external_surface && imported_surface, MFX_ERR_NULL_PTR);
+    RET_IF_FALSE(memory_interface->Context, MFX_ERR_INVALID_HANDLE);
+
+    // the frame is owned by its references, not by the session, so it
+    //   may outlive the session while an application or libav holds it
+    auto frame = std::make_unique<CpuFrame>(nullptr);
+    RET_ERROR(frame->ImportSystemMemory(*external_surface));
+
+    *imported_surface = frame.release();
+    (*imported_surface)->FrameInterface->AddRef(*imported_surface);
+
+    return MFX_ERR_NONE;
+}
+
+mfxStatus CpuWorkstream::GetMemoryStats(mfxCPUMemoryInterface *memory_interface,
+                                        mfxCPUMemoryStats *stats) {
+    RET_IF_FALSE(memory_interface && stats, MFX_ERR_NULL_PTR);
+    RET_IF_FALSE(memory_interface->Context, MFX_ERR_INVALID_HANDLE);
+
+    CpuWorkstream *session = static_cast<CpuWorkstream *>(memory_interface->Context);
+    session->m_memoryStats->GetStats(stats);
+
+    return MFX_ERR_NONE;
+}
+
+// this session first, then the rest of its join group
+// must be called with s_joinMutex held
+std::vector<CpuWorkstream *> CpuWorkstream::GetJoinedSessions() {
+    std::vector<CpuWorkstream *> sessions = { this };
+
+    CpuWorkstream *root = m_parent ? m_parent : this;
+    if (root != this)
+        sessions.push_back(root);
+    for (CpuWorkstream *child : root->m_children) {
+        if (child != this)
+            sessions.push_back(child);
+    }
+
+    return sessions;
+}
 
 mfxStatus CpuWorkstream::Sync(mfxSyncPoint &syncp, mfxU32 wait) {
+    RET_IF_FALSE(syncp, MFX_ERR_NULL_PTR);
+
+    std::shared_ptr<CpuTask> task;
+    {
+        std::lock_guard<std::mutex> lock(s_joinMutex);
+        for (CpuWorkstream *ws : GetJoinedSessions()) {
+            task = ws->FindSyncPoint(syncp, false);
+            if (task)
+                break;
+        }
+    }
+
+    // already synchronized (or retired) - the task has completed
+    if (!task)
+        return MFX_ERR_NONE;
+
+    mfxStatus sts = task->Wait(wait);
+    if (sts != MFX_WRN_IN_EXECUTION) {
+        std::lock_guard<std::mutex> lock(s_joinMutex);
+        for (CpuWorkstream *ws : GetJoinedSessions()) {
+            if (ws->FindSyncPoint(syncp, true))
+                break;
+        }
+    }
+
+    return sts;
+}
+
+mfxStatus CpuWorkstream::SetPriority(mfxPriority priority) {
+    RET_IF_FALSE(priority >= MFX_PRIORITY_LOW && priority <= MFX_PRIORITY_HIGH,
+                 MFX_ERR_UNSUPPORTED);
+    m_priority = priority;
+    return MFX_ERR_NONE;
+}
+
+mfxStatus CpuWorkstream::Join(CpuWorkstream *child) {
+    RET_IF_FALSE(child, MFX_ERR_INVALID_HANDLE);
+
+    std::lock_guard<std::mutex> lock(s_joinMutex);
+
+    // only one level of joining, a session belongs to at most one group
+    RET_IF_FALSE(child != this, MFX_ERR_UNDEFINED_BEHAVIOR);
+    RET_IF_FALSE(!m_parent, MFX_ERR_UNDEFINED_BEHAVIOR);
+    RET_IF_FALSE(!child->m_parent && child->m_children.empty(), MFX_ERR_UNDEFINED_BEHAVIOR);
+    RET_IF_FALSE(child->m_threadPool == m_threadPool, MFX_ERR_UNSUPPORTED);
+
+    child->m_parent = this;
+    m_children.push_back(child);
+
+    // the group shares one thread budget
+    m_threadPool->RemoveClient();
+
     return MFX_ERR_NONE;
 }
+
+mfxStatus CpuWorkstream::Disjoin() {
+    std::lock_guard<std::mutex> lock(s_joinMutex);
+
+    RET_IF_FALSE(m_parent, MFX_ERR_UNDEFINED_BEHAVIOR);
+
+    std::vector<CpuWorkstream *> &siblings = m_parent->m_children;
+    siblings.erase(std::remove(siblings.begin(), siblings.end(), this), siblings.end());
+    m_parent = nullptr;
+
+    m_threadPool->AddClient();
+
+    return MFX_ERR_NONE;
+}
+
+bool CpuWorkstream::HasChildren() {
+    std::lock_guard<std::mutex> lock(s_joinMutex);
+    return !m_children.empty();
+}
@@ -7,14 +7,20 @@
 #ifndef CPU_SRC_CPU_WORKSTREAM_H_
 #define CPU_SRC_CPU_WORKSTREAM_H_
 
+#include <atomic>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <vector>
 #include "src/cpu_common.h"
 #include "src/cpu_decode.h"
 #include "src/cpu_decodevpp.h"
 #include "src/cpu_encode.h"
 #include "src/cpu_frame.h"
 #include "src/cpu_frame_pool.h"
+#include "src/cpu_memory_stats.h"
+#include "src/cpu_task.h"
+#include "src/cpu_thread_pool.h"
 #include "src/cpu_vpp.h"
 
 class CpuWorkstream {
@@ -48,8 +54,52 @@ public:
         return m_decvpp.get();
     }
 
+    // register a submitted task and return the sync point the application waits on
+    mfxSyncPoint AddSyncPoint(std::shared_ptr<CpuTask> task);
     mfxStatus Sync(mfxSyncPoint &syncp, mfxU32 wait);
 
+    // track the task writing a surface, so the next stage of a pipeline
+    //   (e.g. encode of a VPP output) can depend on it instead of the
+    //   application waiting for a sync point in between
+    void SetSurfaceTask(mfxFrameSurface1 *surface, std::shared_ptr<CpuTask> task);
+    std::shared_ptr<CpuTask> GetSurfaceTask(mfxFrameSurface1 *surface);
+
+    // apply session extension buffers given to MFXInitEx/MFXInitialize
+    // must be called before any component is created
+    mfxStatus InitExtParam(mfxExtBuffer **extParam, mfxU16 numExtParam);
+
+    std::shared_ptr<CpuThreadPool> GetThreadPool() {
+        return m_threadPool;
+    }
+
+    // memory the components of this session allocated, see mfxCPUMemoryStats
+    std::shared_ptr<CpuMemoryStats> GetMemoryStats() {
+        return m_memoryStats;
+    }
+
+    // number of threads libav may create for one component of this session
+    mfxU32 GetThreadBudget() {
+        return m_threadPool->GetThreadBudget();
+    }
+
+    // MFXSetPriority/MFXGetPriority
+    // queued work of the session is scheduled by this priority, libav threads
+    //   take the priority in effect when the codec is initialized
+    mfxStatus SetPriority(mfxPriority priority);
+    mfxPriority GetPriority() {
+        return m_priority;
+    }
+    const std::atomic<mfxPriority> *GetPriorityRef() {
+        return &m_priority;
+    }
+
+    // MFXJoinSession/MFXDisjoinSession
+    // joined sessions count as one client of the thread pool and can
+    //   synchronize each other's sync points
+    mfxStatus Join(CpuWorkstream *child);
+    mfxStatus Disjoin();
+    bool HasChildren();
+
     mfxStatus SetFrameAllocator(mfxFrameAllocator *allocator) {
         RET_IF_FALSE(allocator, MFX_ERR_NULL_PTR);
         m_allocator = *allocator;
@@ -76,6 +126,13 @@ public:
     }
 
 private:
+    // mfxCPUMemoryInterface
+    static mfxStatus ImportFrameSurface(mfxCPUMemoryInterface *memory_interface,
+                                        const mfxCPUSurfaceSystem *external_surface,
+                                        mfxFrameSurface1 **imported_surface);
+    static mfxStatus GetMemoryStats(mfxCPUMemoryInterface *memory_interface,
+                                    mfxCPUMemoryStats *stats);
+
     std::unique_ptr<CpuDecode> m_decode;
     std::unique_ptr<CpuEncode> m_encode;
     std::unique_ptr<CpuVPP> m_vpp;
@@ -83,6 +140,20 @@ private:
 
     mfxFrameAllocator m_allocator;
     std::map<mfxHandleType, mfxHDL> m_handles;
+    mfxCPUMemoryInterface m_memoryInterface;
+    std::shared_ptr<CpuMemoryStats> m_memoryStats;
+
+    std::mutex m_syncMutex;
+    std::map<mfxSyncPoint, std::shared_ptr<CpuTask>> m_syncPoints;
+    std::map<mfxFrameSurface1 *, std::shared_ptr<CpuTask>> m_surfaceTasks;
+
+    std::shared_ptr<CpuThreadPool> m_threadPool;
+    std::atomic<mfxPriority> m_priority;
+    CpuWorkstream *m_parent;
+    std::vector<CpuWorkstream *> m_children;
+
+    std::shared_ptr<CpuTask> FindSyncPoint(mfxSyncPoint syncp, bool bRemove);
+    std::vector<CpuWorkstream *> GetJoinedSessions();
 
     /* copy not allowed */
     CpuWorkstream(const CpuWorkstream &);
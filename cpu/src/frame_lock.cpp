@@ -5,12 +5,35 @@
   ############################################################################*/
 
 #include "src/frame_lock.h"
+#include <memory>
 #include "src/cpu_frame.h"
 
+FrameMapCache::FrameMapCache() : m_mutex(), m_allocator(), m_frames() {}
+
+FrameMapCache::~FrameMapCache() {
+    for (auto &frame : m_frames)
+        m_allocator.Unlock(m_allocator.pthis, frame.first, &frame.second);
+}
+
+mfxStatus FrameMapCache::Lock(mfxFrameAllocator *allocator, mfxMemId memId, mfxFrameData **data) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_frames.find(memId);
+    if (it == m_frames.end()) {
+        mfxFrameData locked = { 0 };
+        RET_ERROR(allocator->Lock(allocator->pthis, memId, &locked));
+        m_allocator = *allocator;
+        it          = m_frames.emplace(memId, locked).first;
+    }
+    *data = &it->second;
+    return MFX_ERR_NONE;
+}
+
 FrameLock::FrameLock()
         : m_surface(nullptr),
           m_allocator(nullptr),
           m_newapi(false),
+          m_cached(false),
           m_data(nullptr),
           m_locked_data({ 0 }),
           mem_id(0),
@@ -23,13 +46,22 @@ FrameLock::~FrameLock() {
     }
 }
 
-mfxStatus FrameLock::Lock(mfxFrameSurface1 *surface, mfxU32 flags, mfxFrameAllocator *allocator) {
+mfxStatus FrameLock::Lock(mfxFrameSurface1 *surface,
+                          mfxU32 flags,
+                          mfxFrameAllocator *allocator,
+                          FrameMapCache *cache) {
     Unlock();
 
     m_surface   = surface;
     m_allocator = allocator;
     m_newapi    = surface->Version.Version >= MFX_FRAMESURFACE1_VERSION && surface->FrameInterface;
-    if (allocator && allocator->pthis) {
+    m_cached    = false;
+    if (allocator && allocator->pthis && cache) {
+        RET_ERROR(cache->Lock(allocator, surface->Data.MemId, &m_data));
+        IncrementLocked(&surface->Data);
+        m_cached = true;
+    }
+    else if (allocator && allocator->pthis) {
         mem_id = surface->Data.MemId;
         RET_ERROR(allocator->Lock(allocator->pthis, mem_id, &m_locked_data));
         m_data = &m_locked_data;
@@ -40,7 +72,7 @@ mfxStatus FrameLock::Lock(mfxFrameSurface1 *surface, mfxU32 flags, mfxFrameAlloc
             surface->FrameInterface->AddRef(surface);
         }
         else {
-            surface->Data.Locked++; // TODO(make atomic)
+            IncrementLocked(&surface->Data);
         }
         m_data = &surface->Data;
     }
@@ -51,7 +83,10 @@ mfxStatus FrameLock::Lock(mfxFrameSurface1 *surface, mfxU32 flags, mfxFrameAlloc
 void FrameLock::Unlock() {
     VPL_TRACE_FUNC;
     if (m_data) {
-        if (m_allocator && m_allocator->pthis) {
+        if (m_cached) {
+            DecrementLocked(&m_surface->Data);
+        }
+        else if (m_allocator && m_allocator->pthis) {
             m_allocator->Unlock(m_allocator->pthis, mem_id, m_data);
         }
         else if (m_surface) {
@@ -60,7 +95,7 @@ void FrameLock::Unlock() {
                 m_surface->FrameInterface->Release(m_surface);
             }
             else {
-                m_surface->Data.Locked--; // TODO(make atomic)
+                DecrementLocked(&m_surface->Data);
             }
         }
         m_data = nullptr;
@@ -73,7 +108,8 @@ mfxFrameData *FrameLock::GetData() {
 
 AVFrame *FrameLock::GetAVFrame(mfxFrameSurface1 *surface,
                                mfxU32 flags,
-                               mfxFrameAllocator *allocator) {
+                               mfxFrameAllocator *allocator,
+                               FrameMapCache *cache) {
     VPL_TRACE_FUNC;
     RET_IF_FALSE(surface, nullptr);
 
@@ -96,7 +132,7 @@ AVFrame *FrameLock::GetAVFrame(mfxFrameSurface1 *surface,
     }
 
     // Lock and convert to AVFrame
-    RET_IF_FALSE(Lock(surface, flags, allocator) >= 0, nullptr);
+    RET_IF_FALSE(Lock(surface, flags, allocator, cache) >= 0, nullptr);
 
     if (!m_avframe) {
         m_avframe = av_frame_alloc();
@@ -121,10 +157,13 @@ AVFrame *FrameLock::GetAVFrame(mfxFrameSurface1 *surface,
     switch (info->FourCC) {
         case MFX_FOURCC_I420:
         case MFX_FOURCC_I010:
+        case MFX_FOURCC_I422:
+        case MFX_FOURCC_I210:
             m_avframe->linesize[1] = m_data->Pitch / 2;
             m_avframe->linesize[2] = m_data->Pitch / 2;
             break;
         case MFX_FOURCC_NV12:
+        case MFX_FOURCC_P010:
             m_avframe->linesize[1] = m_data->Pitch;
             break;
         case MFX_FOURCC_YUY2:
@@ -136,3 +175,51 @@ AVFrame *FrameLock::GetAVFrame(mfxFrameSurface1 *surface,
 
     return m_avframe;
 }
+
+static void FreeFrameLock(void *opaque, uint8_t *data) {
+    delete static_cast<FrameLock *>(opaque);
+}
+
+AVFrame *RefSurfaceAVFrame(mfxFrameSurface1 *surface,
+                           mfxU32 flags,
+                           mfxFrameAllocator *allocator,
+                           FrameMapCache *cache) {
+    RET_IF_FALSE(surface, nullptr);
+
+    // runtime surfaces are reference-counted already, the pool does not
+    //   reuse them while libav holds a reference
+    CpuFrame *cpu_frame = CpuFrame::TryCast(surface);
+    if (cpu_frame && cpu_frame->GetAVFrame() && cpu_frame->GetAVFrame()->buf[0])
+        return av_frame_clone(cpu_frame->GetAVFrame());
+
+    auto lock     = std::make_unique<FrameLock>();
+    AVFrame *view = lock->GetAVFrame(surface, flags, allocator, cache);
+    RET_IF_FALSE(view, nullptr);
+
+    AVFrame *frame = av_frame_alloc();
+    RET_IF_FALSE(frame, nullptr);
+    frame->format = view->format;
+    frame->width  = view->width;
+    frame->height = view->height;
+    for (int i = 0; i < AV_NUM_DATA_POINTERS; i++) {
+        frame->data[i]     = view->data[i];
+        frame->linesize[i] = view->linesize[i];
+    }
+    frame->extended_data = frame->data;
+
+    // the buffer owns the lock, the image is not copied - it spans all
+    //   planes, so a copy of the data of any plane keeps the surface locked
+    uint8_t *start = nullptr;
+    size_t size    = GetImageSpan(frame, surface->Info.Height, &start);
+    frame->buf[0]  = av_buffer_create(start,
+                                     size,
+                                     FreeFrameLock,
+                                     lock.get(),
+                                     (flags & MFX_MAP_WRITE) ? 0 : AV_BUFFER_FLAG_READONLY);
+    if (!frame->buf[0]) {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+    lock.release();
+    return frame;
+}
@@ -7,31 +7,68 @@
 #ifndef CPU_SRC_FRAME_LOCK_H_
 #define CPU_SRC_FRAME_LOCK_H_
 
+#include <map>
+#include <mutex>
 #include "src/cpu_common.h"
 
+// Keeps the frames of an external allocator locked while a component uses
+// them, so allocator->Lock runs once per MemId instead of once per frame.
+// The MemIds are unlocked when the cache is destroyed (component Close),
+// the application must not free them before.
+class FrameMapCache {
+public:
+    FrameMapCache();
+    ~FrameMapCache();
+
+    // data of memId, locked on first use
+    mfxStatus Lock(mfxFrameAllocator *allocator, mfxMemId memId, mfxFrameData **data);
+
+private:
+    std::mutex m_mutex;
+    mfxFrameAllocator m_allocator;
+    std::map<mfxMemId, mfxFrameData> m_frames;
+
+    /* copy not allowed */
+    FrameMapCache(const FrameMapCache &);
+    FrameMapCache &operator=(const FrameMapCache &);
+};
+
 class FrameLock {
 public:
     FrameLock();
     ~FrameLock();
 
+    // with a cache, allocator frames stay locked in the cache and
+    //   Data.Locked of the surface is raised instead
     mfxStatus Lock(mfxFrameSurface1 *surface,
                    mfxU32 flags                 = 0,
-                   mfxFrameAllocator *allocator = nullptr);
+                   mfxFrameAllocator *allocator = nullptr,
+                   FrameMapCache *cache         = nullptr);
     void Unlock();
 
     mfxFrameData *GetData();
     AVFrame *GetAVFrame(mfxFrameSurface1 *surface,
                         mfxU32 flags                 = 0,
-                        mfxFrameAllocator *allocator = nullptr);
+                        mfxFrameAllocator *allocator = nullptr,
+                        FrameMapCache *cache         = nullptr);
 
 private:
     mfxFrameSurface1 *m_surface;
     mfxFrameAllocator *m_allocator;
     bool m_newapi;
+    bool m_cached;
     mfxFrameData *m_data;
     mfxFrameData m_locked_data;
     mfxMemId mem_id;
     AVFrame *m_avframe;
 };
 
+// Reference-counted AVFrame of the surface image, libav may keep it (e.g. for
+// encoder reordering) without copying. The surface stays locked until the last
+// reference is released, free the returned frame with av_frame_free().
+AVFrame *RefSurfaceAVFrame(mfxFrameSurface1 *surface,
+                           mfxU32 flags,
+                           mfxFrameAllocator *allocator,
+                           FrameMapCache *cache);
+
 #endif // CPU_SRC_FRAME_LOCK_H_
@@ -0,0 +1,904 @@
+/*############################################################################
+  # Copyright (C) 2020 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#include "src/header_parser.h"
+#include <climits>
+#include <cstring>
+#include <vector>
+
+// Reads a bitstream most significant bit first. Reads past the end return
+// zero bits and set the error flag, so the parsers check it once at the end.
+class BitReader {
+public:
+    BitReader(const mfxU8 *data, size_t size)
+            : m_data(data),
+              m_size(size),
+              m_pos(0),
+              m_bError(false) {}
+
+    // n is at most 32
+    mfxU32 GetBits(int n) {
+        mfxU32 value = 0;
+        for (int i = 0; i < n; i++, m_pos++) {
+            mfxU32 bit = 0;
+            if (m_pos < m_size * 8)
+                bit = (m_data[m_pos >> 3] >> (7 - (m_pos & 7))) & 1;
+            else
+                m_bError = true;
+            value = (value << 1) | bit;
+        }
+        return value;
+    }
+
+    bool GetFlag() {
+        return GetBits(1) != 0;
+    }
+
+    void SkipBits(size_t n) {
+        m_pos += n;
+        if (m_pos > m_size * 8)
+            m_bError = true;
+    }
+
+    // ue(v) of AVC and HEVC
+    mfxU32 GetUE() {
+        int zeros = 0;
+        while (!GetFlag()) {
+            if (m_bError || ++zeros > 31) {
+                m_bError = true;
+                return 0;
+            }
+        }
+        return (1u << zeros) - 1 + GetBits(zeros);
+    }
+
+    // se(v) of AVC and HEVC
+    mfxI32 GetSE() {
+        mfxU32 value = GetUE();
+        return (value & 1) ? static_cast<mfxI32>((value + 1) >> 1)
+                           : -static_cast<mfxI32>(value >> 1);
+    }
+
+    // uvlc() of AV1, values which do not fit 32 bits are an error here
+    mfxU32 GetUVLC() {
+        return GetUE();
+    }
+
+    // leb128() of AV1
+    mfxU64 GetLEB128() {
+        mfxU64 value = 0;
+        for (int i = 0; i < 8; i++) {
+            mfxU32 byte = GetBits(8);
+            value |= static_cast<mfxU64>(byte & 0x7f) << (i * 7);
+            if (!(byte & 0x80))
+                return value;
+        }
+        m_bError = true;
+        return 0;
+    }
+
+    size_t GetBytePos() const {
+        return (m_pos + 7) / 8;
+    }
+
+    bool IsError() const {
+        return m_bError;
+    }
+
+private:
+    const mfxU8 *m_data;
+    size_t m_size;
+    size_t m_pos; // in bits
+    bool m_bError;
+};
+
+// sample aspect ratios of aspect_ratio_idc 0 to 16 of AVC and HEVC
+static const AVRational AspectRatios[] = {
+    { 0, 1 },   { 1, 1 },   { 12, 11 }, { 10, 11 }, { 16, 11 }, { 40, 33 },
+    { 24, 11 }, { 20, 11 }, { 32, 11 }, { 80, 33 }, { 18, 11 }, { 15, 11 },
+    { 64, 33 }, { 160, 99 }, { 4, 3 },  { 3, 2 },   { 2, 1 },
+};
+
+// display aspect ratios of aspect_ratio_information of MPEG-2
+static const AVRational MPEG2AspectRatios[] = {
+    { 0, 1 }, { 1, 1 }, { 4, 3 }, { 16, 9 }, { 221, 100 },
+};
+
+// frame rates of frame_rate_code of MPEG-2
+static const AVRational MPEG2FrameRates[] = {
+    { 0, 0 },  { 24000, 1001 }, { 24, 1 }, { 25, 1 }, { 30000, 1001 },
+    { 30, 1 }, { 50, 1 }, { 60000, 1001 }, { 60, 1 },
+};
+
+// frames the libav decoders (except mjpeg) output for chroma format and
+//   bit depth, AV_PIX_FMT_NONE stands for the formats which have no FourCC
+//   in GetVideoParam() either
+static AVPixelFormat GetPixelFormat(mfxU16 chromaFormat, int bitDepth, bool fullRange) {
+    if (chromaFormat == MFX_CHROMAFORMAT_YUV420) {
+        if (bitDepth == 8)
+            return fullRange ? AV_PIX_FMT_YUVJ420P : AV_PIX_FMT_YUV420P;
+        if (bitDepth == 10)
+            return AV_PIX_FMT_YUV420P10LE;
+    }
+    else if (chromaFormat == MFX_CHROMAFORMAT_YUV422) {
+        if (bitDepth == 8)
+            return fullRange ? AV_PIX_FMT_YUVJ422P : AV_PIX_FMT_YUV422P;
+        if (bitDepth == 10)
+            return AV_PIX_FMT_YUV422P10LE;
+    }
+    return AV_PIX_FMT_NONE;
+}
+
+// next NAL unit of an Annex B byte stream from *offset on, with the
+//   emulation prevention bytes removed, false if there is none
+static bool GetNextNalUnit(const mfxU8 *data,
+                           mfxU32 size,
+                           mfxU32 *offset,
+                           std::vector<mfxU8> *rbsp) {
+    mfxU32 pos = *offset;
+    while (pos + 3 <= size && !(data[pos] == 0 && data[pos + 1] == 0 && data[pos + 2] == 1))
+        pos++;
+    if (pos + 3 > size)
+        return false;
+    pos += 3;
+
+    rbsp->clear();
+    int zeros = 0;
+    for (; pos < size; pos++) {
+        // the next start code, or the zero byte before it
+        if (zeros >= 2 && data[pos] <= 1) {
+            pos -= 2;
+            break;
+        }
+        if (zeros >= 2 && data[pos] == 3) { // emulation_prevention_three_byte
+            zeros = 0;
+            continue;
+        }
+        zeros = data[pos] ? 0 : zeros + 1;
+        rbsp->push_back(data[pos]);
+    }
+
+    // the RBSP ends with a stop bit, zero bytes after it are trailing_zero_8bits
+    while (!rbsp->empty() && !rbsp->back())
+        rbsp->pop_back();
+
+    *offset = pos;
+    return true;
+}
+
+// aspect_ratio_info to chroma_loc_info of the VUI of AVC and HEVC
+static void ParseVuiFormat(BitReader *br, AVRational *aspectRatio, bool *fullRange) {
+    if (br->GetFlag()) { // aspect_ratio_info_present_flag
+        mfxU32 idc = br->GetBits(8);
+        if (idc == 255) { // EXTENDED_SAR
+            aspectRatio->num = br->GetBits(16);
+            aspectRatio->den = br->GetBits(16);
+        }
+        else if (idc < sizeof(AspectRatios) / sizeof(AspectRatios[0])) {
+            *aspectRatio = AspectRatios[idc];
+        }
+    }
+    if (br->GetFlag()) // overscan_info_present_flag
+        br->SkipBits(1);
+    if (br->GetFlag()) { // video_signal_type_present_flag
+        br->SkipBits(3); // video_format
+        *fullRange = br->GetFlag();
+        if (br->GetFlag()) // colour_description_present_flag
+            br->SkipBits(24);
+    }
+    if (br->GetFlag()) { // chroma_loc_info_present_flag
+        br->GetUE();
+        br->GetUE();
+    }
+}
+
+static void SkipAVCScalingList(BitReader *br, int size) {
+    int lastScale = 8;
+    int nextScale = 8;
+    for (int i = 0; i < size; i++) {
+        if (nextScale != 0)
+            nextScale = (lastScale + br->GetSE() + 256) % 256;
+        lastScale = (nextScale == 0) ? lastScale : nextScale;
+    }
+}
+
+static mfxStatus ParseAVCSequenceParameterSet(BitReader *br, StreamHeader *header) {
+    int profileIdc  = br->GetBits(8);
+    int constraints = br->GetBits(8);
+    int levelIdc    = br->GetBits(8);
+    br->GetUE(); // seq_parameter_set_id
+
+    mfxU32 chromaFormatIdc = 1;
+    mfxU32 bitDepth        = 8;
+    if (profileIdc == 100 || profileIdc == 110 || profileIdc == 122 || profileIdc == 244 ||
+        profileIdc == 44 || profileIdc == 83 || profileIdc == 86 || profileIdc == 118 ||
+        profileIdc == 128 || profileIdc == 138 || profileIdc == 139 || profileIdc == 134 ||
+        profileIdc == 135) {
+        chromaFormatIdc = br->GetUE();
+        RET_IF_FALSE(chromaFormatIdc <= 3, MFX_ERR_UNSUPPORTED);
+        if (chromaFormatIdc == 3)
+            RET_IF_FALSE(!br->GetFlag(), MFX_ERR_UNSUPPORTED); // separate_colour_plane_flag
+        bitDepth = br->GetUE() + 8;
+        RET_IF_FALSE(br->GetUE() + 8 == bitDepth, MFX_ERR_UNSUPPORTED); // bit_depth_chroma
+        br->SkipBits(1); // qpprime_y_zero_transform_bypass_flag
+        if (br->GetFlag()) { // seq_scaling_matrix_present_flag
+            for (int i = 0; i < ((chromaFormatIdc != 3) ? 8 : 12); i++) {
+                if (br->GetFlag())
+                    SkipAVCScalingList(br, (i < 6) ? 16 : 64);
+            }
+        }
+    }
+
+    br->GetUE(); // log2_max_frame_num_minus4
+    mfxU32 pocType = br->GetUE();
+    if (pocType == 0) {
+        br->GetUE(); // log2_max_pic_order_cnt_lsb_minus4
+    }
+    else if (pocType == 1) {
+        br->SkipBits(1); // delta_pic_order_always_zero_flag
+        br->GetSE(); // offset_for_non_ref_pic
+        br->GetSE(); // offset_for_top_to_bottom_field
+        mfxU32 cycle = br->GetUE();
+        RET_IF_FALSE(cycle <= 255, MFX_ERR_UNSUPPORTED);
+        for (mfxU32 i = 0; i < cycle; i++)
+            br->GetSE(); // offset_for_ref_frame
+    }
+    else {
+        RET_IF_FALSE(pocType == 2, MFX_ERR_UNSUPPORTED);
+    }
+    br->GetUE(); // max_num_ref_frames
+    br->SkipBits(1); // gaps_in_frame_num_value_allowed_flag
+
+    mfxU32 widthMbs       = br->GetUE() + 1;
+    mfxU32 heightMapUnits = br->GetUE() + 1;
+    bool frameMbsOnly     = br->GetFlag();
+    RET_IF_FALSE(widthMbs <= 1024 && heightMapUnits <= 1024, MFX_ERR_UNSUPPORTED);
+    if (!frameMbsOnly)
+        br->SkipBits(1); // mb_adaptive_frame_field_flag
+    br->SkipBits(1); // direct_8x8_inference_flag
+
+    // in units of chroma samples, of field rows for interlaced streams
+    int64_t cropX = 0;
+    int64_t cropY = 0;
+    if (br->GetFlag()) { // frame_cropping_flag
+        cropX = br->GetUE();
+        cropX += br->GetUE();
+        cropY = br->GetUE();
+        cropY += br->GetUE();
+    }
+    cropX *= (chromaFormatIdc == 1 || chromaFormatIdc == 2) ? 2 : 1;
+    cropY *= ((chromaFormatIdc == 1) ? 2 : 1) * (frameMbsOnly ? 1 : 2);
+
+    AVRational aspectRatio = { 0, 1 };
+    AVRational frameRate   = { 0, 1 };
+    bool fullRange         = false;
+    if (br->GetFlag()) { // vui_parameters_present_flag
+        ParseVuiFormat(br, &aspectRatio, &fullRange);
+        if (br->GetFlag()) { // timing_info_present_flag
+            mfxU32 unitsInTick = br->GetBits(32);
+            mfxU32 timeScale   = br->GetBits(32);
+            // a tick is one field
+            if (unitsInTick && timeScale)
+                av_reduce(&frameRate.den,
+                          &frameRate.num,
+                          2 * static_cast<int64_t>(unitsInTick),
+                          timeScale,
+                          1 << 30);
+        }
+    }
+    RET_IF_FALSE(!br->IsError(), MFX_ERR_MORE_DATA);
+
+    int64_t width  = widthMbs * 16 - cropX;
+    int64_t height = heightMapUnits * 16 * (frameMbsOnly ? 1 : 2) - cropY;
+    RET_IF_FALSE(width > 0 && height > 0, MFX_ERR_UNSUPPORTED);
+
+    // chroma_format_idc has the values of MFX_CHROMAFORMAT_*, monochrome streams
+    //   are decoded to 4:2:0 with neutral chroma
+    mfxU16 chromaFormat = static_cast<mfxU16>(chromaFormatIdc);
+    if (chromaFormat == MFX_CHROMAFORMAT_MONOCHROME)
+        chromaFormat = MFX_CHROMAFORMAT_YUV420;
+
+    header->width       = static_cast<int>(width);
+    header->height      = static_cast<int>(height);
+    header->pixFmt      = GetPixelFormat(chromaFormat, bitDepth, fullRange);
+    header->frameRate   = frameRate;
+    header->aspectRatio = aspectRatio;
+    header->level       = levelIdc;
+
+    // profile with the constraint flags libav adds
+    header->profile = profileIdc;
+    if (profileIdc == FF_PROFILE_H264_BASELINE && (constraints & 0x40))
+        header->profile |= FF_PROFILE_H264_CONSTRAINED;
+    if ((profileIdc == FF_PROFILE_H264_HIGH_10 || profileIdc == FF_PROFILE_H264_HIGH_422 ||
+         profileIdc == FF_PROFILE_H264_HIGH_444_PREDICTIVE) &&
+        (constraints & 0x10))
+        header->profile |= FF_PROFILE_H264_INTRA;
+
+    return MFX_ERR_NONE;
+}
+
+static mfxStatus ParseAVCHeader(const mfxU8 *data, mfxU32 size, StreamHeader *header) {
+    std::vector<mfxU8> rbsp;
+    mfxU32 offset = 0;
+    while (GetNextNalUnit(data, size, &offset, &rbsp)) {
+        if (rbsp.empty() || (rbsp[0] & 0x1f) != 7) // SPS
+            continue;
+
+        BitReader br(rbsp.data() + 1, rbsp.size() - 1);
+        return ParseAVCSequenceParameterSet(&br, header);
+    }
+    return MFX_ERR_MORE_DATA;
+}
+
+// profile_tier_level() of HEVC, profile and level may be null
+static void ParseHEVCProfileTierLevel(BitReader *br,
+                                      mfxU32 maxSubLayersMinus1,
+                                      int *profile,
+                                      int *level) {
+    br->SkipBits(3); // general_profile_space, general_tier_flag
+    mfxU32 profileIdc = br->GetBits(5);
+    br->SkipBits(32 + 48); // compatibility and constraint flags
+    mfxU32 levelIdc = br->GetBits(8);
+
+    bool profilePresent[8] = {};
+    bool levelPresent[8]   = {};
+    for (mfxU32 i = 0; i < maxSubLayersMinus1; i++) {
+        profilePresent[i] = br->GetFlag();
+        levelPresent[i]   = br->GetFlag();
+    }
+    if (maxSubLayersMinus1 > 0)
+        br->SkipBits(2 * (8 - maxSubLayersMinus1)); // reserved_zero_2bits
+    for (mfxU32 i = 0; i < maxSubLayersMinus1; i++) {
+        if (profilePresent[i])
+            br->SkipBits(88);
+        if (levelPresent[i])
+            br->SkipBits(8);
+    }
+
+    if (profile)
+        *profile = profileIdc;
+    if (level)
+        *level = levelIdc;
+}
+
+static void SkipHEVCSubLayerOrderingInfo(BitReader *br, mfxU32 maxSubLayersMinus1) {
+    bool allSubLayers = br->GetFlag();
+    for (mfxU32 i = allSubLayers ? 0 : maxSubLayersMinus1; i <= maxSubLayersMinus1; i++) {
+        br->GetUE(); // max_dec_pic_buffering_minus1
+        br->GetUE(); // max_num_reorder_pics
+        br->GetUE(); // max_latency_increase_plus1
+    }
+}
+
+static void SkipHEVCScalingListData(BitReader *br) {
+    for (int sizeId = 0; sizeId < 4; sizeId++) {
+        for (int matrixId = 0; matrixId < 6; matrixId += (sizeId == 3) ? 3 : 1) {
+            if (!br->GetFlag()) { // scaling_list_pred_mode_flag
+                br->GetUE(); // scaling_list_pred_matrix_id_delta
+                continue;
+            }
+            int coefNum = std::min(64, 1 << (4 + (sizeId << 1)));
+            if (sizeId > 1)
+                br->GetSE(); // scaling_list_dc_coef_minus8
+            for (int i = 0; i < coefNum; i++)
+                br->GetSE(); // scaling_list_delta_coef
+        }
+    }
+}
+
+// st_ref_pic_set(idx) of an HEVC SPS, numDeltaPocs is known for the sets before idx
+static mfxStatus SkipHEVCShortTermRefPicSet(BitReader *br, mfxU32 idx, mfxU32 *numDeltaPocs) {
+    if (idx > 0 && br->GetFlag()) { // inter_ref_pic_set_prediction_flag
+        br->SkipBits(1); // delta_rps_sign
+        br->GetUE(); // abs_delta_rps_minus1
+
+        // use_delta_flag is only coded (and 1 otherwise) if used_by_curr_pic_flag is 0
+        numDeltaPocs[idx] = 0;
+        for (mfxU32 j = 0; j <= numDeltaPocs[idx - 1]; j++) {
+            if (br->GetFlag() || br->GetFlag())
+                numDeltaPocs[idx]++;
+        }
+    }
+    else {
+        mfxU32 numNegative = br->GetUE();
+        mfxU32 numPositive = br->GetUE();
+        RET_IF_FALSE(numNegative <= 16 && numPositive <= 16, MFX_ERR_UNSUPPORTED);
+        for (mfxU32 i = 0; i < numNegative + numPositive; i++) {
+            br->GetUE(); // delta_poc_minus1
+            br->SkipBits(1); // used_by_curr_pic_flag
+        }
+        numDeltaPocs[idx] = numNegative + numPositive;
+    }
+    RET_IF_FALSE(numDeltaPocs[idx] <= 32, MFX_ERR_UNSUPPORTED);
+    return MFX_ERR_NONE;
+}
+
+// timing of the VPS, {num_units_in_tick, time_scale} or 0/0 if it has none
+static AVRational ParseHEVCVideoParameterSet(BitReader *br) {
+    br->SkipBits(4 + 2 + 6); // vps_video_parameter_set_id, base layer flags, max_layers
+    mfxU32 maxSubLayersMinus1 = br->GetBits(3);
+    br->SkipBits(1 + 16); // vps_temporal_id_nesting_flag, vps_reserved_0xffff_16bits
+    ParseHEVCProfileTierLevel(br, maxSubLayersMinus1, nullptr, nullptr);
+    SkipHEVCSubLayerOrderingInfo(br, maxSubLayersMinus1);
+
+    mfxU32 maxLayerId   = br->GetBits(6);
+    mfxU32 numLayerSets = br->GetUE() + 1;
+    if (numLayerSets > 1024)
+        return { 0, 0 };
+    br->SkipBits((numLayerSets - 1) * (maxLayerId + 1)); // layer_id_included_flag
+
+    AVRational timing = { 0, 0 };
+    if (br->GetFlag()) { // vps_timing_info_present_flag
+        timing.num = br->GetBits(32);
+        timing.den = br->GetBits(32);
+    }
+    return br->IsError() ? AVRational{ 0, 0 } : timing;
+}
+
+static mfxStatus ParseHEVCSequenceParameterSet(BitReader *br,
+                                               AVRational vpsTiming,
+                                               StreamHeader *header) {
+    br->SkipBits(4); // sps_video_parameter_set_id
+    mfxU32 maxSubLayersMinus1 = br->GetBits(3);
+    RET_IF_FALSE(maxSubLayersMinus1 <= 6, MFX_ERR_UNSUPPORTED);
+    br->SkipBits(1); // sps_temporal_id_nesting_flag
+
+    int profile = 0;
+    int level   = 0;
+    ParseHEVCProfileTierLevel(br, maxSubLayersMinus1, &profile, &level);
+    br->GetUE(); // sps_seq_parameter_set_id
+
+    mfxU32 chromaFormatIdc = br->GetUE();
+    RET_IF_FALSE(chromaFormatIdc <= 3, MFX_ERR_UNSUPPORTED);
+    if (chromaFormatIdc == 3)
+        RET_IF_FALSE(!br->GetFlag(), MFX_ERR_UNSUPPORTED); // separate_colour_plane_flag
+
+    int64_t width  = br->GetUE();
+    int64_t height = br->GetUE();
+    RET_IF_FALSE(width <= 16384 && height <= 16384, MFX_ERR_UNSUPPORTED);
+    if (br->GetFlag()) { // conformance_window_flag, in units of chroma samples
+        int64_t subWidth  = (chromaFormatIdc == 1 || chromaFormatIdc == 2) ? 2 : 1;
+        int64_t subHeight = (chromaFormatIdc == 1) ? 2 : 1;
+        width -= subWidth * br->GetUE();
+        width -= subWidth * br->GetUE();
+        height -= subHeight * br->GetUE();
+        height -= subHeight * br->GetUE();
+    }
+
+    mfxU32 bitDepth = br->GetUE() + 8;
+    RET_IF_FALSE(br->GetUE() + 8 == bitDepth, MFX_ERR_UNSUPPORTED); // bit_depth_chroma
+    mfxU32 pocLsbBits = br->GetUE() + 4;
+    RET_IF_FALSE(pocLsbBits <= 16, MFX_ERR_UNSUPPORTED);
+    SkipHEVCSubLayerOrderingInfo(br, maxSubLayersMinus1);
+
+    // coding and transform block sizes, max_transform_hierarchy_depth
+    for (int i = 0; i < 6; i++)
+        br->GetUE();
+    if (br->GetFlag() && br->GetFlag()) // scaling_list_enabled, sps_scaling_list_data_present
+        SkipHEVCScalingListData(br);
+    br->SkipBits(2); // amp_enabled_flag, sample_adaptive_offset_enabled_flag
+    if (br->GetFlag()) { // pcm_enabled_flag
+        br->SkipBits(8); // pcm_sample_bit_depth
+        br->GetUE(); // log2_min_pcm_luma_coding_block_size_minus3
+        br->GetUE(); // log2_diff_max_min_pcm_luma_coding_block_size
+        br->SkipBits(1); // pcm_loop_filter_disabled_flag
+    }
+
+    mfxU32 numShortTermRefPicSets = br->GetUE();
+    RET_IF_FALSE(numShortTermRefPicSets <= 64, MFX_ERR_UNSUPPORTED);
+    mfxU32 numDeltaPocs[64] = {};
+    for (mfxU32 i = 0; i < numShortTermRefPicSets; i++)
+        RET_ERROR(SkipHEVCShortTermRefPicSet(br, i, numDeltaPocs));
+    if (br->GetFlag()) { // long_term_ref_pics_present_flag
+        mfxU32 numLongTermRefPics = br->GetUE();
+        RET_IF_FALSE(numLongTermRefPics <= 32, MFX_ERR_UNSUPPORTED);
+        br->SkipBits(numLongTermRefPics * (pocLsbBits + 1));
+    }
+    br->SkipBits(2); // sps_temporal_mvp_enabled_flag, strong_intra_smoothing_enabled_flag
+
+    AVRational aspectRatio = { 0, 1 };
+    AVRational timing      = vpsTiming;
+    bool fullRange         = false;
+    if (br->GetFlag()) { // vui_parameters_present_flag
+        ParseVuiFormat(br, &aspectRatio, &fullRange);
+        br->SkipBits(3); // neutral_chroma_indication, field_seq, frame_field_info_present
+        if (br->GetFlag()) { // default_display_window_flag, not applied by libav
+            for (int i = 0; i < 4; i++)
+                br->GetUE();
+        }
+        if (br->GetFlag()) { // vui_timing_info_present_flag
+            AVRational vuiTiming = { 0, 0 };
+            vuiTiming.num        = br->GetBits(32);
+            vuiTiming.den        = br->GetBits(32);
+
+            // the timing of the VPS takes precedence
+            if (!timing.num || !timing.den)
+                timing = vuiTiming;
+        }
+    }
+    RET_IF_FALSE(!br->IsError(), MFX_ERR_MORE_DATA);
+    RET_IF_FALSE(width > 0 && height > 0, MFX_ERR_UNSUPPORTED);
+
+    AVRational frameRate = { 0, 1 };
+    if (timing.num && timing.den)
+        av_reduce(&frameRate.den,
+                  &frameRate.num,
+                  static_cast<mfxU32>(timing.num),
+                  static_cast<mfxU32>(timing.den),
+                  1 << 30);
+
+    header->width       = static_cast<int>(width);
+    header->height      = static_cast<int>(height);
+    header->pixFmt      = GetPixelFormat(chromaFormatIdc, bitDepth, fullRange); // MFX values
+    header->frameRate   = frameRate;
+    header->aspectRatio = aspectRatio;
+    header->profile     = profile;
+    header->level       = level;
+    return MFX_ERR_NONE;
+}
+
+static mfxStatus ParseHEVCHeader(const mfxU8 *data, mfxU32 size, StreamHeader *header) {
+    std::vector<mfxU8> rbsp;
+    mfxU32 offset        = 0;
+    AVRational vpsTiming = { 0, 0 };
+    while (GetNextNalUnit(data, size, &offset, &rbsp)) {
+        // only the base layer
+        if (rbsp.size() < 2 || (rbsp[0] & 1) || (rbsp[1] >> 3))
+            continue;
+
+        mfxU32 nalUnitType = (rbsp[0] >> 1) & 0x3f;
+        BitReader br(rbsp.data() + 2, rbsp.size() - 2);
+        if (nalUnitType == 32) // VPS
+            vpsTiming = ParseHEVCVideoParameterSet(&br);
+        else if (nalUnitType == 33) // SPS
+            return ParseHEVCSequenceParameterSet(&br, vpsTiming, header);
+    }
+    return MFX_ERR_MORE_DATA;
+}
+
+static mfxStatus ParseAV1SequenceHeaderObu(BitReader *br, StreamHeader *header) {
+    mfxU32 seqProfile = br->GetBits(3);
+    br->SkipBits(1); // still_picture
+    bool reducedStillPictureHeader = br->GetFlag();
+
+    AVRational frameRate = { 0, 1 };
+    mfxU32 seqLevelIdx   = 0;
+    if (reducedStillPictureHeader) {
+        seqLevelIdx = br->GetBits(5);
+    }
+    else {
+        bool decoderModelInfoPresent = false;
+        mfxU32 bufferDelayLength     = 0;
+        if (br->GetFlag()) { // timing_info_present_flag
+            mfxU32 unitsInDisplayTick = br->GetBits(32);
+            mfxU32 timeScale          = br->GetBits(32);
+            if (br->GetFlag()) // equal_picture_interval
+                br->GetUVLC(); // num_ticks_per_picture_minus_1
+            if (unitsInDisplayTick && timeScale)
+                av_reduce(&frameRate.den, &frameRate.num, unitsInDisplayTick, timeScale, INT_MAX);
+
+            decoderModelInfoPresent = br->GetFlag();
+            if (decoderModelInfoPresent) {
+                bufferDelayLength = br->GetBits(5) + 1;
+                br->SkipBits(32 + 5 + 5); // num_units_in_decoding_tick, length fields
+            }
+        }
+        bool initialDisplayDelayPresent = br->GetFlag();
+        mfxU32 operatingPoints          = br->GetBits(5) + 1;
+        for (mfxU32 i = 0; i < operatingPoints; i++) {
+            br->SkipBits(12); // operating_point_idc
+            mfxU32 levelIdx = br->GetBits(5);
+            if (levelIdx > 7)
+                br->SkipBits(1); // seq_tier
+            if (decoderModelInfoPresent && br->GetFlag()) // decoder_model_present_for_this_op
+                br->SkipBits(2 * bufferDelayLength + 1); // operating_parameters_info()
+            if (initialDisplayDelayPresent && br->GetFlag())
+                br->SkipBits(4); // initial_display_delay_minus_1
+            if (i == 0)
+                seqLevelIdx = levelIdx;
+        }
+    }
+
+    int frameWidthBits  = br->GetBits(4) + 1;
+    int frameHeightBits = br->GetBits(4) + 1;
+    mfxU32 maxWidth     = br->GetBits(frameWidthBits) + 1;
+    mfxU32 maxHeight    = br->GetBits(frameHeightBits) + 1;
+    if (!reducedStillPictureHeader && br->GetFlag()) // frame_id_numbers_present_flag
+        br->SkipBits(4 + 3);
+    br->SkipBits(3); // use_128x128_superblock, enable_filter_intra, enable_intra_edge_filter
+    if (!reducedStillPictureHeader) {
+        br->SkipBits(4); // interintra, masked compound, warped motion, dual filter
+        bool enableOrderHint = br->GetFlag();
+        if (enableOrderHint)
+            br->SkipBits(2); // enable_jnt_comp, enable_ref_frame_mvs
+
+        // 2 is SELECT_SCREEN_CONTENT_TOOLS
+        mfxU32 forceScreenContentTools = br->GetFlag() ? 2 : br->GetBits(1);
+        if (forceScreenContentTools > 0 && !br->GetFlag()) // seq_choose_integer_mv
+            br->SkipBits(1); // seq_force_integer_mv
+        if (enableOrderHint)
+            br->SkipBits(3); // order_hint_bits_minus_1
+    }
+    br->SkipBits(3); // enable_superres, enable_cdef, enable_restoration
+
+    // color_config()
+    int bitDepth = 8;
+    if (br->GetFlag()) // high_bitdepth
+        bitDepth = (seqProfile == 2 && br->GetFlag()) ? 12 : 10;
+    bool monochrome       = (seqProfile != 1) && br->GetFlag();
+    mfxU32 colorPrimaries = 2;
+    mfxU32 transfer       = 2;
+    mfxU32 matrix         = 2;
+    if (br->GetFlag()) { // color_description_present_flag
+        colorPrimaries = br->GetBits(8);
+        transfer       = br->GetBits(8);
+        matrix         = br->GetBits(8);
+    }
+
+    // subsampling_x and subsampling_y, sRGB and profile 1 are 4:4:4
+    bool sRGB           = (colorPrimaries == 1 && transfer == 13 && matrix == 0);
+    mfxU16 chromaFormat = MFX_CHROMAFORMAT_YUV444;
+    if (monochrome) {
+        chromaFormat = MFX_CHROMAFORMAT_MONOCHROME;
+    }
+    else if (!sRGB) {
+        br->SkipBits(1); // color_range
+        if (seqProfile == 0)
+            chromaFormat = MFX_CHROMAFORMAT_YUV420;
+        else if (seqProfile == 2 && bitDepth != 12)
+            chromaFormat = MFX_CHROMAFORMAT_YUV422;
+        else if (seqProfile == 2 && br->GetFlag()) // subsampling_x
+            chromaFormat = br->GetFlag() ? MFX_CHROMAFORMAT_YUV420 : MFX_CHROMAFORMAT_YUV422;
+    }
+    RET_IF_FALSE(!br->IsError(), MFX_ERR_MORE_DATA);
+
+    // the maximum is the frame size unless frames override it
+    header->width       = maxWidth;
+    header->height      = maxHeight;
+    header->pixFmt      = GetPixelFormat(chromaFormat, bitDepth, false);
+    header->frameRate   = frameRate;
+    header->aspectRatio = { 0, 1 };
+    header->profile     = seqProfile;
+    header->level       = seqLevelIdx;
+    return MFX_ERR_NONE;
+}
+
+static mfxStatus ParseAV1Header(const mfxU8 *data, mfxU32 size, StreamHeader *header) {
+    mfxU32 pos = 0;
+    while (pos < size) {
+        BitReader br(data + pos, size - pos);
+        br.SkipBits(1); // obu_forbidden_bit
+        mfxU32 obuType = br.GetBits(4);
+        bool extension = br.GetFlag();
+        bool hasSize   = br.GetFlag();
+        br.SkipBits(1 + (extension ? 8 : 0));
+
+        mfxU64 obuSize = size - pos - br.GetBytePos();
+        if (hasSize)
+            obuSize = br.GetLEB128();
+        RET_IF_FALSE(!br.IsError(), MFX_ERR_MORE_DATA);
+
+        mfxU32 headerSize = static_cast<mfxU32>(br.GetBytePos());
+        RET_IF_FALSE(obuSize <= size - pos - headerSize, MFX_ERR_MORE_DATA);
+        if (obuType == 1) { // OBU_SEQUENCE_HEADER
+            BitReader obu(data + pos + headerSize, static_cast<size_t>(obuSize));
+            return ParseAV1SequenceHeaderObu(&obu, header);
+        }
+        pos += headerSize + static_cast<mfxU32>(obuSize);
+    }
+    return MFX_ERR_MORE_DATA;
+}
+
+// offset of the first start code 00 00 01 code in data from offset on, size if there is none
+static mfxU32 FindStartCode(const mfxU8 *data, mfxU32 size, mfxU32 offset, mfxU8 code) {
+    for (mfxU32 pos = offset; pos + 4 <= size; pos++) {
+        if (data[pos] == 0 && data[pos + 1] == 0 && data[pos + 2] == 1 && data[pos + 3] == code)
+            return pos;
+    }
+    return size;
+}
+
+static mfxStatus ParseMPEG2Header(const mfxU8 *data, mfxU32 size, StreamHeader *header) {
+    mfxU32 pos = FindStartCode(data, size, 0, 0xb3); // sequence_header_code
+    RET_IF_FALSE(pos < size, MFX_ERR_MORE_DATA);
+
+    BitReader br(data + pos + 4, size - pos - 4);
+    mfxU32 width          = br.GetBits(12);
+    mfxU32 height         = br.GetBits(12);
+    mfxU32 aspectRatioIdx = br.GetBits(4);
+    mfxU32 frameRateCode  = br.GetBits(4);
+    br.SkipBits(18 + 1 + 10 + 1); // bit_rate_value, marker, vbv_buffer_size, constrained
+    if (br.GetFlag()) // load_intra_quantiser_matrix
+        br.SkipBits(64 * 8);
+    if (br.GetFlag()) // load_non_intra_quantiser_matrix
+        br.SkipBits(64 * 8);
+    RET_IF_FALSE(!br.IsError(), MFX_ERR_MORE_DATA);
+
+    // extensions and user data follow the sequence header, without the sequence
+    //   extension the stream is MPEG-1
+    bool sequenceExtension = false;
+    mfxU32 profileAndLevel = 0;
+    mfxU32 chromaFormat    = 1;
+    mfxU32 frameRateExtN   = 0;
+    mfxU32 frameRateExtD   = 0;
+    mfxU32 displayWidth    = 0;
+    mfxU32 displayHeight   = 0;
+    for (pos += 4 + static_cast<mfxU32>(br.GetBytePos()); pos + 4 <= size; pos++) {
+        if (data[pos] != 0 || data[pos + 1] != 0 || data[pos + 2] != 1)
+            continue;
+        if (data[pos + 3] == 0xb2) // user_data_start_code
+            continue;
+        if (data[pos + 3] != 0xb5) // extension_start_code
+            break;
+
+        BitReader ext(data + pos + 4, size - pos - 4);
+        mfxU32 extensionId = ext.GetBits(4);
+        if (extensionId == 1) {
+            sequenceExtension = true;
+            profileAndLevel   = ext.GetBits(8);
+            ext.SkipBits(1); // progressive_sequence
+            chromaFormat = ext.GetBits(2);
+            width |= ext.GetBits(2) << 12;
+            height |= ext.GetBits(2) << 12;
+            ext.SkipBits(12 + 1 + 8 + 1); // bit_rate_extension, marker, vbv, low_delay
+            frameRateExtN = ext.GetBits(2);
+            frameRateExtD = ext.GetBits(5);
+        }
+        else if (extensionId == 2) {
+            ext.SkipBits(3); // video_format
+            if (ext.GetFlag()) // colour_description
+                ext.SkipBits(24);
+            displayWidth = ext.GetBits(14);
+            ext.SkipBits(1); // marker_bit
+            displayHeight = ext.GetBits(14);
+        }
+        RET_IF_FALSE(!ext.IsError(), MFX_ERR_MORE_DATA);
+    }
+    if (!sequenceExtension)
+        return (pos + 4 > size) ? MFX_ERR_MORE_DATA : MFX_ERR_UNSUPPORTED;
+    RET_IF_FALSE(width && height, MFX_ERR_UNSUPPORTED);
+    RET_IF_FALSE(frameRateCode >= 1 && frameRateCode <= 8, MFX_ERR_UNSUPPORTED);
+    RET_IF_FALSE(chromaFormat == 1 || chromaFormat == 2, MFX_ERR_UNSUPPORTED);
+
+    AVRational frameRate = MPEG2FrameRates[frameRateCode];
+    av_reduce(&frameRate.num,
+              &frameRate.den,
+              frameRate.num * static_cast<int64_t>(frameRateExtN + 1),
+              frameRate.den * static_cast<int64_t>(frameRateExtD + 1),
+              1 << 30);
+
+    // the sample aspect ratio comes from the display aspect ratio and the
+    //   display size, which libav only trusts if the result is 4:3 or 16:9
+    AVRational aspectRatio = { 0, 1 };
+    if (aspectRatioIdx == 1) {
+        aspectRatio = { 1, 1 };
+    }
+    else if (aspectRatioIdx > 1 && aspectRatioIdx <= 4) {
+        AVRational displayAspect = MPEG2AspectRatios[aspectRatioIdx];
+        AVRational imageSize     = { static_cast<int>(width), static_cast<int>(height) };
+        AVRational displaySize   = imageSize;
+        if (displayWidth && displayHeight) {
+            AVRational dar = av_mul_q(av_div_q(displayAspect,
+                                               { static_cast<int>(displayWidth),
+                                                 static_cast<int>(displayHeight) }),
+                                      imageSize);
+            if (!av_cmp_q(dar, { 4, 3 }) || !av_cmp_q(dar, { 16, 9 }))
+                displaySize = { static_cast<int>(displayWidth), static_cast<int>(displayHeight) };
+        }
+        aspectRatio = av_div_q(displayAspect, displaySize);
+    }
+
+    header->width       = width;
+    header->height      = height;
+    header->pixFmt      = GetPixelFormat(chromaFormat, 8, false); // MFX values
+    header->frameRate   = frameRate;
+    header->aspectRatio = aspectRatio;
+    header->profile     = (profileAndLevel >> 4) & 7;
+    header->level       = profileAndLevel & 15;
+    return MFX_ERR_NONE;
+}
+
+static mfxStatus ParseJPEGHeader(const mfxU8 *data, mfxU32 size, StreamHeader *header) {
+    AVRational aspectRatio = { 0, 1 };
+    mfxU32 pos             = 0;
+    while (pos + 2 <= size) {
+        if (data[pos] != 0xff || data[pos + 1] == 0xff) {
+            pos++;
+            continue;
+        }
+        mfxU8 marker = data[pos + 1];
+        pos += 2;
+
+        // markers without a segment
+        if (marker == 0xd8 || marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7) || !marker)
+            continue;
+
+        RET_IF_FALSE(pos + 2 <= size, MFX_ERR_MORE_DATA);
+        mfxU32 length = (data[pos] << 8) | data[pos + 1];
+        RET_IF_FALSE(length >= 2, MFX_ERR_UNSUPPORTED);
+        RET_IF_FALSE(pos + length <= size, MFX_ERR_MORE_DATA);
+
+        BitReader br(data + pos + 2, length - 2);
+        if (marker == 0xe0 && length >= 14 && !memcmp(data + pos + 2, "JFIF", 5)) {
+            br.SkipBits((5 + 2 + 1) * 8); // identifier, version, units
+            aspectRatio.num = br.GetBits(16);
+            aspectRatio.den = br.GetBits(16);
+            if (aspectRatio.num <= 0 || aspectRatio.den <= 0)
+                aspectRatio = { 0, 1 };
+        }
+        else if (marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 &&
+                 marker != 0xcc) {
+            // only Huffman coded DCT, other frames have different libav formats
+            RET_IF_FALSE(marker <= 0xc2, MFX_ERR_UNSUPPORTED);
+
+            mfxU32 precision     = br.GetBits(8);
+            mfxU32 height        = br.GetBits(16);
+            mfxU32 width         = br.GetBits(16);
+            mfxU32 numComponents = br.GetBits(8);
+            mfxU32 sampling      = 0; // factors of 3 components, as libav matches them
+            for (mfxU32 i = 0; i < numComponents && i < 3; i++) {
+                br.SkipBits(8); // component identifier
+                sampling |= br.GetBits(8) << (24 - 8 * i);
+                br.SkipBits(8); // quantization table
+            }
+            RET_IF_FALSE(!br.IsError(), MFX_ERR_MORE_DATA);
+            RET_IF_FALSE(precision == 8 && width && height, MFX_ERR_UNSUPPORTED);
+
+            // all horizontal or vertical factors of 2 are the same as 1
+            if (!(sampling & 0xd0d0d0d0))
+                sampling -= (sampling & 0xf0f0f0f0) >> 1;
+            if (!(sampling & 0x0d0d0d0d))
+                sampling -= (sampling & 0x0f0f0f0f) >> 1;
+
+            AVPixelFormat pixFmt = AV_PIX_FMT_NONE;
+            if (numComponents == 1)
+                pixFmt = AV_PIX_FMT_GRAY8;
+            else if (numComponents == 3 && sampling == 0x22111100)
+                pixFmt = AV_PIX_FMT_YUVJ420P;
+            else if (numComponents == 3 && sampling == 0x21111100)
+                pixFmt = AV_PIX_FMT_YUVJ422P;
+            else if (numComponents == 3 && sampling == 0x11111100)
+                pixFmt = AV_PIX_FMT_YUVJ444P;
+
+            header->width       = width;
+            header->height      = height;
+            header->pixFmt      = pixFmt;
+            header->frameRate   = { 0, 1 };
+            header->aspectRatio = aspectRatio;
+            header->profile     = FF_PROFILE_MJPEG_HUFFMAN_BASELINE_DCT;
+            header->level       = FF_LEVEL_UNKNOWN;
+            if (marker == 0xc1)
+                header->profile = FF_PROFILE_MJPEG_HUFFMAN_EXTENDED_SEQUENTIAL_DCT;
+            else if (marker == 0xc2)
+                header->profile = FF_PROFILE_MJPEG_HUFFMAN_PROGRESSIVE_DCT;
+            return MFX_ERR_NONE;
+        }
+        else if (marker == 0xda) { // start of scan before the frame header
+            return MFX_ERR_UNSUPPORTED;
+        }
+        pos += length;
+    }
+    return MFX_ERR_MORE_DATA;
+}
+
+mfxStatus ParseStreamHeader(mfxU32 codecId, const mfxU8 *data, mfxU32 size, StreamHeader *header) {
+    RET_IF_FALSE(data && header, MFX_ERR_NULL_PTR);
+
+    switch (codecId) {
+        case MFX_CODEC_AVC:
+            return ParseAVCHeader(data, size, header);
+        case MFX_CODEC_HEVC:
+            return ParseHEVCHeader(data, size, header);
+        case MFX_CODEC_AV1:
+            return ParseAV1Header(data, size, header);
+        case MFX_CODEC_MPEG2:
+            return ParseMPEG2Header(data, size, header);
+        case MFX_CODEC_JPEG:
+            return ParseJPEGHeader(data, size, header);
+        default:
+            return MFX_ERR_UNSUPPORTED;
+    }
+}
@@ -0,0 +1,33 @@
+/*############################################################################
+  # Copyright (C) 2020 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#ifndef CPU_SRC_HEADER_PARSER_H_
+#define CPU_SRC_HEADER_PARSER_H_
+
+#include "src/cpu_common.h"
+
+// Stream parameters of a sequence header, in the terms the libav decoder
+// reports them in AVCodecContext once it decoded a frame, so that both map to
+// mfxVideoParam the same way.
+struct StreamHeader {
+    int width; // displayed (cropped) size
+    int height;
+    AVPixelFormat pixFmt;   // of the frames the libav decoder outputs
+    AVRational frameRate;   // 0/1 if the stream does not say
+    AVRational aspectRatio; // of a sample, 0/1 if the stream does not say
+    int profile;            // FF_PROFILE_*
+    int level;
+};
+
+// Find the first sequence header of codecId (AVC and HEVC SPS, AV1 sequence
+// header OBU, MPEG-2 sequence header, JPEG start of frame) in data and parse
+// it without a decoder.
+// Returns MFX_ERR_MORE_DATA if data holds no complete sequence header, and
+// MFX_ERR_UNSUPPORTED for other codecs and headers with features the parser
+// does not handle, in which case the caller has to decode a frame instead.
+mfxStatus ParseStreamHeader(mfxU32 codecId, const mfxU8 *data, mfxU32 size, StreamHeader *header);
+
+#endif // CPU_SRC_HEADER_PARSER_H_
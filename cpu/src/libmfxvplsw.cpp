@@ -69,6 +69,12 @@ mfxStatus MFXInitEx(mfxInitParam par, mfxSession *session) {
         return MFX_ERR_UNSUPPORTED;
     }
 
+    mfxStatus sts = ws->InitExtParam(par.ExtParam, par.NumExtParam);
+    if (sts < 0) {
+        delete ws;
+        return sts;
+    }
+
     // save the handle
     *session = (mfxSession)(ws);
 
@@ -82,6 +88,11 @@ mfxStatus MFXClose(mfxSession session) {
 
     CpuWorkstream *ws = reinterpret_cast<CpuWorkstream *>(session);
 
+    // child sessions must be disjoined (or closed) before the parent
+    if (ws->HasChildren()) {
+        return MFX_ERR_UNDEFINED_BEHAVIOR;
+    }
+
     delete ws;
     ws = nullptr;
 
@@ -116,21 +127,55 @@ mfxStatus MFXQueryVersion(mfxSession session, mfxVersion *pVersion) {
     return MFX_ERR_NONE;
 }
 
-// These functions are optional and not implemented in this
-// reference implementation.
 mfxStatus MFXJoinSession(mfxSession session, mfxSession child) {
-    return MFX_ERR_NOT_IMPLEMENTED;
+    if (0 == session || 0 == child) {
+        return MFX_ERR_INVALID_HANDLE;
+    }
+
+    CpuWorkstream *ws      = reinterpret_cast<CpuWorkstream *>(session);
+    CpuWorkstream *wsChild = reinterpret_cast<CpuWorkstream *>(child);
+
+    return ws->Join(wsChild);
 }
+
 mfxStatus MFXDisjoinSession(mfxSession session) {
-    return MFX_ERR_NOT_IMPLEMENTED;
-}
-mfxStatus MFXCloneSession(mfxSession session, mfxSession *clone) {
-    return MFX_ERR_NOT_IMPLEMENTED;
+    if (0 == session) {
+        return MFX_ERR_INVALID_HANDLE;
+    }
+
+    CpuWorkstream *ws = reinterpret_cast<CpuWorkstream *>(session);
+
+    return ws->Disjoin();
 }
+
 mfxStatus MFXSetPriority(mfxSession session, mfxPriority priority) {
-    return MFX_ERR_NOT_IMPLEMENTED;
+    if (0 == session) {
+        return MFX_ERR_INVALID_HANDLE;
+    }
+
+    CpuWorkstream *ws = reinterpret_cast<CpuWorkstream *>(session);
+
+    return ws->SetPriority(priority);
 }
+
 mfxStatus MFXGetPriority(mfxSession session, mfxPriority *priority) {
+    if (0 == session) {
+        return MFX_ERR_INVALID_HANDLE;
+    }
+    if (0 == priority) {
+        return MFX_ERR_NULL_PTR;
+    }
+
+    CpuWorkstream *ws = reinterpret_cast<CpuWorkstream *>(session);
+
+    *priority = ws->GetPriority();
+
+    return MFX_ERR_NONE;
+}
+
+// These functions are optional and not implemented in this
+// reference implementation.
+mfxStatus MFXCloneSession(mfxSession session, mfxSession *clone) {
     return MFX_ERR_NOT_IMPLEMENTED;
 }
 
@@ -10,7 +10,9 @@
 
 const mfxU32 decColorFmt_c00_p00_m00[] = {
     MFX_FOURCC_I420,
+    MFX_FOURCC_NV12,
     MFX_FOURCC_I010,
+    MFX_FOURCC_P010,
 };
 
 const DecMemDesc decMemDesc_c00_p00[] = {
@@ -19,7 +21,7 @@ const DecMemDesc decMemDesc_c00_p00[] = {
         { 64, 4096, 8 },
         { 64, 4096, 8 },
         {},
-        2,
+        4,
         (mfxU32 *)decColorFmt_c00_p00_m00,
     },
 };
@@ -35,6 +37,7 @@ const DecProfile decProfile_c00[] = {
 
 const mfxU32 decColorFmt_c01_p00_m00[] = {
     MFX_FOURCC_I420,
+    MFX_FOURCC_NV12,
 };
 
 const DecMemDesc decMemDesc_c01_p00[] = {
@@ -43,7 +46,7 @@ const DecMemDesc decMemDesc_c01_p00[] = {
         { 64, 4096, 8 },
         { 64, 4096, 8 },
         {},
-        1,
+        2,
         (mfxU32 *)decColorFmt_c01_p00_m00,
     },
 };
@@ -59,6 +62,7 @@ const DecProfile decProfile_c01[] = {
 
 const mfxU32 decColorFmt_c02_p00_m00[] = {
     MFX_FOURCC_I420,
+    MFX_FOURCC_NV12,
 };
 
 const DecMemDesc decMemDesc_c02_p00[] = {
@@ -67,13 +71,14 @@ const DecMemDesc decMemDesc_c02_p00[] = {
         { 64, 4096, 8 },
         { 64, 4096, 8 },
         {},
-        1,
+        2,
         (mfxU32 *)decColorFmt_c02_p00_m00,
     },
 };
 
 const mfxU32 decColorFmt_c02_p01_m00[] = {
     MFX_FOURCC_I010,
+    MFX_FOURCC_P010,
 };
 
 const DecMemDesc decMemDesc_c02_p01[] = {
@@ -82,7 +87,7 @@ const DecMemDesc decMemDesc_c02_p01[] = {
         { 64, 4096, 8 },
         { 64, 4096, 8 },
         {},
-        1,
+        2,
         (mfxU32 *)decColorFmt_c02_p01_m00,
     },
 };
@@ -104,6 +109,7 @@ const DecProfile decProfile_c02[] = {
 
 const mfxU32 decColorFmt_c03_p00_m00[] = {
     MFX_FOURCC_I420,
+    MFX_FOURCC_NV12,
 };
 
 const DecMemDesc decMemDesc_c03_p00[] = {
@@ -112,7 +118,7 @@ const DecMemDesc decMemDesc_c03_p00[] = {
         { 64, 4096, 8 },
         { 64, 4096, 8 },
         {},
-        1,
+        2,
         (mfxU32 *)decColorFmt_c03_p00_m00,
     },
 };
@@ -128,6 +134,7 @@ const DecProfile decProfile_c03[] = {
 
 const mfxU32 decColorFmt_c04_p00_m00[] = {
     MFX_FOURCC_I420,
+    MFX_FOURCC_NV12,
 };
 
 const DecMemDesc decMemDesc_c04_p00[] = {
@@ -136,7 +143,7 @@ const DecMemDesc decMemDesc_c04_p00[] = {
         { 64, 4096, 8 },
         { 64, 4096, 8 },
         {},
-        1,
+        2,
         (mfxU32 *)decColorFmt_c04_p00_m00,
     },
 };
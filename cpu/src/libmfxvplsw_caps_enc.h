@@ -10,7 +10,9 @@
 
 const mfxU32 encColorFmt_c00_p00_m00[] = {
     MFX_FOURCC_I420,
+    MFX_FOURCC_NV12,
     MFX_FOURCC_I010,
+    MFX_FOURCC_P010,
 };
 
 const EncMemDesc encMemDesc_c00_p00[] = {
@@ -19,7 +21,7 @@ const EncMemDesc encMemDesc_c00_p00[] = {
         { 64, 4096, 8 },
         { 64, 4096, 8 },
         {},
-        2,
+        4,
         (mfxU32 *)encColorFmt_c00_p00_m00,
     },
 };
@@ -35,6 +37,7 @@ const EncProfile encProfile_c00[] = {
 
 const mfxU32 encColorFmt_c01_p00_m00[] = {
     MFX_FOURCC_I420,
+    MFX_FOURCC_NV12,
 };
 
 const EncMemDesc encMemDesc_c01_p00[] = {
@@ -43,13 +46,14 @@ const EncMemDesc encMemDesc_c01_p00[] = {
         { 64, 4096, 8 },
         { 64, 4096, 8 },
         {},
-        1,
+        2,
         (mfxU32 *)encColorFmt_c01_p00_m00,
     },
 };
 
 const mfxU32 encColorFmt_c01_p01_m00[] = {
     MFX_FOURCC_I010,
+    MFX_FOURCC_P010,
 };
 
 const EncMemDesc encMemDesc_c01_p01[] = {
@@ -58,7 +62,7 @@ const EncMemDesc encMemDesc_c01_p01[] = {
         { 64, 4096, 8 },
         { 64, 4096, 8 },
         {},
-        1,
+        2,
         (mfxU32 *)encColorFmt_c01_p01_m00,
     },
 };
@@ -80,6 +84,7 @@ const EncProfile encProfile_c01[] = {
 
 const mfxU32 encColorFmt_c02_p00_m00[] = {
     MFX_FOURCC_I420,
+    MFX_FOURCC_NV12,
 };
 
 const EncMemDesc encMemDesc_c02_p00[] = {
@@ -88,7 +93,7 @@ const EncMemDesc encMemDesc_c02_p00[] = {
         { 64, 4096, 8 },
         { 64, 4096, 8 },
         {},
-        1,
+        2,
         (mfxU32 *)encColorFmt_c02_p00_m00,
     },
 };
@@ -10,36 +10,52 @@
 
 const mfxU32 vppFormatOut_f00_m00_i00[] = {
     MFX_FOURCC_I420,
+    MFX_FOURCC_NV12,
     MFX_FOURCC_RGB4,
 };
 
 const mfxU32 vppFormatOut_f00_m00_i01[] = {
     MFX_FOURCC_I010,
+    MFX_FOURCC_P010,
     MFX_FOURCC_RGB4,
 };
 
 const mfxU32 vppFormatOut_f00_m00_i02[] = {
     MFX_FOURCC_I420,
+    MFX_FOURCC_NV12,
     MFX_FOURCC_I010,
+    MFX_FOURCC_P010,
 };
 
 const VPPFormat vppFormatIn_f00_m00[] = {
     {
         MFX_FOURCC_I010,
         {},
-        2,
+        3,
+        (mfxU32 *)vppFormatOut_f00_m00_i00,
+    },
+    {
+        MFX_FOURCC_P010,
+        {},
+        3,
         (mfxU32 *)vppFormatOut_f00_m00_i00,
     },
     {
         MFX_FOURCC_I420,
         {},
-        2,
+        3,
+        (mfxU32 *)vppFormatOut_f00_m00_i01,
+    },
+    {
+        MFX_FOURCC_NV12,
+        {},
+        3,
         (mfxU32 *)vppFormatOut_f00_m00_i01,
     },
     {
         MFX_FOURCC_RGB4,
         {},
-        2,
+        4,
         (mfxU32 *)vppFormatOut_f00_m00_i02,
     },
 };
@@ -50,17 +66,19 @@ const VPPMemDesc vppMemDesc_f00[] = {
         { 64, 4096, 8 },
         { 64, 4096, 8 },
         {},
-        3,
+        5,
         (VPPFormat *)vppFormatIn_f00_m00,
     },
 };
 
 const mfxU32 vppFormatOut_f01_m00_i00[] = {
     MFX_FOURCC_I010,
+    MFX_FOURCC_P010,
 };
 
 const mfxU32 vppFormatOut_f01_m00_i01[] = {
     MFX_FOURCC_I420,
+    MFX_FOURCC_NV12,
 };
 
 const mfxU32 vppFormatOut_f01_m00_i02[] = {
@@ -71,13 +89,25 @@ const VPPFormat vppFormatIn_f01_m00[] = {
     {
         MFX_FOURCC_I010,
         {},
-        1,
+        2,
+        (mfxU32 *)vppFormatOut_f01_m00_i00,
+    },
+    {
+        MFX_FOURCC_P010,
+        {},
+        2,
         (mfxU32 *)vppFormatOut_f01_m00_i00,
     },
     {
         MFX_FOURCC_I420,
         {},
-        1,
+        2,
+        (mfxU32 *)vppFormatOut_f01_m00_i01,
+    },
+    {
+        MFX_FOURCC_NV12,
+        {},
+        2,
         (mfxU32 *)vppFormatOut_f01_m00_i01,
     },
     {
@@ -94,7 +124,7 @@ const VPPMemDesc vppMemDesc_f01[] = {
         { 64, 4096, 8 },
         { 64, 4096, 8 },
         {},
-        3,
+        5,
         (VPPFormat *)vppFormatIn_f01_m00,
     },
 };
@@ -7,11 +7,12 @@
 #include "./cpu_workstream.h"
 #include "vpl/mfxvideo.h"
 
-// NOTES - for now, just do init, decode the first frame, get params, close codec
+// NOTES - parse the sequence header, if that fails init, decode the first frame,
+//   get params, close codec
 //
 // Differences vs. MSDK 1.0 spec
 // - codec init does not happen here, just header parsing
-// - should not decode a frame
+// - decodes a frame if the header cannot be parsed (e.g. MPEG-1 or lossless JPEG)
 // - may be called at any time before or after initialization
 // - should search for sequence header and move mfxBitstream to first byte
 // - optionally returns header in mfxExtCodingOptionSPSPPS struct
@@ -22,12 +23,18 @@ mfxStatus MFXVideoDECODE_DecodeHeader(mfxSession session, mfxBitstream *bs, mfxV
     RET_IF_FALSE(par, MFX_ERR_NULL_PTR);
     RET_IF_FALSE(bs->DataLength > 0, MFX_ERR_MORE_DATA);
 
+    if (CpuDecode::DecodeHeader(bs, par) == MFX_ERR_NONE)
+        return MFX_ERR_NONE;
+
     CpuWorkstream *ws = reinterpret_cast<CpuWorkstream *>(session);
 
     std::unique_ptr<CpuDecode> decoder(new CpuDecode(ws));
     RET_IF_FALSE(decoder, MFX_ERR_MEMORY_ALLOC);
     RET_ERROR(decoder->InitDecode(par, bs));
 
+    // libav did not find a sequence header either
+    RET_IF_FALSE(par->mfx.FrameInfo.Width && par->mfx.FrameInfo.Height, MFX_ERR_MORE_DATA);
+
     return MFX_ERR_NONE;
 }
 
@@ -137,15 +144,16 @@ mfxStatus MFXVideoDECODE_DecodeFrameAsync(mfxSession session,
         // get a ref-counted surface for decoding into
         // behavior is equivalent to the application calling this and then
         //   passing the surface into DecodeFrameAsync()
-        RET_ERROR(MFXMemory_GetSurfaceForDecode(session, &surface_work));
+        // a bounded pool returns MFX_WRN_ALLOC_TIMEOUT_EXPIRED without a surface
+        mfxStatus sts = MFXMemory_GetSurfaceForDecode(session, &surface_work);
+        if (sts != MFX_ERR_NONE)
+            return sts;
         bInternalMem = true;
     }
 
-    mfxStatus sts = decoder->DecodeFrame(bs, surface_work, surface_out);
-
-    if (surface_work->FrameInterface) {
-        surface_work->FrameInterface->OnComplete(sts);
-    }
+    *syncp        = nullptr;
+    // OnComplete is called by the decoder once the output surface is ready
+    mfxStatus sts = decoder->DecodeFrame(bs, surface_work, surface_out, syncp);
 
     // application will not know to release surface (e.g. if we
     //   need more data) so need to release it here
@@ -153,8 +161,6 @@ mfxStatus MFXVideoDECODE_DecodeFrameAsync(mfxSession session,
         surface_work->FrameInterface->Release(surface_work);
     }
 
-    *syncp = (mfxSyncPoint)(0x12345678);
-
     return sts;
 }
 
@@ -188,15 +194,30 @@ mfxStatus MFXVideoDECODE_Reset(mfxSession session, mfxVideoParam *par) {
     return MFXVideoDECODE_Init(session, par);
 }
 
-// stubs
-mfxStatus MFXVideoDECODE_GetDecodeStat(mfxSession session, mfxDecodeStat *stat) {
+mfxStatus MFXVideoDECODE_SetSkipMode(mfxSession session, mfxSkipMode mode) {
     VPL_TRACE_FUNC;
-    return MFX_ERR_NOT_IMPLEMENTED;
+    RET_IF_FALSE(session, MFX_ERR_INVALID_HANDLE);
+
+    CpuWorkstream *ws  = reinterpret_cast<CpuWorkstream *>(session);
+    CpuDecode *decoder = ws->GetDecoder();
+    RET_IF_FALSE(decoder, MFX_ERR_NOT_INITIALIZED);
+
+    return decoder->SetSkipMode(mode);
 }
-mfxStatus MFXVideoDECODE_SetSkipMode(mfxSession session, mfxSkipMode mode) {
+
+mfxStatus MFXVideoDECODE_GetDecodeStat(mfxSession session, mfxDecodeStat *stat) {
     VPL_TRACE_FUNC;
-    return MFX_ERR_NOT_IMPLEMENTED;
+    RET_IF_FALSE(session, MFX_ERR_INVALID_HANDLE);
+    RET_IF_FALSE(stat, MFX_ERR_NULL_PTR);
+
+    CpuWorkstream *ws  = reinterpret_cast<CpuWorkstream *>(session);
+    CpuDecode *decoder = ws->GetDecoder();
+    RET_IF_FALSE(decoder, MFX_ERR_NOT_INITIALIZED);
+
+    return decoder->GetDecodeStat(stat);
 }
+
+// stubs
 mfxStatus MFXVideoDECODE_GetPayload(mfxSession session, mfxU64 *ts, mfxPayload *payload) {
     VPL_TRACE_FUNC;
     return MFX_ERR_NOT_IMPLEMENTED;
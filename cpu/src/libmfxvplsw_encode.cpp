@@ -72,9 +72,9 @@ mfxStatus MFXVideoENCODE_EncodeFrameAsync(mfxSession session,
     CpuEncode *encoder = ws->GetEncoder();
     RET_IF_FALSE(encoder, MFX_ERR_NOT_INITIALIZED);
 
-    *syncp = (mfxSyncPoint)(0x12345678);
+    *syncp = nullptr;
 
-    mfxStatus sts = encoder->EncodeFrame(surface, ctrl, bs);
+    mfxStatus sts = encoder->EncodeFrame(surface, ctrl, bs, syncp);
     RET_ERROR(sts);
     return sts;
 }
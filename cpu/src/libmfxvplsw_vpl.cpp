@@ -38,6 +38,12 @@ mfxStatus MFXInitialize(mfxInitializationParam par, mfxSession *session) {
         return MFX_ERR_UNSUPPORTED;
     }
 
+    mfxStatus sts = ws->InitExtParam(par.ExtParam, par.NumExtParam);
+    if (sts < 0) {
+        delete ws;
+        return sts;
+    }
+
     // save the handle
     *session = (mfxSession)(ws);
 
@@ -52,10 +58,13 @@ static const mfxAccelerationMode AccelerationMode[NUM_ACCELERATION_MODES_CPU] =
     MFX_ACCEL_MODE_NA,
 };
 
-#define NUM_POOL_POLICIES_CPU 1
+#define NUM_POOL_POLICIES_CPU 3
 
+// OPTIMAL and LIMITED are selected with mfxExtCPUSurfacePool
 static const mfxPoolAllocationPolicy PoolPolicy[NUM_POOL_POLICIES_CPU] = {
+    MFX_ALLOCATION_OPTIMAL,
     MFX_ALLOCATION_UNLIMITED,
+    MFX_ALLOCATION_LIMITED,
 };
 
 // leave table formatting alone
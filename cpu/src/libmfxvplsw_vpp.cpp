@@ -85,9 +85,9 @@ mfxStatus MFXVideoVPP_RunFrameVPPAsync(mfxSession session,
     CpuVPP *vpp       = ws->GetVPP();
     RET_IF_FALSE(vpp, MFX_ERR_NOT_INITIALIZED);
 
-    *syncp = (mfxSyncPoint)(0x12345678);
+    *syncp = nullptr;
 
-    return vpp->ProcessFrame(in, out, aux);
+    return vpp->SubmitFrame(in, out, aux, syncp);
 }
 
 mfxStatus MFXVideoVPP_Reset(mfxSession session, mfxVideoParam *par) {
@@ -126,10 +126,14 @@ mfxStatus MFXVideoVPP_ProcessFrameAsync(mfxSession session,
         // get a ref-counted surface for vpp into
         // behavior is equivalent to the application calling this and then
         //   passing the surface into ProcessFrameAsync()
-        RET_ERROR(MFXMemory_GetSurfaceForVPPOut(session, out));
+        // a bounded pool returns MFX_WRN_ALLOC_TIMEOUT_EXPIRED without a surface
+        mfxStatus sts = MFXMemory_GetSurfaceForVPPOut(session, out);
+        if (sts != MFX_ERR_NONE)
+            return sts;
         (*out)->FrameInterface->Map(*out, MFX_MAP_WRITE);
     }
 
-    mfxStatus sts = vpp->ProcessFrame(in, *out, NULL);
+    // completion is signalled through (*out)->FrameInterface->Synchronize()
+    mfxStatus sts = vpp->SubmitFrame(in, *out, NULL, nullptr);
     return sts;
 }
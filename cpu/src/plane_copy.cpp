@@ -0,0 +1,404 @@
+/*############################################################################
+  # Copyright (C) 2020 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#include "src/plane_copy.h"
+#include <algorithm>
+#include <cstring>
+#include "src/cpu_thread_pool.h"
+
+extern "C" {
+#include "libavutil/cpu.h"
+}
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #include <immintrin.h>
+    #define PLANE_COPY_X86
+    #if defined(__GNUC__) || defined(__clang__)
+        #define TARGET_AVX2   __attribute__((target("avx2")))
+        #define TARGET_AVX512 __attribute__((target("avx512f")))
+    #else
+        #define TARGET_AVX2
+        #define TARGET_AVX512
+    #endif
+#endif
+
+// images of at least 4K luma size are streamed and split into bands
+#define LARGE_COPY_BYTES (3840 * 2160)
+
+// more bands than this do not add memory bandwidth
+#define MAX_COPY_BANDS 8
+
+typedef void (*CopyFunc)(uint8_t *dst, const uint8_t *src, size_t size);
+
+#ifdef PLANE_COPY_X86
+TARGET_AVX2 static void StreamCopyAVX2(uint8_t *dst, const uint8_t *src, size_t size) {
+    size_t head = std::min(size, static_cast<size_t>(-reinterpret_cast<uintptr_t>(dst) & 31));
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    size -= head;
+
+    for (; size >= 128; size -= 128, src += 128, dst += 128) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 32));
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 64));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 96));
+        _mm256_stream_si256(reinterpret_cast<__m256i *>(dst), a);
+        _mm256_stream_si256(reinterpret_cast<__m256i *>(dst + 32), b);
+        _mm256_stream_si256(reinterpret_cast<__m256i *>(dst + 64), c);
+        _mm256_stream_si256(reinterpret_cast<__m256i *>(dst + 96), d);
+    }
+    for (; size >= 32; size -= 32, src += 32, dst += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+        _mm256_stream_si256(reinterpret_cast<__m256i *>(dst), a);
+    }
+    memcpy(dst, src, size);
+}
+
+TARGET_AVX512 static void StreamCopyAVX512(uint8_t *dst, const uint8_t *src, size_t size) {
+    size_t head = std::min(size, static_cast<size_t>(-reinterpret_cast<uintptr_t>(dst) & 63));
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    size -= head;
+
+    for (; size >= 256; size -= 256, src += 256, dst += 256) {
+        __m512i a = _mm512_loadu_si512(src);
+        __m512i b = _mm512_loadu_si512(src + 64);
+        __m512i c = _mm512_loadu_si512(src + 128);
+        __m512i d = _mm512_loadu_si512(src + 192);
+        _mm512_stream_si512(reinterpret_cast<__m512i *>(dst), a);
+        _mm512_stream_si512(reinterpret_cast<__m512i *>(dst + 64), b);
+        _mm512_stream_si512(reinterpret_cast<__m512i *>(dst + 128), c);
+        _mm512_stream_si512(reinterpret_cast<__m512i *>(dst + 192), d);
+    }
+    for (; size >= 64; size -= 64, src += 64, dst += 64) {
+        __m512i a = _mm512_loadu_si512(src);
+        _mm512_stream_si512(reinterpret_cast<__m512i *>(dst), a);
+    }
+    memcpy(dst, src, size);
+}
+#endif
+
+static void Copy(uint8_t *dst, const uint8_t *src, size_t size) {
+    memcpy(dst, src, size);
+}
+
+// row kernels, width samples of the U (or V) plane
+typedef void (*InterleaveFunc)(uint8_t *dst,
+                               const uint8_t *u,
+                               const uint8_t *v,
+                               mfxU32 width,
+                               int shift);
+typedef void (*DeinterleaveFunc)(uint8_t *u,
+                                 uint8_t *v,
+                                 const uint8_t *src,
+                                 mfxU32 width,
+                                 int shift);
+typedef void (*ShiftFunc)(uint8_t *dst, const uint8_t *src, mfxU32 width, int shift);
+
+static inline uint16_t ShiftSample(uint16_t sample, int shift) {
+    return static_cast<uint16_t>(shift >= 0 ? sample << shift : sample >> -shift);
+}
+
+static void InterleaveRow8(uint8_t *dst,
+                           const uint8_t *u,
+                           const uint8_t *v,
+                           mfxU32 width,
+                           int shift) {
+    for (mfxU32 x = 0; x < width; x++) {
+        dst[2 * x]     = u[x];
+        dst[2 * x + 1] = v[x];
+    }
+}
+
+static void InterleaveRow16(uint8_t *dst,
+                            const uint8_t *u,
+                            const uint8_t *v,
+                            mfxU32 width,
+                            int shift) {
+    uint16_t *d        = reinterpret_cast<uint16_t *>(dst);
+    const uint16_t *su = reinterpret_cast<const uint16_t *>(u);
+    const uint16_t *sv = reinterpret_cast<const uint16_t *>(v);
+    for (mfxU32 x = 0; x < width; x++) {
+        d[2 * x]     = ShiftSample(su[x], shift);
+        d[2 * x + 1] = ShiftSample(sv[x], shift);
+    }
+}
+
+static void DeinterleaveRow8(uint8_t *u,
+                             uint8_t *v,
+                             const uint8_t *src,
+                             mfxU32 width,
+                             int shift) {
+    for (mfxU32 x = 0; x < width; x++) {
+        u[x] = src[2 * x];
+        v[x] = src[2 * x + 1];
+    }
+}
+
+static void DeinterleaveRow16(uint8_t *u,
+                              uint8_t *v,
+                              const uint8_t *src,
+                              mfxU32 width,
+                              int shift) {
+    uint16_t *du      = reinterpret_cast<uint16_t *>(u);
+    uint16_t *dv      = reinterpret_cast<uint16_t *>(v);
+    const uint16_t *s = reinterpret_cast<const uint16_t *>(src);
+    for (mfxU32 x = 0; x < width; x++) {
+        du[x] = ShiftSample(s[2 * x], shift);
+        dv[x] = ShiftSample(s[2 * x + 1], shift);
+    }
+}
+
+// dst may be src
+static void ShiftRow16(uint8_t *dst, const uint8_t *src, mfxU32 width, int shift) {
+    uint16_t *d       = reinterpret_cast<uint16_t *>(dst);
+    const uint16_t *s = reinterpret_cast<const uint16_t *>(src);
+    for (mfxU32 x = 0; x < width; x++)
+        d[x] = ShiftSample(s[x], shift);
+}
+
+#ifdef PLANE_COPY_X86
+// 16-bit lanes are shifted left, then right, one of the counts is 0
+TARGET_AVX2 static inline __m256i Shift16(__m256i x, __m128i left, __m128i right) {
+    return _mm256_srl_epi16(_mm256_sll_epi16(x, left), right);
+}
+
+TARGET_AVX2 static void InterleaveRow8AVX2(uint8_t *dst,
+                                           const uint8_t *u,
+                                           const uint8_t *v,
+                                           mfxU32 width,
+                                           int shift) {
+    mfxU32 x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i a  = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(u + x));
+        __m256i b  = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(v + x));
+        __m256i lo = _mm256_unpacklo_epi8(a, b);
+        __m256i hi = _mm256_unpackhi_epi8(a, b);
+        // unpack works within 128-bit lanes
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 2 * x),
+                            _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 2 * x + 32),
+                            _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    InterleaveRow8(dst + 2 * x, u + x, v + x, width - x, shift);
+}
+
+TARGET_AVX2 static void InterleaveRow16AVX2(uint8_t *dst,
+                                            const uint8_t *u,
+                                            const uint8_t *v,
+                                            mfxU32 width,
+                                            int shift) {
+    __m128i left  = _mm_cvtsi32_si128(std::max(shift, 0));
+    __m128i right = _mm_cvtsi32_si128(std::max(-shift, 0));
+    mfxU32 x      = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i a  = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(u + 2 * x));
+        __m256i b  = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(v + 2 * x));
+        a          = Shift16(a, left, right);
+        b          = Shift16(b, left, right);
+        __m256i lo = _mm256_unpacklo_epi16(a, b);
+        __m256i hi = _mm256_unpackhi_epi16(a, b);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 4 * x),
+                            _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 4 * x + 32),
+                            _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    InterleaveRow16(dst + 4 * x, u + 2 * x, v + 2 * x, width - x, shift);
+}
+
+TARGET_AVX2 static void DeinterleaveRow8AVX2(uint8_t *u,
+                                             uint8_t *v,
+                                             const uint8_t *src,
+                                             mfxU32 width,
+                                             int shift) {
+    const __m256i mask = _mm256_set1_epi16(0x00FF);
+    mfxU32 x           = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i s0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 2 * x));
+        __m256i s1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 2 * x + 32));
+        __m256i a  = _mm256_packus_epi16(_mm256_and_si256(s0, mask), _mm256_and_si256(s1, mask));
+        __m256i b  = _mm256_packus_epi16(_mm256_srli_epi16(s0, 8), _mm256_srli_epi16(s1, 8));
+        // pack works within 128-bit lanes
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(u + x), _mm256_permute4x64_epi64(a, 0xD8));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(v + x), _mm256_permute4x64_epi64(b, 0xD8));
+    }
+    DeinterleaveRow8(u + x, v + x, src + 2 * x, width - x, shift);
+}
+
+TARGET_AVX2 static void DeinterleaveRow16AVX2(uint8_t *u,
+                                              uint8_t *v,
+                                              const uint8_t *src,
+                                              mfxU32 width,
+                                              int shift) {
+    __m128i left       = _mm_cvtsi32_si128(std::max(shift, 0));
+    __m128i right      = _mm_cvtsi32_si128(std::max(-shift, 0));
+    const __m256i mask = _mm256_set1_epi32(0xFFFF);
+    mfxU32 x           = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i s0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 4 * x));
+        __m256i s1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 4 * x + 32));
+        s0         = Shift16(s0, left, right);
+        s1         = Shift16(s1, left, right);
+        __m256i a  = _mm256_packus_epi32(_mm256_and_si256(s0, mask), _mm256_and_si256(s1, mask));
+        __m256i b  = _mm256_packus_epi32(_mm256_srli_epi32(s0, 16), _mm256_srli_epi32(s1, 16));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(u + 2 * x),
+                            _mm256_permute4x64_epi64(a, 0xD8));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(v + 2 * x),
+                            _mm256_permute4x64_epi64(b, 0xD8));
+    }
+    DeinterleaveRow16(u + 2 * x, v + 2 * x, src + 4 * x, width - x, shift);
+}
+
+TARGET_AVX2 static void ShiftRow16AVX2(uint8_t *dst, const uint8_t *src, mfxU32 width, int shift) {
+    __m128i left  = _mm_cvtsi32_si128(std::max(shift, 0));
+    __m128i right = _mm_cvtsi32_si128(std::max(-shift, 0));
+    mfxU32 x      = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 2 * x));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 2 * x), Shift16(a, left, right));
+    }
+    ShiftRow16(dst + 2 * x, src + 2 * x, width - x, shift);
+}
+#endif
+
+struct ConvertFuncs {
+    InterleaveFunc interleave8;
+    InterleaveFunc interleave16;
+    DeinterleaveFunc deinterleave8;
+    DeinterleaveFunc deinterleave16;
+    ShiftFunc shift16;
+};
+
+static const ConvertFuncs &GetConvertFuncs() {
+    static const ConvertFuncs funcs = []() -> ConvertFuncs {
+#ifdef PLANE_COPY_X86
+        if (av_get_cpu_flags() & AV_CPU_FLAG_AVX2) {
+            return { InterleaveRow8AVX2,
+                     InterleaveRow16AVX2,
+                     DeinterleaveRow8AVX2,
+                     DeinterleaveRow16AVX2,
+                     ShiftRow16AVX2 };
+        }
+#endif
+        return { InterleaveRow8, InterleaveRow16, DeinterleaveRow8, DeinterleaveRow16, ShiftRow16 };
+    }();
+    return funcs;
+}
+
+// null if the CPU has no streaming copy
+static CopyFunc GetStreamCopy() {
+#ifdef PLANE_COPY_X86
+    static const CopyFunc func = []() -> CopyFunc {
+        int flags = av_get_cpu_flags();
+        if (flags & AV_CPU_FLAG_AVX512)
+            return StreamCopyAVX512;
+        if (flags & AV_CPU_FLAG_AVX2)
+            return StreamCopyAVX2;
+        return nullptr;
+    }();
+    return func;
+#else
+    return nullptr;
+#endif
+}
+
+static bool IsConversion(const CopyPlane &plane) {
+    return plane.src2 || plane.dst2 || (plane.shift && plane.sampleBytes == 2);
+}
+
+static void ConvertRows(const CopyPlane &plane, mfxU32 begin, mfxU32 end) {
+    const ConvertFuncs &funcs = GetConvertFuncs();
+    bool wide                 = plane.sampleBytes == 2;
+
+    for (mfxU32 y = begin; y < end; y++) {
+        const uint8_t *src = plane.src + static_cast<ptrdiff_t>(y) * plane.srcPitch;
+        uint8_t *dst       = plane.dst + static_cast<ptrdiff_t>(y) * plane.dstPitch;
+        if (plane.src2) {
+            const uint8_t *src2       = plane.src2 + static_cast<ptrdiff_t>(y) * plane.srcPitch;
+            InterleaveFunc interleave = wide ? funcs.interleave16 : funcs.interleave8;
+            interleave(dst, src, src2, plane.width, plane.shift);
+        }
+        else if (plane.dst2) {
+            uint8_t *dst2                 = plane.dst2 + static_cast<ptrdiff_t>(y) * plane.dstPitch;
+            DeinterleaveFunc deinterleave = wide ? funcs.deinterleave16 : funcs.deinterleave8;
+            deinterleave(dst, dst2, src, plane.width, plane.shift);
+        }
+        else {
+            funcs.shift16(dst, src, plane.width, plane.shift);
+        }
+    }
+}
+
+static void CopyRows(const CopyPlane &plane, mfxU32 begin, mfxU32 end, CopyFunc copy) {
+    if (begin >= end || !plane.width)
+        return;
+
+    if (IsConversion(plane)) {
+        ConvertRows(plane, begin, end);
+        return;
+    }
+
+    const uint8_t *src = plane.src + static_cast<ptrdiff_t>(begin) * plane.srcPitch;
+    uint8_t *dst       = plane.dst + static_cast<ptrdiff_t>(begin) * plane.dstPitch;
+    size_t rowBytes    = static_cast<size_t>(plane.width) * plane.sampleBytes;
+
+    if (plane.srcPitch == plane.dstPitch && plane.dstPitch > 0) {
+        copy(dst, src, static_cast<size_t>(end - begin - 1) * plane.dstPitch + rowBytes);
+        return;
+    }
+
+    for (mfxU32 y = begin; y < end; y++) {
+        copy(dst, src, rowBytes);
+        src += plane.srcPitch;
+        dst += plane.dstPitch;
+    }
+}
+
+// non-temporal stores are weakly ordered, fence them before the copy is done
+// a fence only orders the stores of its own thread, so each band has one
+static void EndStreamCopy() {
+#ifdef PLANE_COPY_X86
+    _mm_sfence();
+#endif
+}
+
+void CopyPlanes(const CopyPlane *planes, int numPlanes, CpuThreadPool *pool) {
+    size_t size = 0;
+    for (int i = 0; i < numPlanes; i++) {
+        const CopyPlane &plane = planes[i];
+        size_t bytes           = static_cast<size_t>(plane.width) * plane.sampleBytes * plane.rows;
+        size += (plane.src2 || plane.dst2) ? 2 * bytes : bytes;
+    }
+
+    CopyFunc stream = size >= LARGE_COPY_BYTES ? GetStreamCopy() : nullptr;
+    CopyFunc copy   = stream ? stream : Copy;
+
+    int numBands = 1;
+    if (pool && size >= LARGE_COPY_BYTES)
+        numBands = std::min(static_cast<int>(pool->GetNumThreads()) + 1, MAX_COPY_BANDS);
+
+    if (numBands == 1) {
+        for (int i = 0; i < numPlanes; i++)
+            CopyRows(planes[i], 0, planes[i].rows, copy);
+        if (stream)
+            EndStreamCopy();
+        return;
+    }
+
+    pool->ParallelFor(numBands, numBands, [&](int band, int slot) {
+        for (int i = 0; i < numPlanes; i++) {
+            mfxU32 rows = planes[i].rows;
+            CopyRows(planes[i],
+                     static_cast<mfxU32>(static_cast<uint64_t>(rows) * band / numBands),
+                     static_cast<mfxU32>(static_cast<uint64_t>(rows) * (band + 1) / numBands),
+                     copy);
+        }
+        if (stream)
+            EndStreamCopy();
+    });
+}
@@ -0,0 +1,43 @@
+/*############################################################################
+  # Copyright (C) 2020 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#ifndef CPU_SRC_PLANE_COPY_H_
+#define CPU_SRC_PLANE_COPY_H_
+
+#include "src/cpu_common.h"
+
+class CpuThreadPool;
+
+// rows of one image plane, width samples of sampleBytes each
+// with src2 set, the U plane src and V plane src2 are interleaved into dst
+//   (I420 to NV12), with dst2 set, src is split into the U plane dst and the
+//   V plane dst2 (NV12 to I420), width counts the samples of the U plane,
+//   src2 has the pitch of src and dst2 the pitch of dst
+// 16-bit samples are shifted left by shift bits, right if shift is negative,
+//   which moves 10-bit samples between the low (I010) and high (P010) bits
+struct CopyPlane {
+    const uint8_t *src;
+    const uint8_t *src2;
+    int srcPitch;
+    uint8_t *dst;
+    uint8_t *dst2;
+    int dstPitch;
+    mfxU32 width;
+    mfxU32 sampleBytes;
+    mfxU32 rows;
+    int shift;
+};
+
+// Copy the planes of one image.
+// Planes with the same pitch in src and dst are copied with one memcpy, so
+// the bytes between the row width and the pitch must be padding of both images.
+// Large images are written with non-temporal AVX2/AVX-512 stores (the copy
+// would only evict the working set of the other stages from the cache) and
+// split into row bands run on pool, which may be null.
+// Interleave, deinterleave and shift use AVX2 kernels if the CPU has them.
+void CopyPlanes(const CopyPlane *planes, int numPlanes, CpuThreadPool *pool);
+
+#endif // CPU_SRC_PLANE_COPY_H_
@@ -5,6 +5,7 @@
   ############################################################################*/
 
 #include <gtest/gtest.h>
+#include <vector>
 #include "vpl/mfxvideo.h"
 
 //SetFrameAllocator
@@ -112,15 +113,74 @@ TEST(SyncOperation, ValidInputReturnsErrNone) {
     mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    mfxSyncPoint syncp = { 0 };
-    sts                = MFXVideoCORE_SyncOperation(session, syncp, 1000);
+    mfxVideoParam mfxVPPParams = {};
+
+    mfxVPPParams.vpp.In.FourCC        = MFX_FOURCC_I420;
+    mfxVPPParams.vpp.In.ChromaFormat  = MFX_CHROMAFORMAT_YUV420;
+    mfxVPPParams.vpp.In.CropW         = 64;
+    mfxVPPParams.vpp.In.CropH         = 64;
+    mfxVPPParams.vpp.In.FrameRateExtN = 30;
+    mfxVPPParams.vpp.In.FrameRateExtD = 1;
+    mfxVPPParams.vpp.In.Width         = 64;
+    mfxVPPParams.vpp.In.Height        = 64;
+    mfxVPPParams.vpp.Out              = mfxVPPParams.vpp.In;
+
+    mfxVPPParams.IOPattern  = MFX_IOPATTERN_IN_SYSTEM_MEMORY | MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+    mfxVPPParams.AsyncDepth = 4;
+
+    sts = MFXVideoVPP_Init(session, &mfxVPPParams);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
+    // submit a full pipeline of frames before synchronizing any of them
+    const mfxU32 nFrames = 4;
+    std::vector<mfxU8> buf(64 * 64 * 3 / 2 * 2 * nFrames);
+    mfxFrameSurface1 surfIn[nFrames]  = {};
+    mfxFrameSurface1 surfOut[nFrames] = {};
+    mfxSyncPoint syncp[nFrames]       = {};
+    for (mfxU32 i = 0; i < nFrames; i++) {
+        mfxFrameSurface1 *s[2] = { &surfIn[i], &surfOut[i] };
+        for (mfxU32 j = 0; j < 2; j++) {
+            mfxU8 *base      = buf.data() + (i * 2 + j) * 64 * 64 * 3 / 2;
+            s[j]->Info       = mfxVPPParams.vpp.In;
+            s[j]->Data.Y     = base;
+            s[j]->Data.U     = base + 64 * 64;
+            s[j]->Data.V     = base + 64 * 64 + 32 * 32;
+            s[j]->Data.Pitch = 64;
+        }
+        surfIn[i].Data.TimeStamp = 1000 + i;
+
+        sts = MFXVideoVPP_RunFrameVPPAsync(session, &surfIn[i], &surfOut[i], nullptr, &syncp[i]);
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+        ASSERT_NE(syncp[i], nullptr);
+    }
+
+    for (mfxU32 i = 0; i < nFrames; i++) {
+        sts = MFXVideoCORE_SyncOperation(session, syncp[i], 1000);
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+        EXPECT_EQ(surfOut[i].Data.TimeStamp, 1000 + i);
+        EXPECT_EQ(surfIn[i].Data.Locked, 0);
+    }
+
     //free internal resources
     sts = MFXClose(session);
     EXPECT_EQ(sts, MFX_ERR_NONE);
 }
 
+// null sync point
+TEST(SyncOperation, NullSyncPointReturnsErrNullPtr) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxSyncPoint syncp = { 0 };
+    sts                = MFXVideoCORE_SyncOperation(session, syncp, 1000);
+    ASSERT_EQ(sts, MFX_ERR_NULL_PTR);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
 // null session
 TEST(SyncOperation, NullSessionReturnsInvalidHandle) {
     mfxStatus sts = MFXVideoCORE_SyncOperation(0, 0, 0);
@@ -80,6 +80,174 @@ TEST(DecodeHeader, TenBitInReturnsCorrectMetadata) {
     EXPECT_EQ(sts, MFX_ERR_NONE);
 }
 
+TEST(DecodeHeader, JPEGInReturnsCorrectMetadata) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_JPEG;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_32x32_mjpeg::getlen();
+    mfxBS.Data                         = test_bitstream_32x32_mjpeg::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    //check metadata
+    ASSERT_EQ(32, mfxDecParams.mfx.FrameInfo.Width);
+    ASSERT_EQ(32, mfxDecParams.mfx.FrameInfo.Height);
+    ASSERT_EQ(32, mfxDecParams.mfx.FrameInfo.CropW);
+    ASSERT_EQ(32, mfxDecParams.mfx.FrameInfo.CropH);
+    ASSERT_EQ(MFX_FOURCC_I420, mfxDecParams.mfx.FrameInfo.FourCC);
+    ASSERT_EQ(MFX_PROFILE_JPEG_BASELINE, mfxDecParams.mfx.CodecProfile);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+// sequence headers written for these tests, the parser of the runtime reads
+//   them without decoding a frame
+
+// AVC SPS, High profile level 4, 1920x1088 coded and cropped to 1920x1080,
+//   square samples, 30000/1001 fps
+static const mfxU8 avcSequenceParameterSet[] = {
+    0x00, 0x00, 0x00, 0x01, 0x67, 0x64, 0x00, 0x28, 0xac, 0xd9, 0x40, 0x78, 0x02,
+    0x27, 0xe5, 0xc0, 0x44, 0x00, 0x00, 0x0f, 0xa4, 0x00, 0x03, 0xa9, 0x82, 0x10,
+};
+
+// temporal delimiter and sequence header OBU, Main profile level 4.0,
+//   1280x720 10-bit 4:2:0, 60000/1001 fps
+static const mfxU8 av1SequenceHeader[] = {
+    0x12, 0x00, 0x0a, 0x14, 0x04, 0x00, 0x00, 0x0f, 0xa4, 0x00, 0x03, 0xa9,
+    0x80, 0x00, 0x00, 0x10, 0xaa, 0x9f, 0xeb, 0x3c, 0x02, 0x79, 0xc0, 0x40,
+};
+
+// sequence_header(), sequence_extension() and sequence_display_extension() of
+//   MPEG-2, Main profile at Main level, 720x576 16:9 at 25 fps
+static const mfxU8 mpeg2SequenceHeader[] = {
+    0x00, 0x00, 0x01, 0xb3, 0x2d, 0x02, 0x40, 0x33, 0x13, 0x88, 0x23, 0x80,
+    0x00, 0x00, 0x01, 0xb5, 0x14, 0x82, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+    0x01, 0xb5, 0x2a, 0x0b, 0x42, 0x12, 0x00, 0x00, 0x00, 0x01, 0xb8,
+};
+
+static mfxStatus DecodeHeaderOf(mfxU32 codecId,
+                                const mfxU8 *data,
+                                mfxU32 size,
+                                mfxVideoParam *mfxDecParams) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    if (sts != MFX_ERR_NONE)
+        return sts;
+
+    *mfxDecParams             = {};
+    mfxDecParams->mfx.CodecId = codecId;
+    mfxDecParams->IOPattern   = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    // the parser does not write to the data
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = size;
+    mfxBS.Data                         = const_cast<mfxU8 *>(data);
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, mfxDecParams);
+
+    EXPECT_EQ(MFXClose(session), MFX_ERR_NONE);
+    return sts;
+}
+
+TEST(DecodeHeader, AVCSequenceParameterSetReturnsCorrectMetadata) {
+    mfxVideoParam mfxDecParams = {};
+    mfxStatus sts              = DecodeHeaderOf(MFX_CODEC_AVC,
+                                                avcSequenceParameterSet,
+                                                sizeof(avcSequenceParameterSet),
+                                                &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    //check metadata
+    const mfxFrameInfo &info = mfxDecParams.mfx.FrameInfo;
+    EXPECT_EQ(1920, info.Width);
+    EXPECT_EQ(1080, info.Height);
+    EXPECT_EQ(0, info.CropX);
+    EXPECT_EQ(0, info.CropY);
+    EXPECT_EQ(1920, info.CropW);
+    EXPECT_EQ(1080, info.CropH);
+    EXPECT_EQ(30000u, info.FrameRateExtN);
+    EXPECT_EQ(1001u, info.FrameRateExtD);
+    EXPECT_EQ(1, info.AspectRatioW);
+    EXPECT_EQ(1, info.AspectRatioH);
+    EXPECT_EQ(MFX_FOURCC_I420, info.FourCC);
+    EXPECT_EQ(8, info.BitDepthLuma);
+    EXPECT_EQ(MFX_CHROMAFORMAT_YUV420, info.ChromaFormat);
+    EXPECT_EQ(MFX_PROFILE_AVC_HIGH, mfxDecParams.mfx.CodecProfile);
+    EXPECT_EQ(MFX_LEVEL_AVC_4, mfxDecParams.mfx.CodecLevel);
+}
+
+TEST(DecodeHeader, AV1SequenceHeaderReturnsCorrectMetadata) {
+    mfxVideoParam mfxDecParams = {};
+    mfxStatus sts              = DecodeHeaderOf(MFX_CODEC_AV1,
+                                                av1SequenceHeader,
+                                                sizeof(av1SequenceHeader),
+                                                &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    //check metadata
+    const mfxFrameInfo &info = mfxDecParams.mfx.FrameInfo;
+    EXPECT_EQ(1280, info.Width);
+    EXPECT_EQ(720, info.Height);
+    EXPECT_EQ(1280, info.CropW);
+    EXPECT_EQ(720, info.CropH);
+    EXPECT_EQ(60000u, info.FrameRateExtN);
+    EXPECT_EQ(1001u, info.FrameRateExtD);
+    EXPECT_EQ(MFX_FOURCC_I010, info.FourCC);
+    EXPECT_EQ(10, info.BitDepthLuma);
+    EXPECT_EQ(10, info.BitDepthChroma);
+    EXPECT_EQ(MFX_PROFILE_AV1_MAIN, mfxDecParams.mfx.CodecProfile);
+    EXPECT_EQ(MFX_LEVEL_AV1_4, mfxDecParams.mfx.CodecLevel);
+}
+
+TEST(DecodeHeader, MPEG2SequenceHeaderReturnsCorrectMetadata) {
+    mfxVideoParam mfxDecParams = {};
+    mfxStatus sts              = DecodeHeaderOf(MFX_CODEC_MPEG2,
+                                                mpeg2SequenceHeader,
+                                                sizeof(mpeg2SequenceHeader),
+                                                &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    //check metadata, 16:9 on 720x576 are samples of 64:45
+    const mfxFrameInfo &info = mfxDecParams.mfx.FrameInfo;
+    EXPECT_EQ(720, info.Width);
+    EXPECT_EQ(576, info.Height);
+    EXPECT_EQ(720, info.CropW);
+    EXPECT_EQ(576, info.CropH);
+    EXPECT_EQ(25u, info.FrameRateExtN);
+    EXPECT_EQ(1u, info.FrameRateExtD);
+    EXPECT_EQ(64, info.AspectRatioW);
+    EXPECT_EQ(45, info.AspectRatioH);
+    EXPECT_EQ(MFX_FOURCC_I420, info.FourCC);
+    EXPECT_EQ(8, info.BitDepthLuma);
+    EXPECT_EQ(MFX_PROFILE_MPEG2_MAIN, mfxDecParams.mfx.CodecProfile);
+    EXPECT_EQ(MFX_LEVEL_MPEG2_MAIN, mfxDecParams.mfx.CodecLevel);
+}
+
+// the parser needs more data, so libav gets to decode the headers, which it
+//   cannot either
+TEST(DecodeHeader, TruncatedSequenceHeadersReturnMoreData) {
+    mfxVideoParam mfxDecParams = {};
+    mfxStatus sts = DecodeHeaderOf(MFX_CODEC_AVC, avcSequenceParameterSet, 12, &mfxDecParams);
+    EXPECT_EQ(sts, MFX_ERR_MORE_DATA);
+
+    sts = DecodeHeaderOf(MFX_CODEC_AV1, av1SequenceHeader, 12, &mfxDecParams);
+    EXPECT_EQ(sts, MFX_ERR_MORE_DATA);
+
+    sts = DecodeHeaderOf(MFX_CODEC_MPEG2, mpeg2SequenceHeader, 10, &mfxDecParams);
+    EXPECT_EQ(sts, MFX_ERR_MORE_DATA);
+}
+
 TEST(DecodeHeader, NullSessionReturnsInvalidHandle) {
     mfxStatus sts = MFXVideoDECODE_DecodeHeader(0, nullptr, nullptr);
     ASSERT_EQ(sts, MFX_ERR_INVALID_HANDLE);
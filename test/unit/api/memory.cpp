@@ -5,7 +5,12 @@
   ############################################################################*/
 
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
 #include "api/test_bitstreams.h"
+#include "vpl/mfxcpu.h"
 #include "vpl/mfxjpeg.h"
 #include "vpl/mfxsurfacepool.h"
 #include "vpl/mfxvideo.h"
@@ -94,7 +99,7 @@ static mfxStatus InitEncodeBasic(mfxSession *session) {
     return sts;
 }
 
-static mfxStatus InitVPPBasic(mfxSession *session) {
+static mfxStatus InitVPPBasic(mfxSession *session, mfxExtBuffer *extParam = nullptr) {
     mfxVersion ver = {};
     ver.Major      = 2;
     ver.Minor      = 0;
@@ -121,6 +126,11 @@ static mfxStatus InitVPPBasic(mfxSession *session) {
 
     mfxVPPParams.vpp.Out = mfxVPPParams.vpp.In;
 
+    if (extParam) {
+        mfxVPPParams.NumExtParam = 1;
+        mfxVPPParams.ExtParam    = &extParam;
+    }
+
     sts = MFXVideoVPP_Init(*session, &mfxVPPParams);
     if (sts)
         return sts;
@@ -173,6 +183,227 @@ TEST(Memory_GetSurfaceForVPPIn, InitializedVPPReturnsSurface) {
     EXPECT_EQ(sts, MFX_ERR_NONE);
 }
 
+TEST(Memory_GetSurfaceForVPPIn, SurfacesReleasedOnOtherThreadsAreReused) {
+    mfxStatus sts;
+    mfxSession session;
+
+    // init VPP
+    sts = InitVPPBasic(&session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+
+    const int nSurfaces = 8;
+    std::vector<mfxFrameSurface1 *> surfaces(nSurfaces, nullptr);
+    for (int i = 0; i < nSurfaces; i++) {
+        sts = MFXMemory_GetSurfaceForVPPIn(session, &surfaces[i]);
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+    }
+
+    // release concurrently, while this thread keeps taking surfaces
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nSurfaces; i++) {
+        mfxFrameSurface1 *surface = surfaces[i];
+        threads.emplace_back([surface]() {
+            EXPECT_EQ(surface->FrameInterface->Release(surface), MFX_ERR_NONE);
+        });
+    }
+    std::vector<mfxFrameSurface1 *> extra;
+    for (int i = 0; i < nSurfaces; i++) {
+        mfxFrameSurface1 *surface = nullptr;
+        sts                       = MFXMemory_GetSurfaceForVPPIn(session, &surface);
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+        extra.push_back(surface);
+    }
+    for (auto &t : threads)
+        t.join();
+    for (mfxFrameSurface1 *surface : extra)
+        surface->FrameInterface->Release(surface);
+
+    // every surface is free now, no new one must be allocated
+    surfaces.insert(surfaces.end(), extra.begin(), extra.end());
+    std::vector<mfxFrameSurface1 *> reused;
+    for (int i = 0; i < nSurfaces; i++) {
+        mfxFrameSurface1 *surface = nullptr;
+        sts                       = MFXMemory_GetSurfaceForVPPIn(session, &surface);
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+        EXPECT_NE(std::find(surfaces.begin(), surfaces.end(), surface), surfaces.end());
+        reused.push_back(surface);
+    }
+    for (mfxFrameSurface1 *surface : reused)
+        surface->FrameInterface->Release(surface);
+
+    //free internal resources
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(Memory_GetSurfaceForVPPIn, LimitedPoolReturnsWrnTimeoutWhenExhausted) {
+    mfxStatus sts;
+    mfxSession session;
+
+    mfxExtCPUSurfacePool poolParam;
+    memset(&poolParam, 0, sizeof(poolParam));
+    poolParam.Header.BufferId  = MFX_EXTBUFF_CPU_SURFACE_POOL;
+    poolParam.Header.BufferSz  = sizeof(poolParam);
+    poolParam.AllocationPolicy = MFX_ALLOCATION_LIMITED;
+    poolParam.NumSurfaces      = 2;
+    poolParam.Wait             = 0;
+
+    // init VPP
+    sts = InitVPPBasic(&session, &poolParam.Header);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+
+    mfxFrameSurface1 *surface1 = nullptr;
+    mfxFrameSurface1 *surface2 = nullptr;
+    mfxFrameSurface1 *surface3 = nullptr;
+    sts                        = MFXMemory_GetSurfaceForVPPIn(session, &surface1);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    sts = MFXMemory_GetSurfaceForVPPIn(session, &surface2);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // both surfaces are in use
+    sts = MFXMemory_GetSurfaceForVPPIn(session, &surface3);
+    EXPECT_EQ(sts, MFX_WRN_ALLOC_TIMEOUT_EXPIRED);
+    EXPECT_EQ(surface3, nullptr);
+
+    mfxGUID guid = { MFX_GUID_SURFACE_POOL };
+    mfxHDL interface;
+    sts = surface1->FrameInterface->QueryInterface(surface1, guid, &interface);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    mfxSurfacePoolInterface *surfacePoolInterface =
+        reinterpret_cast<mfxSurfacePoolInterface *>(interface);
+
+    mfxPoolAllocationPolicy policy;
+    sts = surfacePoolInterface->GetAllocationPolicy(surfacePoolInterface, &policy);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    EXPECT_EQ(policy, MFX_ALLOCATION_LIMITED);
+
+    mfxU32 size = 0;
+    sts         = surfacePoolInterface->GetMaximumPoolSize(surfacePoolInterface, &size);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    EXPECT_EQ(size, 2u);
+
+    // a released surface is handed out again
+    surface2->FrameInterface->Release(surface2);
+    sts = MFXMemory_GetSurfaceForVPPIn(session, &surface3);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    EXPECT_EQ(surface3, surface2);
+
+    // revoking frees idle surfaces and lowers the limit
+    surface3->FrameInterface->Release(surface3);
+    sts = surfacePoolInterface->RevokeSurfaces(surfacePoolInterface, 1);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    sts = surfacePoolInterface->GetCurrentPoolSize(surfacePoolInterface, &size);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    EXPECT_EQ(size, 1u);
+
+    surfacePoolInterface->Release(surfacePoolInterface);
+    surface1->FrameInterface->Release(surface1);
+
+    //free internal resources
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(Memory_GetSurfaceForVPPIn, PoolStatsReportSurfacesAndBytes) {
+    mfxStatus sts;
+    mfxSession session;
+
+    // init VPP
+    sts = InitVPPBasic(&session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+
+    const int nSurfaces = 3;
+    std::vector<mfxFrameSurface1 *> surfaces(nSurfaces, nullptr);
+    for (int i = 0; i < nSurfaces; i++) {
+        sts = MFXMemory_GetSurfaceForVPPIn(session, &surfaces[i]);
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+    }
+    for (mfxFrameSurface1 *surface : surfaces)
+        surface->FrameInterface->Release(surface);
+
+    mfxExtCPUSurfacePoolStats stats;
+    memset(&stats, 0, sizeof(stats));
+    stats.Header.BufferId = MFX_EXTBUFF_CPU_SURFACE_POOL_STATS;
+    stats.Header.BufferSz = sizeof(stats);
+
+    mfxExtBuffer *extParam = &stats.Header;
+    mfxVideoParam par;
+    memset(&par, 0, sizeof(par));
+    par.NumExtParam = 1;
+    par.ExtParam    = &extParam;
+
+    sts = MFXVideoVPP_GetVideoParam(session, &par);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    EXPECT_EQ(par.ExtParam, &extParam);
+
+    EXPECT_EQ(stats.In.NumSurfaces, (mfxU32)nSurfaces);
+    EXPECT_EQ(stats.In.PeakNumSurfaces, (mfxU32)nSurfaces);
+    EXPECT_EQ(stats.In.NumTrimmed, 0u);
+    // 352x288 I420
+    EXPECT_GE(stats.In.AllocatedBytes, (mfxU64)nSurfaces * 352 * 288 * 3 / 2);
+    EXPECT_EQ(stats.In.PeakAllocatedBytes, stats.In.AllocatedBytes);
+
+    // output pool is not created yet
+    EXPECT_EQ(stats.Out.NumSurfaces, 0u);
+    EXPECT_EQ(stats.Out.AllocatedBytes, 0u);
+
+    //free internal resources
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(Memory_GetSurfaceForVPPIn, IdleSurfacesAreTrimmed) {
+    mfxStatus sts;
+    mfxSession session;
+
+    mfxExtCPUSurfacePool poolParam;
+    memset(&poolParam, 0, sizeof(poolParam));
+    poolParam.Header.BufferId  = MFX_EXTBUFF_CPU_SURFACE_POOL;
+    poolParam.Header.BufferSz  = sizeof(poolParam);
+    poolParam.AllocationPolicy = MFX_ALLOCATION_UNLIMITED;
+    poolParam.IdleTimeout      = 1;
+    poolParam.MinSurfaces      = 1;
+
+    // init VPP
+    sts = InitVPPBasic(&session, &poolParam.Header);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+
+    const int nSurfaces = 4;
+    std::vector<mfxFrameSurface1 *> surfaces(nSurfaces, nullptr);
+    for (int i = 0; i < nSurfaces; i++) {
+        sts = MFXMemory_GetSurfaceForVPPIn(session, &surfaces[i]);
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+    }
+    for (mfxFrameSurface1 *surface : surfaces)
+        surface->FrameInterface->Release(surface);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    // idle surfaces are freed on the next request, down to MinSurfaces
+    mfxFrameSurface1 *surface = nullptr;
+    sts                       = MFXMemory_GetSurfaceForVPPIn(session, &surface);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxGUID guid = { MFX_GUID_SURFACE_POOL };
+    mfxHDL interface;
+    sts = surface->FrameInterface->QueryInterface(surface, guid, &interface);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    mfxSurfacePoolInterface *surfacePoolInterface =
+        reinterpret_cast<mfxSurfacePoolInterface *>(interface);
+
+    mfxU32 size = 0;
+    sts         = surfacePoolInterface->GetCurrentPoolSize(surfacePoolInterface, &size);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    EXPECT_EQ(size, 1u);
+
+    surfacePoolInterface->Release(surfacePoolInterface);
+    surface->FrameInterface->Release(surface);
+
+    //free internal resources
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
 TEST(Memory_GetSurfaceForVPPIn, NullSurfaceReturnsErrNull) {
     mfxStatus sts;
     mfxSession session;
@@ -383,6 +614,288 @@ TEST(Memory_GetSurfaceForEncode, UninitializedEncodeReturnsNotInitialized) {
     EXPECT_EQ(sts, MFX_ERR_NONE);
 }
 
+//ImportFrameSurface
+static void MFX_CDECL CountImportRelease(mfxHDL pthis) {
+    (*static_cast<int *>(pthis))++;
+}
+
+TEST(Memory_ImportFrameSurface, ImportedSurfaceIsEncodedWithoutCopy) {
+    mfxStatus sts;
+    mfxSession session;
+
+    // init encode
+    sts = InitEncodeBasic(&session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxCPUMemoryInterface *memoryInterface = nullptr;
+
+    sts = MFXVideoCORE_GetHandle(session,
+                                 MFX_HANDLE_CPU_MEMORY_INTERFACE,
+                                 reinterpret_cast<mfxHDL *>(&memoryInterface));
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_NE(memoryInterface, nullptr);
+
+    // 352x288 I420 with padded rows, as a capture buffer would have
+    const mfxU16 pitch = 384;
+    std::vector<mfxU8> image(pitch * 288 * 3 / 2, 0x80);
+    int numReleased = 0;
+
+    mfxCPUSurfaceSystem external;
+    memset(&external, 0, sizeof(external));
+    external.Info.FourCC = MFX_FOURCC_I420;
+    external.Info.Width  = 352;
+    external.Info.Height = 288;
+    external.Info.CropW  = 352;
+    external.Info.CropH  = 288;
+    external.Data.Y      = image.data();
+    external.Data.U      = external.Data.Y + pitch * 288;
+    external.Data.V      = external.Data.U + pitch / 2 * 144;
+    external.Data.Pitch  = pitch;
+    external.pthis       = &numReleased;
+    external.Release     = CountImportRelease;
+
+    mfxFrameSurface1 *surface = nullptr;
+
+    sts = memoryInterface->ImportFrameSurface(memoryInterface, &external, &surface);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_NE(surface, nullptr);
+
+    // the surface points into the application buffer
+    EXPECT_EQ(surface->Data.Y, image.data());
+    EXPECT_EQ(surface->Data.Pitch, pitch);
+    EXPECT_EQ(surface->Info.FourCC, (mfxU32)MFX_FOURCC_I420);
+
+    mfxBitstream bs = {};
+    std::vector<mfxU8> bsData(2000000);
+    bs.MaxLength = static_cast<mfxU32>(bsData.size());
+    bs.Data      = bsData.data();
+
+    mfxSyncPoint syncp = nullptr;
+    sts                = MFXVideoENCODE_EncodeFrameAsync(session, nullptr, surface, &bs, &syncp);
+    EXPECT_TRUE(sts == MFX_ERR_NONE || sts == MFX_ERR_MORE_DATA);
+    surface->FrameInterface->Release(surface);
+
+    // drain
+    while (sts >= MFX_ERR_NONE) {
+        if (syncp) {
+            sts = MFXVideoCORE_SyncOperation(session, syncp, MFX_INFINITE);
+            EXPECT_EQ(sts, MFX_ERR_NONE);
+            syncp = nullptr;
+        }
+        sts = MFXVideoENCODE_EncodeFrameAsync(session, nullptr, nullptr, &bs, &syncp);
+    }
+    EXPECT_EQ(sts, MFX_ERR_MORE_DATA);
+    EXPECT_GT(bs.DataLength, 0u);
+
+    // the application gets its buffer back once the encoder is done with it
+    sts = MFXVideoENCODE_Close(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    EXPECT_EQ(numReleased, 1);
+
+    //free internal resources
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(Memory_ImportFrameSurface, UnsupportedFourCCReturnsUnsupported) {
+    mfxStatus sts;
+    mfxSession session;
+
+    mfxVersion ver = { 0, 2 };
+    sts            = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxCPUMemoryInterface *memoryInterface = nullptr;
+
+    sts = MFXVideoCORE_GetHandle(session,
+                                 MFX_HANDLE_CPU_MEMORY_INTERFACE,
+                                 reinterpret_cast<mfxHDL *>(&memoryInterface));
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    std::vector<mfxU8> image(64 * 32 * 2);
+
+    mfxCPUSurfaceSystem external;
+    memset(&external, 0, sizeof(external));
+    external.Info.FourCC = MFX_FOURCC_YUY2;
+    external.Info.Width  = 32;
+    external.Info.Height = 32;
+    external.Data.Y      = image.data();
+    external.Data.Pitch  = 64;
+
+    mfxFrameSurface1 *surface = nullptr;
+
+    sts = memoryInterface->ImportFrameSurface(memoryInterface, &external, &surface);
+    EXPECT_EQ(sts, MFX_ERR_UNSUPPORTED);
+    EXPECT_EQ(surface, nullptr);
+
+    //free internal resources
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+//GetMemoryStats
+TEST(Memory_GetMemoryStats, EncodeSurfaceIsCounted) {
+    mfxStatus sts;
+    mfxSession session;
+
+    // init encode
+    sts = InitEncodeBasic(&session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxCPUMemoryInterface *memoryInterface = nullptr;
+
+    sts = MFXVideoCORE_GetHandle(session,
+                                 MFX_HANDLE_CPU_MEMORY_INTERFACE,
+                                 reinterpret_cast<mfxHDL *>(&memoryInterface));
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_NE(memoryInterface->GetMemoryStats, nullptr);
+
+    mfxFrameSurface1 *encSurfaceIn = nullptr;
+    sts                            = MFXMemory_GetSurfaceForEncode(session, &encSurfaceIn);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxCPUMemoryStats stats = {};
+    sts                     = memoryInterface->GetMemoryStats(memoryInterface, &stats);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // at least one 352x288 I420 surface
+    EXPECT_GE(stats.SurfaceBytes, 352u * 288 * 3 / 2);
+    EXPECT_EQ(stats.TotalBytes,
+              stats.SurfaceBytes + stats.DecodeFrameBytes + stats.BitstreamBytes);
+    EXPECT_GE(stats.PeakTotalBytes, stats.TotalBytes);
+
+    encSurfaceIn->FrameInterface->Release(encSurfaceIn);
+
+    // the pool is freed with the encoder
+    sts = MFXVideoENCODE_Close(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    sts = memoryInterface->GetMemoryStats(memoryInterface, &stats);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    EXPECT_EQ(stats.SurfaceBytes, 0u);
+
+    //free internal resources
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(Memory_GetMemoryStats, NullStatsReturnsErrNull) {
+    mfxStatus sts;
+    mfxSession session;
+
+    mfxVersion ver = { 0, 2 };
+    sts            = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxCPUMemoryInterface *memoryInterface = nullptr;
+
+    sts = MFXVideoCORE_GetHandle(session,
+                                 MFX_HANDLE_CPU_MEMORY_INTERFACE,
+                                 reinterpret_cast<mfxHDL *>(&memoryInterface));
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = memoryInterface->GetMemoryStats(memoryInterface, nullptr);
+    EXPECT_EQ(sts, MFX_ERR_NULL_PTR);
+
+    //free internal resources
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+// decodes the HEVC stream with surfaces of the runtime, in a session pinned
+//   to CPU 0 if pinned is set, returns the memory stats of the session once
+//   the first frame is out
+static void DecodeHEVCWithCache(mfxCPUMemoryStats *firstFrameStats, bool pinned) {
+    mfxExtCPUBufferCache cache = {};
+    cache.Header.BufferId      = MFX_EXTBUFF_CPU_BUFFER_CACHE;
+    cache.Header.BufferSz      = sizeof(mfxExtCPUBufferCache);
+    cache.MaxBytes             = 256 * 1024 * 1024; // the default
+
+    mfxExtCPUAffinity affinity = {};
+    affinity.Header.BufferId   = MFX_EXTBUFF_CPU_AFFINITY;
+    affinity.Header.BufferSz   = sizeof(mfxExtCPUAffinity);
+    affinity.NumaNode          = MFX_CPU_NUMA_NODE_ANY;
+    affinity.CpuMask[0]        = 1; // CPU 0
+    mfxExtBuffer *extParam[]   = { &cache.Header, &affinity.Header };
+
+    mfxInitParam initPar   = { 0 };
+    initPar.Version.Major  = 2;
+    initPar.Version.Minor  = 0;
+    initPar.Implementation = MFX_IMPL_SOFTWARE;
+    initPar.ExtParam       = extParam;
+    initPar.NumExtParam    = pinned ? 2 : 1;
+
+    mfxSession session;
+    mfxStatus sts = MFXInitEx(initPar, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxCPUMemoryInterface *memoryInterface = nullptr;
+
+    sts = MFXVideoCORE_GetHandle(session,
+                                 MFX_HANDLE_CPU_MEMORY_INTERFACE,
+                                 reinterpret_cast<mfxHDL *>(&memoryInterface));
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxBitstream mfxBS = {};
+    mfxBS.CodecId      = MFX_CODEC_HEVC;
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
+    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
+
+    mfxBitstream *bs = &mfxBS;
+    mfxU32 nFrames   = 0;
+    for (;;) {
+        mfxFrameSurface1 *surface_out = nullptr;
+        mfxSyncPoint syncp            = nullptr;
+
+        sts = MFXVideoDECODE_DecodeFrameAsync(session, bs, nullptr, &surface_out, &syncp);
+        if (sts == MFX_ERR_MORE_DATA) {
+            if (!bs)
+                break;
+            bs = nullptr;
+            continue;
+        }
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+
+        sts = MFXVideoCORE_SyncOperation(session, syncp, MFX_INFINITE);
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+        if (nFrames++ == 0) {
+            sts = memoryInterface->GetMemoryStats(memoryInterface, firstFrameStats);
+            ASSERT_EQ(sts, MFX_ERR_NONE);
+        }
+        surface_out->FrameInterface->Release(surface_out);
+    }
+    EXPECT_EQ(nFrames, 8u);
+
+    //free internal resources
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+// the buffers of a closed decoder go to the next one with the same frame size
+TEST(Memory_GetMemoryStats, SecondDecodeReusesCachedBuffers) {
+    mfxCPUMemoryStats first  = {};
+    mfxCPUMemoryStats second = {};
+    DecodeHEVCWithCache(&first, false);
+    DecodeHEVCWithCache(&second, false);
+
+    EXPECT_NE(second.DecodeFrameBytes, 0u);
+    EXPECT_NE(second.ReusedBytes, 0u);
+}
+
+// buffers first written on other CPUs may be on another NUMA node, a pinned
+//   session only reuses those of sessions pinned to the same CPUs
+TEST(Memory_GetMemoryStats, PinnedDecodeDoesNotReuseUnpinnedBuffers) {
+    mfxCPUMemoryStats unpinned = {};
+    mfxCPUMemoryStats first    = {};
+    mfxCPUMemoryStats second   = {};
+    DecodeHEVCWithCache(&unpinned, false);
+    DecodeHEVCWithCache(&first, true);
+    DecodeHEVCWithCache(&second, true);
+
+    EXPECT_NE(first.DecodeFrameBytes, 0u);
+    EXPECT_EQ(first.ReusedBytes, 0u);
+    EXPECT_NE(second.ReusedBytes, 0u);
+}
+
 //GetSurfaceForDecode
 TEST(Memory_GetSurfaceForDecode, InitializedDecodeReturnsSurface) {
     mfxStatus sts;
@@ -1458,7 +1971,7 @@ TEST(Memory_FrameInterfaceQueryInterface,
         reinterpret_cast<mfxSurfacePoolInterface *>(interface);
     EXPECT_NE(surfacePoolInterface, nullptr);
 
-    // CPU RT only supports MFX_ALLOCATION_UNLIMITED, so this should return warning (input is ignored)
+    // pools are MFX_ALLOCATION_UNLIMITED by default, so this should return warning (input is ignored)
     sts = surfacePoolInterface->SetNumSurfaces(surfacePoolInterface, 5);
     EXPECT_EQ(sts, MFX_WRN_INCOMPATIBLE_VIDEO_PARAM);
 
@@ -1513,7 +2026,7 @@ TEST(Memory_FrameInterfaceQueryInterface,
         reinterpret_cast<mfxSurfacePoolInterface *>(interface);
     EXPECT_NE(surfacePoolInterface, nullptr);
 
-    // CPU RT only supports MFX_ALLOCATION_UNLIMITED, so this should return warning (input is ignored)
+    // pools are MFX_ALLOCATION_UNLIMITED by default, so this should return warning (input is ignored)
     sts = surfacePoolInterface->SetNumSurfaces(surfacePoolInterface, 5);
     EXPECT_EQ(sts, MFX_WRN_INCOMPATIBLE_VIDEO_PARAM);
 
@@ -1545,7 +2058,7 @@ TEST(Memory_FrameInterfaceQueryInterface,
         reinterpret_cast<mfxSurfacePoolInterface *>(interface);
     EXPECT_NE(surfacePoolInterface, nullptr);
 
-    // CPU RT only supports MFX_ALLOCATION_UNLIMITED, so this should return warning (input is ignored)
+    // pools are MFX_ALLOCATION_UNLIMITED by default, so this should return warning (input is ignored)
     sts = surfacePoolInterface->SetNumSurfaces(surfacePoolInterface, 5);
     EXPECT_EQ(sts, MFX_WRN_INCOMPATIBLE_VIDEO_PARAM);
 
@@ -1575,7 +2088,7 @@ TEST(Memory_FrameInterfaceQueryInterface, GUIDSurfacePoolGetAllocationPolicyVali
         reinterpret_cast<mfxSurfacePoolInterface *>(interface);
     EXPECT_NE(surfacePoolInterface, nullptr);
 
-    // CPU RT only supports MFX_ALLOCATION_UNLIMITED
+    // pools are MFX_ALLOCATION_UNLIMITED by default
     mfxPoolAllocationPolicy policy = (mfxPoolAllocationPolicy)0xFFFFFFFF;
     sts = surfacePoolInterface->GetAllocationPolicy(surfacePoolInterface, &policy);
     EXPECT_EQ(sts, MFX_ERR_NONE);
@@ -1605,7 +2118,7 @@ TEST(Memory_FrameInterfaceQueryInterface,
         reinterpret_cast<mfxSurfacePoolInterface *>(interface);
     EXPECT_NE(surfacePoolInterface, nullptr);
 
-    // CPU RT only supports MFX_ALLOCATION_UNLIMITED
+    // pools are MFX_ALLOCATION_UNLIMITED by default
     mfxPoolAllocationPolicy policy = (mfxPoolAllocationPolicy)0xFFFFFFFF;
     sts                            = surfacePoolInterface->GetAllocationPolicy(nullptr, &policy);
     EXPECT_EQ(sts, MFX_ERR_NULL_PTR);
@@ -1633,7 +2146,7 @@ TEST(Memory_FrameInterfaceQueryInterface, GUIDSurfacePoolGetMaximumPoolSizeValid
         reinterpret_cast<mfxSurfacePoolInterface *>(interface);
     EXPECT_NE(surfacePoolInterface, nullptr);
 
-    // CPU RT only supports MFX_ALLOCATION_UNLIMITED
+    // pools are MFX_ALLOCATION_UNLIMITED by default
     mfxU32 size = 0;
     sts         = surfacePoolInterface->GetMaximumPoolSize(surfacePoolInterface, &size);
     EXPECT_EQ(sts, MFX_ERR_NONE);
@@ -1663,7 +2176,7 @@ TEST(Memory_FrameInterfaceQueryInterface,
         reinterpret_cast<mfxSurfacePoolInterface *>(interface);
     EXPECT_NE(surfacePoolInterface, nullptr);
 
-    // CPU RT only supports MFX_ALLOCATION_UNLIMITED
+    // pools are MFX_ALLOCATION_UNLIMITED by default
     mfxU32 size = 0;
     sts         = surfacePoolInterface->GetMaximumPoolSize(nullptr, &size);
     EXPECT_EQ(sts, MFX_ERR_NULL_PTR);
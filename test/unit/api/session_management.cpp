@@ -6,6 +6,7 @@
 
 #include <gtest/gtest.h>
 #include <tuple>
+#include "vpl/mfxcpu.h"
 #include "vpl/mfxvideo.h"
 
 // MFXInit tests
@@ -48,6 +49,72 @@ TEST(InitEx, ValidInputReturnsErrNone) {
     EXPECT_EQ(sts, MFX_ERR_NONE);
 }
 
+TEST(InitEx, AffinityParamReturnsErrNone) {
+    mfxExtCPUAffinity affinity = {};
+    affinity.Header.BufferId   = MFX_EXTBUFF_CPU_AFFINITY;
+    affinity.Header.BufferSz   = sizeof(mfxExtCPUAffinity);
+    affinity.NumaNode          = MFX_CPU_NUMA_NODE_ANY;
+    affinity.CpuMask[0]        = 1; // CPU 0
+    mfxExtBuffer *extParam[]   = { &affinity.Header };
+
+    mfxInitParam initPar   = { 0 };
+    initPar.Version.Major  = 2;
+    initPar.Version.Minor  = 0;
+    initPar.Implementation = MFX_IMPL_SOFTWARE;
+    initPar.ExtParam       = extParam;
+    initPar.NumExtParam    = 1;
+
+    mfxSession session;
+    mfxStatus sts = MFXInitEx(initPar, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    //free internal resources
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(InitEx, BadAffinityBufferSizeReturnsInvalidVideoParam) {
+    mfxExtCPUAffinity affinity = {};
+    affinity.Header.BufferId   = MFX_EXTBUFF_CPU_AFFINITY;
+    affinity.Header.BufferSz   = sizeof(mfxExtBuffer);
+    affinity.NumaNode          = MFX_CPU_NUMA_NODE_ANY;
+    mfxExtBuffer *extParam[]   = { &affinity.Header };
+
+    mfxInitParam initPar   = { 0 };
+    initPar.Version.Major  = 2;
+    initPar.Version.Minor  = 0;
+    initPar.Implementation = MFX_IMPL_SOFTWARE;
+    initPar.ExtParam       = extParam;
+    initPar.NumExtParam    = 1;
+
+    mfxSession session;
+    mfxStatus sts = MFXInitEx(initPar, &session);
+    ASSERT_EQ(sts, MFX_ERR_INVALID_VIDEO_PARAM);
+}
+
+TEST(InitEx, BufferCacheParamReturnsErrNone) {
+    mfxExtCPUBufferCache cache = {};
+    cache.Header.BufferId      = MFX_EXTBUFF_CPU_BUFFER_CACHE;
+    cache.Header.BufferSz      = sizeof(mfxExtCPUBufferCache);
+    cache.MaxBytes             = 256 * 1024 * 1024; // the default, other tests are not affected
+    mfxExtBuffer *extParam[]   = { &cache.Header };
+
+    mfxInitParam initPar   = { 0 };
+    initPar.Version.Major  = 2;
+    initPar.Version.Minor  = 0;
+    initPar.Implementation = MFX_IMPL_SOFTWARE;
+    initPar.ExtParam       = extParam;
+    initPar.NumExtParam    = 1;
+
+    mfxSession session;
+    mfxStatus sts = MFXInitEx(initPar, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    //free internal resources
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
 // MFXClose tests
 
 TEST(Close, InitializedSessionReturnsErrNone) {
@@ -179,3 +246,159 @@ TEST(Initialize, NullSessionReturnsInvalidHandle) {
     mfxStatus sts = MFXInitialize(initPar2, nullptr);
     ASSERT_EQ(sts, MFX_ERR_NULL_PTR);
 }
+
+//MFXJoinSession
+TEST(JoinSession, ValidSessionsReturnErrNone) {
+    mfxVersion ver = {};
+    mfxSession session1, session2;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session1);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session2);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXJoinSession(session1, session2);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXDisjoinSession(session2);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    //free internal resources
+    sts = MFXClose(session1);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXClose(session2);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(JoinSession, SameSessionReturnsUndefinedBehavior) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXJoinSession(session, session);
+    ASSERT_EQ(sts, MFX_ERR_UNDEFINED_BEHAVIOR);
+
+    //free internal resources
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(JoinSession, CloseParentWithChildReturnsUndefinedBehavior) {
+    mfxVersion ver = {};
+    mfxSession session1, session2;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session1);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session2);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXJoinSession(session1, session2);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXClose(session1);
+    ASSERT_EQ(sts, MFX_ERR_UNDEFINED_BEHAVIOR);
+
+    // closing the child disjoins it
+    sts = MFXClose(session2);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXClose(session1);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(JoinSession, NullSessionReturnsInvalidHandle) {
+    mfxStatus sts = MFXJoinSession(nullptr, nullptr);
+    ASSERT_EQ(sts, MFX_ERR_INVALID_HANDLE);
+}
+
+//MFXDisjoinSession
+TEST(DisjoinSession, NotJoinedSessionReturnsUndefinedBehavior) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXDisjoinSession(session);
+    ASSERT_EQ(sts, MFX_ERR_UNDEFINED_BEHAVIOR);
+
+    //free internal resources
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DisjoinSession, NullSessionReturnsInvalidHandle) {
+    mfxStatus sts = MFXDisjoinSession(nullptr);
+    ASSERT_EQ(sts, MFX_ERR_INVALID_HANDLE);
+}
+
+//MFXSetPriority
+TEST(SetPriority, ValidPriorityReturnsErrNone) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXSetPriority(session, MFX_PRIORITY_HIGH);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxPriority priority = MFX_PRIORITY_LOW;
+    sts                  = MFXGetPriority(session, &priority);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(priority, MFX_PRIORITY_HIGH);
+
+    //free internal resources
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(SetPriority, InvalidPriorityReturnsUnsupported) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXSetPriority(session, static_cast<mfxPriority>(MFX_PRIORITY_HIGH + 1));
+    ASSERT_EQ(sts, MFX_ERR_UNSUPPORTED);
+
+    //free internal resources
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(SetPriority, NullSessionReturnsInvalidHandle) {
+    mfxStatus sts = MFXSetPriority(nullptr, MFX_PRIORITY_LOW);
+    ASSERT_EQ(sts, MFX_ERR_INVALID_HANDLE);
+}
+
+//MFXGetPriority
+TEST(GetPriority, DefaultPriorityIsNormal) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxPriority priority = MFX_PRIORITY_LOW;
+    sts                  = MFXGetPriority(session, &priority);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(priority, MFX_PRIORITY_NORMAL);
+
+    //free internal resources
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(GetPriority, NullPriorityReturnsErrNull) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXGetPriority(session, nullptr);
+    ASSERT_EQ(sts, MFX_ERR_NULL_PTR);
+
+    //free internal resources
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
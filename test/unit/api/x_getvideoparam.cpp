@@ -5,6 +5,8 @@
   ############################################################################*/
 
 #include <gtest/gtest.h>
+#include "api/test_bitstreams.h"
+#include "vpl/mfxcpu.h"
 #include "vpl/mfxjpeg.h"
 #include "vpl/mfxvideo.h"
 
@@ -118,6 +120,100 @@ TEST(DecodeGetVideoParam, InitializedDecodeReturnsParams) {
     EXPECT_EQ(sts, MFX_ERR_NONE);
 }
 
+TEST(DecodeGetVideoParam, DecodedOrderReturnsNoThreadFrames) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams    = { 0 };
+    mfxDecParams.mfx.CodecId      = MFX_CODEC_HEVC;
+    mfxDecParams.mfx.DecodedOrder = 1;
+    mfxDecParams.AsyncDepth       = 4;
+    mfxDecParams.IOPattern        = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxDecParams.mfx.FrameInfo.FourCC       = MFX_FOURCC_I420;
+    mfxDecParams.mfx.FrameInfo.ChromaFormat = MFX_CHROMAFORMAT_YUV420;
+    mfxDecParams.mfx.FrameInfo.CropW        = 320;
+    mfxDecParams.mfx.FrameInfo.CropH        = 240;
+    mfxDecParams.mfx.FrameInfo.Width        = 320;
+    mfxDecParams.mfx.FrameInfo.Height       = 240;
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxExtCPUDecodeLatency latency = {};
+    latency.Header.BufferId        = MFX_EXTBUFF_CPU_DECODE_LATENCY;
+    latency.Header.BufferSz        = sizeof(mfxExtCPUDecodeLatency);
+    mfxExtBuffer *extParam[]       = { &latency.Header };
+
+    mfxVideoParam testparam = { 0 };
+    testparam.ExtParam      = extParam;
+    testparam.NumExtParam   = 1;
+    sts                     = MFXVideoDECODE_GetVideoParam(session, &testparam);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    EXPECT_EQ(testparam.mfx.DecodedOrder, 1);
+    EXPECT_EQ(latency.ThreadFrames, 0);
+    EXPECT_EQ(latency.FrameDelay, latency.ReorderFrames);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+// with DecodedOrder each complete frame comes out of the call which decodes it
+TEST(DecodeGetVideoParam, DecodedOrderReturnsFirstFrameWithoutDelay) {
+    mfxVersion ver = {};
+    ver.Major      = 2;
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
+    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxDecParams.mfx.DecodedOrder = 1;
+    mfxDecParams.AsyncDepth       = 4;
+    sts                           = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // one frame of the stream per call, the first one has the parameter sets
+    mfxU32 nFrames = 0;
+    for (mfxU32 i = 0; i < 8; i++) {
+        mfxU32 end       = (i < 7) ? test_bitstream_96x64_8bit_hevc::getpos(i + 1)
+                                   : test_bitstream_96x64_8bit_hevc::getlen();
+        mfxBS.DataFlag   = MFX_BITSTREAM_COMPLETE_FRAME;
+        mfxBS.DataOffset = test_bitstream_96x64_8bit_hevc::getpos(i);
+        mfxBS.DataLength = end - mfxBS.DataOffset;
+
+        mfxFrameSurface1 *surface_out = nullptr;
+        mfxSyncPoint syncp            = nullptr;
+        sts = MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, nullptr, &surface_out, &syncp);
+        if (i == 0) {
+            ASSERT_EQ(sts, MFX_ERR_NONE);
+        }
+        if (sts == MFX_ERR_MORE_DATA)
+            continue;
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+
+        sts = MFXVideoCORE_SyncOperation(session, syncp, MFX_INFINITE);
+        EXPECT_EQ(sts, MFX_ERR_NONE);
+        surface_out->FrameInterface->Release(surface_out);
+        nFrames++;
+    }
+    EXPECT_EQ(nFrames, 8u);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
 TEST(DecodeGetVideoParam, DecodeUninitializedReturnsNotInitialized) {
     mfxVersion ver = {};
     mfxSession session;
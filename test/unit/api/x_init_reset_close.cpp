@@ -5,6 +5,7 @@
   ############################################################################*/
 
 #include <gtest/gtest.h>
+#include "vpl/mfxcpu.h"
 #include "vpl/mfxjpeg.h"
 #include "vpl/mfxvideo.h"
 
@@ -50,6 +51,43 @@ TEST(EncodeInit, ValidParamsInReturnsErrNone) {
     EXPECT_EQ(sts, MFX_ERR_NONE);
 }
 
+TEST(EncodeInit, ThreadingParamsInReturnsErrNone) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxExtCPUThreading threading = {};
+    threading.Header.BufferId    = MFX_EXTBUFF_CPU_THREADING;
+    threading.Header.BufferSz    = sizeof(mfxExtCPUThreading);
+    threading.ThreadType         = MFX_CPU_THREAD_TYPE_SLICE;
+    mfxExtBuffer *extParam[]     = { &threading.Header };
+
+    mfxVideoParam mfxEncParams               = { 0 };
+    mfxEncParams.mfx.CodecId                 = MFX_CODEC_JPEG;
+    mfxEncParams.mfx.FrameInfo.FourCC        = MFX_FOURCC_I420;
+    mfxEncParams.mfx.FrameInfo.ChromaFormat  = MFX_CHROMAFORMAT_YUV420;
+    mfxEncParams.mfx.FrameInfo.CropW         = 320;
+    mfxEncParams.mfx.FrameInfo.CropH         = 240;
+    mfxEncParams.mfx.FrameInfo.Width         = 320;
+    mfxEncParams.mfx.FrameInfo.Height        = 240;
+    mfxEncParams.mfx.FrameInfo.FrameRateExtN = 30;
+    mfxEncParams.mfx.FrameInfo.FrameRateExtD = 1;
+    mfxEncParams.mfx.NumThread               = 2;
+    mfxEncParams.IOPattern                   = MFX_IOPATTERN_IN_SYSTEM_MEMORY;
+    mfxEncParams.ExtParam                    = extParam;
+    mfxEncParams.NumExtParam                 = 1;
+
+    sts = MFXVideoENCODE_Init(session, &mfxEncParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXVideoENCODE_Close(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
 TEST(EncodeInit, ProtectedInReturnsInvalidVideoParam) {
     mfxVersion ver = {};
     mfxSession session;
@@ -510,6 +548,137 @@ TEST(DecodeInit, ValidParamsInReturnsErrNone) {
     EXPECT_EQ(sts, MFX_ERR_NONE);
 }
 
+TEST(DecodeInit, ThreadingParamsInReturnsErrNone) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxExtCPUThreading threading = {};
+    threading.Header.BufferId    = MFX_EXTBUFF_CPU_THREADING;
+    threading.Header.BufferSz    = sizeof(mfxExtCPUThreading);
+    threading.ThreadType         = MFX_CPU_THREAD_TYPE_FRAME;
+    mfxExtBuffer *extParam[]     = { &threading.Header };
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.mfx.NumThread = 2;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+    mfxDecParams.ExtParam      = extParam;
+    mfxDecParams.NumExtParam   = 1;
+
+    mfxDecParams.mfx.FrameInfo.FourCC       = MFX_FOURCC_I420;
+    mfxDecParams.mfx.FrameInfo.ChromaFormat = MFX_CHROMAFORMAT_YUV420;
+    mfxDecParams.mfx.FrameInfo.CropW        = 320;
+    mfxDecParams.mfx.FrameInfo.CropH        = 240;
+    mfxDecParams.mfx.FrameInfo.Width        = 320;
+    mfxDecParams.mfx.FrameInfo.Height       = 240;
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeInit, InvalidThreadTypeInReturnsInvalidVideoParam) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxExtCPUThreading threading = {};
+    threading.Header.BufferId    = MFX_EXTBUFF_CPU_THREADING;
+    threading.Header.BufferSz    = sizeof(mfxExtCPUThreading);
+    threading.ThreadType         = MFX_CPU_THREAD_TYPE_SLICE + 1;
+    mfxExtBuffer *extParam[]     = { &threading.Header };
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+    mfxDecParams.ExtParam      = extParam;
+    mfxDecParams.NumExtParam   = 1;
+
+    mfxDecParams.mfx.FrameInfo.FourCC       = MFX_FOURCC_I420;
+    mfxDecParams.mfx.FrameInfo.ChromaFormat = MFX_CHROMAFORMAT_YUV420;
+    mfxDecParams.mfx.FrameInfo.CropW        = 320;
+    mfxDecParams.mfx.FrameInfo.CropH        = 240;
+    mfxDecParams.mfx.FrameInfo.Width        = 320;
+    mfxDecParams.mfx.FrameInfo.Height       = 240;
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_INVALID_VIDEO_PARAM);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeInit, AutoSkipParamsInReturnsErrNone) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxExtCPUDecodeSkip skip = {};
+    skip.Header.BufferId     = MFX_EXTBUFF_CPU_DECODE_SKIP;
+    skip.Header.BufferSz     = sizeof(mfxExtCPUDecodeSkip);
+    skip.AutoSkip            = MFX_CODINGOPTION_ON;
+    skip.MaxSkipLevel        = 2;
+    mfxExtBuffer *extParam[] = { &skip.Header };
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+    mfxDecParams.ExtParam      = extParam;
+    mfxDecParams.NumExtParam   = 1;
+
+    mfxDecParams.mfx.FrameInfo.FourCC       = MFX_FOURCC_I420;
+    mfxDecParams.mfx.FrameInfo.ChromaFormat = MFX_CHROMAFORMAT_YUV420;
+    mfxDecParams.mfx.FrameInfo.CropW        = 320;
+    mfxDecParams.mfx.FrameInfo.CropH        = 240;
+    mfxDecParams.mfx.FrameInfo.Width        = 320;
+    mfxDecParams.mfx.FrameInfo.Height       = 240;
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeInit, InvalidMaxSkipLevelInReturnsInvalidVideoParam) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxExtCPUDecodeSkip skip = {};
+    skip.Header.BufferId     = MFX_EXTBUFF_CPU_DECODE_SKIP;
+    skip.Header.BufferSz     = sizeof(mfxExtCPUDecodeSkip);
+    skip.AutoSkip            = MFX_CODINGOPTION_ON;
+    skip.MaxSkipLevel        = MFX_CPU_DECODE_MAX_SKIP_LEVEL + 1;
+    mfxExtBuffer *extParam[] = { &skip.Header };
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+    mfxDecParams.ExtParam      = extParam;
+    mfxDecParams.NumExtParam   = 1;
+
+    mfxDecParams.mfx.FrameInfo.FourCC       = MFX_FOURCC_I420;
+    mfxDecParams.mfx.FrameInfo.ChromaFormat = MFX_CHROMAFORMAT_YUV420;
+    mfxDecParams.mfx.FrameInfo.CropW        = 320;
+    mfxDecParams.mfx.FrameInfo.CropH        = 240;
+    mfxDecParams.mfx.FrameInfo.Width        = 320;
+    mfxDecParams.mfx.FrameInfo.Height       = 240;
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_INVALID_VIDEO_PARAM);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
 TEST(DecodeInit, ProtectedInReturnsInvalidVideoParam) {
     mfxVersion ver = {};
     mfxSession session;
@@ -296,7 +296,7 @@ TEST(VPPQuery, PopulatedParamsInReturnsCorrected) {
     EXPECT_EQ(sts, MFX_ERR_NONE);
 }
 
-TEST(VPPQuery, InvalidParamsReturnsUnsupported) {
+TEST(VPPQuery, NV12ParamsInReturnsNV12Out) {
     mfxVersion ver = {};
     mfxSession session;
     mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
@@ -305,6 +305,29 @@ TEST(VPPQuery, InvalidParamsReturnsUnsupported) {
     mfxVideoParam mfxVPPParams;
     memset(&mfxVPPParams, 0, sizeof(mfxVPPParams));
     mfxVPPParams.vpp.In.FourCC = MFX_FOURCC_NV12;
+    mfxVPPParams.vpp.In.Width  = 320;
+    mfxVPPParams.vpp.In.Height = 240;
+
+    mfxVideoParam par;
+    memset(&par, 0, sizeof(par));
+    sts = MFXVideoVPP_Query(session, &mfxVPPParams, &par);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(MFX_FOURCC_NV12, par.vpp.In.FourCC);
+    ASSERT_EQ(MFX_FOURCC_NV12, par.vpp.Out.FourCC);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(VPPQuery, InvalidParamsReturnsUnsupported) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxVPPParams;
+    memset(&mfxVPPParams, 0, sizeof(mfxVPPParams));
+    mfxVPPParams.vpp.In.FourCC = MFX_FOURCC_YUY2;
     mfxVideoParam par;
     memset(&par, 0, sizeof(par));
     sts = MFXVideoVPP_Query(session, &mfxVPPParams, &par);
@@ -5,10 +5,129 @@
   ############################################################################*/
 
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <vector>
 #include "api/test_bitstreams.h"
+#include "vpl/mfxcpu.h"
 #include "vpl/mfxjpeg.h"
 #include "vpl/mfxvideo.h"
 
+// one plane of a 4:2:0 test image, width in samples
+struct TestPlane {
+    mfxU8 *data;
+    mfxU32 pitch;
+    mfxU32 width;
+    mfxU32 rows;
+};
+
+static mfxU32 GetSampleBytes(mfxU32 fourcc) {
+    return (fourcc == MFX_FOURCC_I010 || fourcc == MFX_FOURCC_P010) ? 2 : 1;
+}
+
+static size_t GetTestImageBytes(const mfxFrameInfo &info, mfxU32 pitch) {
+    return static_cast<size_t>(pitch) * (info.Height + (info.Height + 1) / 2);
+}
+
+// points the surface with the pitch set at buf, returns the planes
+static std::vector<TestPlane> SetTestPlanes(mfxFrameSurface1 *surface, mfxU8 *buf) {
+    const mfxFrameInfo &info = surface->Info;
+    mfxU32 pitch             = surface->Data.Pitch;
+    mfxU32 chromaW           = (info.Width + 1) / 2;
+    mfxU32 chromaH           = (info.Height + 1) / 2;
+
+    std::vector<TestPlane> planes;
+    planes.push_back({ buf, pitch, info.Width, info.Height });
+    surface->Data.Y = buf;
+    buf += static_cast<size_t>(pitch) * info.Height;
+    if (info.FourCC == MFX_FOURCC_NV12 || info.FourCC == MFX_FOURCC_P010) {
+        surface->Data.UV = buf;
+        planes.push_back({ buf, pitch, 2 * chromaW, chromaH });
+    }
+    else {
+        surface->Data.U = buf;
+        surface->Data.V = buf + pitch / 2 * chromaH;
+        planes.push_back({ surface->Data.U, pitch / 2, chromaW, chromaH });
+        planes.push_back({ surface->Data.V, pitch / 2, chromaW, chromaH });
+    }
+    return planes;
+}
+
+// address of sample x of row y of the cropped image in plane p of a 4:2:0
+//   surface (0 Y, 1 U, 2 V), U and V of semi-planar surfaces share one plane
+static mfxU8 *GetSamplePtr(mfxFrameSurface1 *surface, int p, mfxU32 x, mfxU32 y) {
+    const mfxFrameInfo &info = surface->Info;
+    const mfxFrameData &data = surface->Data;
+    mfxU32 bytes             = GetSampleBytes(info.FourCC);
+
+    if (p == 0)
+        return data.Y + static_cast<size_t>(info.CropY + y) * data.Pitch + (info.CropX + x) * bytes;
+
+    x += info.CropX / 2;
+    y += info.CropY / 2;
+    if (info.FourCC == MFX_FOURCC_NV12 || info.FourCC == MFX_FOURCC_P010)
+        return data.UV + static_cast<size_t>(y) * data.Pitch + (2 * x + p - 1) * bytes;
+
+    mfxU8 *plane = (p == 1) ? data.U : data.V;
+    return plane + static_cast<size_t>(y) * (data.Pitch / 2) + x * bytes;
+}
+
+// 10-bit samples are in the low bits, whatever the Shift of the surface
+static mfxU16 GetSample(mfxFrameSurface1 *surface, int p, mfxU32 x, mfxU32 y) {
+    mfxU8 *ptr = GetSamplePtr(surface, p, x, y);
+    if (GetSampleBytes(surface->Info.FourCC) == 1)
+        return *ptr;
+
+    mfxU16 value = *reinterpret_cast<mfxU16 *>(ptr);
+    return (surface->Info.FourCC == MFX_FOURCC_P010 && surface->Info.Shift) ? value >> 6 : value;
+}
+
+static void SetSample(mfxFrameSurface1 *surface, int p, mfxU32 x, mfxU32 y, mfxU16 value) {
+    mfxU8 *ptr = GetSamplePtr(surface, p, x, y);
+    if (GetSampleBytes(surface->Info.FourCC) == 1) {
+        *ptr = static_cast<mfxU8>(value);
+        return;
+    }
+
+    if (surface->Info.FourCC == MFX_FOURCC_P010 && surface->Info.Shift)
+        value = static_cast<mfxU16>(value << 6);
+    *reinterpret_cast<mfxU16 *>(ptr) = value;
+}
+
+// all samples of the cropped image, Y then U then V
+static std::vector<mfxU16> GetSurfaceSamples(mfxFrameSurface1 *surface) {
+    const mfxFrameInfo &info = surface->Info;
+
+    std::vector<mfxU16> samples;
+    for (int p = 0; p < 3; p++) {
+        mfxU32 width  = p ? (info.CropW + 1) / 2 : info.CropW;
+        mfxU32 height = p ? (info.CropH + 1) / 2 : info.CropH;
+        for (mfxU32 y = 0; y < height; y++) {
+            for (mfxU32 x = 0; x < width; x++)
+                samples.push_back(GetSample(surface, p, x, y));
+        }
+    }
+    return samples;
+}
+
+// fills the cropped image with a pattern of 8-bit or 10-bit samples
+static void SetSurfacePattern(mfxFrameSurface1 *surface) {
+    const mfxFrameInfo &info = surface->Info;
+    mfxU32 mask              = (GetSampleBytes(info.FourCC) == 2) ? 0x3FF : 0xFF;
+
+    for (int p = 0; p < 3; p++) {
+        mfxU32 width  = p ? (info.CropW + 1) / 2 : info.CropW;
+        mfxU32 height = p ? (info.CropH + 1) / 2 : info.CropH;
+        for (mfxU32 y = 0; y < height; y++) {
+            for (mfxU32 x = 0; x < width; x++)
+                SetSample(surface, p, x, y, static_cast<mfxU16>((x * 7 + y * 13 + p * 29) & mask));
+        }
+    }
+}
+
 /*!
     EncodeFrame overview
     Takes a single input frame in and generates its output bitstream. 
@@ -177,79 +296,122 @@ TEST(EncodeFrameAsync, SurfaceTimestampReturnsBitstreamTimestamp) {
     delete[] mfxBS.Data;
 }
 
-TEST(EncodeFrameAsync, EncCtrlReturnsErrInvalidVideoParam) {
+// VPP output goes straight to the encoder, the session orders the two stages
+TEST(EncodeFrameAsync, VPPOutputWithoutSyncReturnsErrNone) {
     mfxVersion ver = {};
     mfxSession session;
     mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    mfxVideoParam mfxEncParams;
-    memset(&mfxEncParams, 0, sizeof(mfxEncParams));
-    mfxEncParams.mfx.CodecId                 = MFX_CODEC_JPEG;
-    mfxEncParams.mfx.FrameInfo.FourCC        = MFX_FOURCC_I420;
-    mfxEncParams.mfx.FrameInfo.ChromaFormat  = MFX_CHROMAFORMAT_YUV420;
-    mfxEncParams.mfx.FrameInfo.CropW         = 320;
-    mfxEncParams.mfx.FrameInfo.CropH         = 240;
-    mfxEncParams.mfx.FrameInfo.Width         = 320;
-    mfxEncParams.mfx.FrameInfo.Height        = 240;
-    mfxEncParams.mfx.FrameInfo.FrameRateExtN = 30;
-    mfxEncParams.mfx.FrameInfo.FrameRateExtD = 1;
-    mfxEncParams.IOPattern                   = MFX_IOPATTERN_IN_SYSTEM_MEMORY;
+    mfxVideoParam mfxVPPParams = {};
 
-    mfxU16 nEncSurfNum = 16;
-    mfxU32 lumaSize    = mfxEncParams.mfx.FrameInfo.Width * mfxEncParams.mfx.FrameInfo.Height;
+    mfxVPPParams.vpp.In.FourCC        = MFX_FOURCC_I420;
+    mfxVPPParams.vpp.In.ChromaFormat  = MFX_CHROMAFORMAT_YUV420;
+    mfxVPPParams.vpp.In.CropW         = 320;
+    mfxVPPParams.vpp.In.CropH         = 240;
+    mfxVPPParams.vpp.In.FrameRateExtN = 30;
+    mfxVPPParams.vpp.In.FrameRateExtD = 1;
+    mfxVPPParams.vpp.In.Width         = 320;
+    mfxVPPParams.vpp.In.Height        = 240;
+    mfxVPPParams.vpp.Out              = mfxVPPParams.vpp.In;
 
-    mfxU8 *surfaceBuffers = new mfxU8[(mfxU32)(lumaSize * 1.5 * nEncSurfNum)];
-    memset(surfaceBuffers, 0, (mfxU32)(lumaSize * 1.5 * nEncSurfNum));
+    mfxVPPParams.IOPattern  = MFX_IOPATTERN_IN_SYSTEM_MEMORY | MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+    mfxVPPParams.AsyncDepth = 4;
 
-    mfxFrameSurface1 *encSurfaces = new mfxFrameSurface1[nEncSurfNum];
-    for (mfxI32 i = 0; i < nEncSurfNum; i++) {
-        encSurfaces[i]            = { 0 };
-        encSurfaces[i].Info       = mfxEncParams.mfx.FrameInfo;
-        encSurfaces[i].Data.Y     = &surfaceBuffers[(mfxU32)(lumaSize * 1.5 * i)];
-        encSurfaces[i].Data.U     = encSurfaces[i].Data.Y + lumaSize;
-        encSurfaces[i].Data.V     = encSurfaces[i].Data.U + lumaSize / 4;
-        encSurfaces[i].Data.Pitch = mfxEncParams.mfx.FrameInfo.Width;
-    }
+    sts = MFXVideoVPP_Init(session, &mfxVPPParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxEncParams = {};
+    mfxEncParams.mfx.CodecId   = MFX_CODEC_JPEG;
+    mfxEncParams.mfx.FrameInfo = mfxVPPParams.vpp.Out;
+    mfxEncParams.IOPattern     = MFX_IOPATTERN_IN_SYSTEM_MEMORY;
+    mfxEncParams.AsyncDepth    = 4;
 
     sts = MFXVideoENCODE_Init(session, &mfxEncParams);
-    if (sts != MFX_ERR_NONE) {
-        if (encSurfaces)
-            delete[] encSurfaces;
-        ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    const mfxU32 nFrames  = 8;
+    const mfxU32 lumaSize = 320 * 240;
+    std::vector<mfxU8> buf(lumaSize * 3 / 2 * 2 * nFrames);
+    std::vector<mfxFrameSurface1> surfIn(nFrames);
+    std::vector<mfxFrameSurface1> surfOut(nFrames);
+    for (mfxU32 i = 0; i < nFrames; i++) {
+        mfxFrameSurface1 *s[2] = { &surfIn[i], &surfOut[i] };
+        for (mfxU32 j = 0; j < 2; j++) {
+            mfxU8 *base      = buf.data() + (i * 2 + j) * lumaSize * 3 / 2;
+            *s[j]            = {};
+            s[j]->Info       = mfxVPPParams.vpp.In;
+            s[j]->Data.Y     = base;
+            s[j]->Data.U     = base + lumaSize;
+            s[j]->Data.V     = base + lumaSize + lumaSize / 4;
+            s[j]->Data.Pitch = 320;
+        }
+        surfIn[i].Data.TimeStamp = 1000 + i;
     }
 
-    mfxBitstream mfxBS = { 0 };
-    mfxBS.MaxLength    = 20000;
-    mfxBS.Data         = new mfxU8[mfxBS.MaxLength];
+    mfxBitstream mfxBS = {};
+    std::vector<mfxU8> bsData(100000);
+    mfxBS.MaxLength = (mfxU32)bsData.size();
+    mfxBS.Data      = bsData.data();
 
-    mfxI32 nEncSurfIdx = 0;
+    std::vector<mfxU64> timeStamps;
     mfxSyncPoint syncp;
+    for (mfxU32 i = 0; i <= nFrames; i++) {
+        // no SyncOperation between VPP and encode
+        mfxFrameSurface1 *encSurface = nullptr;
+        if (i < nFrames) {
+            sts = MFXVideoVPP_RunFrameVPPAsync(session, &surfIn[i], &surfOut[i], nullptr, &syncp);
+            ASSERT_EQ(sts, MFX_ERR_NONE);
+            encSurface = &surfOut[i];
+        }
 
-    mfxEncodeCtrl ctrl = { 0 };
-    ctrl.QP            = 1;
+        for (;;) {
+            sts = MFXVideoENCODE_EncodeFrameAsync(session, nullptr, encSurface, &mfxBS, &syncp);
+            if (sts == MFX_ERR_MORE_DATA)
+                break;
+            ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    // Encode a frame asynchronously (returns immediately)
-    sts =
-        MFXVideoENCODE_EncodeFrameAsync(session, &ctrl, &encSurfaces[nEncSurfIdx], &mfxBS, &syncp);
+            sts = MFXVideoCORE_SyncOperation(session, syncp, 1000);
+            ASSERT_EQ(sts, MFX_ERR_NONE);
+            ASSERT_GT(mfxBS.DataLength, (mfxU32)0);
+            timeStamps.push_back(mfxBS.TimeStamp);
+            mfxBS.DataLength = 0;
 
-    ASSERT_EQ(sts, MFX_ERR_INVALID_VIDEO_PARAM);
+            // a frame gives at most one packet, drain until no more are left
+            if (encSurface)
+                break;
+        }
+    }
 
-    MFXClose(session);
+    ASSERT_EQ(timeStamps.size(), nFrames);
+    for (mfxU32 i = 0; i < nFrames; i++)
+        EXPECT_EQ(timeStamps[i], 1000 + i);
 
-    delete[] surfaceBuffers;
-    delete[] encSurfaces;
-    delete[] mfxBS.Data;
+    //free internal resources
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
 }
 
-TEST(EncodeFrameAsync, InsufficientOutBufferReturnsNotEnoughBuffer) {
+static void MFX_CDECL CountBitstreamReady(mfxHDL pthis) {
+    (*reinterpret_cast<std::atomic<mfxU32> *>(pthis))++;
+}
+
+TEST(EncodeFrameAsync, BitstreamReadyCallbackCalledForEachBitstream) {
     mfxVersion ver = {};
     mfxSession session;
     mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    mfxVideoParam mfxEncParams;
-    memset(&mfxEncParams, 0, sizeof(mfxEncParams));
+    std::atomic<mfxU32> numReady(0);
+
+    mfxExtCPUEncodeCallback callback = {};
+    callback.Header.BufferId         = MFX_EXTBUFF_CPU_ENCODE_CALLBACK;
+    callback.Header.BufferSz         = sizeof(callback);
+    callback.pthis                   = &numReady;
+    callback.BitstreamReady          = CountBitstreamReady;
+    mfxExtBuffer *extParam[]         = { &callback.Header };
+
+    mfxVideoParam mfxEncParams               = {};
     mfxEncParams.mfx.CodecId                 = MFX_CODEC_JPEG;
     mfxEncParams.mfx.FrameInfo.FourCC        = MFX_FOURCC_I420;
     mfxEncParams.mfx.FrameInfo.ChromaFormat  = MFX_CHROMAFORMAT_YUV420;
@@ -260,71 +422,109 @@ TEST(EncodeFrameAsync, InsufficientOutBufferReturnsNotEnoughBuffer) {
     mfxEncParams.mfx.FrameInfo.FrameRateExtN = 30;
     mfxEncParams.mfx.FrameInfo.FrameRateExtD = 1;
     mfxEncParams.IOPattern                   = MFX_IOPATTERN_IN_SYSTEM_MEMORY;
-
-    mfxU16 nEncSurfNum = 16;
-    mfxU32 lumaSize    = mfxEncParams.mfx.FrameInfo.Width * mfxEncParams.mfx.FrameInfo.Height;
-
-    mfxU8 *surfaceBuffers = new mfxU8[(mfxU32)(lumaSize * 1.5 * nEncSurfNum)];
-    memset(surfaceBuffers, 0, (mfxU32)(lumaSize * 1.5 * nEncSurfNum));
-
-    mfxFrameSurface1 *encSurfaces = new mfxFrameSurface1[nEncSurfNum];
-    for (mfxI32 i = 0; i < nEncSurfNum; i++) {
-        encSurfaces[i]            = { 0 };
-        encSurfaces[i].Info       = mfxEncParams.mfx.FrameInfo;
-        encSurfaces[i].Data.Y     = &surfaceBuffers[(mfxU32)(lumaSize * 1.5 * i)];
-        encSurfaces[i].Data.U     = encSurfaces[i].Data.Y + lumaSize;
-        encSurfaces[i].Data.V     = encSurfaces[i].Data.U + lumaSize / 4;
-        encSurfaces[i].Data.Pitch = mfxEncParams.mfx.FrameInfo.Width;
-    }
+    mfxEncParams.AsyncDepth                  = 4;
+    mfxEncParams.ExtParam                    = extParam;
+    mfxEncParams.NumExtParam                 = 1;
 
     sts = MFXVideoENCODE_Init(session, &mfxEncParams);
-    if (sts != MFX_ERR_NONE) {
-        if (encSurfaces)
-            delete[] encSurfaces;
-        ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    const mfxU32 nFrames  = 8;
+    const mfxU32 lumaSize = 320 * 240;
+    std::vector<mfxU8> buf(lumaSize * 3 / 2 * nFrames);
+    std::vector<mfxFrameSurface1> surfaces(nFrames);
+    for (mfxU32 i = 0; i < nFrames; i++) {
+        surfaces[i]            = {};
+        surfaces[i].Info       = mfxEncParams.mfx.FrameInfo;
+        surfaces[i].Data.Y     = buf.data() + i * lumaSize * 3 / 2;
+        surfaces[i].Data.U     = surfaces[i].Data.Y + lumaSize;
+        surfaces[i].Data.V     = surfaces[i].Data.U + lumaSize / 4;
+        surfaces[i].Data.Pitch = 320;
     }
 
-    mfxBitstream mfxBS = { 0 };
-    mfxBS.MaxLength    = 20;
-    mfxBS.Data         = new mfxU8[mfxBS.MaxLength];
+    mfxBitstream mfxBS = {};
+    std::vector<mfxU8> bsData(100000);
+    mfxBS.MaxLength = (mfxU32)bsData.size();
+    mfxBS.Data      = bsData.data();
 
-    mfxI32 nEncSurfIdx = 0;
+    mfxU32 numBitstreams = 0;
     mfxSyncPoint syncp;
+    for (mfxU32 i = 0; i <= nFrames; i++) {
+        mfxFrameSurface1 *surface = (i < nFrames) ? &surfaces[i] : nullptr;
+        for (;;) {
+            sts = MFXVideoENCODE_EncodeFrameAsync(session, nullptr, surface, &mfxBS, &syncp);
+            if (sts == MFX_ERR_MORE_DATA)
+                break;
+            ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    while (true) {
-        // Encode a frame asynchronously (returns immediately)
-        sts = MFXVideoENCODE_EncodeFrameAsync(session,
-                                              NULL,
-                                              &encSurfaces[nEncSurfIdx],
-                                              &mfxBS,
-                                              &syncp);
+            // the callback came before the bitstream was returned
+            numBitstreams++;
+            EXPECT_GE(numReady.load(), numBitstreams);
+            mfxBS.DataLength = 0;
 
-        if (sts != MFX_ERR_MORE_DATA)
-            break;
-        nEncSurfIdx++;
+            if (surface)
+                break;
+        }
     }
-    ASSERT_EQ(sts, MFX_ERR_NOT_ENOUGH_BUFFER);
 
-    MFXClose(session);
+    EXPECT_EQ(numBitstreams, nFrames);
+    EXPECT_EQ(numReady.load(), nFrames);
 
-    delete[] surfaceBuffers;
-    delete[] encSurfaces;
-    delete[] mfxBS.Data;
+    //free internal resources
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
 }
 
-TEST(EncodeFrameAsync, NullSessionReturnsInvalidHandle) {
-    mfxStatus sts = MFXVideoENCODE_EncodeFrameAsync(0, nullptr, nullptr, nullptr, nullptr);
-    ASSERT_EQ(sts, MFX_ERR_INVALID_HANDLE);
+// 320x240 I420 frames at MemId 1 and 2, counts the calls per MemId
+struct CountingAllocator {
+    std::vector<mfxU8> buf;
+    std::atomic<mfxU32> numLock[2];
+    std::atomic<mfxU32> numUnlock[2];
+};
+
+static mfxStatus MFX_CDECL CountingLock(mfxHDL pthis, mfxMemId mid, mfxFrameData *ptr) {
+    CountingAllocator *alloc = reinterpret_cast<CountingAllocator *>(pthis);
+    size_t idx               = reinterpret_cast<size_t>(mid) - 1;
+    const mfxU32 lumaSize    = 320 * 240;
+
+    alloc->numLock[idx]++;
+    ptr->Y     = alloc->buf.data() + idx * lumaSize * 3 / 2;
+    ptr->U     = ptr->Y + lumaSize;
+    ptr->V     = ptr->U + lumaSize / 4;
+    ptr->Pitch = 320;
+    return MFX_ERR_NONE;
 }
 
-TEST(EncodeFrameAsync, NullSyncpReturnsNullPtr) {
+static mfxStatus MFX_CDECL CountingUnlock(mfxHDL pthis, mfxMemId mid, mfxFrameData *ptr) {
+    CountingAllocator *alloc = reinterpret_cast<CountingAllocator *>(pthis);
+    size_t idx               = reinterpret_cast<size_t>(mid) - 1;
+
+    alloc->numUnlock[idx]++;
+    ptr->Y = ptr->U = ptr->V = nullptr;
+    return MFX_ERR_NONE;
+}
+
+TEST(EncodeFrameAsync, ExternalAllocatorFramesStayLockedAcrossFrames) {
     mfxVersion ver = {};
     mfxSession session;
     mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    mfxVideoParam mfxEncParams;
-    memset(&mfxEncParams, 0, sizeof(mfxEncParams));
+    CountingAllocator counting;
+    counting.buf.resize(320 * 240 * 3 / 2 * 2);
+    for (mfxU32 i = 0; i < 2; i++) {
+        counting.numLock[i]   = 0;
+        counting.numUnlock[i] = 0;
+    }
+
+    mfxFrameAllocator allocator = {};
+    allocator.pthis             = &counting;
+    allocator.Lock              = CountingLock;
+    allocator.Unlock            = CountingUnlock;
+    sts                         = MFXVideoCORE_SetFrameAllocator(session, &allocator);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxEncParams               = {};
     mfxEncParams.mfx.CodecId                 = MFX_CODEC_JPEG;
     mfxEncParams.mfx.FrameInfo.FourCC        = MFX_FOURCC_I420;
     mfxEncParams.mfx.FrameInfo.ChromaFormat  = MFX_CHROMAFORMAT_YUV420;
@@ -336,150 +536,1203 @@ TEST(EncodeFrameAsync, NullSyncpReturnsNullPtr) {
     mfxEncParams.mfx.FrameInfo.FrameRateExtD = 1;
     mfxEncParams.IOPattern                   = MFX_IOPATTERN_IN_SYSTEM_MEMORY;
 
-    mfxU16 nEncSurfNum = 1;
-    mfxU32 lumaSize    = mfxEncParams.mfx.FrameInfo.Width * mfxEncParams.mfx.FrameInfo.Height;
-
-    mfxU8 *surfaceBuffers = new mfxU8[(mfxU32)(lumaSize * 1.5 * nEncSurfNum)];
-    memset(surfaceBuffers, 0, (mfxU32)(lumaSize * 1.5 * nEncSurfNum));
+    sts = MFXVideoENCODE_Init(session, &mfxEncParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    mfxFrameSurface1 *encSurfaces = new mfxFrameSurface1[nEncSurfNum];
-    for (mfxI32 i = 0; i < nEncSurfNum; i++) {
-        encSurfaces[i]            = { 0 };
-        encSurfaces[i].Info       = mfxEncParams.mfx.FrameInfo;
-        encSurfaces[i].Data.Y     = &surfaceBuffers[(mfxU32)(lumaSize * 1.5 * i)];
-        encSurfaces[i].Data.U     = encSurfaces[i].Data.Y + lumaSize;
-        encSurfaces[i].Data.V     = encSurfaces[i].Data.U + lumaSize / 4;
-        encSurfaces[i].Data.Pitch = mfxEncParams.mfx.FrameInfo.Width;
+    // the surfaces have no data pointers, only the allocator can map them
+    mfxFrameSurface1 surfaces[2] = {};
+    for (mfxU32 i = 0; i < 2; i++) {
+        surfaces[i].Info       = mfxEncParams.mfx.FrameInfo;
+        surfaces[i].Data.MemId = reinterpret_cast<mfxMemId>(static_cast<size_t>(i + 1));
     }
 
-    sts = MFXVideoENCODE_Init(session, &mfxEncParams);
-    if (sts != MFX_ERR_NONE) {
-        if (encSurfaces)
-            delete[] encSurfaces;
+    mfxBitstream mfxBS = {};
+    std::vector<mfxU8> bsData(100000);
+    mfxBS.MaxLength = (mfxU32)bsData.size();
+    mfxBS.Data      = bsData.data();
+
+    const mfxU32 nFrames = 8;
+    mfxSyncPoint syncp;
+    for (mfxU32 i = 0; i < nFrames; i++) {
+        mfxFrameSurface1 *surface = &surfaces[i % 2];
+        sts = MFXVideoENCODE_EncodeFrameAsync(session, nullptr, surface, &mfxBS, &syncp);
         ASSERT_EQ(sts, MFX_ERR_NONE);
+        sts = MFXVideoCORE_SyncOperation(session, syncp, MFX_INFINITE);
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+        mfxBS.DataLength = 0;
     }
-    else {
-        mfxBitstream mfxBS = { 0 };
-        mfxBS.MaxLength    = 20;
-        mfxBS.Data         = new mfxU8[mfxBS.MaxLength];
 
-        mfxI32 nEncSurfIdx = 0;
+    for (mfxU32 i = 0; i < 2; i++) {
+        EXPECT_EQ(counting.numLock[i].load(), 1u);
+        EXPECT_EQ(counting.numUnlock[i].load(), 0u);
+    }
 
-        // Encode a frame asynchronously (returns immediately)
-        sts = MFXVideoENCODE_EncodeFrameAsync(session,
-                                              NULL,
-                                              &encSurfaces[nEncSurfIdx],
-                                              &mfxBS,
-                                              nullptr);
+    sts = MFXVideoENCODE_Close(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
 
-        ASSERT_EQ(sts, MFX_ERR_NULL_PTR);
+    for (mfxU32 i = 0; i < 2; i++) {
+        EXPECT_EQ(counting.numLock[i].load(), 1u);
+        EXPECT_EQ(counting.numUnlock[i].load(), 1u);
+        EXPECT_EQ(surfaces[i].Data.Locked, 0);
+    }
 
-        MFXClose(session);
+    //free internal resources
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
 
-        delete[] surfaceBuffers;
-        delete[] encSurfaces;
-        delete[] mfxBS.Data;
+// decodes a complete elementary stream, returns the luma sample in the
+//   middle of each frame in display order
+static std::vector<mfxU16> DecodeCenterLuma(mfxU32 codecId, std::vector<mfxU8> &stream) {
+    std::vector<mfxU16> samples;
+
+    mfxVersion ver = {};
+    ver.Major      = 2;
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    if (sts != MFX_ERR_NONE)
+        return samples;
+
+    mfxBitstream mfxBS = {};
+    mfxBS.CodecId      = codecId;
+    mfxBS.Data         = stream.data();
+    mfxBS.MaxLength = mfxBS.DataLength = (mfxU32)stream.size();
+
+    mfxBitstream *bs = &mfxBS;
+    for (;;) {
+        mfxFrameSurface1 *surface_out = nullptr;
+        mfxSyncPoint syncp            = nullptr;
+
+        sts = MFXVideoDECODE_DecodeFrameAsync(session, bs, nullptr, &surface_out, &syncp);
+        if (sts == MFX_ERR_MORE_DATA) {
+            if (!bs)
+                break;
+            bs = nullptr;
+            continue;
+        }
+        EXPECT_EQ(sts, MFX_ERR_NONE);
+        if (sts != MFX_ERR_NONE)
+            break;
+
+        sts = MFXVideoCORE_SyncOperation(session, syncp, MFX_INFINITE);
+        EXPECT_EQ(sts, MFX_ERR_NONE);
+        sts = surface_out->FrameInterface->Map(surface_out, MFX_MAP_READ);
+        EXPECT_EQ(sts, MFX_ERR_NONE);
+
+        mfxFrameInfo &info = surface_out->Info;
+        mfxFrameData &data = surface_out->Data;
+        size_t x           = info.CropX + info.CropW / 2;
+        size_t y           = info.CropY + info.CropH / 2;
+        if (info.FourCC == MFX_FOURCC_I010 || info.FourCC == MFX_FOURCC_P010)
+            samples.push_back(reinterpret_cast<mfxU16 *>(data.Y + y * data.Pitch)[x]);
+        else
+            samples.push_back(data.Y[y * data.Pitch + x]);
+
+        surface_out->FrameInterface->Unmap(surface_out);
+        surface_out->FrameInterface->Release(surface_out);
     }
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    return samples;
 }
 
-TEST(EncodeFrameAsync, NullBitstreamReturnsErrNull) {
+// decodes the HEVC stream into application surfaces of fourcc, returns the
+//   samples of each frame, see GetSurfaceSamples()
+static std::vector<std::vector<mfxU16>> DecodeHEVCSamples(mfxU8 *stream,
+                                                          mfxU32 len,
+                                                          mfxU32 fourcc,
+                                                          mfxU16 shift) {
+    std::vector<std::vector<mfxU16>> frames;
+
     mfxVersion ver = {};
     mfxSession session;
     mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
-    ASSERT_EQ(sts, MFX_ERR_NONE);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    if (sts != MFX_ERR_NONE)
+        return frames;
 
-    mfxVideoParam mfxEncParams;
-    memset(&mfxEncParams, 0, sizeof(mfxEncParams));
-    mfxEncParams.mfx.CodecId                 = MFX_CODEC_JPEG;
-    mfxEncParams.mfx.FrameInfo.FourCC        = MFX_FOURCC_I420;
-    mfxEncParams.mfx.FrameInfo.ChromaFormat  = MFX_CHROMAFORMAT_YUV420;
-    mfxEncParams.mfx.FrameInfo.CropW         = 320;
-    mfxEncParams.mfx.FrameInfo.CropH         = 240;
-    mfxEncParams.mfx.FrameInfo.Width         = 320;
-    mfxEncParams.mfx.FrameInfo.Height        = 240;
-    mfxEncParams.mfx.FrameInfo.FrameRateExtN = 30;
-    mfxEncParams.mfx.FrameInfo.FrameRateExtD = 1;
-    mfxEncParams.IOPattern                   = MFX_IOPATTERN_IN_SYSTEM_MEMORY;
+    mfxVideoParam mfxDecParams = {};
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
 
-    mfxU16 nEncSurfNum = 16;
-    mfxU32 lumaSize    = mfxEncParams.mfx.FrameInfo.Width * mfxEncParams.mfx.FrameInfo.Height;
+    mfxBitstream mfxBS = {};
+    mfxBS.Data         = stream;
+    mfxBS.MaxLength = mfxBS.DataLength = len;
 
-    mfxU8 *surfaceBuffers = new mfxU8[(mfxU32)(lumaSize * 1.5 * nEncSurfNum)];
-    memset(surfaceBuffers, 0, (mfxU32)(lumaSize * 1.5 * nEncSurfNum));
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
 
-    mfxFrameSurface1 *encSurfaces = new mfxFrameSurface1[nEncSurfNum];
-    for (mfxI32 i = 0; i < nEncSurfNum; i++) {
-        encSurfaces[i]            = { 0 };
-        encSurfaces[i].Info       = mfxEncParams.mfx.FrameInfo;
-        encSurfaces[i].Data.Y     = &surfaceBuffers[(mfxU32)(lumaSize * 1.5 * i)];
-        encSurfaces[i].Data.U     = encSurfaces[i].Data.Y + lumaSize;
-        encSurfaces[i].Data.V     = encSurfaces[i].Data.U + lumaSize / 4;
-        encSurfaces[i].Data.Pitch = mfxEncParams.mfx.FrameInfo.Width;
+    mfxDecParams.mfx.FrameInfo.FourCC = fourcc;
+    mfxDecParams.mfx.FrameInfo.Shift  = shift;
+    sts                               = MFXVideoDECODE_Init(session, &mfxDecParams);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+
+    mfxFrameAllocRequest request = {};
+    sts = MFXVideoDECODE_QueryIOSurf(session, &mfxDecParams, &request);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+
+    const mfxFrameInfo &info = mfxDecParams.mfx.FrameInfo;
+    mfxU16 pitch             = static_cast<mfxU16>(info.Width * GetSampleBytes(fourcc));
+    size_t imageBytes        = GetTestImageBytes(info, pitch);
+    mfxU32 nSurfaces         = request.NumFrameSuggested + 4;
+
+    std::vector<mfxU8> buf(imageBytes * nSurfaces);
+    std::vector<mfxFrameSurface1> surfaces(nSurfaces);
+    for (mfxU32 i = 0; i < nSurfaces; i++) {
+        surfaces[i]            = {};
+        surfaces[i].Info       = info;
+        surfaces[i].Data.Pitch = pitch;
+        SetTestPlanes(&surfaces[i], buf.data() + i * imageBytes);
     }
 
-    sts = MFXVideoENCODE_Init(session, &mfxEncParams);
+    mfxBitstream *bs = &mfxBS;
+    for (;;) {
+        auto it = std::find_if(surfaces.begin(), surfaces.end(), [](mfxFrameSurface1 &s) {
+            return s.Data.Locked == 0;
+        });
+        EXPECT_NE(it, surfaces.end());
+        if (it == surfaces.end())
+            break;
+
+        mfxFrameSurface1 *surface_out = nullptr;
+        mfxSyncPoint syncp            = nullptr;
+
+        sts = MFXVideoDECODE_DecodeFrameAsync(session, bs, &*it, &surface_out, &syncp);
+        if (sts == MFX_ERR_MORE_DATA) {
+            if (!bs)
+                break;
+            bs = nullptr;
+            continue;
+        }
+        if (sts == MFX_ERR_MORE_SURFACE)
+            continue;
+        EXPECT_EQ(sts, MFX_ERR_NONE);
+        if (sts != MFX_ERR_NONE)
+            break;
+
+        sts = MFXVideoCORE_SyncOperation(session, syncp, MFX_INFINITE);
+        EXPECT_EQ(sts, MFX_ERR_NONE);
+        EXPECT_EQ(surface_out->Info.FourCC, fourcc);
+        frames.push_back(GetSurfaceSamples(surface_out));
+    }
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    return frames;
+}
+
+// flat frames of a different level each, which survive encoding about unchanged
+static mfxU8 FrameLevel(mfxU32 frame) {
+    return static_cast<mfxU8>(16 + 12 * (frame % 16));
+}
+
+TEST(EncodeFrameAsync, InputSurfacesReusedOnceUnlockedKeepTheirFrames) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // B-frames, the encoder may hold input frames for reordering
+    mfxVideoParam mfxEncParams               = {};
+    mfxEncParams.mfx.CodecId                 = MFX_CODEC_HEVC;
+    mfxEncParams.mfx.TargetKbps              = 4000;
+    mfxEncParams.mfx.RateControlMethod       = MFX_RATECONTROL_VBR;
+    mfxEncParams.mfx.GopPicSize              = 16;
+    mfxEncParams.mfx.GopRefDist              = 4;
+    mfxEncParams.mfx.FrameInfo.FourCC        = MFX_FOURCC_I420;
+    mfxEncParams.mfx.FrameInfo.ChromaFormat  = MFX_CHROMAFORMAT_YUV420;
+    mfxEncParams.mfx.FrameInfo.PicStruct     = MFX_PICSTRUCT_PROGRESSIVE;
+    mfxEncParams.mfx.FrameInfo.CropW         = 320;
+    mfxEncParams.mfx.FrameInfo.CropH         = 240;
+    mfxEncParams.mfx.FrameInfo.Width         = 320;
+    mfxEncParams.mfx.FrameInfo.Height        = 240;
+    mfxEncParams.mfx.FrameInfo.FrameRateExtN = 30;
+    mfxEncParams.mfx.FrameInfo.FrameRateExtD = 1;
+    mfxEncParams.IOPattern                   = MFX_IOPATTERN_IN_SYSTEM_MEMORY;
+    mfxEncParams.AsyncDepth                  = 1;
+
+    sts = MFXVideoENCODE_Init(session, &mfxEncParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    const mfxU32 nSurfaces = 8;
+    const mfxU32 lumaSize  = 320 * 240;
+    std::vector<mfxU8> buf(lumaSize * 3 / 2 * nSurfaces);
+    std::vector<mfxFrameSurface1> surfaces(nSurfaces);
+    for (mfxU32 i = 0; i < nSurfaces; i++) {
+        surfaces[i]            = {};
+        surfaces[i].Info       = mfxEncParams.mfx.FrameInfo;
+        surfaces[i].Data.Y     = buf.data() + i * lumaSize * 3 / 2;
+        surfaces[i].Data.U     = surfaces[i].Data.Y + lumaSize;
+        surfaces[i].Data.V     = surfaces[i].Data.U + lumaSize / 4;
+        surfaces[i].Data.Pitch = 320;
+    }
+
+    mfxBitstream mfxBS = {};
+    std::vector<mfxU8> bsData(1000000);
+    mfxBS.MaxLength = (mfxU32)bsData.size();
+    mfxBS.Data      = bsData.data();
+
+    // a surface is overwritten with the next frame as soon as it is unlocked,
+    //   a frame the encoder still referenced without a lock would change
+    const mfxU32 nFrames = 32;
+    std::vector<mfxU8> stream;
+    mfxSyncPoint syncp;
+    for (mfxU32 i = 0; i <= nFrames; i++) {
+        mfxFrameSurface1 *surface = nullptr;
+        if (i < nFrames) {
+            auto it = std::find_if(surfaces.begin(), surfaces.end(), [](mfxFrameSurface1 &s) {
+                return s.Data.Locked == 0;
+            });
+            ASSERT_NE(it, surfaces.end());
+            surface = &*it;
+            memset(surface->Data.Y, FrameLevel(i), lumaSize);
+            memset(surface->Data.U, 128, lumaSize / 2);
+        }
+
+        for (;;) {
+            sts = MFXVideoENCODE_EncodeFrameAsync(session, nullptr, surface, &mfxBS, &syncp);
+            if (sts == MFX_ERR_MORE_DATA)
+                break;
+            ASSERT_EQ(sts, MFX_ERR_NONE);
+            sts = MFXVideoCORE_SyncOperation(session, syncp, MFX_INFINITE);
+            ASSERT_EQ(sts, MFX_ERR_NONE);
+
+            stream.insert(stream.end(), mfxBS.Data, mfxBS.Data + mfxBS.DataLength);
+            mfxBS.DataLength = 0;
+
+            if (surface)
+                break;
+        }
+    }
+
+    sts = MFXVideoENCODE_Close(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+
+    // libav let go of every frame
+    for (mfxU32 i = 0; i < nSurfaces; i++)
+        EXPECT_EQ(surfaces[i].Data.Locked, 0);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+
+    std::vector<mfxU16> samples = DecodeCenterLuma(MFX_CODEC_HEVC, stream);
+    ASSERT_EQ(samples.size(), nFrames);
+    for (mfxU32 i = 0; i < nFrames; i++)
+        EXPECT_NEAR(samples[i], FrameLevel(i), 3) << "frame " << i;
+}
+
+// fills the image of a frame before it is sent to the encoder
+typedef void (*FillFrameFunc)(mfxFrameSurface1 *surface, mfxU32 frame);
+
+// encodes nFrames 320x240 application surfaces of fourcc, returns the stream
+static std::vector<mfxU8> EncodeSurfaces(mfxU32 codecId,
+                                         mfxU32 fourcc,
+                                         mfxU16 shift,
+                                         mfxU32 nFrames,
+                                         FillFrameFunc fill) {
+    std::vector<mfxU8> stream;
+
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    if (sts != MFX_ERR_NONE)
+        return stream;
+
+    mfxU16 bitDepth = static_cast<mfxU16>(GetSampleBytes(fourcc) == 2 ? 10 : 8);
+
+    mfxVideoParam mfxEncParams                = {};
+    mfxEncParams.mfx.CodecId                  = codecId;
+    mfxEncParams.mfx.FrameInfo.FourCC         = fourcc;
+    mfxEncParams.mfx.FrameInfo.Shift          = shift;
+    mfxEncParams.mfx.FrameInfo.BitDepthLuma   = bitDepth;
+    mfxEncParams.mfx.FrameInfo.BitDepthChroma = bitDepth;
+    mfxEncParams.mfx.FrameInfo.ChromaFormat   = MFX_CHROMAFORMAT_YUV420;
+    mfxEncParams.mfx.FrameInfo.PicStruct      = MFX_PICSTRUCT_PROGRESSIVE;
+    mfxEncParams.mfx.FrameInfo.CropW          = 320;
+    mfxEncParams.mfx.FrameInfo.CropH          = 240;
+    mfxEncParams.mfx.FrameInfo.Width          = 320;
+    mfxEncParams.mfx.FrameInfo.Height         = 240;
+    mfxEncParams.mfx.FrameInfo.FrameRateExtN  = 30;
+    mfxEncParams.mfx.FrameInfo.FrameRateExtD  = 1;
+    mfxEncParams.IOPattern                    = MFX_IOPATTERN_IN_SYSTEM_MEMORY;
+
+    if (codecId == MFX_CODEC_HEVC) {
+        mfxEncParams.mfx.TargetKbps        = 4000;
+        mfxEncParams.mfx.RateControlMethod = MFX_RATECONTROL_VBR;
+        mfxEncParams.mfx.CodecProfile =
+            (bitDepth == 10) ? MFX_PROFILE_HEVC_MAIN10 : MFX_PROFILE_HEVC_MAIN;
+    }
+
+    sts = MFXVideoENCODE_Init(session, &mfxEncParams);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+
+    mfxFrameSurface1 surface = {};
+    surface.Info             = mfxEncParams.mfx.FrameInfo;
+    surface.Data.Pitch       = static_cast<mfxU16>(320 * GetSampleBytes(fourcc));
+    std::vector<mfxU8> buf(GetTestImageBytes(surface.Info, surface.Data.Pitch));
+    SetTestPlanes(&surface, buf.data());
+
+    mfxBitstream mfxBS = {};
+    std::vector<mfxU8> bsData(2000000);
+    mfxBS.MaxLength = (mfxU32)bsData.size();
+    mfxBS.Data      = bsData.data();
+
+    mfxSyncPoint syncp;
+    for (mfxU32 i = 0; i <= nFrames && sts >= MFX_ERR_NONE; i++) {
+        mfxFrameSurface1 *input = nullptr;
+        if (i < nFrames) {
+            // the encoder copies each frame, see EncodeFrameAsync overview
+            EXPECT_EQ(surface.Data.Locked, 0);
+            fill(&surface, i);
+            input = &surface;
+        }
+
+        for (;;) {
+            sts = MFXVideoENCODE_EncodeFrameAsync(session, nullptr, input, &mfxBS, &syncp);
+            if (sts == MFX_ERR_MORE_DATA)
+                break;
+            EXPECT_EQ(sts, MFX_ERR_NONE);
+            if (sts != MFX_ERR_NONE)
+                break;
+            sts = MFXVideoCORE_SyncOperation(session, syncp, MFX_INFINITE);
+            EXPECT_EQ(sts, MFX_ERR_NONE);
+
+            stream.insert(stream.end(), mfxBS.Data, mfxBS.Data + mfxBS.DataLength);
+            mfxBS.DataLength = 0;
+
+            if (input)
+                break;
+        }
+    }
+
+    sts = MFXVideoENCODE_Close(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    return stream;
+}
+
+static void FillPatternFrame(mfxFrameSurface1 *surface, mfxU32 frame) {
+    SetSurfacePattern(surface);
+}
+
+// flat frames at FrameLevel() in 10 bits, U and V at different levels
+static void FillFlat10BitFrame(mfxFrameSurface1 *surface, mfxU32 frame) {
+    const mfxFrameInfo &info = surface->Info;
+    for (mfxU32 y = 0; y < info.CropH; y++) {
+        for (mfxU32 x = 0; x < info.CropW; x++)
+            SetSample(surface, 0, x, y, static_cast<mfxU16>(FrameLevel(frame) * 4));
+    }
+    for (mfxU32 y = 0; y < info.CropH / 2; y++) {
+        for (mfxU32 x = 0; x < info.CropW / 2; x++) {
+            SetSample(surface, 1, x, y, 640);
+            SetSample(surface, 2, x, y, 384);
+        }
+    }
+}
+
+// NV12 input is deinterleaved for the JPEG encoder, the stream must not differ
+//   from the one of the same image as I420
+TEST(EncodeFrameAsync, NV12InputEncodesAsI420) {
+    std::vector<mfxU8> i420 =
+        EncodeSurfaces(MFX_CODEC_JPEG, MFX_FOURCC_I420, 0, 2, FillPatternFrame);
+    std::vector<mfxU8> nv12 =
+        EncodeSurfaces(MFX_CODEC_JPEG, MFX_FOURCC_NV12, 0, 2, FillPatternFrame);
+    EXPECT_NE(i420.size(), 0u);
+    EXPECT_TRUE(nv12 == i420);
+}
+
+// P010 input is deinterleaved and shifted to the low bits for the HEVC
+//   encoder, each plane must keep its level
+TEST(EncodeFrameAsync, P010InputEncodesAsI010) {
+    const mfxU32 nFrames = 8;
+    const mfxU16 shifts[] = { 0, 1 };
+
+    for (mfxU16 shift : shifts) {
+        std::vector<mfxU8> stream =
+            EncodeSurfaces(MFX_CODEC_HEVC, MFX_FOURCC_P010, shift, nFrames, FillFlat10BitFrame);
+        std::vector<std::vector<mfxU16>> frames =
+            DecodeHEVCSamples(stream.data(), (mfxU32)stream.size(), MFX_FOURCC_I010, 0);
+        ASSERT_EQ(frames.size(), nFrames) << "Shift " << shift;
+
+        // Y, U and V planes of the 320x240 frames, samples in the middle of each
+        const size_t lumaSize   = 320 * 240;
+        const size_t chromaSize = lumaSize / 4;
+        for (mfxU32 i = 0; i < nFrames; i++) {
+            std::vector<mfxU16> &samples = frames[i];
+            EXPECT_NEAR(samples[120 * 320 + 160], FrameLevel(i) * 4, 12) << "frame " << i;
+            EXPECT_NEAR(samples[lumaSize + 60 * 160 + 80], 640, 12) << "frame " << i;
+            EXPECT_NEAR(samples[lumaSize + chromaSize + 60 * 160 + 80], 384, 12)
+                << "frame " << i;
+        }
+    }
+}
+
+TEST(EncodeFrameAsync, EncCtrlReturnsErrInvalidVideoParam) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxEncParams;
+    memset(&mfxEncParams, 0, sizeof(mfxEncParams));
+    mfxEncParams.mfx.CodecId                 = MFX_CODEC_JPEG;
+    mfxEncParams.mfx.FrameInfo.FourCC        = MFX_FOURCC_I420;
+    mfxEncParams.mfx.FrameInfo.ChromaFormat  = MFX_CHROMAFORMAT_YUV420;
+    mfxEncParams.mfx.FrameInfo.CropW         = 320;
+    mfxEncParams.mfx.FrameInfo.CropH         = 240;
+    mfxEncParams.mfx.FrameInfo.Width         = 320;
+    mfxEncParams.mfx.FrameInfo.Height        = 240;
+    mfxEncParams.mfx.FrameInfo.FrameRateExtN = 30;
+    mfxEncParams.mfx.FrameInfo.FrameRateExtD = 1;
+    mfxEncParams.IOPattern                   = MFX_IOPATTERN_IN_SYSTEM_MEMORY;
+
+    mfxU16 nEncSurfNum = 16;
+    mfxU32 lumaSize    = mfxEncParams.mfx.FrameInfo.Width * mfxEncParams.mfx.FrameInfo.Height;
+
+    mfxU8 *surfaceBuffers = new mfxU8[(mfxU32)(lumaSize * 1.5 * nEncSurfNum)];
+    memset(surfaceBuffers, 0, (mfxU32)(lumaSize * 1.5 * nEncSurfNum));
+
+    mfxFrameSurface1 *encSurfaces = new mfxFrameSurface1[nEncSurfNum];
+    for (mfxI32 i = 0; i < nEncSurfNum; i++) {
+        encSurfaces[i]            = { 0 };
+        encSurfaces[i].Info       = mfxEncParams.mfx.FrameInfo;
+        encSurfaces[i].Data.Y     = &surfaceBuffers[(mfxU32)(lumaSize * 1.5 * i)];
+        encSurfaces[i].Data.U     = encSurfaces[i].Data.Y + lumaSize;
+        encSurfaces[i].Data.V     = encSurfaces[i].Data.U + lumaSize / 4;
+        encSurfaces[i].Data.Pitch = mfxEncParams.mfx.FrameInfo.Width;
+    }
+
+    sts = MFXVideoENCODE_Init(session, &mfxEncParams);
+    if (sts != MFX_ERR_NONE) {
+        if (encSurfaces)
+            delete[] encSurfaces;
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+    }
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength    = 20000;
+    mfxBS.Data         = new mfxU8[mfxBS.MaxLength];
+
+    mfxI32 nEncSurfIdx = 0;
+    mfxSyncPoint syncp;
+
+    mfxEncodeCtrl ctrl = { 0 };
+    ctrl.QP            = 1;
+
+    // Encode a frame asynchronously (returns immediately)
+    sts =
+        MFXVideoENCODE_EncodeFrameAsync(session, &ctrl, &encSurfaces[nEncSurfIdx], &mfxBS, &syncp);
+
+    ASSERT_EQ(sts, MFX_ERR_INVALID_VIDEO_PARAM);
+
+    MFXClose(session);
+
+    delete[] surfaceBuffers;
+    delete[] encSurfaces;
+    delete[] mfxBS.Data;
+}
+
+TEST(EncodeFrameAsync, InsufficientOutBufferReturnsNotEnoughBuffer) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxEncParams;
+    memset(&mfxEncParams, 0, sizeof(mfxEncParams));
+    mfxEncParams.mfx.CodecId                 = MFX_CODEC_JPEG;
+    mfxEncParams.mfx.FrameInfo.FourCC        = MFX_FOURCC_I420;
+    mfxEncParams.mfx.FrameInfo.ChromaFormat  = MFX_CHROMAFORMAT_YUV420;
+    mfxEncParams.mfx.FrameInfo.CropW         = 320;
+    mfxEncParams.mfx.FrameInfo.CropH         = 240;
+    mfxEncParams.mfx.FrameInfo.Width         = 320;
+    mfxEncParams.mfx.FrameInfo.Height        = 240;
+    mfxEncParams.mfx.FrameInfo.FrameRateExtN = 30;
+    mfxEncParams.mfx.FrameInfo.FrameRateExtD = 1;
+    mfxEncParams.IOPattern                   = MFX_IOPATTERN_IN_SYSTEM_MEMORY;
+
+    mfxU16 nEncSurfNum = 16;
+    mfxU32 lumaSize    = mfxEncParams.mfx.FrameInfo.Width * mfxEncParams.mfx.FrameInfo.Height;
+
+    mfxU8 *surfaceBuffers = new mfxU8[(mfxU32)(lumaSize * 1.5 * nEncSurfNum)];
+    memset(surfaceBuffers, 0, (mfxU32)(lumaSize * 1.5 * nEncSurfNum));
+
+    mfxFrameSurface1 *encSurfaces = new mfxFrameSurface1[nEncSurfNum];
+    for (mfxI32 i = 0; i < nEncSurfNum; i++) {
+        encSurfaces[i]            = { 0 };
+        encSurfaces[i].Info       = mfxEncParams.mfx.FrameInfo;
+        encSurfaces[i].Data.Y     = &surfaceBuffers[(mfxU32)(lumaSize * 1.5 * i)];
+        encSurfaces[i].Data.U     = encSurfaces[i].Data.Y + lumaSize;
+        encSurfaces[i].Data.V     = encSurfaces[i].Data.U + lumaSize / 4;
+        encSurfaces[i].Data.Pitch = mfxEncParams.mfx.FrameInfo.Width;
+    }
+
+    sts = MFXVideoENCODE_Init(session, &mfxEncParams);
+    if (sts != MFX_ERR_NONE) {
+        if (encSurfaces)
+            delete[] encSurfaces;
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+    }
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength    = 20;
+    mfxBS.Data         = new mfxU8[mfxBS.MaxLength];
+
+    mfxI32 nEncSurfIdx = 0;
+    mfxSyncPoint syncp;
+
+    while (true) {
+        // Encode a frame asynchronously (returns immediately)
+        sts = MFXVideoENCODE_EncodeFrameAsync(session,
+                                              NULL,
+                                              &encSurfaces[nEncSurfIdx],
+                                              &mfxBS,
+                                              &syncp);
+
+        if (sts != MFX_ERR_MORE_DATA)
+            break;
+        nEncSurfIdx++;
+    }
+    ASSERT_EQ(sts, MFX_ERR_NOT_ENOUGH_BUFFER);
+
+    // the retry with a larger bitstream and the same surface does not encode
+    //   the frame again, each submitted frame gives one packet
+    delete[] mfxBS.Data;
+    mfxBS.MaxLength = lumaSize * 4;
+    mfxBS.Data      = new mfxU8[mfxBS.MaxLength];
+
+    sts = MFXVideoENCODE_EncodeFrameAsync(session,
+                                          NULL,
+                                          &encSurfaces[nEncSurfIdx],
+                                          &mfxBS,
+                                          &syncp);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    sts = MFXVideoCORE_SyncOperation(session, syncp, MFX_INFINITE);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxI32 nPackets = 1;
+    for (;;) {
+        mfxBS.DataLength = 0;
+        mfxBS.DataOffset = 0;
+        sts = MFXVideoENCODE_EncodeFrameAsync(session, NULL, NULL, &mfxBS, &syncp);
+        if (sts != MFX_ERR_NONE)
+            break;
+        nPackets++;
+    }
+    EXPECT_EQ(sts, MFX_ERR_MORE_DATA);
+    EXPECT_EQ(nPackets, nEncSurfIdx + 1);
+
+    MFXClose(session);
+
+    delete[] surfaceBuffers;
+    delete[] encSurfaces;
+    delete[] mfxBS.Data;
+}
+
+TEST(EncodeFrameAsync, NullSessionReturnsInvalidHandle) {
+    mfxStatus sts = MFXVideoENCODE_EncodeFrameAsync(0, nullptr, nullptr, nullptr, nullptr);
+    ASSERT_EQ(sts, MFX_ERR_INVALID_HANDLE);
+}
+
+TEST(EncodeFrameAsync, NullSyncpReturnsNullPtr) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxEncParams;
+    memset(&mfxEncParams, 0, sizeof(mfxEncParams));
+    mfxEncParams.mfx.CodecId                 = MFX_CODEC_JPEG;
+    mfxEncParams.mfx.FrameInfo.FourCC        = MFX_FOURCC_I420;
+    mfxEncParams.mfx.FrameInfo.ChromaFormat  = MFX_CHROMAFORMAT_YUV420;
+    mfxEncParams.mfx.FrameInfo.CropW         = 320;
+    mfxEncParams.mfx.FrameInfo.CropH         = 240;
+    mfxEncParams.mfx.FrameInfo.Width         = 320;
+    mfxEncParams.mfx.FrameInfo.Height        = 240;
+    mfxEncParams.mfx.FrameInfo.FrameRateExtN = 30;
+    mfxEncParams.mfx.FrameInfo.FrameRateExtD = 1;
+    mfxEncParams.IOPattern                   = MFX_IOPATTERN_IN_SYSTEM_MEMORY;
+
+    mfxU16 nEncSurfNum = 1;
+    mfxU32 lumaSize    = mfxEncParams.mfx.FrameInfo.Width * mfxEncParams.mfx.FrameInfo.Height;
+
+    mfxU8 *surfaceBuffers = new mfxU8[(mfxU32)(lumaSize * 1.5 * nEncSurfNum)];
+    memset(surfaceBuffers, 0, (mfxU32)(lumaSize * 1.5 * nEncSurfNum));
+
+    mfxFrameSurface1 *encSurfaces = new mfxFrameSurface1[nEncSurfNum];
+    for (mfxI32 i = 0; i < nEncSurfNum; i++) {
+        encSurfaces[i]            = { 0 };
+        encSurfaces[i].Info       = mfxEncParams.mfx.FrameInfo;
+        encSurfaces[i].Data.Y     = &surfaceBuffers[(mfxU32)(lumaSize * 1.5 * i)];
+        encSurfaces[i].Data.U     = encSurfaces[i].Data.Y + lumaSize;
+        encSurfaces[i].Data.V     = encSurfaces[i].Data.U + lumaSize / 4;
+        encSurfaces[i].Data.Pitch = mfxEncParams.mfx.FrameInfo.Width;
+    }
+
+    sts = MFXVideoENCODE_Init(session, &mfxEncParams);
+    if (sts != MFX_ERR_NONE) {
+        if (encSurfaces)
+            delete[] encSurfaces;
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+    }
+    else {
+        mfxBitstream mfxBS = { 0 };
+        mfxBS.MaxLength    = 20;
+        mfxBS.Data         = new mfxU8[mfxBS.MaxLength];
+
+        mfxI32 nEncSurfIdx = 0;
+
+        // Encode a frame asynchronously (returns immediately)
+        sts = MFXVideoENCODE_EncodeFrameAsync(session,
+                                              NULL,
+                                              &encSurfaces[nEncSurfIdx],
+                                              &mfxBS,
+                                              nullptr);
+
+        ASSERT_EQ(sts, MFX_ERR_NULL_PTR);
+
+        MFXClose(session);
+
+        delete[] surfaceBuffers;
+        delete[] encSurfaces;
+        delete[] mfxBS.Data;
+    }
+}
+
+TEST(EncodeFrameAsync, NullBitstreamReturnsErrNull) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxEncParams;
+    memset(&mfxEncParams, 0, sizeof(mfxEncParams));
+    mfxEncParams.mfx.CodecId                 = MFX_CODEC_JPEG;
+    mfxEncParams.mfx.FrameInfo.FourCC        = MFX_FOURCC_I420;
+    mfxEncParams.mfx.FrameInfo.ChromaFormat  = MFX_CHROMAFORMAT_YUV420;
+    mfxEncParams.mfx.FrameInfo.CropW         = 320;
+    mfxEncParams.mfx.FrameInfo.CropH         = 240;
+    mfxEncParams.mfx.FrameInfo.Width         = 320;
+    mfxEncParams.mfx.FrameInfo.Height        = 240;
+    mfxEncParams.mfx.FrameInfo.FrameRateExtN = 30;
+    mfxEncParams.mfx.FrameInfo.FrameRateExtD = 1;
+    mfxEncParams.IOPattern                   = MFX_IOPATTERN_IN_SYSTEM_MEMORY;
+
+    mfxU16 nEncSurfNum = 16;
+    mfxU32 lumaSize    = mfxEncParams.mfx.FrameInfo.Width * mfxEncParams.mfx.FrameInfo.Height;
+
+    mfxU8 *surfaceBuffers = new mfxU8[(mfxU32)(lumaSize * 1.5 * nEncSurfNum)];
+    memset(surfaceBuffers, 0, (mfxU32)(lumaSize * 1.5 * nEncSurfNum));
+
+    mfxFrameSurface1 *encSurfaces = new mfxFrameSurface1[nEncSurfNum];
+    for (mfxI32 i = 0; i < nEncSurfNum; i++) {
+        encSurfaces[i]            = { 0 };
+        encSurfaces[i].Info       = mfxEncParams.mfx.FrameInfo;
+        encSurfaces[i].Data.Y     = &surfaceBuffers[(mfxU32)(lumaSize * 1.5 * i)];
+        encSurfaces[i].Data.U     = encSurfaces[i].Data.Y + lumaSize;
+        encSurfaces[i].Data.V     = encSurfaces[i].Data.U + lumaSize / 4;
+        encSurfaces[i].Data.Pitch = mfxEncParams.mfx.FrameInfo.Width;
+    }
+
+    sts = MFXVideoENCODE_Init(session, &mfxEncParams);
+    if (sts != MFX_ERR_NONE) {
+        if (encSurfaces)
+            delete[] encSurfaces;
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+    }
+
+    mfxI32 nEncSurfIdx = 0;
+    mfxSyncPoint syncp;
+
+    // Encode a frame asynchronously (returns immediately)
+    sts =
+        MFXVideoENCODE_EncodeFrameAsync(session, NULL, &encSurfaces[nEncSurfIdx], nullptr, &syncp);
+
+    ASSERT_EQ(sts, MFX_ERR_NULL_PTR);
+
+    MFXClose(session);
+
+    delete[] surfaceBuffers;
+    delete[] encSurfaces;
+}
+
+TEST(EncodeFrameAsync, EncodeUninitializedReturnsNotInitialized) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxFrameSurface1 encSurfaces;
+
+    mfxBitstream mfxBS = { 0 };
+
+    mfxSyncPoint syncp;
+
+    sts = MFXVideoENCODE_EncodeFrameAsync(session, NULL, &encSurfaces, &mfxBS, &syncp);
+
+    ASSERT_EQ(sts, MFX_ERR_NOT_INITIALIZED);
+
+    MFXClose(session);
+}
+
+/*!
+   DecodeFrame overview
+   Decodes the input bitstream to a single output frame.
+
+   MFX_ERR_NONE The function completed successfully and the output surface is ready for decoding \n
+   MFX_ERR_MORE_DATA The function requires more bitstream at input before decoding can proceed. \n
+   MFX_ERR_MORE_SURFACE The function requires more frame surface at output before decoding can proceed. \n
+   MFX_WRN_VIDEO_PARAM_CHANGED  The decoder detected a new sequence header in the bitstream. Video parameters may have changed. \n
+
+*/
+//mfxStatus MFX_CDECL MFXVideoDECODE_DecodeFrameAsync(mfxSession session, mfxBitstream *bs, mfxFrameSurface1 *surface_work, mfxFrameSurface1 **surface_out, mfxSyncPoint *syncp);
+
+TEST(DecodeFrameAsync, ValidInputsReturnsErrNone) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams;
+    memset(&mfxDecParams, 0, sizeof(mfxDecParams));
+    mfxDecParams.mfx.CodecId = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern   = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
+    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxU32 nSurfNumDec            = 8;
+    mfxFrameSurface1 *decSurfaces = new mfxFrameSurface1[nSurfNumDec];
+    mfxU32 surfW                  = mfxDecParams.mfx.FrameInfo.Width;
+    mfxU32 surfH                  = mfxDecParams.mfx.FrameInfo.Height;
+
+    mfxU8 *DECoutbuf = new mfxU8[(mfxU32)(surfW * surfH * nSurfNumDec * 1.5)];
+
+    for (mfxU32 i = 0; i < nSurfNumDec; i++) {
+        decSurfaces[i]            = { 0 };
+        decSurfaces[i].Info       = mfxDecParams.mfx.FrameInfo;
+        int buf_offset            = i * surfW * surfH;
+        decSurfaces[i].Data.Y     = DECoutbuf + buf_offset;
+        decSurfaces[i].Data.U     = DECoutbuf + buf_offset + (surfW * surfH);
+        decSurfaces[i].Data.V     = decSurfaces[i].Data.U + ((surfW / 2) * (surfH / 2));
+        decSurfaces[i].Data.Pitch = surfW;
+    }
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    if (sts != MFX_ERR_NONE) {
+        if (decSurfaces)
+            delete[] decSurfaces;
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+    }
+
+    mfxSyncPoint syncp;
+    int nIndex                       = 0;
+    mfxFrameSurface1 *pmfxOutSurface = nullptr;
+    sts                              = MFXVideoDECODE_DecodeFrameAsync(session,
+                                          &mfxBS,
+                                          &decSurfaces[nIndex++],
+                                          &pmfxOutSurface,
+                                          &syncp);
+    EXPECT_EQ(sts, MFX_ERR_MORE_DATA);
+
+    sts = MFXVideoDECODE_DecodeFrameAsync(session,
+                                          nullptr,
+                                          &decSurfaces[nIndex++],
+                                          &pmfxOutSurface,
+                                          &syncp);
+    ASSERT_EQ(pmfxOutSurface->Data.FrameOrder, 0);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXVideoDECODE_DecodeFrameAsync(session,
+                                          nullptr,
+                                          &decSurfaces[nIndex++],
+                                          &pmfxOutSurface,
+                                          &syncp);
+    ASSERT_EQ(pmfxOutSurface->Data.FrameOrder, 1);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXClose(session);
+
+    delete[] DECoutbuf;
+    delete[] decSurfaces;
+}
+
+TEST(DecodeFrameAsync, CompleteFrameJPEGReturnsFrame) {
+    mfxStatus sts = MFX_ERR_NONE;
+
+    mfxVersion ver = {};
+    mfxSession session;
+    sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_JPEG;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_32x32_mjpeg::getlen();
+    mfxBS.Data                         = test_bitstream_32x32_mjpeg::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxU32 nSurfNumDec            = 8;
+    mfxFrameSurface1 *decSurfaces = new mfxFrameSurface1[nSurfNumDec];
+    mfxU32 surfW                  = mfxDecParams.mfx.FrameInfo.Width;
+    mfxU32 surfH                  = mfxDecParams.mfx.FrameInfo.Height;
+
+    mfxU8 *DECoutbuf = new mfxU8[(mfxU32)(surfW * surfH * nSurfNumDec * 1.5)];
+
+    for (mfxU32 i = 0; i < nSurfNumDec; i++) {
+        decSurfaces[i]            = { 0 };
+        decSurfaces[i].Info       = mfxDecParams.mfx.FrameInfo;
+        int buf_offset            = i * surfW * surfH;
+        decSurfaces[i].Data.Y     = DECoutbuf + buf_offset;
+        decSurfaces[i].Data.U     = DECoutbuf + buf_offset + (surfW * surfH);
+        decSurfaces[i].Data.V     = decSurfaces[i].Data.U + ((surfW / 2) * (surfH / 2));
+        decSurfaces[i].Data.Pitch = surfW;
+    }
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    if (sts != MFX_ERR_NONE) {
+        if (decSurfaces)
+            delete[] decSurfaces;
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+    }
+
+    mfxFrameSurface1 *pmfxOutSurface = nullptr;
+    mfxSyncPoint syncp               = {};
+    int nIndex                       = 0;
+
+    mfxBS.DataFlag = MFX_BITSTREAM_COMPLETE_FRAME;
+
+    int frame = 2; //use the 3rd frame in the bitstream
+
+    mfxBS.Data = test_bitstream_32x32_mjpeg::getdata() + test_bitstream_32x32_mjpeg::getpos(frame);
+    mfxBS.DataLength =
+        test_bitstream_32x32_mjpeg::getpos(frame + 1) - test_bitstream_32x32_mjpeg::getpos(frame);
+    mfxBS.DataOffset = 0;
+
+    sts = MFXVideoDECODE_DecodeFrameAsync(session,
+                                          &mfxBS,
+                                          &decSurfaces[nIndex++],
+                                          &pmfxOutSurface,
+                                          &syncp);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXClose(session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    delete[] DECoutbuf;
+    delete[] decSurfaces;
+}
+
+// the 32x32 frames come out at 16x16 in the top left of the full size surface
+TEST(DecodeFrameAsync, LowResJPEGDecodesSmallerFrame) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxExtCPUDecodeSkip skip = {};
+    skip.Header.BufferId     = MFX_EXTBUFF_CPU_DECODE_SKIP;
+    skip.Header.BufferSz     = sizeof(mfxExtCPUDecodeSkip);
+    skip.LowRes              = 1;
+    mfxExtBuffer *extParam[] = { &skip.Header };
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_JPEG;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_32x32_mjpeg::getlen();
+    mfxBS.Data                         = test_bitstream_32x32_mjpeg::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(mfxDecParams.mfx.FrameInfo.Width, 32);
+    ASSERT_EQ(mfxDecParams.mfx.FrameInfo.Height, 32);
+
+    // marker outside the decoded image
+    const mfxU32 surfW = 32, surfH = 32;
+    std::vector<mfxU8> buffer(surfW * surfH * 3 / 2, 0xAB);
+    mfxFrameSurface1 surface = { 0 };
+    surface.Info             = mfxDecParams.mfx.FrameInfo;
+    surface.Data.Y           = buffer.data();
+    surface.Data.U           = surface.Data.Y + surfW * surfH;
+    surface.Data.V           = surface.Data.U + (surfW / 2) * (surfH / 2);
+    surface.Data.Pitch       = surfW;
+
+    mfxDecParams.ExtParam    = extParam;
+    mfxDecParams.NumExtParam = 1;
+    sts                      = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxBS.DataFlag   = MFX_BITSTREAM_COMPLETE_FRAME;
+    mfxBS.DataOffset = 0;
+    mfxBS.DataLength = test_bitstream_32x32_mjpeg::getpos(1);
+
+    mfxFrameSurface1 *pmfxOutSurface = nullptr;
+    mfxSyncPoint syncp               = {};
+    sts = MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, &surface, &pmfxOutSurface, &syncp);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(pmfxOutSurface, &surface);
+
+    sts = MFXVideoCORE_SyncOperation(session, syncp, MFX_INFINITE);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    EXPECT_EQ(surface.Info.CropX, 0);
+    EXPECT_EQ(surface.Info.CropY, 0);
+    EXPECT_EQ(surface.Info.CropW, 16);
+    EXPECT_EQ(surface.Info.CropH, 16);
+
+    int nOutside = 0, nInside = 0;
+    for (mfxU32 y = 0; y < surfH; y++) {
+        for (mfxU32 x = 0; x < surfW; x++) {
+            bool inside = (x < 16 && y < 16);
+            if (surface.Data.Y[y * surfW + x] == 0xAB)
+                inside ? nInside++ : nOutside++;
+        }
+    }
+    EXPECT_EQ(nOutside, 16 * 16 * 3);
+    EXPECT_LT(nInside, 16 * 16);
+
+    mfxVideoParam par = { 0 };
+    sts               = MFXVideoDECODE_GetVideoParam(session, &par);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    EXPECT_EQ(par.mfx.FrameInfo.Width, 16);
+    EXPECT_EQ(par.mfx.FrameInfo.Height, 16);
+    EXPECT_EQ(par.mfx.FrameInfo.CropW, 16);
+    EXPECT_EQ(par.mfx.FrameInfo.CropH, 16);
+
+    sts = MFXClose(session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+}
+
+// internal surfaces get the size of the decoded frame
+TEST(DecodeFrameAsync, LowResJPEGInternalSurfacesAreSmaller) {
+    mfxVersion ver = {};
+    ver.Major      = 2;
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxExtCPUDecodeSkip skip = {};
+    skip.Header.BufferId     = MFX_EXTBUFF_CPU_DECODE_SKIP;
+    skip.Header.BufferSz     = sizeof(mfxExtCPUDecodeSkip);
+    skip.LowRes              = 1;
+    mfxExtBuffer *extParam[] = { &skip.Header };
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_JPEG;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_32x32_mjpeg::getlen();
+    mfxBS.Data                         = test_bitstream_32x32_mjpeg::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxDecParams.ExtParam    = extParam;
+    mfxDecParams.NumExtParam = 1;
+    sts                      = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxBS.DataFlag   = MFX_BITSTREAM_COMPLETE_FRAME;
+    mfxBS.DataOffset = 0;
+    mfxBS.DataLength = test_bitstream_32x32_mjpeg::getpos(1);
+
+    mfxFrameSurface1 *surface_out = nullptr;
+    mfxSyncPoint syncp            = {};
+    sts = MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, nullptr, &surface_out, &syncp);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXVideoCORE_SyncOperation(session, syncp, MFX_INFINITE);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    EXPECT_EQ(surface_out->Info.CropW, 16);
+    EXPECT_EQ(surface_out->Info.CropH, 16);
+    EXPECT_GE(surface_out->Info.Width, 16);
+    EXPECT_GE(surface_out->Info.Height, 16);
+    surface_out->FrameInterface->Release(surface_out);
+
+    mfxVideoParam par = { 0 };
+    sts               = MFXVideoDECODE_GetVideoParam(session, &par);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    EXPECT_EQ(par.mfx.FrameInfo.Width, 16);
+    EXPECT_EQ(par.mfx.FrameInfo.Height, 16);
+
+    sts = MFXClose(session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeFrameAsync, EoSReturnsFrame) {
+    mfxStatus sts = MFX_ERR_NONE;
+
+    mfxVersion ver = {};
+    mfxSession session;
+    sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_JPEG;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_32x32_mjpeg::getlen();
+    mfxBS.Data                         = test_bitstream_32x32_mjpeg::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxU32 nSurfNumDec            = 8;
+    mfxFrameSurface1 *decSurfaces = new mfxFrameSurface1[nSurfNumDec];
+    mfxU32 surfW                  = mfxDecParams.mfx.FrameInfo.Width;
+    mfxU32 surfH                  = mfxDecParams.mfx.FrameInfo.Height;
+
+    mfxU8 *DECoutbuf = new mfxU8[(mfxU32)(surfW * surfH * nSurfNumDec * 1.5)];
+
+    for (mfxU32 i = 0; i < nSurfNumDec; i++) {
+        decSurfaces[i]            = { 0 };
+        decSurfaces[i].Info       = mfxDecParams.mfx.FrameInfo;
+        int buf_offset            = i * surfW * surfH;
+        decSurfaces[i].Data.Y     = DECoutbuf + buf_offset;
+        decSurfaces[i].Data.U     = DECoutbuf + buf_offset + (surfW * surfH);
+        decSurfaces[i].Data.V     = decSurfaces[i].Data.U + ((surfW / 2) * (surfH / 2));
+        decSurfaces[i].Data.Pitch = surfW;
+    }
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    if (sts != MFX_ERR_NONE) {
+        if (decSurfaces)
+            delete[] decSurfaces;
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+    }
+
+    mfxFrameSurface1 *pmfxOutSurface = nullptr;
+    mfxSyncPoint syncp               = {};
+    int nIndex                       = 0;
+
+    mfxBS.DataFlag = MFX_BITSTREAM_EOS;
+
+    int frame = 2; //use the 3rd frame in the bitstream
+
+    mfxBS.Data = test_bitstream_32x32_mjpeg::getdata() + test_bitstream_32x32_mjpeg::getpos(frame);
+    mfxBS.DataLength =
+        test_bitstream_32x32_mjpeg::getpos(frame + 1) - test_bitstream_32x32_mjpeg::getpos(frame);
+    mfxBS.DataOffset = 0;
+
+    sts = MFXVideoDECODE_DecodeFrameAsync(session,
+                                          &mfxBS,
+                                          &decSurfaces[nIndex++],
+                                          &pmfxOutSurface,
+                                          &syncp);
+    ASSERT_EQ(sts, MFX_ERR_MORE_DATA);
+
+    sts = MFXVideoDECODE_DecodeFrameAsync(session,
+                                          nullptr,
+                                          &decSurfaces[nIndex++],
+                                          &pmfxOutSurface,
+                                          &syncp);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXClose(session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    delete[] DECoutbuf;
+    delete[] decSurfaces;
+}
+
+TEST(DecodeFrameAsync, BSTimestampReturnsFrameTimestamp) {
+    mfxStatus sts = MFX_ERR_NONE;
+
+    mfxVersion ver = {};
+    mfxSession session;
+    sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams                = { 0 };
+    mfxDecParams.mfx.CodecId                  = MFX_CODEC_JPEG;
+    mfxDecParams.IOPattern                    = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+    mfxDecParams.mfx.FrameInfo.Width          = 32;
+    mfxDecParams.mfx.FrameInfo.CropW          = 32;
+    mfxDecParams.mfx.FrameInfo.Height         = 32;
+    mfxDecParams.mfx.FrameInfo.CropH          = 32;
+    mfxDecParams.mfx.FrameInfo.FourCC         = MFX_FOURCC_I420;
+    mfxDecParams.mfx.FrameInfo.ChromaFormat   = MFX_CHROMAFORMAT_YUV420;
+    mfxDecParams.mfx.FrameInfo.BitDepthLuma   = 8;
+    mfxDecParams.mfx.FrameInfo.BitDepthChroma = 8;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_32x32_mjpeg::getlen();
+    mfxBS.Data                         = test_bitstream_32x32_mjpeg::getdata();
+
+    mfxU32 nSurfNumDec            = 1;
+    mfxFrameSurface1 *decSurfaces = new mfxFrameSurface1[nSurfNumDec];
+    mfxU32 surfW                  = 32;
+    mfxU32 surfH                  = 32;
+
+    mfxU8 *DECoutbuf = new mfxU8[(mfxU32)(surfW * surfH * nSurfNumDec * 1.5)];
+
+    for (mfxU32 i = 0; i < nSurfNumDec; i++) {
+        decSurfaces[i]            = { 0 };
+        decSurfaces[i].Info       = mfxDecParams.mfx.FrameInfo;
+        int buf_offset            = i * surfW * surfH;
+        decSurfaces[i].Data.Y     = DECoutbuf + buf_offset;
+        decSurfaces[i].Data.U     = DECoutbuf + buf_offset + (surfW * surfH);
+        decSurfaces[i].Data.V     = decSurfaces[i].Data.U + ((surfW / 2) * (surfH / 2));
+        decSurfaces[i].Data.Pitch = surfW;
+    }
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
     if (sts != MFX_ERR_NONE) {
-        if (encSurfaces)
-            delete[] encSurfaces;
+        if (decSurfaces)
+            delete[] decSurfaces;
         ASSERT_EQ(sts, MFX_ERR_NONE);
     }
 
-    mfxI32 nEncSurfIdx = 0;
-    mfxSyncPoint syncp;
-
-    // Encode a frame asynchronously (returns immediately)
-    sts =
-        MFXVideoENCODE_EncodeFrameAsync(session, NULL, &encSurfaces[nEncSurfIdx], nullptr, &syncp);
-
-    ASSERT_EQ(sts, MFX_ERR_NULL_PTR);
+    mfxFrameSurface1 *pmfxOutSurface = nullptr;
+    mfxSyncPoint syncp               = {};
 
-    MFXClose(session);
+    mfxBS.DataFlag = MFX_BITSTREAM_COMPLETE_FRAME;
 
-    delete[] surfaceBuffers;
-    delete[] encSurfaces;
-}
+    mfxBS.Data       = test_bitstream_32x32_mjpeg::getdata();
+    mfxBS.DataLength = test_bitstream_32x32_mjpeg::getpos(1);
+    mfxBS.DataOffset = 0;
+    mfxBS.TimeStamp  = 111111;
 
-TEST(EncodeFrameAsync, EncodeUninitializedReturnsNotInitialized) {
-    mfxVersion ver = {};
-    mfxSession session;
-    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    sts =
+        MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, &decSurfaces[0], &pmfxOutSurface, &syncp);
     ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(decSurfaces[0].Data.TimeStamp, 111111);
 
-    mfxFrameSurface1 encSurfaces;
-
-    mfxBitstream mfxBS = { 0 };
-
-    mfxSyncPoint syncp;
-
-    sts = MFXVideoENCODE_EncodeFrameAsync(session, NULL, &encSurfaces, &mfxBS, &syncp);
-
-    ASSERT_EQ(sts, MFX_ERR_NOT_INITIALIZED);
+    sts = MFXClose(session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    MFXClose(session);
+    delete[] DECoutbuf;
+    delete[] decSurfaces;
 }
 
-/*!
-   DecodeFrame overview
-   Decodes the input bitstream to a single output frame.
-
-   MFX_ERR_NONE The function completed successfully and the output surface is ready for decoding \n
-   MFX_ERR_MORE_DATA The function requires more bitstream at input before decoding can proceed. \n
-   MFX_ERR_MORE_SURFACE The function requires more frame surface at output before decoding can proceed. \n
-   MFX_WRN_VIDEO_PARAM_CHANGED  The decoder detected a new sequence header in the bitstream. Video parameters may have changed. \n
-
-*/
-//mfxStatus MFX_CDECL MFXVideoDECODE_DecodeFrameAsync(mfxSession session, mfxBitstream *bs, mfxFrameSurface1 *surface_work, mfxFrameSurface1 **surface_out, mfxSyncPoint *syncp);
+TEST(DecodeFrameAsync, CompleteFrameHEVCReturnsFrame) {
+    mfxStatus sts = MFX_ERR_NONE;
 
-TEST(DecodeFrameAsync, ValidInputsReturnsErrNone) {
     mfxVersion ver = {};
     mfxSession session;
-    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    mfxVideoParam mfxDecParams;
-    memset(&mfxDecParams, 0, sizeof(mfxDecParams));
-    mfxDecParams.mfx.CodecId = MFX_CODEC_HEVC;
-    mfxDecParams.IOPattern   = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
 
     mfxBitstream mfxBS = { 0 };
     mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
@@ -512,53 +1765,151 @@ TEST(DecodeFrameAsync, ValidInputsReturnsErrNone) {
         ASSERT_EQ(sts, MFX_ERR_NONE);
     }
 
-    mfxSyncPoint syncp;
-    int nIndex                       = 0;
     mfxFrameSurface1 *pmfxOutSurface = nullptr;
-    sts                              = MFXVideoDECODE_DecodeFrameAsync(session,
-                                          &mfxBS,
-                                          &decSurfaces[nIndex++],
-                                          &pmfxOutSurface,
-                                          &syncp);
-    EXPECT_EQ(sts, MFX_ERR_MORE_DATA);
+    mfxSyncPoint syncp               = {};
+    int nIndex                       = 0;
+
+    mfxBS.DataFlag = MFX_BITSTREAM_COMPLETE_FRAME;
+
+    mfxBS.Data       = test_bitstream_96x64_8bit_hevc::getdata();
+    mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getpos(1);
+    mfxBS.DataOffset = 0;
 
     sts = MFXVideoDECODE_DecodeFrameAsync(session,
-                                          nullptr,
+                                          &mfxBS,
                                           &decSurfaces[nIndex++],
                                           &pmfxOutSurface,
                                           &syncp);
-    ASSERT_EQ(pmfxOutSurface->Data.FrameOrder, 0);
-    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(sts, MFX_ERR_MORE_DATA);
 
     sts = MFXVideoDECODE_DecodeFrameAsync(session,
                                           nullptr,
                                           &decSurfaces[nIndex++],
                                           &pmfxOutSurface,
                                           &syncp);
-    ASSERT_EQ(pmfxOutSurface->Data.FrameOrder, 1);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
     sts = MFXClose(session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
 
     delete[] DECoutbuf;
     delete[] decSurfaces;
 }
 
-TEST(DecodeFrameAsync, CompleteFrameJPEGReturnsFrame) {
-    mfxStatus sts = MFX_ERR_NONE;
+// decode the 96x64 HEVC stream into application surfaces, pitch and alignment
+//   select whether the decoder may write into the surfaces directly
+static void DecodeHEVCToSurfaces(mfxU16 pitch, mfxU32 align, std::vector<mfxU32> &checksums) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
+    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxU32 nSurfNumDec = 8;
+    mfxU32 surfH       = mfxDecParams.mfx.FrameInfo.Height;
+    mfxU32 surfSize    = pitch * surfH * 3 / 2;
+    std::vector<mfxU8> DECoutbuf(surfSize * nSurfNumDec + align);
+    mfxU8 *base = DECoutbuf.data() + align - reinterpret_cast<uintptr_t>(DECoutbuf.data()) % align;
+    std::vector<mfxFrameSurface1> decSurfaces(nSurfNumDec);
+
+    for (mfxU32 i = 0; i < nSurfNumDec; i++) {
+        decSurfaces[i]            = { 0 };
+        decSurfaces[i].Info       = mfxDecParams.mfx.FrameInfo;
+        decSurfaces[i].Data.Y     = base + i * surfSize;
+        decSurfaces[i].Data.U     = decSurfaces[i].Data.Y + pitch * surfH;
+        decSurfaces[i].Data.V     = decSurfaces[i].Data.U + (pitch / 2) * (surfH / 2);
+        decSurfaces[i].Data.Pitch = pitch;
+    }
+
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxBitstream *bs = &mfxBS;
+    mfxU32 nIndex    = 0;
+    for (;;) {
+        // round-robin over the surfaces the decoder does not hold
+        mfxFrameSurface1 *surface_work = nullptr;
+        for (mfxU32 i = 0; i < nSurfNumDec && !surface_work; i++, nIndex++) {
+            if (!decSurfaces[nIndex % nSurfNumDec].Data.Locked)
+                surface_work = &decSurfaces[nIndex % nSurfNumDec];
+        }
+        ASSERT_NE(surface_work, nullptr);
+
+        mfxFrameSurface1 *pmfxOutSurface = nullptr;
+        mfxSyncPoint syncp               = {};
+        sts = MFXVideoDECODE_DecodeFrameAsync(session, bs, surface_work, &pmfxOutSurface, &syncp);
+        if (sts == MFX_ERR_MORE_DATA) {
+            if (!bs)
+                break;
+            bs = nullptr; // drain
+            continue;
+        }
+        if (sts == MFX_ERR_MORE_SURFACE)
+            continue;
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+
+        sts = MFXVideoCORE_SyncOperation(session, syncp, 1000);
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+
+        mfxFrameInfo *info = &pmfxOutSurface->Info;
+        mfxFrameData *data = &pmfxOutSurface->Data;
+        ASSERT_EQ(info->CropW, mfxDecParams.mfx.FrameInfo.Width);
+        ASSERT_EQ(info->CropH, mfxDecParams.mfx.FrameInfo.Height);
 
+        mfxU32 checksum = 0;
+        for (mfxU32 y = 0; y < info->CropH; y++) {
+            mfxU8 *row = data->Y + (info->CropY + y) * data->Pitch + info->CropX;
+            for (mfxU32 x = 0; x < info->CropW; x++)
+                checksum = checksum * 31 + row[x];
+        }
+        checksums.push_back(checksum);
+    }
+
+    sts = MFXClose(session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(DecodeFrameAsync, AlignedSurfacesDecodeSameAsCopiedFrames) {
+    std::vector<mfxU32> copied, direct;
+
+    // pitch = width, libav frames are copied into the surfaces
+    DecodeHEVCToSurfaces(96, 1, copied);
+    // pitch and planes aligned for libav, frames are decoded in place
+    DecodeHEVCToSurfaces(128, 64, direct);
+
+    ASSERT_FALSE(copied.empty());
+    EXPECT_EQ(copied, direct);
+}
+
+TEST(DecodeFrameAsync, KeyFramesOnlyReturnsKeyFrames) {
     mfxVersion ver = {};
     mfxSession session;
-    sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
+    mfxExtCPUDecodeSkip skip = {};
+    skip.Header.BufferId     = MFX_EXTBUFF_CPU_DECODE_SKIP;
+    skip.Header.BufferSz     = sizeof(mfxExtCPUDecodeSkip);
+    skip.KeyFramesOnly       = MFX_CODINGOPTION_ON;
+    mfxExtBuffer *extParam[] = { &skip.Header };
+
     mfxVideoParam mfxDecParams = { 0 };
-    mfxDecParams.mfx.CodecId   = MFX_CODEC_JPEG;
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
     mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
 
     mfxBitstream mfxBS = { 0 };
-    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_32x32_mjpeg::getlen();
-    mfxBS.Data                         = test_bitstream_32x32_mjpeg::getdata();
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
+    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
 
     sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
     ASSERT_EQ(sts, MFX_ERR_NONE);
@@ -580,6 +1931,9 @@ TEST(DecodeFrameAsync, CompleteFrameJPEGReturnsFrame) {
         decSurfaces[i].Data.Pitch = surfW;
     }
 
+    mfxDecParams.ExtParam    = extParam;
+    mfxDecParams.NumExtParam = 1;
+
     sts = MFXVideoDECODE_Init(session, &mfxDecParams);
     if (sts != MFX_ERR_NONE) {
         if (decSurfaces)
@@ -587,48 +1941,159 @@ TEST(DecodeFrameAsync, CompleteFrameJPEGReturnsFrame) {
         ASSERT_EQ(sts, MFX_ERR_NONE);
     }
 
+    // the stream has one IDR frame followed by 7 trailing frames
     mfxFrameSurface1 *pmfxOutSurface = nullptr;
     mfxSyncPoint syncp               = {};
-    int nIndex                       = 0;
+    mfxBitstream *bs                 = &mfxBS;
+    int nFrames                      = 0;
+    for (mfxU32 nIndex = 0; nIndex < nSurfNumDec; nIndex++) {
+        sts = MFXVideoDECODE_DecodeFrameAsync(session,
+                                              bs,
+                                              &decSurfaces[nIndex],
+                                              &pmfxOutSurface,
+                                              &syncp);
+        if (sts == MFX_ERR_NONE)
+            nFrames++;
+        else if (sts == MFX_ERR_MORE_DATA && bs)
+            bs = nullptr;
+        else
+            break;
+    }
+    EXPECT_EQ(sts, MFX_ERR_MORE_DATA);
+    EXPECT_EQ(nFrames, 1);
 
-    mfxBS.DataFlag = MFX_BITSTREAM_COMPLETE_FRAME;
+    sts = MFXClose(session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    int frame = 2; //use the 3rd frame in the bitstream
+    delete[] DECoutbuf;
+    delete[] decSurfaces;
+}
 
-    mfxBS.Data = test_bitstream_32x32_mjpeg::getdata() + test_bitstream_32x32_mjpeg::getpos(frame);
-    mfxBS.DataLength =
-        test_bitstream_32x32_mjpeg::getpos(frame + 1) - test_bitstream_32x32_mjpeg::getpos(frame);
-    mfxBS.DataOffset = 0;
+static std::atomic<mfxU32> s_numOnComplete(0);
+static std::atomic<int> s_onCompleteError(MFX_ERR_NONE);
 
-    sts = MFXVideoDECODE_DecodeFrameAsync(session,
-                                          &mfxBS,
-                                          &decSurfaces[nIndex++],
-                                          &pmfxOutSurface,
-                                          &syncp);
+static void MFX_CDECL CountOnComplete(mfxStatus sts) {
+    if (sts != MFX_ERR_NONE)
+        s_onCompleteError = sts;
+    s_numOnComplete++;
+}
+
+// I420 frames are decoded in place into the surfaces, NV12 frames are
+//   interleaved into them by a task on the session thread pool
+static void DecodeHEVCWithOnComplete(mfxU32 fourcc) {
+    mfxVersion ver = {};
+    ver.Major      = 2;
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    sts = MFXClose(session);
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+    mfxDecParams.AsyncDepth    = 4;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
+    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    delete[] DECoutbuf;
-    delete[] decSurfaces;
+    mfxDecParams.mfx.FrameInfo.FourCC = fourcc;
+    sts                               = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    s_numOnComplete   = 0;
+    s_onCompleteError = MFX_ERR_NONE;
+
+    mfxBitstream *bs = &mfxBS;
+    mfxU32 nFrames   = 0;
+    for (;;) {
+        mfxFrameSurface1 *surface_work = nullptr;
+        sts                            = MFXMemory_GetSurfaceForDecode(session, &surface_work);
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+        surface_work->FrameInterface->OnComplete = CountOnComplete;
+
+        mfxFrameSurface1 *surface_out = nullptr;
+        mfxSyncPoint syncp            = nullptr;
+
+        sts = MFXVideoDECODE_DecodeFrameAsync(session, bs, surface_work, &surface_out, &syncp);
+        if (sts == MFX_ERR_MORE_DATA) {
+            surface_work->FrameInterface->Release(surface_work);
+            EXPECT_EQ(s_numOnComplete.load(), nFrames);
+            if (!bs)
+                break;
+            bs = nullptr;
+            continue;
+        }
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+        ASSERT_EQ(surface_out, surface_work);
+
+        sts = MFXVideoCORE_SyncOperation(session, syncp, MFX_INFINITE);
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+        nFrames++;
+        EXPECT_EQ(s_numOnComplete.load(), nFrames);
+
+        // the runtime let go of the surface, the application holds the only reference
+        mfxU32 refCount = 0;
+        sts             = surface_out->FrameInterface->GetRefCounter(surface_out, &refCount);
+        EXPECT_EQ(sts, MFX_ERR_NONE);
+        EXPECT_EQ(refCount, 1u);
+        surface_out->FrameInterface->Release(surface_out);
+    }
+    EXPECT_EQ(nFrames, 8u);
+    EXPECT_EQ(s_onCompleteError.load(), MFX_ERR_NONE);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
 }
 
-TEST(DecodeFrameAsync, EoSReturnsFrame) {
-    mfxStatus sts = MFX_ERR_NONE;
+TEST(DecodeFrameAsync, OnCompleteCalledOnceForInPlaceFrames) {
+    DecodeHEVCWithOnComplete(MFX_FOURCC_I420);
+}
+
+TEST(DecodeFrameAsync, OnCompleteCalledOnceForCopiedFrames) {
+    DecodeHEVCWithOnComplete(MFX_FOURCC_NV12);
+}
+
+TEST(DecodeFrameAsync, NV12OutputHasTheSamplesOfI420) {
+    mfxU8 *stream = test_bitstream_96x64_8bit_hevc::getdata();
+    mfxU32 len    = test_bitstream_96x64_8bit_hevc::getlen();
+
+    std::vector<std::vector<mfxU16>> i420 = DecodeHEVCSamples(stream, len, MFX_FOURCC_I420, 0);
+    std::vector<std::vector<mfxU16>> nv12 = DecodeHEVCSamples(stream, len, MFX_FOURCC_NV12, 0);
+    EXPECT_EQ(i420.size(), 8u);
+    EXPECT_TRUE(nv12 == i420);
+}
+
+TEST(DecodeFrameAsync, P010OutputHasTheSamplesOfI010) {
+    mfxU8 *stream = test_bitstream_96x64_10bit_hevc::getdata();
+    mfxU32 len    = test_bitstream_96x64_10bit_hevc::getlen();
+
+    std::vector<std::vector<mfxU16>> i010 = DecodeHEVCSamples(stream, len, MFX_FOURCC_I010, 0);
+    EXPECT_EQ(i010.size(), 8u);
+
+    // samples in the low bits, then in the high bits
+    for (mfxU16 shift = 0; shift <= 1; shift++) {
+        std::vector<std::vector<mfxU16>> p010 =
+            DecodeHEVCSamples(stream, len, MFX_FOURCC_P010, shift);
+        EXPECT_TRUE(p010 == i010) << "Shift " << shift;
+    }
+}
 
+TEST(DecodeFrameAsync, InsufficientInBitstreamReturnsMoreData) {
     mfxVersion ver = {};
     mfxSession session;
-    sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
     mfxVideoParam mfxDecParams = { 0 };
-    mfxDecParams.mfx.CodecId   = MFX_CODEC_JPEG;
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
     mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
 
     mfxBitstream mfxBS = { 0 };
-    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_32x32_mjpeg::getlen();
-    mfxBS.Data                         = test_bitstream_32x32_mjpeg::getdata();
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
+    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
 
     sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
     ASSERT_EQ(sts, MFX_ERR_NONE);
@@ -657,32 +2122,16 @@ TEST(DecodeFrameAsync, EoSReturnsFrame) {
         ASSERT_EQ(sts, MFX_ERR_NONE);
     }
 
-    mfxFrameSurface1 *pmfxOutSurface = nullptr;
-    mfxSyncPoint syncp               = {};
+    mfxBS.MaxLength = mfxBS.DataLength = 1;
+    mfxSyncPoint syncp;
     int nIndex                       = 0;
-
-    mfxBS.DataFlag = MFX_BITSTREAM_EOS;
-
-    int frame = 2; //use the 3rd frame in the bitstream
-
-    mfxBS.Data = test_bitstream_32x32_mjpeg::getdata() + test_bitstream_32x32_mjpeg::getpos(frame);
-    mfxBS.DataLength =
-        test_bitstream_32x32_mjpeg::getpos(frame + 1) - test_bitstream_32x32_mjpeg::getpos(frame);
-    mfxBS.DataOffset = 0;
-
-    sts = MFXVideoDECODE_DecodeFrameAsync(session,
+    mfxFrameSurface1 *pmfxOutSurface = nullptr;
+    sts                              = MFXVideoDECODE_DecodeFrameAsync(session,
                                           &mfxBS,
                                           &decSurfaces[nIndex++],
                                           &pmfxOutSurface,
                                           &syncp);
-    ASSERT_EQ(sts, MFX_ERR_MORE_DATA);
-
-    sts = MFXVideoDECODE_DecodeFrameAsync(session,
-                                          nullptr,
-                                          &decSurfaces[nIndex++],
-                                          &pmfxOutSurface,
-                                          &syncp);
-    ASSERT_EQ(sts, MFX_ERR_NONE);
+    EXPECT_EQ(sts, MFX_ERR_MORE_DATA);
 
     sts = MFXClose(session);
     ASSERT_EQ(sts, MFX_ERR_NONE);
@@ -691,34 +2140,33 @@ TEST(DecodeFrameAsync, EoSReturnsFrame) {
     delete[] decSurfaces;
 }
 
-TEST(DecodeFrameAsync, BSTimestampReturnsFrameTimestamp) {
-    mfxStatus sts = MFX_ERR_NONE;
-
+TEST(DecodeFrameAsync, NullSessionReturnsInvalidHandle) {
+    mfxStatus sts = MFXVideoDECODE_DecodeFrameAsync(0, nullptr, nullptr, nullptr, nullptr);
+    ASSERT_EQ(sts, MFX_ERR_INVALID_HANDLE);
+}
+
+TEST(DecodeFrameAsync, NullSurfaceOutReturnsErrNull) {
     mfxVersion ver = {};
     mfxSession session;
-    sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    mfxVideoParam mfxDecParams                = { 0 };
-    mfxDecParams.mfx.CodecId                  = MFX_CODEC_JPEG;
-    mfxDecParams.IOPattern                    = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
-    mfxDecParams.mfx.FrameInfo.Width          = 32;
-    mfxDecParams.mfx.FrameInfo.CropW          = 32;
-    mfxDecParams.mfx.FrameInfo.Height         = 32;
-    mfxDecParams.mfx.FrameInfo.CropH          = 32;
-    mfxDecParams.mfx.FrameInfo.FourCC         = MFX_FOURCC_I420;
-    mfxDecParams.mfx.FrameInfo.ChromaFormat   = MFX_CHROMAFORMAT_YUV420;
-    mfxDecParams.mfx.FrameInfo.BitDepthLuma   = 8;
-    mfxDecParams.mfx.FrameInfo.BitDepthChroma = 8;
+    mfxVideoParam mfxDecParams;
+    memset(&mfxDecParams, 0, sizeof(mfxDecParams));
+    mfxDecParams.mfx.CodecId = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern   = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
 
     mfxBitstream mfxBS = { 0 };
-    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_32x32_mjpeg::getlen();
-    mfxBS.Data                         = test_bitstream_32x32_mjpeg::getdata();
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
+    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
 
-    mfxU32 nSurfNumDec            = 1;
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxU32 nSurfNumDec            = 8;
     mfxFrameSurface1 *decSurfaces = new mfxFrameSurface1[nSurfNumDec];
-    mfxU32 surfW                  = 32;
-    mfxU32 surfH                  = 32;
+    mfxU32 surfW                  = mfxDecParams.mfx.FrameInfo.Width;
+    mfxU32 surfH                  = mfxDecParams.mfx.FrameInfo.Height;
 
     mfxU8 *DECoutbuf = new mfxU8[(mfxU32)(surfW * surfH * nSurfNumDec * 1.5)];
 
@@ -739,39 +2187,32 @@ TEST(DecodeFrameAsync, BSTimestampReturnsFrameTimestamp) {
         ASSERT_EQ(sts, MFX_ERR_NONE);
     }
 
-    mfxFrameSurface1 *pmfxOutSurface = nullptr;
-    mfxSyncPoint syncp               = {};
-
-    mfxBS.DataFlag = MFX_BITSTREAM_COMPLETE_FRAME;
-
-    mfxBS.Data       = test_bitstream_32x32_mjpeg::getdata();
-    mfxBS.DataLength = test_bitstream_32x32_mjpeg::getpos(1);
-    mfxBS.DataOffset = 0;
-    mfxBS.TimeStamp  = 111111;
-
-    sts =
-        MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, &decSurfaces[0], &pmfxOutSurface, &syncp);
-    ASSERT_EQ(sts, MFX_ERR_NONE);
-    ASSERT_EQ(decSurfaces[0].Data.TimeStamp, 111111);
+    mfxBS.MaxLength = mfxBS.DataLength = 1;
+    int nIndex                         = 0;
+    mfxFrameSurface1 *pmfxOutSurface   = nullptr;
+    sts                                = MFXVideoDECODE_DecodeFrameAsync(session,
+                                          &mfxBS,
+                                          &decSurfaces[nIndex++],
+                                          &pmfxOutSurface,
+                                          nullptr);
+    EXPECT_EQ(sts, MFX_ERR_NULL_PTR);
 
     sts = MFXClose(session);
-    ASSERT_EQ(sts, MFX_ERR_NONE);
 
     delete[] DECoutbuf;
     delete[] decSurfaces;
 }
 
-TEST(DecodeFrameAsync, CompleteFrameHEVCReturnsFrame) {
-    mfxStatus sts = MFX_ERR_NONE;
-
+TEST(DecodeFrameAsync, NullSyncpReturnsErrNull) {
     mfxVersion ver = {};
     mfxSession session;
-    sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    mfxVideoParam mfxDecParams = { 0 };
-    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
-    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+    mfxVideoParam mfxDecParams;
+    memset(&mfxDecParams, 0, sizeof(mfxDecParams));
+    mfxDecParams.mfx.CodecId = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern   = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
 
     mfxBitstream mfxBS = { 0 };
     mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
@@ -803,39 +2244,53 @@ TEST(DecodeFrameAsync, CompleteFrameHEVCReturnsFrame) {
             delete[] decSurfaces;
         ASSERT_EQ(sts, MFX_ERR_NONE);
     }
+    else {
+        mfxFrameSurface1 *pmfxOutSurface = nullptr;
+        mfxBS.MaxLength = mfxBS.DataLength = 1;
+        int nIndex                         = 0;
+        sts                                = MFXVideoDECODE_DecodeFrameAsync(session,
+                                              &mfxBS,
+                                              &decSurfaces[nIndex++],
+                                              &pmfxOutSurface,
+                                              nullptr);
+        EXPECT_EQ(sts, MFX_ERR_NULL_PTR);
 
-    mfxFrameSurface1 *pmfxOutSurface = nullptr;
-    mfxSyncPoint syncp               = {};
-    int nIndex                       = 0;
+        sts = MFXClose(session);
 
-    mfxBS.DataFlag = MFX_BITSTREAM_COMPLETE_FRAME;
+        delete[] DECoutbuf;
+        delete[] decSurfaces;
+    }
+}
 
-    mfxBS.Data       = test_bitstream_96x64_8bit_hevc::getdata();
-    mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getpos(1);
-    mfxBS.DataOffset = 0;
+TEST(DecodeFrameAsync, NullSurfaceWorkReturnsErrMoreData) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    sts = MFXVideoDECODE_DecodeFrameAsync(session,
-                                          &mfxBS,
-                                          &decSurfaces[nIndex++],
-                                          &pmfxOutSurface,
-                                          &syncp);
-    ASSERT_EQ(sts, MFX_ERR_MORE_DATA);
+    mfxVideoParam mfxDecParams;
+    memset(&mfxDecParams, 0, sizeof(mfxDecParams));
+    mfxDecParams.mfx.CodecId = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern   = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
 
-    sts = MFXVideoDECODE_DecodeFrameAsync(session,
-                                          nullptr,
-                                          &decSurfaces[nIndex++],
-                                          &pmfxOutSurface,
-                                          &syncp);
-    ASSERT_EQ(sts, MFX_ERR_NONE);
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
+    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
 
-    sts = MFXClose(session);
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    delete[] DECoutbuf;
-    delete[] decSurfaces;
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+
+    mfxSyncPoint syncp;
+    mfxFrameSurface1 *pmfxOutSurface = nullptr;
+    sts = MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, nullptr, &pmfxOutSurface, &syncp);
+    ASSERT_EQ(sts, MFX_ERR_MORE_DATA);
+
+    sts = MFXClose(session);
 }
 
-TEST(DecodeFrameAsync, InsufficientInBitstreamReturnsMoreData) {
+TEST(DecodeFrameAsync, DecodeUninitializedReturnsNotInitialized) {
     mfxVersion ver = {};
     mfxSession session;
     mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
@@ -869,14 +2324,6 @@ TEST(DecodeFrameAsync, InsufficientInBitstreamReturnsMoreData) {
         decSurfaces[i].Data.Pitch = surfW;
     }
 
-    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
-    if (sts != MFX_ERR_NONE) {
-        if (decSurfaces)
-            delete[] decSurfaces;
-        ASSERT_EQ(sts, MFX_ERR_NONE);
-    }
-
-    mfxBS.MaxLength = mfxBS.DataLength = 1;
     mfxSyncPoint syncp;
     int nIndex                       = 0;
     mfxFrameSurface1 *pmfxOutSurface = nullptr;
@@ -885,30 +2332,36 @@ TEST(DecodeFrameAsync, InsufficientInBitstreamReturnsMoreData) {
                                           &decSurfaces[nIndex++],
                                           &pmfxOutSurface,
                                           &syncp);
-    EXPECT_EQ(sts, MFX_ERR_MORE_DATA);
+    EXPECT_EQ(sts, MFX_ERR_NOT_INITIALIZED);
 
     sts = MFXClose(session);
-    ASSERT_EQ(sts, MFX_ERR_NONE);
 
     delete[] DECoutbuf;
     delete[] decSurfaces;
 }
 
-TEST(DecodeFrameAsync, NullSessionReturnsInvalidHandle) {
-    mfxStatus sts = MFXVideoDECODE_DecodeFrameAsync(0, nullptr, nullptr, nullptr, nullptr);
-    ASSERT_EQ(sts, MFX_ERR_INVALID_HANDLE);
+TEST(DecodeSetSkipMode, DecodeUninitializedReturnsNotInitialized) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXVideoDECODE_SetSkipMode(session, MFX_SKIPMODE_MORE);
+    EXPECT_EQ(sts, MFX_ERR_NOT_INITIALIZED);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
 }
 
-TEST(DecodeFrameAsync, NullSurfaceOutReturnsErrNull) {
+TEST(DecodeSetSkipMode, MoreAndLessStopAtLimits) {
     mfxVersion ver = {};
     mfxSession session;
     mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    mfxVideoParam mfxDecParams;
-    memset(&mfxDecParams, 0, sizeof(mfxDecParams));
-    mfxDecParams.mfx.CodecId = MFX_CODEC_HEVC;
-    mfxDecParams.IOPattern   = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
 
     mfxBitstream mfxBS = { 0 };
     mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
@@ -917,56 +2370,209 @@ TEST(DecodeFrameAsync, NullSurfaceOutReturnsErrNull) {
     sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    mfxU32 nSurfNumDec            = 8;
-    mfxFrameSurface1 *decSurfaces = new mfxFrameSurface1[nSurfNumDec];
-    mfxU32 surfW                  = mfxDecParams.mfx.FrameInfo.Width;
-    mfxU32 surfH                  = mfxDecParams.mfx.FrameInfo.Height;
+    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    mfxU8 *DECoutbuf = new mfxU8[(mfxU32)(surfW * surfH * nSurfNumDec * 1.5)];
+    sts = MFXVideoDECODE_SetSkipMode(session, MFX_SKIPMODE_LESS);
+    EXPECT_EQ(sts, MFX_WRN_VALUE_NOT_CHANGED);
 
-    for (mfxU32 i = 0; i < nSurfNumDec; i++) {
-        decSurfaces[i]            = { 0 };
-        decSurfaces[i].Info       = mfxDecParams.mfx.FrameInfo;
-        int buf_offset            = i * surfW * surfH;
-        decSurfaces[i].Data.Y     = DECoutbuf + buf_offset;
-        decSurfaces[i].Data.U     = DECoutbuf + buf_offset + (surfW * surfH);
-        decSurfaces[i].Data.V     = decSurfaces[i].Data.U + ((surfW / 2) * (surfH / 2));
-        decSurfaces[i].Data.Pitch = surfW;
+    for (int i = 0; i < MFX_CPU_DECODE_MAX_SKIP_LEVEL; i++) {
+        sts = MFXVideoDECODE_SetSkipMode(session, MFX_SKIPMODE_MORE);
+        EXPECT_EQ(sts, MFX_ERR_NONE);
     }
+    sts = MFXVideoDECODE_SetSkipMode(session, MFX_SKIPMODE_MORE);
+    EXPECT_EQ(sts, MFX_WRN_VALUE_NOT_CHANGED);
+
+    sts = MFXVideoDECODE_SetSkipMode(session, MFX_SKIPMODE_LESS);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXVideoDECODE_SetSkipMode(session, MFX_SKIPMODE_NOSKIP);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXVideoDECODE_SetSkipMode(session, MFX_SKIPMODE_NOSKIP);
+    EXPECT_EQ(sts, MFX_WRN_VALUE_NOT_CHANGED);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+// each concurrent step counts, so the maximum is reached after exactly as many
+TEST(DecodeSetSkipMode, ConcurrentCallsEachMoveOneLevel) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
+    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
 
     sts = MFXVideoDECODE_Init(session, &mfxDecParams);
-    if (sts != MFX_ERR_NONE) {
-        if (decSurfaces)
-            delete[] decSurfaces;
-        ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    std::atomic<int> numChanged(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < MFX_CPU_DECODE_MAX_SKIP_LEVEL; i++) {
+        threads.emplace_back([session, &numChanged]() {
+            if (MFXVideoDECODE_SetSkipMode(session, MFX_SKIPMODE_MORE) == MFX_ERR_NONE)
+                numChanged++;
+        });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+    EXPECT_EQ(numChanged.load(), MFX_CPU_DECODE_MAX_SKIP_LEVEL);
+
+    sts = MFXVideoDECODE_SetSkipMode(session, MFX_SKIPMODE_MORE);
+    EXPECT_EQ(sts, MFX_WRN_VALUE_NOT_CHANGED);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+// decodes the 8 frames of the HEVC stream at skip level and with skip, calls
+//   DecodeFrameAsync at the frame rate of the stream if paced is set, returns
+//   the number of frames output
+static mfxU32 DecodeHEVCWithSkip(int level, const mfxExtCPUDecodeSkip &skip, bool paced) {
+    mfxVersion ver = {};
+    ver.Major      = 2;
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    if (sts != MFX_ERR_NONE)
+        return 0;
+
+    mfxExtCPUDecodeSkip skipParam = skip;
+    skipParam.Header.BufferId     = MFX_EXTBUFF_CPU_DECODE_SKIP;
+    skipParam.Header.BufferSz     = sizeof(mfxExtCPUDecodeSkip);
+    mfxExtBuffer *extParam[]      = { &skipParam.Header };
+
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxBitstream mfxBS = { 0 };
+    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
+    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
+
+    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+
+    mfxDecParams.ExtParam    = extParam;
+    mfxDecParams.NumExtParam = 1;
+    sts                      = MFXVideoDECODE_Init(session, &mfxDecParams);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+
+    for (int i = 0; i < level; i++) {
+        sts = MFXVideoDECODE_SetSkipMode(session, MFX_SKIPMODE_MORE);
+        EXPECT_EQ(sts, MFX_ERR_NONE);
+    }
+
+    const mfxFrameInfo &info = mfxDecParams.mfx.FrameInfo;
+    std::chrono::duration<double> frameTime(
+        (info.FrameRateExtN && info.FrameRateExtD)
+            ? static_cast<double>(info.FrameRateExtD) / info.FrameRateExtN
+            : 1.0 / 30);
+    auto start = std::chrono::steady_clock::now();
+
+    mfxBitstream *bs = &mfxBS;
+    mfxU32 nFrames   = 0;
+    for (int nCalls = 0; sts >= MFX_ERR_NONE || sts == MFX_ERR_MORE_DATA; nCalls++) {
+        if (paced)
+            std::this_thread::sleep_until(
+                start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                            frameTime * nCalls));
+
+        mfxFrameSurface1 *surface_out = nullptr;
+        mfxSyncPoint syncp            = nullptr;
+
+        sts = MFXVideoDECODE_DecodeFrameAsync(session, bs, nullptr, &surface_out, &syncp);
+        if (sts == MFX_ERR_MORE_DATA) {
+            if (!bs)
+                break;
+            bs = nullptr;
+            continue;
+        }
+        EXPECT_EQ(sts, MFX_ERR_NONE);
+        if (sts != MFX_ERR_NONE)
+            break;
+
+        sts = MFXVideoCORE_SyncOperation(session, syncp, MFX_INFINITE);
+        EXPECT_EQ(sts, MFX_ERR_NONE);
+        surface_out->FrameInterface->Release(surface_out);
+        nFrames++;
     }
 
-    mfxBS.MaxLength = mfxBS.DataLength = 1;
-    int nIndex                         = 0;
-    mfxFrameSurface1 *pmfxOutSurface   = nullptr;
-    sts                                = MFXVideoDECODE_DecodeFrameAsync(session,
-                                          &mfxBS,
-                                          &decSurfaces[nIndex++],
-                                          &pmfxOutSurface,
-                                          nullptr);
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    return nFrames;
+}
+
+// the stream has one IDR frame followed by 7 trailing frames
+TEST(DecodeFrameAsync, SkipLevelsDropFrames) {
+    mfxExtCPUDecodeSkip skip = {};
+    EXPECT_EQ(DecodeHEVCWithSkip(0, skip, false), 8u);
+    EXPECT_EQ(DecodeHEVCWithSkip(MFX_CPU_DECODE_MAX_SKIP_LEVEL, skip, false), 1u);
+
+    skip.KeyFramesOnly = MFX_CODINGOPTION_ON;
+    EXPECT_EQ(DecodeHEVCWithSkip(0, skip, false), 1u);
+}
+
+// an application which keeps up with the frame rate gets all frames
+TEST(DecodeFrameAsync, AutoSkipStaysOffWhilePacketsAreOnTime) {
+    mfxExtCPUDecodeSkip skip = {};
+    skip.AutoSkip            = MFX_CODINGOPTION_ON;
+    EXPECT_EQ(DecodeHEVCWithSkip(0, skip, true), 8u);
+}
+
+TEST(DecodeGetDecodeStat, NullSessionReturnsInvalidHandle) {
+    mfxDecodeStat stat = {};
+    mfxStatus sts      = MFXVideoDECODE_GetDecodeStat(nullptr, &stat);
+    ASSERT_EQ(sts, MFX_ERR_INVALID_HANDLE);
+}
+
+TEST(DecodeGetDecodeStat, NullStatReturnsErrNull) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXVideoDECODE_GetDecodeStat(session, nullptr);
     EXPECT_EQ(sts, MFX_ERR_NULL_PTR);
 
     sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
 
-    delete[] DECoutbuf;
-    delete[] decSurfaces;
+TEST(DecodeGetDecodeStat, DecodeUninitializedReturnsNotInitialized) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxDecodeStat stat = {};
+    sts                = MFXVideoDECODE_GetDecodeStat(session, &stat);
+    EXPECT_EQ(sts, MFX_ERR_NOT_INITIALIZED);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
 }
 
-TEST(DecodeFrameAsync, NullSyncpReturnsErrNull) {
+TEST(DecodeGetDecodeStat, DecodedStreamReturnsFrameCountAndBytes) {
     mfxVersion ver = {};
     mfxSession session;
     mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    mfxVideoParam mfxDecParams;
-    memset(&mfxDecParams, 0, sizeof(mfxDecParams));
-    mfxDecParams.mfx.CodecId = MFX_CODEC_HEVC;
-    mfxDecParams.IOPattern   = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+    mfxVideoParam mfxDecParams = { 0 };
+    mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
+    mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
 
     mfxBitstream mfxBS = { 0 };
     mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
@@ -975,7 +2581,7 @@ TEST(DecodeFrameAsync, NullSyncpReturnsErrNull) {
     sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    mfxU32 nSurfNumDec            = 8;
+    mfxU32 nSurfNumDec            = 16;
     mfxFrameSurface1 *decSurfaces = new mfxFrameSurface1[nSurfNumDec];
     mfxU32 surfW                  = mfxDecParams.mfx.FrameInfo.Width;
     mfxU32 surfH                  = mfxDecParams.mfx.FrameInfo.Height;
@@ -998,58 +2604,78 @@ TEST(DecodeFrameAsync, NullSyncpReturnsErrNull) {
             delete[] decSurfaces;
         ASSERT_EQ(sts, MFX_ERR_NONE);
     }
-    else {
-        mfxFrameSurface1 *pmfxOutSurface = nullptr;
-        mfxBS.MaxLength = mfxBS.DataLength = 1;
-        int nIndex                         = 0;
-        sts                                = MFXVideoDECODE_DecodeFrameAsync(session,
-                                              &mfxBS,
-                                              &decSurfaces[nIndex++],
-                                              &pmfxOutSurface,
-                                              nullptr);
-        EXPECT_EQ(sts, MFX_ERR_NULL_PTR);
 
-        sts = MFXClose(session);
+    mfxDecodeStat stat = {};
+    sts                = MFXVideoDECODE_GetDecodeStat(session, &stat);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    EXPECT_EQ(stat.NumFrame, 0u);
 
-        delete[] DECoutbuf;
-        delete[] decSurfaces;
+    // decode and drain the whole stream
+    mfxFrameSurface1 *pmfxOutSurface = nullptr;
+    mfxSyncPoint syncp               = {};
+    mfxBitstream *bs                 = &mfxBS;
+    mfxU32 nFrames                   = 0;
+    for (mfxU32 nIndex = 0; nIndex < nSurfNumDec; nIndex++) {
+        sts = MFXVideoDECODE_DecodeFrameAsync(session,
+                                              bs,
+                                              &decSurfaces[nIndex],
+                                              &pmfxOutSurface,
+                                              &syncp);
+        if (sts == MFX_ERR_NONE)
+            nFrames++;
+        else if (sts == MFX_ERR_MORE_DATA && bs)
+            bs = nullptr;
+        else
+            break;
     }
-}
-
-TEST(DecodeFrameAsync, NullSurfaceWorkReturnsErrMoreData) {
-    mfxVersion ver = {};
-    mfxSession session;
-    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
-    ASSERT_EQ(sts, MFX_ERR_NONE);
-
-    mfxVideoParam mfxDecParams;
-    memset(&mfxDecParams, 0, sizeof(mfxDecParams));
-    mfxDecParams.mfx.CodecId = MFX_CODEC_HEVC;
-    mfxDecParams.IOPattern   = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+    EXPECT_EQ(sts, MFX_ERR_MORE_DATA);
+    EXPECT_GT(nFrames, 0u);
 
-    mfxBitstream mfxBS = { 0 };
-    mfxBS.MaxLength = mfxBS.DataLength = test_bitstream_96x64_8bit_hevc::getlen();
-    mfxBS.Data                         = test_bitstream_96x64_8bit_hevc::getdata();
+    sts = MFXVideoDECODE_GetDecodeStat(session, &stat);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    EXPECT_EQ(stat.NumFrame, nFrames);
+    EXPECT_EQ(stat.NumError, 0u);
+    // nothing is left in the decoder after the drain
+    EXPECT_EQ(stat.NumCachedFrame, 0u);
+    EXPECT_EQ(stat.NumSkippedFrame, 0u);
+
+    mfxExtCPUDecodeStats stats = {};
+    stats.Header.BufferId      = MFX_EXTBUFF_CPU_DECODE_STATS;
+    stats.Header.BufferSz      = sizeof(mfxExtCPUDecodeStats);
+    mfxExtBuffer *extParam[]   = { &stats.Header };
+
+    mfxVideoParam par = { 0 };
+    par.ExtParam      = extParam;
+    par.NumExtParam   = 1;
+    sts               = MFXVideoDECODE_GetVideoParam(session, &par);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    EXPECT_EQ(stats.BytesConsumed, (mfxU64)test_bitstream_96x64_8bit_hevc::getlen());
+    EXPECT_GT(stats.DecodeTime, 0u);
+    EXPECT_LE(stats.LatencyP50, stats.LatencyP90);
+    EXPECT_LE(stats.LatencyP90, stats.LatencyP99);
+    EXPECT_LE(stats.LatencyP99, stats.LatencyMax);
 
-    sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
+    sts = MFXClose(session);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    sts = MFXVideoDECODE_Init(session, &mfxDecParams);
-
-    mfxSyncPoint syncp;
-    mfxFrameSurface1 *pmfxOutSurface = nullptr;
-    sts = MFXVideoDECODE_DecodeFrameAsync(session, &mfxBS, nullptr, &pmfxOutSurface, &syncp);
-    ASSERT_EQ(sts, MFX_ERR_MORE_DATA);
-
-    sts = MFXClose(session);
+    delete[] DECoutbuf;
+    delete[] decSurfaces;
 }
 
-TEST(DecodeFrameAsync, DecodeUninitializedReturnsNotInitialized) {
+// the 7 trailing frames of the stream never reach the decoder
+TEST(DecodeGetDecodeStat, KeyFramesOnlyCountsSkippedFrames) {
     mfxVersion ver = {};
+    ver.Major      = 2;
     mfxSession session;
     mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
+    mfxExtCPUDecodeSkip skip = {};
+    skip.Header.BufferId     = MFX_EXTBUFF_CPU_DECODE_SKIP;
+    skip.Header.BufferSz     = sizeof(mfxExtCPUDecodeSkip);
+    skip.KeyFramesOnly       = MFX_CODINGOPTION_ON;
+    mfxExtBuffer *extParam[] = { &skip.Header };
+
     mfxVideoParam mfxDecParams = { 0 };
     mfxDecParams.mfx.CodecId   = MFX_CODEC_HEVC;
     mfxDecParams.IOPattern     = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
@@ -1061,38 +2687,45 @@ TEST(DecodeFrameAsync, DecodeUninitializedReturnsNotInitialized) {
     sts = MFXVideoDECODE_DecodeHeader(session, &mfxBS, &mfxDecParams);
     ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    mfxU32 nSurfNumDec            = 8;
-    mfxFrameSurface1 *decSurfaces = new mfxFrameSurface1[nSurfNumDec];
-    mfxU32 surfW                  = mfxDecParams.mfx.FrameInfo.Width;
-    mfxU32 surfH                  = mfxDecParams.mfx.FrameInfo.Height;
+    mfxDecParams.ExtParam    = extParam;
+    mfxDecParams.NumExtParam = 1;
+    sts                      = MFXVideoDECODE_Init(session, &mfxDecParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
 
-    mfxU8 *DECoutbuf = new mfxU8[(mfxU32)(surfW * surfH * nSurfNumDec * 1.5)];
+    // decode and drain the whole stream
+    mfxBitstream *bs = &mfxBS;
+    mfxU32 nFrames   = 0;
+    for (;;) {
+        mfxFrameSurface1 *surface_out = nullptr;
+        mfxSyncPoint syncp            = nullptr;
+        sts = MFXVideoDECODE_DecodeFrameAsync(session, bs, nullptr, &surface_out, &syncp);
+        if (sts == MFX_ERR_MORE_DATA && bs) {
+            bs = nullptr;
+            continue;
+        }
+        if (sts != MFX_ERR_NONE)
+            break;
 
-    for (mfxU32 i = 0; i < nSurfNumDec; i++) {
-        decSurfaces[i]            = { 0 };
-        decSurfaces[i].Info       = mfxDecParams.mfx.FrameInfo;
-        int buf_offset            = i * surfW * surfH;
-        decSurfaces[i].Data.Y     = DECoutbuf + buf_offset;
-        decSurfaces[i].Data.U     = DECoutbuf + buf_offset + (surfW * surfH);
-        decSurfaces[i].Data.V     = decSurfaces[i].Data.U + ((surfW / 2) * (surfH / 2));
-        decSurfaces[i].Data.Pitch = surfW;
+        sts = MFXVideoCORE_SyncOperation(session, syncp, MFX_INFINITE);
+        EXPECT_EQ(sts, MFX_ERR_NONE);
+        surface_out->FrameInterface->Release(surface_out);
+        nFrames++;
     }
+    EXPECT_EQ(sts, MFX_ERR_MORE_DATA);
+    EXPECT_EQ(nFrames, 1u);
 
-    mfxSyncPoint syncp;
-    int nIndex                       = 0;
-    mfxFrameSurface1 *pmfxOutSurface = nullptr;
-    sts                              = MFXVideoDECODE_DecodeFrameAsync(session,
-                                          &mfxBS,
-                                          &decSurfaces[nIndex++],
-                                          &pmfxOutSurface,
-                                          &syncp);
-    EXPECT_EQ(sts, MFX_ERR_NOT_INITIALIZED);
+    mfxDecodeStat stat = {};
+    sts                = MFXVideoDECODE_GetDecodeStat(session, &stat);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+    EXPECT_EQ(stat.NumFrame, 1u);
+    EXPECT_EQ(stat.NumSkippedFrame, 7u);
+    EXPECT_EQ(stat.NumCachedFrame, 0u);
+    EXPECT_EQ(stat.NumError, 0u);
 
     sts = MFXClose(session);
-
-    delete[] DECoutbuf;
-    delete[] decSurfaces;
+    ASSERT_EQ(sts, MFX_ERR_NONE);
 }
+
 /*!
    RunFrameVPPAsync overview
    Processes a single input frame to a single output frame. 
@@ -1165,6 +2798,261 @@ TEST(RunFrameVPPAsync, ValidInputsReturnsErrNone) {
     delete[] DECoutbuf;
 }
 
+TEST(RunFrameVPPAsync, OnCompleteCalledOnceForEachOutputSurface) {
+    mfxVersion ver = {};
+    ver.Major      = 2;
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxVPPParams = {};
+
+    mfxVPPParams.vpp.In.FourCC        = MFX_FOURCC_I420;
+    mfxVPPParams.vpp.In.ChromaFormat  = MFX_CHROMAFORMAT_YUV420;
+    mfxVPPParams.vpp.In.CropW         = 320;
+    mfxVPPParams.vpp.In.CropH         = 240;
+    mfxVPPParams.vpp.In.FrameRateExtN = 30;
+    mfxVPPParams.vpp.In.FrameRateExtD = 1;
+    mfxVPPParams.vpp.In.Width         = mfxVPPParams.vpp.In.CropW;
+    mfxVPPParams.vpp.In.Height        = mfxVPPParams.vpp.In.CropH;
+    mfxVPPParams.vpp.Out              = mfxVPPParams.vpp.In;
+
+    mfxVPPParams.IOPattern  = MFX_IOPATTERN_IN_SYSTEM_MEMORY | MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+    mfxVPPParams.AsyncDepth = 4;
+
+    sts = MFXVideoVPP_Init(session, &mfxVPPParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    const mfxU32 nFrames  = 4;
+    const mfxU32 lumaSize = 320 * 240;
+    std::vector<mfxU8> buf(lumaSize * 3 / 2, 128);
+    mfxFrameSurface1 surface_in = {};
+    surface_in.Info             = mfxVPPParams.vpp.In;
+    surface_in.Data.Y           = buf.data();
+    surface_in.Data.U           = surface_in.Data.Y + lumaSize;
+    surface_in.Data.V           = surface_in.Data.U + lumaSize / 4;
+    surface_in.Data.Pitch       = 320;
+
+    s_numOnComplete   = 0;
+    s_onCompleteError = MFX_ERR_NONE;
+
+    for (mfxU32 i = 0; i <= nFrames; i++) {
+        mfxFrameSurface1 *surface_out = nullptr;
+        sts                           = MFXMemory_GetSurfaceForVPPOut(session, &surface_out);
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+        surface_out->FrameInterface->OnComplete = CountOnComplete;
+
+        // the last call drains, the filter graph has no frame left
+        mfxFrameSurface1 *surface_in_i = (i < nFrames) ? &surface_in : nullptr;
+        mfxSyncPoint syncp             = nullptr;
+
+        sts = MFXVideoVPP_RunFrameVPPAsync(session, surface_in_i, surface_out, nullptr, &syncp);
+        if (i == nFrames) {
+            EXPECT_EQ(sts, MFX_ERR_MORE_DATA);
+            EXPECT_EQ(s_numOnComplete.load(), nFrames);
+            surface_out->FrameInterface->Release(surface_out);
+            break;
+        }
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+
+        sts = MFXVideoCORE_SyncOperation(session, syncp, MFX_INFINITE);
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+        EXPECT_EQ(s_numOnComplete.load(), i + 1);
+
+        // the runtime let go of the surface, the application holds the only reference
+        mfxU32 refCount = 0;
+        sts             = surface_out->FrameInterface->GetRefCounter(surface_out, &refCount);
+        EXPECT_EQ(sts, MFX_ERR_NONE);
+        EXPECT_EQ(refCount, 1u);
+        surface_out->FrameInterface->Release(surface_out);
+    }
+    EXPECT_EQ(s_onCompleteError.load(), MFX_ERR_NONE);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+// passes an application surface through VPP, which copies the frame into
+//   the output surface, and compares the two row by row
+static void CheckVPPCopy(mfxU32 fourcc,
+                         mfxU16 shift,
+                         mfxU16 width,
+                         mfxU16 height,
+                         mfxU16 inPitch,
+                         mfxU16 outPitch) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxU32 bytes = GetSampleBytes(fourcc);
+
+    mfxVideoParam mfxVPPParams = {};
+
+    mfxVPPParams.vpp.In.FourCC         = fourcc;
+    mfxVPPParams.vpp.In.ChromaFormat   = MFX_CHROMAFORMAT_YUV420;
+    mfxVPPParams.vpp.In.BitDepthLuma   = (bytes == 2) ? 10 : 8;
+    mfxVPPParams.vpp.In.BitDepthChroma = (bytes == 2) ? 10 : 8;
+    mfxVPPParams.vpp.In.Shift          = shift;
+    mfxVPPParams.vpp.In.CropW          = width;
+    mfxVPPParams.vpp.In.CropH          = height;
+    mfxVPPParams.vpp.In.FrameRateExtN  = 30;
+    mfxVPPParams.vpp.In.FrameRateExtD  = 1;
+    mfxVPPParams.vpp.In.Width          = width;
+    mfxVPPParams.vpp.In.Height         = height;
+    mfxVPPParams.vpp.Out               = mfxVPPParams.vpp.In;
+
+    mfxVPPParams.IOPattern = MFX_IOPATTERN_IN_SYSTEM_MEMORY | MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    sts = MFXVideoVPP_Init(session, &mfxVPPParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxFrameSurface1 surface_in = {};
+    surface_in.Info             = mfxVPPParams.vpp.In;
+    surface_in.Data.Pitch       = inPitch;
+    std::vector<mfxU8> bufIn(GetTestImageBytes(surface_in.Info, inPitch));
+    std::vector<TestPlane> planesIn = SetTestPlanes(&surface_in, bufIn.data());
+
+    mfxFrameSurface1 surface_out = {};
+    surface_out.Info             = mfxVPPParams.vpp.Out;
+    surface_out.Data.Pitch       = outPitch;
+    std::vector<mfxU8> bufOut(GetTestImageBytes(surface_out.Info, outPitch), 0xEE);
+    std::vector<TestPlane> planesOut = SetTestPlanes(&surface_out, bufOut.data());
+
+    // 10-bit samples, in the high bits for P010 with Shift set
+    for (size_t p = 0; p < planesIn.size(); p++) {
+        const TestPlane &plane = planesIn[p];
+        for (mfxU32 y = 0; y < plane.rows; y++) {
+            mfxU8 *row = plane.data + static_cast<size_t>(y) * plane.pitch;
+            for (mfxU32 x = 0; x < plane.width; x++) {
+                mfxU32 value = x * 7 + y * 13 + static_cast<mfxU32>(p) * 29;
+                if (bytes == 1)
+                    row[x] = static_cast<mfxU8>(value);
+                else
+                    reinterpret_cast<mfxU16 *>(row)[x] =
+                        static_cast<mfxU16>((value & 0x3FF) << (shift ? 6 : 0));
+            }
+        }
+    }
+
+    mfxSyncPoint syncp = nullptr;
+    sts = MFXVideoVPP_RunFrameVPPAsync(session, &surface_in, &surface_out, nullptr, &syncp);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    sts = MFXVideoCORE_SyncOperation(session, syncp, MFX_INFINITE);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    for (size_t p = 0; p < planesIn.size(); p++) {
+        for (mfxU32 y = 0; y < planesIn[p].rows; y++) {
+            const mfxU8 *in  = planesIn[p].data + static_cast<size_t>(y) * planesIn[p].pitch;
+            const mfxU8 *out = planesOut[p].data + static_cast<size_t>(y) * planesOut[p].pitch;
+            ASSERT_EQ(memcmp(in, out, planesIn[p].width * bytes), 0)
+                << "plane " << p << " row " << y;
+        }
+    }
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+TEST(RunFrameVPPAsync, OddWidthFramesCopiedRowByRow) {
+    CheckVPPCopy(MFX_FOURCC_I420, 0, 33, 17, 40, 48);
+    CheckVPPCopy(MFX_FOURCC_NV12, 0, 33, 17, 40, 36);
+    CheckVPPCopy(MFX_FOURCC_I010, 0, 33, 17, 80, 68);
+    CheckVPPCopy(MFX_FOURCC_P010, 1, 33, 17, 72, 80);
+}
+
+TEST(RunFrameVPPAsync, FramesWithEqualPitchCopiedWhole) {
+    CheckVPPCopy(MFX_FOURCC_I420, 0, 64, 32, 64, 64);
+    CheckVPPCopy(MFX_FOURCC_I420, 0, 33, 17, 40, 40);
+    CheckVPPCopy(MFX_FOURCC_P010, 1, 33, 17, 72, 72);
+}
+
+TEST(RunFrameVPPAsync, P010SamplesShiftedToLibavAndBack) {
+    CheckVPPCopy(MFX_FOURCC_P010, 0, 33, 17, 72, 80);
+    CheckVPPCopy(MFX_FOURCC_P010, 0, 64, 32, 128, 128);
+}
+
+TEST(RunFrameVPPAsync, LargeFramesCopiedInBands) {
+    CheckVPPCopy(MFX_FOURCC_I420, 0, 3840, 2160, 3840, 3840);
+    CheckVPPCopy(MFX_FOURCC_I420, 0, 3840, 2160, 3904, 3840);
+    CheckVPPCopy(MFX_FOURCC_P010, 0, 3840, 2160, 7680, 7680);
+    CheckVPPCopy(MFX_FOURCC_NV12, 0, 3841, 2161, 3904, 3872);
+}
+
+// converts the frame of one application surface into another with VPP
+static void ConvertWithVPP(mfxFrameSurface1 *in, mfxFrameSurface1 *out) {
+    mfxVersion ver = {};
+    mfxSession session;
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxVideoParam mfxVPPParams = {};
+    mfxVPPParams.vpp.In        = in->Info;
+    mfxVPPParams.vpp.Out       = out->Info;
+    mfxVPPParams.IOPattern     = MFX_IOPATTERN_IN_SYSTEM_MEMORY | MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    sts = MFXVideoVPP_Init(session, &mfxVPPParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    mfxSyncPoint syncp = nullptr;
+    sts                = MFXVideoVPP_RunFrameVPPAsync(session, in, out, nullptr, &syncp);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    sts = MFXVideoCORE_SyncOperation(session, syncp, MFX_INFINITE);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
+// converts a planar frame to semi-planar and back, no sample may change
+static void CheckVPPRoundTrip(mfxU32 fourcc, mfxU32 semiPlanarFourcc, mfxU16 shift) {
+    const mfxU16 width  = 96;
+    const mfxU16 height = 64;
+    mfxU32 bytes        = GetSampleBytes(fourcc);
+
+    mfxFrameInfo info   = {};
+    info.FourCC         = fourcc;
+    info.ChromaFormat   = MFX_CHROMAFORMAT_YUV420;
+    info.BitDepthLuma   = (bytes == 2) ? 10 : 8;
+    info.BitDepthChroma = (bytes == 2) ? 10 : 8;
+    info.CropW          = width;
+    info.CropH          = height;
+    info.FrameRateExtN  = 30;
+    info.FrameRateExtD  = 1;
+    info.Width          = width;
+    info.Height         = height;
+
+    mfxFrameSurface1 planar = {};
+    planar.Info             = info;
+    planar.Data.Pitch       = static_cast<mfxU16>(width * bytes);
+    std::vector<mfxU8> bufPlanar(GetTestImageBytes(info, planar.Data.Pitch));
+    SetTestPlanes(&planar, bufPlanar.data());
+    SetSurfacePattern(&planar);
+    std::vector<mfxU16> samples = GetSurfaceSamples(&planar);
+
+    mfxFrameSurface1 semiPlanar = planar;
+    semiPlanar.Info.FourCC      = semiPlanarFourcc;
+    semiPlanar.Info.Shift       = shift;
+    std::vector<mfxU8> bufSemiPlanar(GetTestImageBytes(info, planar.Data.Pitch));
+    SetTestPlanes(&semiPlanar, bufSemiPlanar.data());
+
+    ConvertWithVPP(&planar, &semiPlanar);
+    EXPECT_TRUE(GetSurfaceSamples(&semiPlanar) == samples);
+
+    std::fill(bufPlanar.begin(), bufPlanar.end(), static_cast<mfxU8>(0));
+    ConvertWithVPP(&semiPlanar, &planar);
+    EXPECT_TRUE(GetSurfaceSamples(&planar) == samples);
+}
+
+TEST(RunFrameVPPAsync, NV12RoundTripKeepsSamples) {
+    CheckVPPRoundTrip(MFX_FOURCC_I420, MFX_FOURCC_NV12, 0);
+}
+
+TEST(RunFrameVPPAsync, P010RoundTripKeepsSamples) {
+    CheckVPPRoundTrip(MFX_FOURCC_I010, MFX_FOURCC_P010, 0);
+    CheckVPPRoundTrip(MFX_FOURCC_I010, MFX_FOURCC_P010, 1);
+}
+
 TEST(RunFrameVPPAsync, NullSessionReturnsInvalidHandle) {
     mfxStatus sts = MFXVideoVPP_RunFrameVPPAsync(0, nullptr, nullptr, nullptr, nullptr);
     ASSERT_EQ(sts, MFX_ERR_INVALID_HANDLE);
@@ -1408,6 +3296,89 @@ TEST(ProcessFrameAsync, ValidInputsReturnsErrNone) {
     delete[] surf_buf;
 }
 
+TEST(ProcessFrameAsync, ScaledOutputKeepsHalfChromaPitchForUnalignedWidth) {
+    mfxSession session;
+    mfxVersion ver = {};
+    ver.Major      = 2;
+    ver.Minor      = 1;
+
+    mfxStatus sts = MFXInit(MFX_IMPL_SOFTWARE, &ver, &session);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // init VPP, 1366 is not a multiple of the libav buffer alignment
+    mfxVideoParam mfxVPPParams;
+    memset(&mfxVPPParams, 0, sizeof(mfxVPPParams));
+    mfxVPPParams.IOPattern = MFX_IOPATTERN_IN_SYSTEM_MEMORY | MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
+
+    mfxVPPParams.vpp.In.FourCC        = MFX_FOURCC_I420;
+    mfxVPPParams.vpp.In.ChromaFormat  = MFX_CHROMAFORMAT_YUV420;
+    mfxVPPParams.vpp.In.Width         = 352;
+    mfxVPPParams.vpp.In.Height        = 288;
+    mfxVPPParams.vpp.In.CropH         = mfxVPPParams.vpp.In.Height;
+    mfxVPPParams.vpp.In.CropW         = mfxVPPParams.vpp.In.Width;
+    mfxVPPParams.vpp.In.FrameRateExtN = 30;
+    mfxVPPParams.vpp.In.FrameRateExtD = 1;
+
+    mfxVPPParams.vpp.Out        = mfxVPPParams.vpp.In;
+    mfxVPPParams.vpp.Out.Width  = 1366;
+    mfxVPPParams.vpp.Out.Height = 768;
+    mfxVPPParams.vpp.Out.CropW  = mfxVPPParams.vpp.Out.Width;
+    mfxVPPParams.vpp.Out.CropH  = mfxVPPParams.vpp.Out.Height;
+
+    sts = MFXVideoVPP_Init(session, &mfxVPPParams);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // flat input, scaling keeps every plane flat
+    const mfxU32 surfW = mfxVPPParams.vpp.In.Width;
+    const mfxU32 surfH = mfxVPPParams.vpp.In.Height;
+    std::vector<mfxU8> surf_buf(surfW * surfH * 3 / 2);
+    std::fill(surf_buf.begin(), surf_buf.begin() + surfW * surfH, 0x50);
+    std::fill(surf_buf.begin() + surfW * surfH, surf_buf.begin() + surfW * surfH * 5 / 4, 0x60);
+    std::fill(surf_buf.begin() + surfW * surfH * 5 / 4, surf_buf.end(), 0x70);
+
+    mfxFrameSurface1 vppSurfaceIn = {};
+    vppSurfaceIn.Info             = mfxVPPParams.vpp.In;
+    vppSurfaceIn.Data.Y           = surf_buf.data();
+    vppSurfaceIn.Data.U           = vppSurfaceIn.Data.Y + surfW * surfH;
+    vppSurfaceIn.Data.V           = vppSurfaceIn.Data.U + surfW * surfH / 4;
+    vppSurfaceIn.Data.Pitch       = surfW;
+
+    mfxFrameSurface1 *vppSurfaceOut = nullptr;
+
+    sts = MFXVideoVPP_ProcessFrameAsync(session, &vppSurfaceIn, &vppSurfaceOut);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    ASSERT_NE(vppSurfaceOut, nullptr);
+
+    sts = vppSurfaceOut->FrameInterface->Synchronize(vppSurfaceOut, MFX_INFINITE);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    sts = vppSurfaceOut->FrameInterface->Map(vppSurfaceOut, MFX_MAP_READ);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    // U and V rows are Pitch / 2 apart, as applications address them
+    mfxFrameData *data = &vppSurfaceOut->Data;
+
+    mfxU32 badY = 0, badU = 0, badV = 0;
+    for (mfxU32 y = 0; y < 768; y++) {
+        for (mfxU32 x = 0; x < 1366; x++)
+            badY += std::abs(data->Y[y * data->Pitch + x] - 0x50) > 1;
+    }
+    for (mfxU32 y = 0; y < 384; y++) {
+        for (mfxU32 x = 0; x < 683; x++) {
+            badU += std::abs(data->U[y * data->Pitch / 2 + x] - 0x60) > 1;
+            badV += std::abs(data->V[y * data->Pitch / 2 + x] - 0x70) > 1;
+        }
+    }
+    EXPECT_EQ(badY, 0u);
+    EXPECT_EQ(badU, 0u);
+    EXPECT_EQ(badV, 0u);
+
+    vppSurfaceOut->FrameInterface->Unmap(vppSurfaceOut);
+    vppSurfaceOut->FrameInterface->Release(vppSurfaceOut);
+
+    sts = MFXClose(session);
+    EXPECT_EQ(sts, MFX_ERR_NONE);
+}
+
 TEST(ProcessFrameAsync, NullSessionReturnsInvalidHandle) {
     mfxStatus sts = MFXVideoVPP_ProcessFrameAsync(0, nullptr, nullptr);
     ASSERT_EQ(sts, MFX_ERR_INVALID_HANDLE);